@@ -465,6 +465,10 @@ void GlobalUIModel::SetGlobalDisplaySettings(
   // Update the RAI codes in all slice views
   m_Driver->SetDisplayGeometry(IRISDisplayGeometry(raiNew[0], raiNew[1], raiNew[2]));
 
+  // Let zoomed out views use coarse slices if the user asked for them
+  m_Driver->SetUseMultiResolutionOrthogonalSlicing(
+        m_GlobalDisplaySettings->GetFlagDisplayCoarseSlicesWhenZoomedOut());
+
   // React to the change in RAI codes
   if(raiOld[0] != raiNew[0] || raiOld[1] != raiNew[1] || raiOld[2] != raiNew[2])
     {
@@ -1419,8 +1419,18 @@ void SnakeWizardModel::OnEvolutionPageEnter()
 
 bool SnakeWizardModel::PerformEvolutionStep()
 {
+  SNAPImageData *sid = m_Driver->GetSNAPImageData();
+  if(sid->IsSegmentationThreadRunning())
+    {
+    // The snake is evolving in the background. Show the latest snapshot, if
+    // there is a new one
+    if(sid->UpdateSnakeFromSnapshot())
+      InvokeEvent(EvolutionIterationEvent());
+    return false;
+    }
+
   // Do the segmentation step!
-  m_Driver->GetSNAPImageData()->RunSegmentation(m_StepSizeModel->GetValue());
+  sid->RunSegmentation(m_StepSizeModel->GetValue());
 
   // Fire an event
   InvokeEvent(EvolutionIterationEvent());
@@ -1431,6 +1441,24 @@ bool SnakeWizardModel::PerformEvolutionStep()
   return false;
 }
 
+void SnakeWizardModel::StartEvolution()
+{
+  // Snapshots are published as often as the step size asks for
+  SNAPImageData *sid = m_Driver->GetSNAPImageData();
+  if(sid->IsSegmentationActive())
+    sid->StartSegmentationThread(m_StepSizeModel->GetValue());
+}
+
+void SnakeWizardModel::PauseEvolution()
+{
+  SNAPImageData *sid = m_Driver->GetSNAPImageData();
+  if(sid && sid->IsSegmentationThreadRunning())
+    {
+    sid->StopSegmentationThread();
+    InvokeEvent(EvolutionIterationEvent());
+    }
+}
+
 int SnakeWizardModel::GetEvolutionIterationValue()
 {
   if(m_Driver->IsSnakeModeActive() &&
@@ -204,10 +204,17 @@ public:
 
   /**
    * Perform a single step of snake evolution. Returns true if the evolution
-   * has converged
+   * has converged. If the evolution is running in the background, this only
+   * displays the latest result without waiting for the evolution.
    */
   bool PerformEvolutionStep();
 
+  /** Start evolving the snake in the background */
+  void StartEvolution();
+
+  /** Stop the background evolution */
+  void PauseEvolution();
+
   /** Rewind the evolution */
   void RewindEvolution();
 
@@ -340,16 +340,23 @@ void SnakeWizardPanel::on_stack_currentChanged(int page)
 
 void SnakeWizardPanel::on_btnPlay_toggled(bool checked)
 {
-  // This is where we toggle the snake evolution!
+  // This is where we toggle the snake evolution! The snake evolves in a
+  // background thread and the timer picks up its snapshots for display
   if(checked)
+    {
+    m_Model->StartEvolution();
     m_EvolutionTimer->start(10);
+    }
   else
+    {
     m_EvolutionTimer->stop();
+    m_Model->PauseEvolution();
+    }
 }
 
 void SnakeWizardPanel::idleCallback()
 {
-  // Step the snake. If converged (returns true), stop playing
+  // Show the latest snapshot. If converged (returns true), stop playing
   if(m_Model->PerformEvolutionStep())
     ui->btnPlay->setChecked(false);
 }
@@ -127,6 +127,7 @@ void PreferencesDialog::SetModel(GlobalPreferencesModel *model)
   makeCoupling(ui->chkShowThumbnail, gds->GetFlagDisplayZoomThumbnailModel());
   makeCoupling(ui->inThumbnailFraction, gds->GetZoomThumbnailSizeInPercentModel());
   makeCoupling(ui->inThumbnailMaxSize, gds->GetZoomThumbnailMaximumSizeModel());
+  makeCoupling(ui->chkCoarseSlices, gds->GetFlagDisplayCoarseSlicesWhenZoomedOutModel());
 
   // Couple the interpolation mode (the domain is not provided by the model)
   makeCoupling(ui->inInterpolationMode, gds->GetGreyInterpolationModeModel());
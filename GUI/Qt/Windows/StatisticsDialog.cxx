@@ -58,7 +58,9 @@ void StatisticsDialog::FillTable()
   header << "Label Name" << "Voxel Count" << "Volume (mm3)";
   m_ItemModel->setHorizontalHeaderLabels(header);
 
+  // Each layer has a column for the mean and SD, and one for each percentile
   const std::vector<std::string> &cols = m_Stats->GetImageStatisticsColumns();
+  int npct = (int) m_Stats->GetPercentiles().size();
   for(int j = 0; j < cols.size(); j++)
     {
     QString label = QString("Intensity Mean %1 SD\n(%2)").arg(QChar(0x00B1)).arg(from_utf8(cols[j]));
@@ -68,7 +70,17 @@ void StatisticsDialog::FillTable()
     item->setToolTip(
           QString("Mean intensity and standard deviation for layer %1").arg(from_utf8(cols[j])));
 
-    m_ItemModel->setHorizontalHeaderItem(j+3, item);
+    m_ItemModel->setHorizontalHeaderItem(3 + j * (npct + 1), item);
+
+    for(int k = 0; k < npct; k++)
+      {
+      double p = m_Stats->GetPercentiles()[k];
+      QStandardItem *pitem = new QStandardItem();
+      pitem->setText(p == 50.0
+                     ? QString("Intensity Median\n(%1)").arg(from_utf8(cols[j]))
+                     : QString("Intensity %1th Percentile\n(%2)").arg(p).arg(from_utf8(cols[j])));
+      m_ItemModel->setHorizontalHeaderItem(4 + j * (npct + 1) + k, pitem);
+      }
     }
 
   // Add all the rows
@@ -92,6 +104,8 @@ void StatisticsDialog::FillTable()
             .arg(QChar(0x00B1))
             .arg(row.stdev[j],0,'f',4);
         qsi.append(new QStandardItem(text));
+        for(int k = 0; k < npct; k++)
+          qsi.append(new QStandardItem(QString("%1").arg(row.percentile(j,k),0,'f',4)));
         }
       m_ItemModel->appendRow(qsi);
       m_ItemModel->setVerticalHeaderItem(m_ItemModel->rowCount()-1,
@@ -114,6 +128,18 @@ void StatisticsDialog::on_btnUpdate_clicked()
   this->FillTable();
 }
 
+void StatisticsDialog::on_chkMedian_toggled(bool checked)
+{
+  // The median is computed along with the other statistics, and is included
+  // in the table and in the copied and exported statistics
+  std::vector<double> pct;
+  if(checked)
+    pct.push_back(50.0);
+  m_Stats->SetPercentiles(pct);
+
+  QtCursorOverride cursy(Qt::WaitCursor);
+  this->FillTable();
+}
 
 void StatisticsDialog::on_btnCopy_clicked()
 {
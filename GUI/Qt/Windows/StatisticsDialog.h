@@ -31,6 +31,8 @@ private slots:
 
   void on_btnExport_clicked();
 
+  void on_chkMedian_toggled(bool checked);
+
 private:
   Ui::StatisticsDialog *ui;
 
@@ -38,6 +38,8 @@
 #include "LayerAssociation.txx"
 #include "SliceWindowCoordinator.h"
 #include "PaintbrushSettingsModel.h"
+#include "RGBASliceCompositor.h"
+#include <sstream>
 
 GenericSliceRenderer
 ::GenericSliceRenderer()
@@ -45,6 +47,8 @@ GenericSliceRenderer
   this->m_DrawingZoomThumbnail = false;
   this->m_DrawingLayerThumbnail = false;
   this->m_DrawingViewportIndex = -1;
+  this->m_UseCPUCompositing = getenv("ITKSNAP_CPU_COMPOSITING") != NULL;
+  this->m_SegmentationComposited = false;
 }
 
 void
@@ -196,7 +200,8 @@ GenericSliceRenderer
 
         // We don't want to draw segmentation over the speed image and other
         // SNAP-mode layers.
-        this->DrawSegmentationTexture();
+        if(!m_SegmentationComposited)
+          this->DrawSegmentationTexture();
 
         // Draw the overlays
         if(as->GetOverallVisibility())
@@ -364,12 +369,20 @@ bool GenericSliceRenderer::DrawImageLayers(ImageWrapperBase *base_layer, const V
   GenericImageData *id = m_Model->GetImageData();
 
   // If drawing the thumbnail, only draw the main layer
+  m_SegmentationComposited = false;
   if(m_DrawingZoomThumbnail)
     {
     DrawTextureForLayer(base_layer, vp, false);
     return true;
     }
 
+  // Blend all the layers on the CPU if requested and possible
+  if(m_UseCPUCompositing && this->DrawCompositedLayers(base_layer, vp))
+    {
+    m_SegmentationComposited = true;
+    return true;
+    }
+
   // Is the display partitioned into rows and columns?
   if(!this->IsTiledMode())
     {
@@ -418,6 +431,136 @@ bool GenericSliceRenderer::DrawImageLayers(ImageWrapperBase *base_layer, const V
   }
 }
 
+bool GenericSliceRenderer::CanCompositeLayer(ImageWrapperBase *layer)
+{
+  if(!layer->IsInitialized() || !layer->IsSlicingOrthogonal())
+    return false;
+
+  // Layers rendered as grids need the per-layer drawing code
+  AbstractMultiChannelDisplayMappingPolicy *dp = dynamic_cast<
+      AbstractMultiChannelDisplayMappingPolicy *>(layer->GetDisplayMapping());
+  return !(dp && dp->GetDisplayMode().RenderAsGrid);
+}
+
+bool GenericSliceRenderer::DrawCompositedLayers(ImageWrapperBase *base_layer, const ViewportType &vp)
+{
+  GenericImageData *id = m_Model->GetImageData();
+  unsigned int view = m_Model->GetId();
+
+  // Collect the layers in the order in which they would be drawn
+  std::vector<ImageWrapperBase *> layers;
+  std::vector<double> opacity;
+  layers.push_back(base_layer);
+  opacity.push_back(1.0);
+
+  if(!vp.isThumbnail)
+    {
+    for(LayerIterator it(id); !it.IsAtEnd(); ++it)
+      {
+      ImageWrapperBase *layer = it.GetLayer();
+      bool overlay = this->IsTiledMode()
+          ? it.GetRole() != MAIN_ROLE
+          : it.GetRole() != LABEL_ROLE;
+      if(overlay && layer != base_layer && layer->IsDrawable()
+         && layer->IsSticky() && layer->GetAlpha() > 0)
+        {
+        layers.push_back(layer);
+        opacity.push_back(layer->GetAlpha());
+        }
+      }
+    }
+
+  // The segmentation goes on top
+  double seg_alpha = m_Model->GetDriver()->GetGlobalState()->GetSegmentationAlpha();
+  ImageWrapperBase *seg_layer = id->FindLayer(
+        m_Model->GetDriver()->GetGlobalState()->GetSelectedSegmentationLayerId(),
+        false, LABEL_ROLE);
+  if(seg_layer && seg_alpha > 0)
+    {
+    layers.push_back(seg_layer);
+    opacity.push_back(seg_alpha);
+    }
+
+  // All the layers must be sliced on the same grid
+  std::vector<RGBASliceCompositor::ImageType *> slices;
+  for(unsigned int i = 0; i < layers.size(); i++)
+    {
+    if(!this->CanCompositeLayer(layers[i]))
+      return false;
+
+    RGBASliceCompositor::ImageType *slice = layers[i]->GetDisplaySlice(view);
+    slice->UpdateOutputInformation();
+    if(i > 0 && slice->GetLargestPossibleRegion() != slices[0]->GetLargestPossibleRegion())
+      return false;
+
+    slices.push_back(slice);
+    }
+
+  // Get the compositor and its texture, stored with the base layer. The same
+  // layer is drawn with different overlays in the main view and in its
+  // thumbnail, and may be drawn by more than one renderer, so each renderer
+  // keeps its own compositor for each kind of viewport
+  std::ostringstream oss_id;
+  oss_id << "[" << view << "," << (vp.isThumbnail ? "Thumbnail" : "Main")
+         << "," << this << "]";
+  std::string compositor_id = "SliceCompositor" + oss_id.str();
+  std::string texture_id = "SliceCompositorTexture" + oss_id.str();
+
+  SmartPtr<RGBASliceCompositor> compositor =
+      static_cast<RGBASliceCompositor *>(base_layer->GetUserData(compositor_id));
+  if(!compositor)
+    {
+    compositor = RGBASliceCompositor::New();
+    base_layer->SetUserData(compositor_id, compositor.GetPointer());
+    }
+
+  compositor->SetLayers(slices, opacity);
+
+  SmartPtr<Texture> tex =
+      static_cast<Texture *>(base_layer->GetUserData(texture_id));
+  if(!tex || tex->GetImage() != compositor->GetOutput())
+    {
+    tex = Texture::New();
+    tex->SetDepth(4, GL_RGBA);
+    tex->SetImage(compositor->GetOutput());
+    base_layer->SetUserData(texture_id, tex.GetPointer());
+    }
+
+  const GlobalDisplaySettings *gds = m_Model->GetParentUI()->GetGlobalDisplaySettings();
+  tex->SetInterpolation(
+        gds->GetGreyInterpolationMode() == GlobalDisplaySettings::LINEAR
+        ? GL_LINEAR : GL_NEAREST);
+  tex->SetMipMapping(true);
+
+  // The composite is opaque, so it is drawn like the base layer
+  Vector2d offset, scale;
+  this->GetOrthogonalSliceLayout(slices[0], offset, scale);
+  glPushMatrix();
+  glTranslated(offset[0], offset[1], 0.0);
+  glScaled(scale[0], scale[1], 1.0);
+  tex->Draw(Vector3d(1.0));
+  glPopMatrix();
+  return true;
+}
+
+void GenericSliceRenderer::GetOrthogonalSliceLayout(
+    itk::ImageBase<2> *slice, Vector2d &offset, Vector2d &scale)
+{
+  slice->UpdateOutputInformation();
+  const ImageCoordinateTransform *tran = m_Model->GetDisplayToImageTransform();
+  for(int d = 0; d < 2; d++)
+    {
+    scale[d] = slice->GetSpacing()[d] / m_Model->GetSliceSpacing()[d];
+
+    // When the slice is traversed backwards along an image axis, its first
+    // pixel covers the last block of voxels along that axis, which extends
+    // past the image when the image size is not a multiple of the block size
+    double extent = slice->GetLargestPossibleRegion().GetSize(d) * scale[d];
+    offset[d] = (tran->GetCoordinateOrientation(d) > 0)
+        ? 0.0 : m_Model->GetSliceSize()[d] - extent;
+    }
+}
+
 bool GenericSliceRenderer::IsTiledMode() const
 {
   DisplayLayoutModel *dlm = m_Model->GetParentUI()->GetDisplayLayoutModel();
@@ -477,7 +620,8 @@ GenericSliceRenderer
 Vector3d GenericSliceRenderer::ComputeGridPosition(
     const Vector3d &disp_pix,
     const itk::Index<2> &slice_index,
-    ImageWrapperBase *vecimg)
+    ImageWrapperBase *vecimg,
+    const Vector2d &offset, const Vector2d &scale)
 {
   // The pixel must be mapped to native
   Vector3d disp;
@@ -493,8 +637,8 @@ Vector3d GenericSliceRenderer::ComputeGridPosition(
     // We need to map it back into the slice domain. First, we need to know the 3D index
     // of the current pixel in the image space
     Vector3d xSlice;
-    xSlice[0] = slice_index[0] + 0.5;
-    xSlice[1] = slice_index[1] + 0.5;
+    xSlice[0] = offset[0] + (slice_index[0] + 0.5) * scale[0];
+    xSlice[1] = offset[1] + (slice_index[1] + 0.5) * scale[1];
     xSlice[2] = m_Model->GetSliceIndex();
 
     // For orthogonal slicing, the input coordinates are in units of image voxels
@@ -584,6 +728,16 @@ void GenericSliceRenderer::DrawTextureForLayer(
   // Paint the texture with alpha
   if(tex)
     {
+    // An orthogonal slice may be coarser than the image
+    Vector2d offset(0.0), scale(1.0);
+    if(layer->IsSlicingOrthogonal())
+      this->GetOrthogonalSliceLayout(
+            layer->GetDisplaySlice(m_Model->GetId()).GetPointer(), offset, scale);
+
+    glPushMatrix();
+    glTranslated(offset[0], offset[1], 0.0);
+    glScaled(scale[0], scale[1], 1.0);
+
     tex->SetInterpolation(interp);
     if(use_transparency)
       {
@@ -596,6 +750,8 @@ void GenericSliceRenderer::DrawTextureForLayer(
         : Vector3d(1.0);
       tex->Draw(clrBackground);
       }
+
+    glPopMatrix();
     }
 
   // TODO: move this somewhere
@@ -612,6 +768,11 @@ void GenericSliceRenderer::DrawTextureForLayer(
       AnatomicImageWrapper::SliceType::Pointer slice = vecimg->GetSlice(m_Model->GetId());
       slice->GetSource()->UpdateLargestPossibleRegion();
 
+      // The slice may be coarser than the image
+      Vector2d offset(0.0), scale(1.0);
+      if(vecimg->IsSlicingOrthogonal())
+        this->GetOrthogonalSliceLayout(slice, offset, scale);
+
       // Appearance settings for grid lines
       SNAPAppearanceSettings *as = m_Model->GetParentUI()->GetAppearanceSettings();
       const OpenGLAppearanceElement *elt =
@@ -632,14 +793,14 @@ void GenericSliceRenderer::DrawTextureForLayer(
 
       // Compute the initial displacement G0
       ind.Fill(0); phi.fill(0.0f);
-      G0 = ComputeGridPosition(phi, ind, vecimg);
+      G0 = ComputeGridPosition(phi, ind, vecimg, offset, scale);
 
       // Compute derivative of grid displacement wrt warp components
       for(int a = 0; a < 3; a++)
         {
         ind.Fill(0); phi.fill(0.0f);
         phi[a] = 1.0f;
-        d_grid_d_phi[a] = ComputeGridPosition(phi, ind, vecimg) - G0;
+        d_grid_d_phi[a] = ComputeGridPosition(phi, ind, vecimg, offset, scale) - G0;
         }
 
       // Compute derivative of grid displacement wrt index components
@@ -647,7 +808,7 @@ void GenericSliceRenderer::DrawTextureForLayer(
         {
         ind.Fill(0); phi.fill(0.0f);
         ind[b] = 1;
-        d_grid_d_ind[b] = ComputeGridPosition(phi, ind, vecimg) - G0;
+        d_grid_d_ind[b] = ComputeGridPosition(phi, ind, vecimg, offset, scale) - G0;
         }
 
       // Iterate line direction
@@ -666,7 +827,8 @@ void GenericSliceRenderer::DrawTextureForLayer(
           // Figure out how frequently to sample lines. The spacing on the screen should be at
           // most every 4 pixels. Zoom is in units of px/mm. Spacing is in units of mm/vox, so
           // zoom * spacing is (display pixels) / (image voxels).
-          double disp_pix_per_vox = m_Model->GetSliceSpacing()[d] * m_Model->GetViewZoom();
+          double disp_pix_per_vox =
+              m_Model->GetSliceSpacing()[d] * scale[d] * m_Model->GetViewZoom();
           vox_increment = (int) ceil(8.0 / disp_pix_per_vox);
           }
         else
@@ -109,6 +109,16 @@ public:
   // Set list of child renderers
   void SetChildRenderers(std::list<AbstractRenderer *> renderers);
 
+  /**
+   * When on, the image layers and the segmentation shown in each cell are
+   * blended on the CPU into a single texture, instead of being drawn as one
+   * textured quad per layer. This is much faster with software OpenGL (e.g.,
+   * llvmpipe over VNC). Layers that are not sliced orthogonally or that are
+   * rendered as grids fall back to the per-layer drawing. The default can be
+   * set with the ITKSNAP_CPU_COMPOSITING environment variable.
+   */
+  irisGetSetMacro(UseCPUCompositing, bool)
+
 protected:
 
   GenericSliceRenderer();
@@ -130,6 +140,19 @@ protected:
       ImageWrapperBase *base_layer,
       const ViewportType &vp);
 
+  // Blend the layers for a cell on the CPU and draw them as a single texture.
+  // Returns false if the layers cannot be composited, in which case nothing
+  // is drawn
+  bool DrawCompositedLayers(ImageWrapperBase *base_layer, const ViewportType &vp);
+
+  // Whether a layer can be included in the CPU composite
+  bool CanCompositeLayer(ImageWrapperBase *layer);
+
+  // For a layer that is sliced orthogonally, the slice may come from a coarse
+  // level of the image pyramid, with each pixel covering several voxels. This
+  // computes the offset and scaling that map slice pixels to slice units
+  void GetOrthogonalSliceLayout(itk::ImageBase<2> *slice, Vector2d &offset, Vector2d &scale);
+
   // This method can be used by the renderer delegates to draw a texture
   void DrawTextureForLayer(ImageWrapperBase *layer, const ViewportType &vp, bool use_transparency);
 
@@ -143,13 +166,19 @@ protected:
   // The index of the viewport that is currently being drawn - for use in child renderers
   int m_DrawingViewportIndex;
 
+  // Whether layers are composited on the CPU, and whether the segmentation
+  // was included in the composite for the cell currently being drawn
+  bool m_UseCPUCompositing, m_SegmentationComposited;
+
   // A list of overlays that the user can configure
   RendererDelegateList m_TiledOverlays, m_GlobalOverlays;
 
   // List of child renderers
   std::list<AbstractRenderer *>m_ChildRenderers;
 
-  Vector3d ComputeGridPosition(const Vector3d &disp_pix, const itk::Index<2> &slice_index, ImageWrapperBase *vecimg);
+  Vector3d ComputeGridPosition(const Vector3d &disp_pix, const itk::Index<2> &slice_index,
+                               ImageWrapperBase *vecimg,
+                               const Vector2d &offset, const Vector2d &scale);
 };
 
 
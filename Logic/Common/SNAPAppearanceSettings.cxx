@@ -358,6 +358,9 @@ GlobalDisplaySettings::GlobalDisplaySettings()
   m_ZoomThumbnailSizeInPercentModel =
       NewRangedProperty("ZoomThumbnailSizeInPercent", 30.0, 5.0, 50.0, 1.0);
 
+  m_FlagDisplayCoarseSlicesWhenZoomedOutModel =
+      NewSimpleProperty("FlagDisplayCoarseSlicesWhenZoomedOut", false);
+
   m_GreyInterpolationModeModel =
       NewSimpleEnumProperty("GreyInterpolationMode", NEAREST, emap_interp);
 
@@ -108,6 +108,7 @@ public:
   irisSimplePropertyAccessMacro(FlagDisplayZoomThumbnail, bool)
   irisRangedPropertyAccessMacro(ZoomThumbnailSizeInPercent, double)
   irisRangedPropertyAccessMacro(ZoomThumbnailMaximumSize, int)
+  irisSimplePropertyAccessMacro(FlagDisplayCoarseSlicesWhenZoomedOut, bool)
   irisSimplePropertyAccessMacro(GreyInterpolationMode, UIGreyInterpolation)
   irisSimplePropertyAccessMacro(FlagLayoutPatientAnteriorShownLeft, bool)
   irisSimplePropertyAccessMacro(FlagLayoutPatientRightShownLeft, bool)
@@ -129,6 +130,7 @@ protected:
   SmartPtr<ConcreteSimpleBooleanProperty> m_FlagDisplayZoomThumbnailModel;
   SmartPtr<ConcreteRangedDoubleProperty> m_ZoomThumbnailSizeInPercentModel;
   SmartPtr<ConcreteRangedIntProperty> m_ZoomThumbnailMaximumSizeModel;
+  SmartPtr<ConcreteSimpleBooleanProperty> m_FlagDisplayCoarseSlicesWhenZoomedOutModel;
   SmartPtr<ConcreteSimpleBooleanProperty> m_FlagLayoutPatientAnteriorShownLeftModel;
   SmartPtr<ConcreteSimpleBooleanProperty> m_FlagLayoutPatientRightShownLeftModel;
 
@@ -119,6 +119,12 @@ SNAPRegistryIO
     registry["SolverAlgorithm"].GetEnum(
       m_EnumMapSolver,defaultSet.GetSolver()));
 
+  out.SetMultiResolutionFactor(
+    registry["MultiResolutionFactor"][defaultSet.GetMultiResolutionFactor()]);
+
+  out.SetCoarseIterations(
+    registry["CoarseIterations"][defaultSet.GetCoarseIterations()]);
+
   return out;
 }
 
@@ -141,6 +147,8 @@ SNAPRegistryIO
   registry["AdvectionSpeedExponent"] << in.GetAdvectionSpeedExponent();
   registry["SnakeType"].PutEnum(m_EnumMapSnakeType,in.GetSnakeType());
   registry["SolverAlgorithm"].PutEnum(m_EnumMapSolver,in.GetSolver());
+  registry["MultiResolutionFactor"] << in.GetMultiResolutionFactor();
+  registry["CoarseIterations"] << in.GetCoarseIterations();
 }
 
 /** Read mesh options from a registry */
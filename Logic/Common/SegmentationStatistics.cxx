@@ -36,15 +36,297 @@
 #include "GenericImageData.h"
 #include "IRISApplication.h"
 #include "ImageCollectionToImageFilter.h"
+#include <itkMultiThreader.h>
+#include <itkVectorImage.h>
 
 #include <iostream>
 #include <iomanip>
+#include <algorithm>
+#include <limits>
+#include <cmath>
 
 
 using namespace std;
 
+/**
+ * The part of the statistics computation that runs in parallel. The lines of
+ * the RLE segmentation are divided between the threads. For each run in a
+ * line, the voxels of every image layer under the run are read directly from
+ * the image buffers, and added to per-thread accumulators for the label of
+ * the run. The accumulators hold the mean and the sum of squared deviations
+ * from the mean, which are combined for each run and then across threads
+ * using the pairwise update of Chan et al., which unlike the sums of values
+ * and squared values does not lose precision for large counts.
+ */
+class SegmentationStatisticsWorker
+{
+public:
+  typedef LabelImageWrapper::ImageType                         LabelImageType;
+  typedef LabelImageType::RLLine                                       RLLine;
+
+  // An image layer read directly from the buffer. Its components are stored
+  // in columns [col, col + nc) of the statistics. A NULL buffer means that
+  // the statistics of the layer cannot be computed
+  struct Source
+  {
+    const GreyType *buffer;
+    int nc, col;
+  };
+
+  // Histogram bins for an image column. If exact, each bin holds one value
+  struct Binning
+  {
+    double min, width;
+    int nbins;
+    bool exact;
+  };
+
+  // Statistics of a label: voxel count, and for each column the mean, the
+  // sum of squared deviations from the mean, and optionally a histogram
+  struct Accumulator
+  {
+    unsigned long count;
+    std::vector<double> mean, m2;
+    std::vector<unsigned int> hist;
+  };
+
+  typedef std::map<LabelType, Accumulator> AccumulatorMap;
+
+  // Inputs
+  const RLLine *m_Lines;
+  long m_NumberOfLines, m_LineLength;
+  int m_NumberOfColumns;
+  std::vector<Source> m_Sources;
+
+  // Binning for each column, empty if no histograms are needed
+  std::vector<Binning> m_Binning;
+  int m_HistogramStride;
+
+  // Per-thread results, and the combined result
+  std::vector<AccumulatorMap> m_ThreadAccumulators;
+  AccumulatorMap m_Result;
+
+  void Run();
+
+  // Value at a position in the sorted intensities of a column of an
+  // accumulator, interpolated between neighboring positions
+  double GetPercentile(const Accumulator &acc, int col, double p) const;
+
+protected:
+
+  Accumulator &GetAccumulator(AccumulatorMap &accMap, LabelType label);
+
+  void ProcessLines(long k0, long k1, AccumulatorMap &accMap);
+
+  void MergeAccumulator(Accumulator &trg, const Accumulator &src);
+
+  double GetValueAtRank(const unsigned int *hist, const Binning &b, unsigned long r) const;
+
+  static ITK_THREAD_RETURN_TYPE ThreadCallback(void *arg);
+};
+
+/**
+ * Add a run of n voxels of an image with nc interleaved components to the
+ * running statistics of a label, which so far cover nOld voxels
+ */
+template <class TComponent>
+static void AccumulateRun(
+    const TComponent *data, int nc, long n, unsigned long nOld,
+    double *mean, double *m2,
+    unsigned int *hist, int stride,
+    const SegmentationStatisticsWorker::Binning *binning)
+{
+  double nNew = (double) nOld + n;
+  for(int c = 0; c < nc; c++)
+    {
+    const TComponent *p = data + c;
+
+    // Mean and squared deviations within the run
+    double sum = 0;
+    for(long i = 0; i < n; i++)
+      sum += p[i * nc];
+
+    double rmean = sum / n, rm2 = 0;
+    for(long i = 0; i < n; i++)
+      {
+      double d = p[i * nc] - rmean;
+      rm2 += d * d;
+      }
+
+    // Combine with the statistics so far
+    double delta = rmean - mean[c];
+    mean[c] += delta * n / nNew;
+    m2[c] += rm2 + delta * delta * ((double) nOld * n / nNew);
+
+    if(hist)
+      {
+      const SegmentationStatisticsWorker::Binning &b = binning[c];
+      unsigned int *h = hist + c * stride;
+      for(long i = 0; i < n; i++)
+        {
+        int bin = (int) ((p[i * nc] - b.min) / b.width);
+        h[std::max(0, std::min(b.nbins - 1, bin))]++;
+        }
+      }
+    }
+}
+
+SegmentationStatisticsWorker::Accumulator &
+SegmentationStatisticsWorker
+::GetAccumulator(AccumulatorMap &accMap, LabelType label)
+{
+  AccumulatorMap::iterator it = accMap.find(label);
+  if(it != accMap.end())
+    return it->second;
+
+  Accumulator &acc = accMap[label];
+  acc.count = 0;
+  acc.mean.resize(m_NumberOfColumns, 0.0);
+  acc.m2.resize(m_NumberOfColumns, 0.0);
+  if(m_Binning.size())
+    acc.hist.resize(m_NumberOfColumns * m_HistogramStride, 0);
+  return acc;
+}
+
+void
+SegmentationStatisticsWorker
+::ProcessLines(long k0, long k1, AccumulatorMap &accMap)
+{
+  // Cache the accumulator to avoid many calls to std::map
+  Accumulator *cached = NULL;
+  LabelType cachedLabel = 0;
+
+  for(long k = k0; k < k1; k++)
+    {
+    const RLLine &line = m_Lines[k];
+    long x = 0;
+    for(size_t s = 0; s < line.size(); s++)
+      {
+      long n = line[s].first;
+      LabelType label = line[s].second;
+      if(!cached || label != cachedLabel)
+        {
+        cached = &this->GetAccumulator(accMap, label);
+        cachedLabel = label;
+        }
+
+      for(size_t j = 0; j < m_Sources.size(); j++)
+        {
+        const Source &src = m_Sources[j];
+        if(src.buffer)
+          {
+          AccumulateRun(src.buffer + (k * m_LineLength + x) * src.nc, src.nc, n,
+                        cached->count, &cached->mean[src.col], &cached->m2[src.col],
+                        cached->hist.size() ? &cached->hist[src.col * m_HistogramStride] : NULL,
+                        m_HistogramStride,
+                        m_Binning.size() ? &m_Binning[src.col] : NULL);
+          }
+        }
+
+      cached->count += n;
+      x += n;
+      }
+    }
+}
+
+ITK_THREAD_RETURN_TYPE
+SegmentationStatisticsWorker
+::ThreadCallback(void *arg)
+{
+  typedef itk::MultiThreader::ThreadInfoStruct ThreadInfo;
+  ThreadInfo *info = static_cast<ThreadInfo *>(arg);
+  SegmentationStatisticsWorker *self = static_cast<SegmentationStatisticsWorker *>(info->UserData);
+
+  // The range of lines handled by this thread
+  int thread = info->ThreadID, nThreads = info->NumberOfThreads;
+  long k0 = (long) (((long long) self->m_NumberOfLines * thread) / nThreads);
+  long k1 = (long) (((long long) self->m_NumberOfLines * (thread + 1)) / nThreads);
+  self->ProcessLines(k0, k1, self->m_ThreadAccumulators[thread]);
+
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+void
+SegmentationStatisticsWorker
+::MergeAccumulator(Accumulator &trg, const Accumulator &src)
+{
+  if(src.count == 0)
+    return;
+
+  double nNew = (double) trg.count + src.count;
+  for(int c = 0; c < m_NumberOfColumns; c++)
+    {
+    double delta = src.mean[c] - trg.mean[c];
+    trg.mean[c] += delta * src.count / nNew;
+    trg.m2[c] += src.m2[c] + delta * delta * ((double) trg.count * src.count / nNew);
+    }
+
+  for(size_t i = 0; i < trg.hist.size(); i++)
+    trg.hist[i] += src.hist[i];
+
+  trg.count += src.count;
+}
+
+void
+SegmentationStatisticsWorker
+::Run()
+{
+  SmartPtr<itk::MultiThreader> threader = itk::MultiThreader::New();
+  int nThreads = (int) std::max(1L, std::min((long) threader->GetNumberOfThreads(), m_NumberOfLines));
+  threader->SetNumberOfThreads(nThreads);
+
+  m_ThreadAccumulators.clear();
+  m_ThreadAccumulators.resize(nThreads);
+  threader->SetSingleMethod(&SegmentationStatisticsWorker::ThreadCallback, this);
+  threader->SingleMethodExecute();
+
+  // Combine the results of the threads
+  m_Result.clear();
+  for(int t = 0; t < nThreads; t++)
+    {
+    AccumulatorMap &accMap = m_ThreadAccumulators[t];
+    for(AccumulatorMap::const_iterator it = accMap.begin(); it != accMap.end(); ++it)
+      this->MergeAccumulator(this->GetAccumulator(m_Result, it->first), it->second);
+    accMap.clear();
+    }
+}
+
+double
+SegmentationStatisticsWorker
+::GetValueAtRank(const unsigned int *hist, const Binning &b, unsigned long r) const
+{
+  unsigned long cum = 0;
+  for(int i = 0; i < b.nbins; i++)
+    {
+    if(cum + hist[i] > r)
+      {
+      // Within a wide bin, the voxels are taken to be evenly spread
+      return b.exact
+          ? b.min + i
+          : b.min + b.width * (i + (r - cum + 0.5) / hist[i]);
+      }
+    cum += hist[i];
+    }
+
+  return b.min + b.width * b.nbins;
+}
+
+double
+SegmentationStatisticsWorker
+::GetPercentile(const Accumulator &acc, int col, double p) const
+{
+  const Binning &b = m_Binning[col];
+  const unsigned int *hist = &acc.hist[col * m_HistogramStride];
+
+  double pos = std::max(0.0, std::min(1.0, p / 100.0)) * (acc.count - 1);
+  unsigned long r0 = (unsigned long) floor(pos);
+  unsigned long r1 = std::min(r0 + 1, acc.count - 1);
+  double v0 = this->GetValueAtRank(hist, b, r0);
+  double v1 = this->GetValueAtRank(hist, b, r1);
+  return v0 + (pos - r0) * (v1 - v0);
+}
+
 
-// TODO: improve efficiency by using filters to integrate label intensities
 void
 SegmentationStatistics
 ::Compute(IRISApplication *app)
@@ -54,21 +336,38 @@ SegmentationStatistics
 
   // Get the selected segmentation layer
   LabelImageWrapper *seg = app->GetSelectedSegmentationLayer();
+  LabelImageType *imSeg = seg->GetImage();
+  itk::ImageRegion<3> region = imSeg->GetBufferedRegion();
 
-  // A list of image sources
-  vector<ScalarImageWrapperBase *> layers;
+  // The layers are read directly from their buffers, and each of their
+  // components is a column of the statistics
+  vector<LayerSource> sources;
+  vector<ColumnInfo> columns;
 
   // Clear the list of column names
   m_ImageStatisticsColumnNames.clear();
 
   // Find all the images available for statistics computation
+  typedef itk::VectorImage<GreyType, 3> GreyVectorImageType;
   for(LayerIterator it(id, MAIN_ROLE | OVERLAY_ROLE); !it.IsAtEnd(); ++it)
     {
+    LayerSource src;
+    src.buffer = NULL;
+
+    // The scalar layer of each column, used for the range and to map the
+    // intensities to native format
+    vector<ScalarImageWrapperBase *> layers;
+
     ScalarImageWrapperBase *lscalar = it.GetLayerAsScalar();
     if(lscalar)
       {
       m_ImageStatisticsColumnNames.push_back(lscalar->GetNickname());
       layers.push_back(lscalar);
+
+      GreyImageType *img = dynamic_cast<GreyImageType *>(lscalar->GetImageBase());
+      if(img)
+        src.buffer = img->GetBufferPointer();
+      src.nc = 1;
       }
     else
       {
@@ -83,92 +382,167 @@ SegmentationStatistics
         layers.push_back(lvector->GetScalarRepresentation(
               SCALAR_REP_COMPONENT, j));
         }
+
+      GreyVectorImageType *img = dynamic_cast<GreyVectorImageType *>(lvector->GetImageBase());
+      if(img)
+        src.buffer = img->GetBufferPointer();
+      src.nc = (int) lvector->GetNumberOfComponents();
+      }
+
+    // The statistics are only computed for images that share the voxel grid
+    // of the segmentation
+    if(!it.GetLayer()->IsSlicingOrthogonal() ||
+       it.GetLayer()->GetImageBase()->GetBufferedRegion() != region)
+      src.buffer = NULL;
+
+    sources.push_back(src);
+    for(size_t j = 0; j < layers.size(); j++)
+      {
+      ColumnInfo col;
+      col.min = layers[j]->GetImageMinAsDouble();
+      col.max = layers[j]->GetImageMaxAsDouble();
+      col.mapping = layers[j]->GetNativeIntensityMapping();
+      columns.push_back(col);
       }
     }
 
-  // Get the number of gray image layers
-  size_t ngray = layers.size();
+  // Compute the size of a voxel, in mm^3
+  const double *spacing = 
+    id->GetMain()->GetImageBase()->GetSpacing().GetDataPointer();
+  double volVoxel = spacing[0] * spacing[1] * spacing[2];
+
+  this->ComputeFromLayers(imSeg, sources, columns, volVoxel);
+}
 
-  // Clear and initialize the statistics table
-  m_Stats.clear();
+void
+SegmentationStatistics
+::Compute(LabelImageType *seg, const std::vector<GreyImageType *> &images,
+          double volVoxel)
+{
+  vector<LayerSource> sources;
+  vector<ColumnInfo> columns;
+  m_ImageStatisticsColumnNames.clear();
 
-  // Start the label image iteration
-  LabelImageWrapper::ConstIterator itLabel = seg->GetImageConstIterator();
-  itk::ImageRegion<3> region = itLabel.GetRegion();
+  for(size_t i = 0; i < images.size(); i++)
+    {
+    const GreyType *p = images[i]->GetBufferPointer();
+    size_t n = images[i]->GetBufferedRegion().GetNumberOfPixels();
+
+    LayerSource src;
+    src.buffer = images[i]->GetBufferedRegion() == seg->GetBufferedRegion() ? p : NULL;
+    src.nc = 1;
+    sources.push_back(src);
+
+    ColumnInfo col;
+    col.min = n ? *std::min_element(p, p + n) : 0;
+    col.max = n ? *std::max_element(p, p + n) : 0;
+    col.mapping = NULL;
+    columns.push_back(col);
+
+    std::ostringstream oss;
+    oss << "Image " << i;
+    m_ImageStatisticsColumnNames.push_back(oss.str());
+    }
+
+  this->ComputeFromLayers(seg, sources, columns, volVoxel);
+}
 
-  // Cache the entry to avoid many calls to std::map
-  LabelType runLabel = 0;
-  Entry *cachedEntry = &m_Stats[runLabel];
-  cachedEntry->resize(ngray);
-  itk::Index<3> runStart = itLabel.GetIndex();
-  long runLength = 0;
+void
+SegmentationStatistics
+::ComputeFromLayers(LabelImageType *seg,
+                    const std::vector<LayerSource> &sources,
+                    const std::vector<ColumnInfo> &columns,
+                    double volVoxel)
+{
+  itk::ImageRegion<3> region = seg->GetBufferedRegion();
+  SegmentationStatisticsWorker worker;
 
-  // Aggregate the statistical data
-  for( ; !itLabel.IsAtEnd(); ++itLabel, ++runLength)
+  // Assign the columns to the layers, and record whether the statistics can
+  // be computed for each column
+  vector<bool> valid;
+  for(size_t i = 0; i < sources.size(); i++)
     {
-    // Get the label and the corresponding entry (use cache to reduce time wasted in std::map)
-    LabelType label = itLabel.Value();
-    if(label != runLabel)
-      {
-      // Record the statistics from the last run
-      this->RecordRunLength(ngray, layers, region, runStart, runLength, cachedEntry);
+    SegmentationStatisticsWorker::Source src;
+    src.buffer = sources[i].buffer;
+    src.nc = sources[i].nc;
+    src.col = (int) valid.size();
+    worker.m_Sources.push_back(src);
+    valid.resize(valid.size() + src.nc, src.buffer != NULL);
+    }
 
-      // Change the cached entry
-      runLabel = label;
-      cachedEntry = &m_Stats[runLabel];
-      if(cachedEntry->count == 0)
-        cachedEntry->resize(ngray);
+  // Get the number of image columns
+  size_t ngray = columns.size();
+  size_t npct = m_Percentiles.size();
 
-      runStart = itLabel.GetIndex();
-      runLength = 0;
+  // Set up the histograms for the percentiles. Integer images with a small
+  // range of values get one bin per value, so that the percentiles are exact
+  const int maxBins = 1024;
+  worker.m_HistogramStride = 0;
+  if(npct)
+    {
+    for(size_t j = 0; j < ngray; j++)
+      {
+      SegmentationStatisticsWorker::Binning b;
+      b.min = columns[j].min;
+      double range = columns[j].max - b.min;
+      b.exact = std::numeric_limits<GreyType>::is_integer && range < maxBins;
+      b.nbins = b.exact ? (int) range + 1 : maxBins;
+      b.width = (b.exact || range <= 0) ? 1.0 : range / maxBins;
+      worker.m_Binning.push_back(b);
+      worker.m_HistogramStride = std::max(worker.m_HistogramStride, b.nbins);
       }
     }
 
-  // Record the statistics from the last run
-  this->RecordRunLength(ngray, layers, region, runStart, runLength, cachedEntry);
+  // Integrate the statistics over all the lines of the segmentation
+  worker.m_Lines = seg->GetBuffer()->GetBufferPointer();
+  worker.m_NumberOfLines = region.GetSize(1) * region.GetSize(2);
+  worker.m_LineLength = region.GetSize(0);
+  worker.m_NumberOfColumns = (int) ngray;
+  worker.Run();
 
-  // Compute the size of a voxel, in mm^3
-  const double *spacing = 
-    id->GetMain()->GetImageBase()->GetSpacing().GetDataPointer();
-  double volVoxel = spacing[0] * spacing[1] * spacing[2];
-  
   // Compute the mean and standard deviation
-  for(EntryMap::iterator it = m_Stats.begin(); it != m_Stats.end(); ++it)
+  m_Stats.clear();
+  for(SegmentationStatisticsWorker::AccumulatorMap::const_iterator it = worker.m_Result.begin();
+      it != worker.m_Result.end(); ++it)
     {
-    Entry &entry = it->second;
+    const SegmentationStatisticsWorker::Accumulator &acc = it->second;
+    Entry &entry = m_Stats[it->first];
+    entry.resize(ngray, npct);
+    entry.count = acc.count;
+
     for(size_t j = 0; j < ngray; j++)
       {
-      // Map to native format
-      double mean = entry.sum[j] / entry.count;
-      double stdev = sqrt((entry.sumsq[j] - entry.sum[j] * mean) / (entry.count - 1));
+      // Columns of layers whose statistics cannot be computed are NaN
+      if(!valid[j])
+        {
+        entry.sum[j] = entry.sumsq[j] = entry.mean[j] = entry.stdev[j] = nan("");
+        entry.percentile.set_row(j, nan(""));
+        continue;
+        }
+
+      // Statistics in internal format
+      double mean = acc.mean[j];
+      double stdev = sqrt(acc.m2[j] / (acc.count - 1));
+      entry.sum[j] = mean * acc.count;
+      entry.sumsq[j] = acc.m2[j] + mean * mean * acc.count;
 
       // Map with scale and shift
-      entry.mean[j] = layers[j]->GetNativeIntensityMapping()->MapInternalToNative(mean);
+      const AbstractNativeIntensityMapping *nim = columns[j].mapping;
+      entry.mean[j] = nim ? nim->MapInternalToNative(mean) : mean;
 
       // Map with just shift
-      entry.stdev[j] = layers[j]->GetNativeIntensityMapping()->MapGradientMagnitudeToNative(stdev);
+      entry.stdev[j] = nim ? nim->MapGradientMagnitudeToNative(stdev) : stdev;
+
+      for(size_t k = 0; k < npct; k++)
+        {
+        double v = worker.GetPercentile(acc, (int) j, m_Percentiles[k]);
+        entry.percentile(j, k) = nim ? nim->MapInternalToNative(v) : v;
+        }
       }
     entry.volume_mm3 = entry.count * volVoxel;
     }
 }
 
-void SegmentationStatistics
-::RecordRunLength(size_t ngray, vector<ScalarImageWrapperBase *> &layers,
-                  itk::ImageRegion<3> &region, itk::Index<3> &runStart,
-                  long runLength, Entry *cachedEntry)
-{
-  // Record the statistics from the last run
-  for(size_t j = 0; j < ngray; j++)
-    {
-    layers[j]->GetRunLengthIntensityStatistics(
-          region, runStart, runLength,
-          cachedEntry->sum.data_block() + j,
-          cachedEntry->sumsq.data_block() + j);
-    }
-
-  cachedEntry->count += runLength;
-}
-
 void 
 SegmentationStatistics
 ::ExportLegacy(ostream &fout, const ColorLabelTable &clt)
@@ -230,6 +604,8 @@ void SegmentationStatistics
 
     oss << colsep << "Image mean (" << colname << ")";
     oss << colsep << "Image stdev (" << colname << ")";
+    for(size_t k = 0; k < m_Percentiles.size(); k++)
+      oss << colsep << "Image " << GetPercentileName(m_Percentiles[k]) << " (" << colname << ")";
     }
 
   // Endline
@@ -253,9 +629,21 @@ void SegmentationStatistics
       {
       oss << colsep << entry.mean[j];
       oss << colsep << entry.stdev[j];
+      for(int k = 0; k < entry.percentile.cols(); k++)
+        oss << colsep << entry.percentile(j, k);
       }
 
     oss << std::endl;
     }
 }
 
+string SegmentationStatistics
+::GetPercentileName(double p)
+{
+  if(p == 50.0)
+    return "median";
+
+  std::ostringstream oss;
+  oss << "percentile " << p;
+  return oss.str();
+}
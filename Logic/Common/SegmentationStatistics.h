@@ -36,6 +36,9 @@
 #define __SegmentationStatistics_h_
 
 #include "SNAPCommon.h"
+#include "RLEImage.h"
+#include <itkImage.h>
+#include <vnl/vnl_matrix.h>
 #include <vector>
 #include <string>
 #include <iostream>
@@ -45,11 +48,7 @@ class GenericImageData;
 class ColorLabelTable;
 class ScalarImageWrapperBase;
 class IRISApplication;
-
-namespace itk {
-  template <unsigned int VDim> class ImageRegion;
-  template <unsigned int VDim> class Index;
-}
+class AbstractNativeIntensityMapping;
 
 class SegmentationStatistics
 {
@@ -62,24 +61,47 @@ public:
     GrayStats() : sum(0), sumsq(0), mean(0), sd() {} 
   };
 
-  /* Data structure corresponding to a row in the statistics table */
+  /* Data structure corresponding to a row in the statistics table. The
+     percentiles are stored with one row per image column */
   struct Entry {
     unsigned long int count;
     double volume_mm3;
     vnl_vector<double> sum, sumsq, mean, stdev;
+    vnl_matrix<double> percentile;
     Entry() : count(0),volume_mm3(0) {}
-    void resize(int n) {
+    void resize(int n, int np = 0) {
       sum.set_size(n); sum.fill(0);
       sumsq.set_size(n); sumsq.fill(0);
       mean.set_size(n); mean.fill(0);
       stdev.set_size(n); stdev.fill(0);
+      percentile.set_size(n, np); percentile.fill(0);
     }
   };
 
   typedef std::map<LabelType, Entry> EntryMap;
 
-  /* Compute statistics from a segmentation image */
+  typedef RLEImage<LabelType> LabelImageType;
+  typedef itk::Image<GreyType, 3> GreyImageType;
+
+  /* Compute statistics from a segmentation image. The lines of the
+     segmentation are divided between threads, and the statistics of all the
+     image layers are computed in a single pass over the lines */
   void Compute(IRISApplication *app);
+
+  /* Compute statistics from a segmentation image and a list of images,
+     without mapping the intensities to native format. Images that do not
+     share the buffered region of the segmentation get NaN statistics */
+  void Compute(LabelImageType *seg, const std::vector<GreyImageType *> &images,
+               double volVoxel = 1.0);
+
+  /* Set the percentiles (between 0 and 100) of the intensity to report for
+     each label and image, e.g., 50 for the median. The percentiles are
+     estimated from per-label histograms. By default, none are computed */
+  void SetPercentiles(const std::vector<double> &percentiles)
+    { m_Percentiles = percentiles; }
+
+  const std::vector<double> &GetPercentiles() const
+    { return m_Percentiles; }
   
   /* Export to a text file using legacy format */
   void ExportLegacy(std::ostream &oss, const ColorLabelTable &clt);
@@ -95,19 +117,39 @@ public:
 
 private:
 
+  // An image layer read directly from its buffer, with nc interleaved
+  // components. A NULL buffer means that the statistics cannot be computed
+  struct LayerSource
+  {
+    const GreyType *buffer;
+    int nc;
+  };
+
+  // Intensity range of an image column, and the mapping of its intensities
+  // to native format (NULL for none)
+  struct ColumnInfo
+  {
+    double min, max;
+    const AbstractNativeIntensityMapping *mapping;
+  };
+
+  // Compute the statistics of the columns of a list of layers
+  void ComputeFromLayers(LabelImageType *seg,
+                         const std::vector<LayerSource> &sources,
+                         const std::vector<ColumnInfo> &columns,
+                         double volVoxel);
+
   // Label statistics
   EntryMap m_Stats;
 
   // Column information
   std::vector<std::string> m_ImageStatisticsColumnNames;
-  
-  void RecordRunLength(
-      size_t ngray,
-      std::vector<ScalarImageWrapperBase *> &layers,
-      itk::ImageRegion<3> &region,
-      itk::Index<3> &runStart,
-      long runLength,
-      Entry *cachedEntry);
+
+  // Requested percentiles
+  std::vector<double> m_Percentiles;
+
+  // Column header for a percentile
+  static std::string GetPercentileName(double p);
 };
 
 #endif
@@ -77,6 +77,9 @@ GenericImageData
   m_DisplayViewportGeometry[0] = ImageBaseType::New();
   m_DisplayViewportGeometry[1] = ImageBaseType::New();
   m_DisplayViewportGeometry[2] = ImageBaseType::New();
+
+  // Coarse orthogonal slices are only shown when asked for
+  m_UseMultiResolutionOrthogonalSlicing = false;
 }
 
 GenericImageData
@@ -156,6 +159,7 @@ GenericImageData::CreateAnatomicWrapper(GuidedNativeImageIO *io, ITKTransformTyp
     wrapper->SetNativeMapping(mapper);
     for(int i = 0; i < 3; i++)
       wrapper->SetDisplayViewportGeometry(i, m_DisplayViewportGeometry[i]);
+    wrapper->SetUseMultiResolutionOrthogonalSlicing(m_UseMultiResolutionOrthogonalSlicing);
 
     out_wrapper = wrapper.GetPointer();
     }
@@ -183,6 +187,7 @@ GenericImageData::CreateAnatomicWrapper(GuidedNativeImageIO *io, ITKTransformTyp
 
     for(int i = 0; i < 3; i++)
       wrapper->SetDisplayViewportGeometry(i, m_DisplayViewportGeometry[i]);
+    wrapper->SetUseMultiResolutionOrthogonalSlicing(m_UseMultiResolutionOrthogonalSlicing);
 
     out_wrapper = wrapper.GetPointer();
     }
@@ -412,6 +417,14 @@ void GenericImageData::SetDisplayGeometry(const IRISDisplayGeometry &dispGeom)
       }
 }
 
+void GenericImageData::SetUseMultiResolutionOrthogonalSlicing(bool flag)
+{
+  m_UseMultiResolutionOrthogonalSlicing = flag;
+  for(LayerIterator lit(this); !lit.IsAtEnd(); ++lit)
+    if(lit.GetLayer())
+      lit.GetLayer()->SetUseMultiResolutionOrthogonalSlicing(flag);
+}
+
 GenericImageData::ImageBaseType *GenericImageData::GetDisplayViewportGeometry(int index)
 {
   return m_DisplayViewportGeometry[index];
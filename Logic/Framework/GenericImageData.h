@@ -294,6 +294,14 @@ public:
    */
   virtual void SetDisplayGeometry(const IRISDisplayGeometry &dispGeom);
 
+  /**
+   * Whether orthogonal slices may be taken from the coarser levels of the
+   * image pyramid when a view is zoomed out. This is off by default, and is
+   * propagated to all of the loaded anatomical layers
+   */
+  virtual void SetUseMultiResolutionOrthogonalSlicing(bool flag);
+  irisGetMacro(UseMultiResolutionOrthogonalSlicing, bool)
+
   /**
    * Get a pointer to the display viewport geometry object corresponding
    * to viewports 0, 1 or 2. Viewport geometry is represented by an ImageBase
@@ -345,6 +353,9 @@ protected:
   // space as the 3D images. This specification is used to sample images onto the viewport.
   ImageBasePointer m_DisplayViewportGeometry[3];
 
+  // Whether orthogonal slices may be taken from coarse pyramid levels
+  bool m_UseMultiResolutionOrthogonalSlicing;
+
   // Image annotations - these are distinct from segmentations
   SmartPtr<ImageAnnotationData> m_Annotations;
 
@@ -53,6 +53,7 @@
 #include "itkPasteImageFilter.h"
 #include "itkIdentityTransform.h"
 #include "itkResampleImageFilter.h"
+#include "AxisAlignedResampleImageFilter.h"
 #include "itkNearestNeighborInterpolateImageFunction.h"
 #include "itkBSplineInterpolateImageFunction.h"
 #include "itkLinearInterpolateImageFunction.h"
@@ -76,6 +77,7 @@
 #include "EdgePreprocessingImageFilter.h"
 #include "UnsupervisedClustering.h"
 #include "GMMClassifyImageFilter.h"
+#include "SpeedImageCache.h"
 #include "DefaultBehaviorSettings.h"
 #include "ColorMapPresetManager.h"
 #include "ImageIODelegates.h"
@@ -85,6 +87,7 @@
 #include "LabelUseHistory.h"
 #include "ImageAnnotationData.h"
 #include "SegmentationUpdateIterator.h"
+#include "LevelSetSegmentationMerger.h"
 #include "AffineTransformHelper.h"
 
 #include <stdio.h>
@@ -142,6 +145,7 @@ IRISApplication
   // Initialize the preprocessing settings
   // TODO: m_ThresholdSettings = ThresholdSettings::New();
   m_EdgePreprocessingSettings = EdgePreprocessingSettings::New();
+  m_SpeedImageCache = SpeedImageCache::New();
 
   // Initialize the preprocessing filter preview wrappers
   m_ThresholdPreviewWrapper = ThresholdPreviewWrapperType::New();
@@ -261,6 +265,14 @@ IRISApplication
   InvokeEvent(DisplayToAnatomyCoordinateMappingChangeEvent());
 }
 
+void
+IRISApplication
+::SetUseMultiResolutionOrthogonalSlicing(bool flag)
+{
+  m_IRISImageData->SetUseMultiResolutionOrthogonalSlicing(flag);
+  m_SNAPImageData->SetUseMultiResolutionOrthogonalSlicing(flag);
+}
+
 
 void 
 IRISApplication
@@ -691,7 +703,27 @@ IRISApplication
   SNAPSegmentationROISettings roi = m_GlobalState->GetSegmentationROISettings();
 
   // If the ROI has been resampled, resample the segmentation in reverse direction
-  if(roi.IsResampling())
+  if(roi.IsResampling() && (roi.GetInterpolationMethod() == NEAREST_NEIGHBOR
+                             || roi.GetInterpolationMethod() == TRILINEAR))
+    {
+    // The ROI grid is a scaled version of the image grid, so the faster
+    // axis-aligned filter can be used
+    typedef AxisAlignedResampleImageFilter<SourceImageType,SourceImageType> FastResampleFilterType;
+    FastResampleFilterType::Pointer fltFast = FastResampleFilterType::New();
+    fltFast->SetInput(source);
+    fltFast->SetUseNearestNeighbor(roi.GetInterpolationMethod() == NEAREST_NEIGHBOR);
+    fltFast->SetSize(roi.GetROI().GetSize());
+    fltFast->SetOutputSpacing(target->GetSpacing());
+    fltFast->SetOutputOrigin(source->GetOrigin());
+    fltFast->SetDefaultValue(4.0);
+
+    if(progressCommand)
+      fltFast->AddObserver(itk::AnyEvent(),progressCommand);
+
+    fltFast->UpdateLargestPossibleRegion();
+    source = fltFast->GetOutput();
+    }
+  else if(roi.IsResampling())
     {
     // Create a resampling filter
     typedef itk::ResampleImageFilter<SourceImageType,SourceImageType> ResampleFilterType;
@@ -758,40 +790,16 @@ IRISApplication
     source = fltSample->GetOutput();
     }  
 
-  // Creat the source iterator
-  typedef itk::ImageRegionConstIterator<SourceImageType> SourceIteratorType;
-  SourceIteratorType itSource(source,source->GetLargestPossibleRegion());
-
-  // Create the smart target iterator
-  SegmentationUpdateIterator itTarget(
+  // Paint the thresholded level set into the segmentation, line by line
+  LevelSetSegmentationMerger merger(
         target, roi.GetROI(),
         m_GlobalState->GetDrawingColorLabel(), m_GlobalState->GetDrawOverFilter());
-
-  // Inversion state
-  bool invert = m_GlobalState->GetPolygonInvert();
-
-  // Go through both iterators, copy the new over the old
-  while(!itSource.IsAtEnd())
-    {
-    // Get the level set value
-    float voxSNAP = itSource.Value();
-    if((!invert && voxSNAP <= 0) || (invert && voxSNAP >= 0))
-      itTarget.PaintAsForeground();
-    else
-      itTarget.PaintAsBackground();
-
-    // Iterate
-    ++itSource;
-    ++itTarget;
-    }
-
-  // Finalize the segmentation
-  itTarget.Finalize();
+  merger.Merge(source, m_GlobalState->GetPolygonInvert());
 
   // Store the undo delta
-  if(itTarget.GetNumberOfChangedVoxels() > 0)
+  if(merger.GetNumberOfChangedVoxels() > 0)
     {
-    iris_seg->StoreUndoPoint("Automatic Segmentation", itTarget.RelinquishDelta());
+    iris_seg->StoreUndoPoint("Automatic Segmentation", merger.RelinquishDelta());
     RecordCurrentLabelUse();
     InvokeEvent(SegmentationChangeEvent());
     }
@@ -998,17 +1006,23 @@ IRISApplication
 
   // Find the slicer that slices along that direction
   typedef ImageWrapperBase::DisplaySliceType SliceType;
+  ImageWrapperBase *main = m_CurrentImageData->GetMain();
   SmartPtr<SliceType> imgGrey = NULL;
+  size_t iSlicer = 0;
   for(size_t i = 0; i < 3; i++)
     {
-    if(iSliceImg == m_CurrentImageData->GetMain()->GetDisplaySliceImageAxis(i))
+    if(iSliceImg == main->GetDisplaySliceImageAxis(i))
       {
-      imgGrey = m_CurrentImageData->GetMain()->GetDisplaySlice(i);
+      imgGrey = main->GetDisplaySlice(i);
+      iSlicer = i;
       break;
       }
     }
   assert(imgGrey);
 
+  // The exported slice must be at full resolution, regardless of the zoom
+  main->SetSlicingLevelOverride(iSlicer, 0);
+
   // Flip the image in the Y direction
   typedef itk::FlipImageFilter<SliceType> FlipFilter;
   FlipFilter::Pointer fltFlip = FlipFilter::New();
@@ -1023,7 +1037,18 @@ IRISApplication
   WriterType::Pointer writer = WriterType::New();
   writer->SetInput(fltFlip->GetOutput());
   writer->SetFileName(file);
-  writer->Update();
+
+  try
+    {
+    writer->Update();
+    }
+  catch(...)
+    {
+    main->SetSlicingLevelOverride(iSlicer, -1);
+    throw;
+    }
+
+  main->SetSlicingLevelOverride(iSlicer, -1);
 }
 
 void 
@@ -1194,8 +1219,8 @@ IRISApplication
   return nvoxels;
 }
 
-// TODO: This information should be cached at the segmentation layer level
-// by keeping track of label counts after every update operation.
+// The label counts are cached at the segmentation layer level, and updated
+// from the undo deltas after every update operation.
 size_t
 IRISApplication
 ::GetNumberOfVoxelsWithLabel(LabelType label)
@@ -1208,15 +1233,7 @@ IRISApplication
       !it.IsAtEnd(); ++it)
     {
     LabelImageWrapper *wrapper = dynamic_cast<LabelImageWrapper *>(it.GetLayer());
-    LabelImageType *seg = wrapper->GetImage();
-
-    // Get the number of voxels
-    for(LabelImageWrapper::ConstIterator it(seg, seg->GetBufferedRegion());
-        !it.IsAtEnd(); ++it)
-      {
-      if(it.Get() == label)
-        ++nvoxels;
-      }
+    nvoxels += wrapper->GetLabelIndex()->GetNumberOfVoxels(label);
     }
 
   return nvoxels;
@@ -1781,6 +1798,9 @@ IRISApplication
   // Reset the automatic segmentation ROI
   m_GlobalState->SetSegmentationROI(GlobalState::RegionType());
 
+  // The cached speed images can no longer be used
+  m_SpeedImageCache->Clear();
+
   // Unload the main image
   m_CurrentImageData->UnloadMainImage();
 
@@ -2748,11 +2768,118 @@ IRISApplication
 
   if(wrapper)
     {
-    wrapper->ComputeOutputVolume(progress);
+    // Check if the speed image has already been computed
+    std::string key = this->GetSpeedImageCacheKey();
+    SpeedImageWrapper::ImageType *speed = m_SNAPImageData->GetSpeed()->GetImage();
+    if(key.length() && m_SpeedImageCache->Retrieve(key, speed))
+      {
+      speed->Modified();
+      }
+    else
+      {
+      wrapper->ComputeOutputVolume(progress);
+      if(key.length())
+        m_SpeedImageCache->Store(key, speed);
+      }
+
     m_GlobalState->SetSpeedValid(true);
     }
 }
 
+std::string
+IRISApplication
+::GetSpeedImageCacheKey()
+{
+  std::ostringstream key;
+  key << std::setprecision(17);
+
+  // The mode and the region of interest
+  SNAPSegmentationROISettings roi = m_GlobalState->GetSegmentationROISettings();
+  key << "mode:" << m_PreprocessingMode
+      << " roi:" << roi.GetROI().GetIndex() << roi.GetROI().GetSize()
+      << " resample:" << roi.GetResampleDimensions()
+      << " interp:" << roi.GetInterpolationMethod();
+
+  // The layers from which the layers in snake mode were created. The SNAP
+  // layers themselves are recreated each time snake mode is entered.
+  key << " layers:";
+  for(LayerIterator lit = m_IRISImageData->GetLayers(MAIN_ROLE | OVERLAY_ROLE);
+      !lit.IsAtEnd(); ++lit)
+    {
+    key << lit.GetLayer()->GetImageBase()->GetMTime() << ",";
+    }
+
+  // The parameters of the mode
+  switch(m_PreprocessingMode)
+    {
+    case PREPROCESS_THRESHOLD:
+    case PREPROCESS_EDGE:
+      {
+      // Find the position of the active layer among the scalar layers and
+      // the scalar representations of the vector layers
+      ScalarImageWrapperBase *active =
+          this->GetPreprocessingFilterPreviewer(m_PreprocessingMode)->GetActiveScalarLayer();
+      int pos = 0, found = -1;
+      for(LayerIterator lit = m_SNAPImageData->GetLayers(MAIN_ROLE | OVERLAY_ROLE);
+          !lit.IsAtEnd(); ++lit)
+        {
+        if(lit.GetLayer() == active)
+          found = pos;
+        pos++;
+
+        VectorImageWrapperBase *vec = lit.GetLayerAsVector();
+        if(vec)
+          {
+          for(ScalarRepresentationIterator it(vec); !it.IsAtEnd(); ++it, ++pos)
+            if(vec->GetScalarRepresentation(it) == active)
+              found = pos;
+          }
+        }
+
+      if(found < 0)
+        return std::string();
+      key << " active:" << found;
+
+      if(m_PreprocessingMode == PREPROCESS_THRESHOLD)
+        {
+        ThresholdSettings *ts = dynamic_cast<ThresholdSettings *>(
+              active->GetUserData("ThresholdSettings"));
+        if(!ts)
+          return std::string();
+        key << " threshold:" << ts->GetLowerThreshold() << "," << ts->GetUpperThreshold()
+            << "," << ts->GetSmoothness() << "," << ts->GetThresholdMode();
+        }
+      else
+        {
+        EdgePreprocessingSettings *es = m_EdgePreprocessingSettings;
+        key << " edge:" << es->GetGaussianBlurScale() << "," << es->GetRemappingSteepness()
+            << "," << es->GetRemappingExponent();
+        }
+      break;
+      }
+
+    case PREPROCESS_GMM:
+      {
+      // The mixture model is edited in place, so its parameters are the key
+      GaussianMixtureModel *gmm = m_ClusteringEngine->GetMixtureModel();
+      key << " gmm:";
+      for(int i = 0; i < gmm->GetNumberOfGaussians(); i++)
+        {
+        key << gmm->GetWeight(i) << "," << gmm->IsForeground(i) << ","
+            << gmm->GetMean(i) << "," << gmm->GetCovariance(i) << ";";
+        }
+      break;
+      }
+
+    default:
+      // The random forest classifier is retrained in place and cannot be
+      // summarized cheaply, so random forest speed images are not cached
+      return std::string();
+    }
+
+  return key.str();
+}
+
 IRISApplication::BubbleArray&
 IRISApplication::GetBubbleArray()
 {
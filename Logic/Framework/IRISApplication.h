@@ -61,6 +61,7 @@ class ThresholdSettings;
 class EdgePreprocessingSettings;
 class AbstractSlicePreviewFilterWrapper;
 class UnsupervisedClustering;
+class SpeedImageCache;
 class ImageWrapperBase;
 class MeshManager;
 class AbstractLoadImageDelegate;
@@ -380,10 +381,19 @@ public:
 
   /**
     Uses the current preprocessing mode to compute the entire extents of the
-    speed image. This also sets the SpeedValid flag in GlobalState to true
+    speed image. This also sets the SpeedValid flag in GlobalState to true.
+    If a speed image was previously computed with the same mode, parameters
+    and input layers, it is taken from the speed image cache instead.
     */
   void ApplyCurrentPreprocessingModeToSpeedVolume(itk::Command *progress = 0);
 
+  /**
+    Get the key under which the speed image for the current preprocessing
+    mode, its parameters and the input layers is stored in the speed image
+    cache. Returns an empty string if the speed image should not be cached.
+    */
+  std::string GetSpeedImageCacheKey();
+
   /**
     Get the current preprocessing mode
     */
@@ -430,6 +440,12 @@ public:
   /** Update the display-anatomy mapping as an RAI code */
   void SetDisplayGeometry(const IRISDisplayGeometry &dispGeom);
 
+  /**
+   * Allow orthogonal slices to be taken from coarse levels of the image
+   * pyramid when the views are zoomed out, in both IRIS and SNAP modes
+   */
+  void SetUseMultiResolutionOrthogonalSlicing(bool flag);
+
   /** Get the current display-anatomy mapping */
   irisGetMacro(DisplayGeometry, const IRISDisplayGeometry &)
 
@@ -686,6 +702,10 @@ protected:
   // place to put this stuff!
   SmartPtr<EdgePreprocessingSettings> m_EdgePreprocessingSettings;
 
+  // Speed images computed previously, keyed by the preprocessing mode, the
+  // parameters and the state of the input layers
+  SmartPtr<SpeedImageCache> m_SpeedImageCache;
+
   // The last mixture model used for clustering. This is reused during repeated
   // calls to the active contour segmentation, as long as the layers haven't
   // been updated.
@@ -0,0 +1,277 @@
+#include "LevelSetSegmentationMerger.h"
+#include "IRISException.h"
+#include <algorithm>
+#include <limits>
+
+LevelSetSegmentationMerger
+::LevelSetSegmentationMerger(LabelImageType *labelImage,
+                             const RegionType &region,
+                             LabelType active_label,
+                             DrawOverFilter draw_over)
+  : m_LabelImage(labelImage),
+    m_Region(region),
+    m_ActiveLabel(active_label),
+    m_DrawOver(draw_over),
+    m_LevelSet(NULL),
+    m_Invert(false),
+    m_ChangedVoxels(0)
+{
+  m_LineOffset = region.GetIndex(0) - labelImage->GetBufferedRegion().GetIndex(0);
+  m_Delta = new UndoDelta();
+  m_Delta->SetRegion(region);
+}
+
+LevelSetSegmentationMerger
+::~LevelSetSegmentationMerger()
+{
+  if(m_Delta)
+    delete m_Delta;
+}
+
+LevelSetSegmentationMerger::UndoDelta *
+LevelSetSegmentationMerger
+::RelinquishDelta()
+{
+  UndoDelta *delta = m_Delta;
+  m_Delta = NULL;
+  return delta;
+}
+
+LabelType
+LevelSetSegmentationMerger
+::PaintInside(LabelType l) const
+{
+  if(m_DrawOver.CoverageMode == PAINT_OVER_ALL ||
+     (m_DrawOver.CoverageMode == PAINT_OVER_ONE && l == m_DrawOver.DrawOverLabel) ||
+     (m_DrawOver.CoverageMode == PAINT_OVER_VISIBLE && l != 0))
+    return m_ActiveLabel;
+  return l;
+}
+
+LabelType
+LevelSetSegmentationMerger
+::PaintOutside(LabelType l) const
+{
+  return (m_ActiveLabel != 0 && l == m_ActiveLabel) ? 0 : l;
+}
+
+LevelSetSegmentationMerger::RLLine &
+LevelSetSegmentationMerger
+::GetLine(int k)
+{
+  int ny = m_Region.GetSize(1);
+  LabelImageType::BufferType::IndexType idx;
+  idx[0] = m_Region.GetIndex(1) + k % ny;
+  idx[1] = m_Region.GetIndex(2) + k / ny;
+  return m_LabelImage->GetBuffer()->GetPixel(idx);
+}
+
+unsigned long
+LevelSetSegmentationMerger
+::MergeLine(int k, long &xMin, long &xMax)
+{
+  RLLine &line = this->GetLine(k);
+
+  // The level set along this line, and its extent in line coordinates
+  long nx = m_Region.GetSize(0);
+  const float *phi = m_LevelSet->GetBufferPointer() + k * nx;
+  long x0 = m_LineOffset, x1 = m_LineOffset + nx;
+
+  // Split the runs of the line where the level set changes sign, and compute
+  // the new label for each piece
+  RLLine out;
+  out.reserve(line.size() + 2);
+  unsigned long changed = 0;
+  long x = 0;
+  for(size_t s = 0; s < line.size(); s++)
+    {
+    long xEnd = x + line[s].first;
+    LabelType l = line[s].second;
+    while(x < xEnd)
+      {
+      long pieceEnd;
+      LabelType value;
+      if(x < x0)
+        {
+        pieceEnd = std::min(xEnd, x0);
+        value = l;
+        }
+      else if(x >= x1)
+        {
+        pieceEnd = xEnd;
+        value = l;
+        }
+      else
+        {
+        bool inside = IsInside(phi[x - x0]);
+        long limit = std::min(xEnd, x1);
+        for(pieceEnd = x + 1; pieceEnd < limit; pieceEnd++)
+          if(IsInside(phi[pieceEnd - x0]) != inside)
+            break;
+        value = inside ? PaintInside(l) : PaintOutside(l);
+        }
+
+      if(value != l)
+        {
+        changed += pieceEnd - x;
+        xMin = std::min(xMin, x);
+        xMax = std::max(xMax, pieceEnd - 1);
+        }
+
+      // Append the piece, merging it with the last run if possible
+      if(!out.empty() && out.back().second == value)
+        out.back().first += pieceEnd - x;
+      else
+        out.push_back(RLSegment(pieceEnd - x, value));
+
+      x = pieceEnd;
+      }
+    }
+
+  // Keep the old line for the undo delta
+  if(changed)
+    {
+    m_OldLines[k].swap(line);
+    line.swap(out);
+    m_LineChanged[k] = 1;
+    }
+
+  return changed;
+}
+
+void
+LevelSetSegmentationMerger
+::EncodeLineDelta(int k, long x0, long x1)
+{
+  const RLLine &lOld = m_OldLines[k], &lNew = this->GetLine(k);
+
+  // Find the runs of both lines that contain x0
+  size_t iOld = 0, iNew = 0;
+  long eOld = lOld[0].first, eNew = lNew[0].first;
+  while(eOld <= x0)
+    eOld += lOld[++iOld].first;
+  while(eNew <= x0)
+    eNew += lNew[++iNew].first;
+
+  // Walk the runs of both lines together
+  for(long x = x0; x < x1; )
+    {
+    long e = std::min(std::min(eOld, eNew), x1);
+    m_Delta->EncodeRun((LabelType) (lNew[iNew].second - lOld[iOld].second), e - x);
+    x = e;
+    if(x < x1 && x == eOld)
+      eOld += lOld[++iOld].first;
+    if(x < x1 && x == eNew)
+      eNew += lNew[++iNew].first;
+    }
+}
+
+ITK_THREAD_RETURN_TYPE
+LevelSetSegmentationMerger
+::ThreadCallback(void *arg)
+{
+  typedef itk::MultiThreader::ThreadInfoStruct ThreadInfo;
+  ThreadInfo *info = static_cast<ThreadInfo *>(arg);
+  LevelSetSegmentationMerger *self = static_cast<LevelSetSegmentationMerger *>(info->UserData);
+
+  // The range of lines handled by this thread
+  int thread = info->ThreadID, nThreads = info->NumberOfThreads;
+  int nLines = (int) self->m_LineChanged.size(), ny = self->m_Region.GetSize(1);
+  int k0 = (int) (((long long) nLines * thread) / nThreads);
+  int k1 = (int) (((long long) nLines * (thread + 1)) / nThreads);
+
+  ThreadResult &res = self->m_ThreadResults[thread];
+  for(int k = k0; k < k1; k++)
+    {
+    unsigned long changed = self->MergeLine(k, res.xMin, res.xMax);
+    if(changed)
+      {
+      long y = k % ny, z = k / ny;
+      res.yMin = std::min(res.yMin, y);
+      res.yMax = std::max(res.yMax, y);
+      res.zMin = std::min(res.zMin, z);
+      res.zMax = std::max(res.zMax, z);
+      res.changed += changed;
+      }
+    }
+
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+void
+LevelSetSegmentationMerger
+::Merge(const LevelSetImageType *levelSet, bool invert)
+{
+  if(levelSet->GetBufferedRegion().GetSize() != m_Region.GetSize())
+    throw IRISException("The level set does not match the segmentation region");
+
+  m_LevelSet = levelSet;
+  m_Invert = invert;
+
+  int ny = m_Region.GetSize(1), nz = m_Region.GetSize(2);
+  m_OldLines.clear();
+  m_OldLines.resize(ny * nz);
+  m_LineChanged.assign(ny * nz, 0);
+
+  // Merge the lines in parallel
+  SmartPtr<itk::MultiThreader> threader = itk::MultiThreader::New();
+  int nThreads = std::max(1, std::min((int) threader->GetNumberOfThreads(), nz * ny));
+  threader->SetNumberOfThreads(nThreads);
+
+  ThreadResult empty;
+  empty.xMin = empty.yMin = empty.zMin = std::numeric_limits<long>::max();
+  empty.xMax = empty.yMax = empty.zMax = -1;
+  empty.changed = 0;
+  m_ThreadResults.assign(nThreads, empty);
+
+  threader->SetSingleMethod(&LevelSetSegmentationMerger::ThreadCallback, this);
+  threader->SingleMethodExecute();
+
+  // Combine the results of the threads
+  ThreadResult box = empty;
+  for(int t = 0; t < nThreads; t++)
+    {
+    const ThreadResult &res = m_ThreadResults[t];
+    box.xMin = std::min(box.xMin, res.xMin);
+    box.xMax = std::max(box.xMax, res.xMax);
+    box.yMin = std::min(box.yMin, res.yMin);
+    box.yMax = std::max(box.yMax, res.yMax);
+    box.zMin = std::min(box.zMin, res.zMin);
+    box.zMax = std::max(box.zMax, res.zMax);
+    box.changed += res.changed;
+    }
+  m_ChangedVoxels = box.changed;
+
+  // Encode the undo delta over the bounding box of the changes, which is
+  // traversed in the same order as by an image iterator
+  if(m_ChangedVoxels > 0)
+    {
+    RegionType bbox;
+    bbox.SetIndex(0, m_LabelImage->GetBufferedRegion().GetIndex(0) + box.xMin);
+    bbox.SetIndex(1, m_Region.GetIndex(1) + box.yMin);
+    bbox.SetIndex(2, m_Region.GetIndex(2) + box.zMin);
+    bbox.SetSize(0, box.xMax - box.xMin + 1);
+    bbox.SetSize(1, box.yMax - box.yMin + 1);
+    bbox.SetSize(2, box.zMax - box.zMin + 1);
+    m_Delta->SetRegion(bbox);
+
+    for(long z = box.zMin; z <= box.zMax; z++)
+      {
+      for(long y = box.yMin; y <= box.yMax; y++)
+        {
+        int k = (int) (y + ny * z);
+        if(m_LineChanged[k])
+          this->EncodeLineDelta(k, box.xMin, box.xMax + 1);
+        else
+          m_Delta->EncodeRun(0, bbox.GetSize(0));
+        }
+      }
+
+    m_LabelImage->Modified();
+    }
+
+  m_Delta->FinishEncoding();
+
+  // Release the old lines
+  m_OldLines.clear();
+}
@@ -0,0 +1,112 @@
+#ifndef LEVELSETSEGMENTATIONMERGER_H
+#define LEVELSETSEGMENTATIONMERGER_H
+
+#include "SNAPCommon.h"
+#include "ImageWrapperTraits.h"
+#include "UndoDataManager.h"
+#include <itkMultiThreader.h>
+#include <vector>
+
+/**
+ * \class LevelSetSegmentationMerger
+ * \brief Pastes the result of the snake into the main segmentation
+ *
+ * The level set is thresholded into runs of inside and outside voxels
+ * along each line, and these runs are merged with the runs of the RLE
+ * label image directly, so the label image is never expanded. Voxels
+ * inside of the contour are painted with the active label, subject to the
+ * draw-over filter; voxels outside of the contour that have the active
+ * label are cleared. This is the same as what SegmentationUpdateIterator's
+ * PaintAsForeground() and PaintAsBackground() would do voxel by voxel.
+ *
+ * The lines are processed in parallel. The undo delta is restricted to the
+ * bounding box of the voxels that changed, and it is also encoded run by
+ * run from the old and the new lines.
+ */
+class LevelSetSegmentationMerger
+{
+public:
+  typedef itk::ImageRegion<3>                                  RegionType;
+  typedef LabelImageWrapperTraits::ImageType                   LabelImageType;
+  typedef LabelImageType::RLLine                               RLLine;
+  typedef LabelImageType::RLSegment                            RLSegment;
+  typedef LevelSetImageWrapperTraits::ImageType                LevelSetImageType;
+  typedef UndoDataManager<LabelType>::Delta                    UndoDelta;
+
+  /**
+   * Set up the merge into the region of the label image, with the current
+   * drawing label and draw-over filter
+   */
+  LevelSetSegmentationMerger(LabelImageType *labelImage,
+                             const RegionType &region,
+                             LabelType active_label,
+                             DrawOverFilter draw_over);
+
+  ~LevelSetSegmentationMerger();
+
+  /**
+   * Merge a level set image that has the size of the region. Negative values
+   * are inside of the contour, or positive values if invert is set. This
+   * updates the label image and computes the undo delta.
+   */
+  void Merge(const LevelSetImageType *levelSet, bool invert);
+
+  /** Keep the delta from being deleted */
+  UndoDelta *RelinquishDelta();
+
+  /** Get the number of changed voxels */
+  unsigned long GetNumberOfChangedVoxels() const
+    { return m_ChangedVoxels; }
+
+protected:
+
+  // Whether a level set value is inside of the contour
+  bool IsInside(float phi) const
+    { return m_Invert ? phi >= 0 : phi <= 0; }
+
+  // Label assigned to a voxel with label l inside or outside of the contour
+  LabelType PaintInside(LabelType l) const;
+  LabelType PaintOutside(LabelType l) const;
+
+  // The label image line that holds the k-th line of the region
+  RLLine &GetLine(int k);
+
+  // Merge the level set into the k-th line of the region. Returns the
+  // number of changed voxels, and updates the extent of the changes in x
+  unsigned long MergeLine(int k, long &xMin, long &xMax);
+
+  // Encode the difference between the old and the new k-th line over the
+  // range [x0, x1) into the delta
+  void EncodeLineDelta(int k, long x0, long x1);
+
+  static ITK_THREAD_RETURN_TYPE ThreadCallback(void *arg);
+
+  LabelImageType *m_LabelImage;
+  RegionType m_Region;
+  LabelType m_ActiveLabel;
+  DrawOverFilter m_DrawOver;
+
+  // Inputs to the merge
+  const LevelSetImageType *m_LevelSet;
+  bool m_Invert;
+
+  // Offset of the region from the start of the label image lines
+  long m_LineOffset;
+
+  // The lines of the region before the merge, kept for the lines that change
+  std::vector<RLLine> m_OldLines;
+  std::vector<char> m_LineChanged;
+
+  // Per-thread extent and number of changed voxels
+  struct ThreadResult
+  {
+    long xMin, xMax, yMin, yMax, zMin, zMax;
+    unsigned long changed;
+  };
+  std::vector<ThreadResult> m_ThreadResults;
+
+  UndoDelta *m_Delta;
+  unsigned long m_ChangedVoxels;
+};
+
+#endif // LEVELSETSEGMENTATIONMERGER_H
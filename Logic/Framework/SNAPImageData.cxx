@@ -46,6 +46,8 @@
 #include "itkSubtractImageFilter.h"
 #include "itkUnaryFunctorImageFilter.h"
 #include "itkFastMutexLock.h"
+#include "itkMutexLockHolder.h"
+#include "itksys/SystemTools.hxx"
 
 #include "SmoothBinaryThresholdImageFilter.h"
 #include "GlobalState.h"
@@ -60,6 +62,8 @@
 #include "SlicePreviewFilterWrapper.h"
 #include "PreprocessingFilterConfigTraits.h"
 
+#include <algorithm>
+
 
 SNAPImageData
 ::SNAPImageData()
@@ -72,21 +76,41 @@ SNAPImageData
   // Set the initial label color
   m_SnakeColorLabel = 0;
 
-  // Create the mutex lock
+  // Create the mutex locks
   m_LevelSetPipelineMutexLock = itk::FastMutexLock::New();
-
-  m_CompressedAlternateLabelImage = NULL;
+  m_LevelSetDriverMutexLock = itk::FastMutexLock::New();
+  m_SnapshotMutexLock = itk::FastMutexLock::New();
+
+  // The segmentation thread is not running
+  m_SegmentationThreader = itk::MultiThreader::New();
+  m_SegmentationThreadId = -1;
+  m_SegmentationThreadPublishIterations = 1;
+  m_SegmentationThreadPublishInterval = 100.0;
+  m_SegmentationThreadStopRequested = false;
+  m_SnapshotPending = false;
+  m_SnapshotIterations = 0;
+  m_PublishedIterations = 0;
+
+  m_AlternateUndoManager = NULL;
 }
 
 
 SNAPImageData
 ::~SNAPImageData() 
 {
+  // Wait for the segmentation thread to finish its iteration
+  if(IsSegmentationThreadRunning())
+    {
+    m_SnapshotMutexLock->Lock();
+    m_SegmentationThreadStopRequested = true;
+    m_SnapshotMutexLock->Unlock();
+    m_SegmentationThreader->TerminateThread(m_SegmentationThreadId);
+    }
+
   if(m_LevelSetDriver)
     delete m_LevelSetDriver;
 
-  if(m_CompressedAlternateLabelImage)
-    delete m_CompressedAlternateLabelImage;
+  ClearAlternateLabelImage();
 }
 
 void 
@@ -373,7 +397,7 @@ SNAPImageData
   m_CurrentSnakeParameters = p;
 
   // Enter a thread-safe section
-  m_LevelSetPipelineMutexLock->Lock();
+  m_LevelSetDriverMutexLock->Lock();
 
   // Initialize the snake driver and pass the parameters
   m_LevelSetDriver = new SNAPLevelSetDriver3d(
@@ -382,13 +406,24 @@ SNAPImageData
     m_CurrentSnakeParameters,
     m_ExternalAdvectionField);
 
-  // This makes sure that m_SnakeWrapper->IsDrawable() returns true
-  m_SnakeWrapper->SetImage(m_LevelSetDriver->GetCurrentState());
-  m_SnakeWrapper->GetImage()->Modified();
+  // The snake wrapper gets its own copy of the level set, so that it can be
+  // displayed while the driver is evolving it. This also makes sure that
+  // m_SnakeWrapper->IsDrawable() returns true
+  LevelSetImageType *state = m_LevelSetDriver->GetCurrentState();
+  SmartPtr<LevelSetImageType> front = LevelSetImageType::New();
+  front->CopyInformation(state);
+  front->SetRegions(state->GetBufferedRegion());
+  front->Allocate();
 
-  // Finish thread-safe section
+  m_LevelSetPipelineMutexLock->Lock();
+  m_SnakeWrapper->SetImage(front);
   m_LevelSetPipelineMutexLock->Unlock();
 
+  PublishLevelSetToSnake();
+
+  // Finish thread-safe section
+  m_LevelSetDriverMutexLock->Unlock();
+
   // Fire events (layers changed and level set image changed)
   this->InvokeEvent(LayerChangeEvent());
   this->InvokeEvent(LevelSetImageChangeEvent());
@@ -406,17 +441,21 @@ SNAPImageData
   // Should be in level set mode
   assert(m_LevelSetDriver);
 
-  // Pass through to the level set driver
+  // Stepping manually stops the background evolution
+  StopSegmentationThread();
 
   // Enter a thread-safe section
-  m_LevelSetPipelineMutexLock->Lock();
+  m_LevelSetDriverMutexLock->Lock();
 
   // clock_t c1 = clock();
   m_LevelSetDriver->Run(nIterations);
   // clock_t c2 = clock();
 
+  // Show the result in the snake wrapper
+  PublishLevelSetToSnake();
+
   // Leave a thread-safe section
-  m_LevelSetPipelineMutexLock->Unlock();
+  m_LevelSetDriverMutexLock->Unlock();
 
   /*
   std::cout << (c2 - c1) * 1.0 / (CLOCKS_PER_SEC * nIterations)
@@ -426,12 +465,202 @@ SNAPImageData
   this->InvokeEvent(LevelSetImageChangeEvent());
 }
 
+void
+SNAPImageData
+::PublishLevelSetToSnake()
+{
+  // The caller holds the driver lock. The pipeline lock keeps the mesh
+  // thread from reading the snake image while it is being overwritten
+  LevelSetImageType *source = m_LevelSetDriver->GetCurrentState();
+  LevelSetImageType *target = m_SnakeWrapper->GetImage();
+  size_t n = source->GetBufferedRegion().GetNumberOfPixels();
+  assert(n == target->GetBufferedRegion().GetNumberOfPixels());
+
+  m_LevelSetPipelineMutexLock->Lock();
+  std::copy(source->GetBufferPointer(), source->GetBufferPointer() + n,
+            target->GetBufferPointer());
+  target->Modified();
+  m_LevelSetPipelineMutexLock->Unlock();
+
+  m_PublishedIterations = m_LevelSetDriver->GetElapsedIterations();
+}
+
+void
+SNAPImageData
+::PublishLevelSetToSnapshot(unsigned int nIterations)
+{
+  // Called from the segmentation thread with the driver lock held. The copy
+  // goes into the back buffer, which belongs to the segmentation thread, so
+  // the GUI is only locked out for the duration of the swap
+  LevelSetImageType *source = m_LevelSetDriver->GetCurrentState();
+  size_t n = source->GetBufferedRegion().GetNumberOfPixels();
+  std::copy(source->GetBufferPointer(), source->GetBufferPointer() + n,
+            m_SnapshotBackBuffer->GetBufferPointer());
+
+  itk::MutexLockHolder<itk::FastMutexLock> holder(*m_SnapshotMutexLock);
+  LevelSetImageType::PixelContainerPointer pc = m_SnapshotBuffer->GetPixelContainer();
+  m_SnapshotBuffer->SetPixelContainer(m_SnapshotBackBuffer->GetPixelContainer());
+  m_SnapshotBackBuffer->SetPixelContainer(pc);
+  m_SnapshotIterations = nIterations;
+  m_SnapshotPending = true;
+}
+
+ITK_THREAD_RETURN_TYPE
+SNAPImageData
+::SegmentationThreadCallback(void *arg)
+{
+  typedef itk::MultiThreader::ThreadInfoStruct ThreadInfo;
+  ThreadInfo *info = static_cast<ThreadInfo *>(arg);
+  SNAPImageData *self = static_cast<SNAPImageData *>(info->UserData);
+
+  unsigned int nLast = self->m_PublishedIterations;
+  double tLast = itksys::SystemTools::GetTime();
+
+  // Run one iteration at a time, so that stop requests are honored promptly
+  while(true)
+    {
+    self->m_SnapshotMutexLock->Lock();
+    bool stop = self->m_SegmentationThreadStopRequested;
+    self->m_SnapshotMutexLock->Unlock();
+    if(stop)
+      break;
+
+    try
+      {
+      itk::MutexLockHolder<itk::FastMutexLock> holder(*self->m_LevelSetDriverMutexLock);
+      self->m_LevelSetDriver->Run(1);
+
+      // Publish a snapshot if enough iterations or enough time have elapsed
+      unsigned int n = self->m_LevelSetDriver->GetElapsedIterations();
+      double t = itksys::SystemTools::GetTime();
+      if(n >= nLast + self->m_SegmentationThreadPublishIterations ||
+         1000.0 * (t - tLast) >= self->m_SegmentationThreadPublishInterval)
+        {
+        self->PublishLevelSetToSnapshot(n);
+        nLast = n;
+        tLast = t;
+        }
+      }
+    catch(std::exception &exc)
+      {
+      // Report the error to the GUI thread and quit
+      itk::MutexLockHolder<itk::FastMutexLock> holder(*self->m_SnapshotMutexLock);
+      self->m_SegmentationThreadError = exc.what();
+      break;
+      }
+    }
+
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+void
+SNAPImageData
+::StartSegmentationThread(unsigned int nIterations, double publishMs)
+{
+  // Should be in level set mode
+  assert(m_LevelSetDriver);
+
+  if(IsSegmentationThreadRunning())
+    return;
+
+  // Allocate the snapshot buffers to match the snake image
+  LevelSetImageType *front = m_SnakeWrapper->GetImage();
+  SmartPtr<LevelSetImageType> *buffers[] = { &m_SnapshotBackBuffer, &m_SnapshotBuffer };
+  for(int i = 0; i < 2; i++)
+    {
+    SmartPtr<LevelSetImageType> &buffer = *buffers[i];
+    if(!buffer || buffer->GetBufferedRegion() != front->GetBufferedRegion())
+      {
+      buffer = LevelSetImageType::New();
+      buffer->CopyInformation(front);
+      buffer->SetRegions(front->GetBufferedRegion());
+      buffer->Allocate();
+      }
+    }
+
+  m_SegmentationThreadPublishIterations = std::max(nIterations, 1u);
+  m_SegmentationThreadPublishInterval = publishMs;
+  m_SegmentationThreadStopRequested = false;
+  m_SegmentationThreadError.clear();
+  m_SnapshotPending = false;
+
+  m_SegmentationThreadId = (int) m_SegmentationThreader->SpawnThread(
+        &SNAPImageData::SegmentationThreadCallback, this);
+}
+
+void
+SNAPImageData
+::StopSegmentationThread()
+{
+  if(!IsSegmentationThreadRunning())
+    return;
+
+  // Ask the thread to stop and wait for the current iteration to finish
+  m_SnapshotMutexLock->Lock();
+  m_SegmentationThreadStopRequested = true;
+  m_SnapshotMutexLock->Unlock();
+
+  m_SegmentationThreader->TerminateThread(m_SegmentationThreadId);
+  m_SegmentationThreadId = -1;
+  m_SnapshotPending = false;
+
+  // Show the final state of the evolution, rather than the last snapshot
+  m_LevelSetDriverMutexLock->Lock();
+  PublishLevelSetToSnake();
+  m_LevelSetDriverMutexLock->Unlock();
+
+  this->InvokeEvent(LevelSetImageChangeEvent());
+}
+
+bool
+SNAPImageData
+::UpdateSnakeFromSnapshot()
+{
+  if(!IsSegmentationThreadRunning())
+    return false;
+
+  std::string error;
+  bool pending;
+
+  m_SnapshotMutexLock->Lock();
+  error = m_SegmentationThreadError;
+  pending = m_SnapshotPending;
+  if(pending)
+    {
+    // Swap the snapshot into the snake wrapper. The old contents of the
+    // wrapper become the buffer for the next snapshot
+    LevelSetImageType *front = m_SnakeWrapper->GetImage();
+    LevelSetImageType::PixelContainerPointer pc = front->GetPixelContainer();
+
+    m_LevelSetPipelineMutexLock->Lock();
+    front->SetPixelContainer(m_SnapshotBuffer->GetPixelContainer());
+    front->Modified();
+    m_LevelSetPipelineMutexLock->Unlock();
+
+    m_SnapshotBuffer->SetPixelContainer(pc);
+    m_PublishedIterations = m_SnapshotIterations;
+    m_SnapshotPending = false;
+    }
+  m_SnapshotMutexLock->Unlock();
+
+  if(error.size())
+    {
+    StopSegmentationThread();
+    throw IRISException("Level set evolution failed: %s", error.c_str());
+    }
+
+  if(pending)
+    this->InvokeEvent(LevelSetImageChangeEvent());
+
+  return pending;
+}
+
 bool
 SNAPImageData
 ::IsEvolutionConverged()
 {
   // Make the method reentrant
-  itk::MutexLockHolder<itk::FastMutexLock> holder(*m_LevelSetPipelineMutexLock);
+  itk::MutexLockHolder<itk::FastMutexLock> holder(*m_LevelSetDriverMutexLock);
 
   return m_LevelSetDriver->IsEvolutionConverged();
 }
@@ -443,14 +672,18 @@ SNAPImageData
   // Should be in level set mode
   assert(m_LevelSetDriver);
 
+  // Stop the background evolution
+  StopSegmentationThread();
+
   // Enter a thread-safe section
-  m_LevelSetPipelineMutexLock->Lock();
+  m_LevelSetDriverMutexLock->Lock();
 
   // Pass through to the level set driver
   m_LevelSetDriver->Restart();
+  PublishLevelSetToSnake();
 
   // Leave a thread-safe section
-  m_LevelSetPipelineMutexLock->Unlock();
+  m_LevelSetDriverMutexLock->Unlock();
 
   // Fire the update event
   this->InvokeEvent(LevelSetImageChangeEvent());
@@ -463,14 +696,21 @@ SNAPImageData
   // Should be in level set mode
   assert(m_LevelSetDriver);
 
+  // Stop the background evolution
+  StopSegmentationThread();
+
   // Enter a thread-safe section
-  m_LevelSetPipelineMutexLock->Lock();
+  m_LevelSetDriverMutexLock->Lock();
 
   // Delete the level set driver and all the problems that go along with it
   delete m_LevelSetDriver; m_LevelSetDriver = NULL;
 
   // Leave a thread-safe section
-  m_LevelSetPipelineMutexLock->Unlock();
+  m_LevelSetDriverMutexLock->Unlock();
+
+  // The snapshot buffers are no longer needed
+  m_SnapshotBackBuffer = NULL;
+  m_SnapshotBuffer = NULL;
 
   // Fire the update event
   this->InvokeEvent(LevelSetImageChangeEvent());
@@ -483,7 +723,9 @@ SNAPImageData
   // Should be in level set mode
   assert(m_LevelSetDriver);
 
-  // Pass through to the level set driver
+  // Pass through to the level set driver. This may happen while the level
+  // set is evolving in the background
+  itk::MutexLockHolder<itk::FastMutexLock> holder(*m_LevelSetDriverMutexLock);
   m_LevelSetDriver->SetSnakeParameters(parameters);
 }
 
@@ -491,6 +733,11 @@ unsigned int
 SNAPImageData::
 GetElapsedSegmentationIterations() const
 {
+  // While the level set evolves in the background, report the iteration
+  // that is being displayed
+  if(IsSegmentationThreadRunning())
+    return m_PublishedIterations;
+
   return m_LevelSetDriver->GetElapsedIterations();
 }
 
@@ -509,51 +756,49 @@ SNAPImageData
   return m_LevelSetDriver->GetLevelSetFunction();
 }
 
-// TODO: this must go away!
-void SNAPImageData::SwapLabelImageWithCompressedAlternative()
+void SNAPImageData::ClearAlternateLabelImage()
 {
-  // Create a compressed version of the current segmentation
-  CompressedLabelImageType *save = new CompressedLabelImageType();
-  LabelImageWrapper *liw = this->GetFirstSegmentationLayer();
-  for(LabelImageWrapper::ConstIterator iter(liw->GetImage(), liw->GetBufferedRegion());
-      !iter.IsAtEnd(); ++iter)
-    {
-    save->Encode(iter.Value());
-    }
-  save->FinishEncoding();
+  m_AlternateLabelImage = NULL;
+  delete m_AlternateUndoManager;
+  m_AlternateUndoManager = NULL;
+}
 
-  // Clear the undo manager
-  liw->ClearUndoPoints();
+void SNAPImageData::SwapLabelImageWithAlternative()
+{
+  LabelImageWrapper *liw = this->GetFirstSegmentationLayer();
+  LabelImageType *image = liw->GetImage();
 
-  // Decompress the currently saved alternative
-  if(m_CompressedAlternateLabelImage)
+  // The alternate image is discarded if the segmentation has been
+  // reallocated with a different size
+  if(m_AlternateLabelImage
+     && m_AlternateLabelImage->GetBufferedRegion() != image->GetBufferedRegion())
     {
-    LabelImageWrapper::Iterator it_write(liw->GetImage(), liw->GetBufferedRegion());
-    for(size_t i = 0; i < m_CompressedAlternateLabelImage->GetNumberOfRLEs(); ++i)
-      {
-      LabelType value = m_CompressedAlternateLabelImage->GetRLEValue(i);
-      for(size_t j = 0; j < m_CompressedAlternateLabelImage->GetRLELength(i); ++j, ++it_write)
-        it_write.Set(value);
-      }
+    ClearAlternateLabelImage();
     }
-  else
+
+  // The first time around, the alternate segmentation is empty
+  if(!m_AlternateLabelImage)
     {
-    liw->GetImage()->FillBuffer(0);
+    m_AlternateLabelImage = LabelImageType::New();
+    m_AlternateLabelImage->CopyInformation(image);
+    m_AlternateLabelImage->SetRegions(image->GetBufferedRegion());
+    m_AlternateLabelImage->Allocate();
+    m_AlternateLabelImage->FillBuffer(0);
     }
 
-  liw->GetImage()->Modified();
-  m_CompressedAlternateLabelImage = save;
+  // Swap the voxels and the undo histories
+  liw->SwapImageContents(m_AlternateLabelImage, m_AlternateUndoManager);
 }
 
 void SNAPImageData::SwitchLabelImageToExamples()
 {
-  this->SwapLabelImageWithCompressedAlternative();
+  this->SwapLabelImageWithAlternative();
   m_LabelImageInExampleMode = true;
 }
 
 void SNAPImageData::SwitchLabelImageToMainSegmentation()
 {
-  this->SwapLabelImageWithCompressedAlternative();
+  this->SwapLabelImageWithAlternative();
   m_LabelImageInExampleMode = false;
 }
 
@@ -591,11 +836,8 @@ SNAPImageData
     }
 
   // Destroy the alternate image if there is none or if the ROI settings have changed
-  if(m_CompressedAlternateLabelImage && m_ROISettings != roi)
-    {
-    delete m_CompressedAlternateLabelImage;
-    m_CompressedAlternateLabelImage = NULL;
-    }
+  if(m_AlternateLabelImage && m_ROISettings != roi)
+    ClearAlternateLabelImage();
 
   // Cache the ROI settings
   m_ROISettings = roi;
@@ -639,6 +881,9 @@ void SNAPImageData::CopyLayerMetadata(
 
 void SNAPImageData::UnloadAll()
 {
+  // The background evolution must not outlive the snake wrapper
+  StopSegmentationThread();
+
   // Unload all the data
   this->UnloadOverlays();
   this->UnloadMainImage();
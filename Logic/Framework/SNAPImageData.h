@@ -51,6 +51,7 @@
 
 #include "SNAPLevelSetFunction.h"
 #include "itkImageAdaptor.h"
+#include "itkMultiThreader.h"
 #include "UndoDataManager.h"
 
 namespace itk {
@@ -161,9 +162,35 @@ public:
   bool InitializeSegmentation(const SnakeParameters &parameters, 
     const std::vector<Bubble> &bubbles, unsigned int labelColor);
 
-  /** Run the segmentation for a fixed number of iterations */
+  /** Run the segmentation for a fixed number of iterations. The result is
+   * copied into the snake image wrapper when the iterations are done */
   void RunSegmentation(unsigned int nIterations);
 
+  /**
+   * Start evolving the level set continuously in a background thread. The
+   * thread publishes a snapshot of the level set every nIterations iterations
+   * or every publishMs milliseconds, whichever comes first. Snapshots are
+   * shown by calling UpdateSnakeFromSnapshot() from the GUI thread.
+   */
+  void StartSegmentationThread(unsigned int nIterations, double publishMs = 100.0);
+
+  /**
+   * Stop the background evolution. The thread finishes the iteration that it
+   * is performing, and the final state is copied into the snake wrapper.
+   */
+  void StopSegmentationThread();
+
+  /** Check if the level set is evolving in the background */
+  bool IsSegmentationThreadRunning() const
+    { return m_SegmentationThreadId >= 0; }
+
+  /**
+   * Copy the latest snapshot published by the background thread into the
+   * snake image wrapper. Returns true if there was a new snapshot, in which
+   * case LevelSetImageChangeEvent is fired. Never waits for the evolution.
+   */
+  bool UpdateSnakeFromSnapshot();
+
   /** Revert the segmentation to the beginning */
   void RestartSegmentation();
 
@@ -196,7 +223,9 @@ public:
   void MergeSnakeWithIRIS(IRISImageData *target) const;
 
   /**
-   * Get the level set image currently being evolved
+   * Get the level set image currently being evolved. This is the driver's
+   * working image, which is being modified while the segmentation thread is
+   * running; GetSnake() holds the latest published copy.
    */
   LevelSetImageType *GetLevelSetImage();
 
@@ -208,7 +237,8 @@ public:
    * SNAPImageData provides a mutex lock that prevents multiple threads from
    * causing the level set pipeline to update at once. In particular this
    * can happen if the meshes are being generated from the level set data
-   * in a background thread
+   * in a background thread. The lock is only held while a new snapshot is
+   * copied into the snake wrapper, not during the evolution itself.
    */
   irisGetMacro(LevelSetPipelineMutexLock, itk::FastMutexLock *)
 
@@ -255,6 +285,15 @@ protected:
   /** Another callback, used in non-interactive mode */
   void TerminatingPauseCallback();
 
+  /** Copy the driver's current level set into the snake wrapper */
+  void PublishLevelSetToSnake();
+
+  /** Copy the driver's current level set into the snapshot buffer */
+  void PublishLevelSetToSnapshot(unsigned int nIterations);
+
+  /** Body of the background segmentation thread */
+  static ITK_THREAD_RETURN_TYPE SegmentationThreadCallback(void *arg);
+
   /** Type of fommands used for callbacks to the user of this class */
   typedef itk::SmartPointer<itk::Command> CommandPointer;
   
@@ -294,18 +333,49 @@ protected:
   // causing the level set pipeline to update at once.
   SmartPtr<itk::FastMutexLock> m_LevelSetPipelineMutexLock;
 
+  // Serializes access to the level set driver between the segmentation
+  // thread and the calls that change its state
+  SmartPtr<itk::FastMutexLock> m_LevelSetDriverMutexLock;
+
+  // Protects the snapshot handed from the segmentation thread to the GUI
+  SmartPtr<itk::FastMutexLock> m_SnapshotMutexLock;
+
+  // The segmentation thread writes the level set into the back buffer and
+  // then swaps it with the snapshot buffer, which the GUI thread in turn
+  // swaps with the image in the snake wrapper. Pixel containers are swapped,
+  // so the images are never reallocated while the evolution runs.
+  SmartPtr<LevelSetImageType> m_SnapshotBackBuffer;
+  SmartPtr<LevelSetImageType> m_SnapshotBuffer;
+  bool m_SnapshotPending;
+  unsigned int m_SnapshotIterations;
+
+  // Iterations shown in the snake wrapper
+  unsigned int m_PublishedIterations;
+
+  // The background segmentation thread
+  SmartPtr<itk::MultiThreader> m_SegmentationThreader;
+  int m_SegmentationThreadId;
+  unsigned int m_SegmentationThreadPublishIterations;
+  double m_SegmentationThreadPublishInterval;
+  bool m_SegmentationThreadStopRequested;
+  std::string m_SegmentationThreadError;
+
   // Are we in example mode
   bool m_LabelImageInExampleMode;
 
-  // Compressed data for the example/main segmentation image
-  typedef UndoDataManager<LabelType>::Delta CompressedLabelImageType;
-  CompressedLabelImageType *m_CompressedAlternateLabelImage;
+  // The example/main segmentation image that is not currently shown, and
+  // its undo history
+  SmartPtr<LabelImageType> m_AlternateLabelImage;
+  LabelImageWrapper::UndoManagerType *m_AlternateUndoManager;
+
+  // Release the alternate segmentation
+  void ClearAlternateLabelImage();
 
   // Current ROI settings
   SNAPSegmentationROISettings m_ROISettings;
 
 
-  void SwapLabelImageWithCompressedAlternative();
+  void SwapLabelImageWithAlternative();
 };
 
 
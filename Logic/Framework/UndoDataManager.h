@@ -61,6 +61,9 @@ public:
 
   void Encode(const TPixel &value);
 
+  /** Encode a run of identical values, same as calling Encode() n times */
+  void EncodeRun(const TPixel &value, size_t n);
+
   void FinishEncoding();
 
   size_t GetNumberOfRLEs()
@@ -45,10 +45,12 @@
 #include "RLEImageRegionIterator.h"
 #include "RLERegionOfInterestImageFilter.h"
 #include "itkImageSliceConstIteratorWithIndex.h"
+#include "itkImageRegionIterator.h"
 #include "itkNumericTraits.h"
 #include "itkRegionOfInterestImageFilter.h"
 #include "itkIdentityTransform.h"
 #include "AdaptiveSlicingPipeline.h"
+#include "ImagePyramid.h"
 #include "SNAPSegmentationROISettings.h"
 #include "itkCommand.h"
 #include "ImageCoordinateGeometry.h"
@@ -72,6 +74,7 @@
 #include "itkTransform.h"
 #include "itkExtractImageFilter.h"
 #include "AffineTransformHelper.h"
+#include "AxisAlignedResampleImageFilter.h"
 
 
 #include <vnl/vnl_inverse.h>
@@ -209,6 +212,26 @@ public:
             element_product((to_double(vROIIndex) - 0.5), vOldSpacing) +
             vNewSpacing * 0.5);
 
+      // When the image is in the reference space, the ROI grid is just a
+      // scaled version of the image grid and a faster filter can be used
+      if(!force_resampling && (roi.GetInterpolationMethod() == NEAREST_NEIGHBOR
+                               || roi.GetInterpolationMethod() == TRILINEAR))
+        {
+        typedef AxisAlignedResampleImageFilter<ImageType,ImageType> FastResampleFilterType;
+        typename FastResampleFilterType::Pointer fltFast = FastResampleFilterType::New();
+        fltFast->SetInput(image);
+        fltFast->SetUseNearestNeighbor(roi.GetInterpolationMethod() == NEAREST_NEIGHBOR);
+        fltFast->SetSize(to_itkSize(roi.GetResampleDimensions()));
+        fltFast->SetOutputSpacing(vNewSpacing.data_block());
+        fltFast->SetOutputOrigin(vNewOrigin.data_block());
+
+        if(progressCommand)
+          fltFast->AddObserver(itk::AnyEvent(),progressCommand);
+
+        fltFast->Update();
+        return fltFast->GetOutput();
+        }
+
       // Create a filter for resampling the image
       typedef itk::ResampleImageFilter<ImageType,ImageType> ResampleFilterType;
       typename ResampleFilterType::Pointer fltSample = ResampleFilterType::New();
@@ -440,6 +463,30 @@ public:
           outConv->Update();
           typename UncompressedType::Pointer imgUncompressed = outConv->GetOutput();
 
+          // Labels are resampled with the faster filter when possible, and
+          // then compressed again
+          if (!force_resampling && roi.GetInterpolationMethod() == NEAREST_NEIGHBOR)
+          {
+              typedef AxisAlignedResampleImageFilter<UncompressedType, UncompressedType> FastResampleFilterType;
+              typename FastResampleFilterType::Pointer fltFast = FastResampleFilterType::New();
+              fltFast->SetInput(imgUncompressed);
+              fltFast->SetUseNearestNeighbor(true);
+              fltFast->SetSize(to_itkSize(roi.GetResampleDimensions()));
+              fltFast->SetOutputSpacing(vNewSpacing.data_block());
+              fltFast->SetOutputOrigin(vNewOrigin.data_block());
+
+              if (progressCommand)
+                  fltFast->AddObserver(itk::AnyEvent(), progressCommand);
+
+              typedef itk::RegionOfInterestImageFilter<UncompressedType, ImageType> inConverterType;
+              typename inConverterType::Pointer inConv = inConverterType::New();
+              inConv->SetInput(fltFast->GetOutput());
+              fltFast->UpdateOutputInformation();
+              inConv->SetRegionOfInterest(fltFast->GetOutput()->GetLargestPossibleRegion());
+              inConv->Update();
+              return inConv->GetOutput();
+          }
+
           // Create a filter for resampling the image
           typedef itk::ResampleImageFilter<UncompressedType, ImageType> ResampleFilterType;
           typename ResampleFilterType::Pointer fltSample = ResampleFilterType::New();
@@ -566,6 +613,11 @@ ImageWrapper<TTraits,TBase>
   m_Slicer[1] = SlicerType::New();
   m_Slicer[2] = SlicerType::New();
 
+  // Create the image pyramid, which is shared between the slicers
+  m_ImagePyramid = ImagePyramidType::New();
+  for(unsigned int i = 0; i < 3; i++)
+    m_Slicer[i]->SetImagePyramid(m_ImagePyramid);
+
   // Initialize the display mapping
   m_DisplayMapping = DisplayMapping::New();
   m_DisplayMapping->Initialize(static_cast<typename DisplayMapping::WrapperType *>(this));
@@ -959,6 +1011,9 @@ ImageWrapper<TTraits,TBase>
   this->m_ImageBase = newImage;
   this->m_Image = newImage;
 
+  // Any previously computed downsampled images are no longer valid
+  m_ImagePyramid->SetImage(newImage);
+
   // Create the transform if it does not exist
   typename ITKTransformType::Pointer tran = transform;
   if(tran.IsNull())
@@ -1126,6 +1181,7 @@ ImageWrapper<TTraits,TBase>
     {
     m_Image->ReleaseData();
     m_Image = NULL;
+    m_ImagePyramid->SetImage(NULL);
     }
   m_Initialized = false;
 
@@ -1228,6 +1284,14 @@ ImageWrapper<TTraits,TBase>
   m_Slicer[index]->SetObliqueReferenceImage(viewport_image);
 }
 
+template<class TTraits, class TBase>
+void
+ImageWrapper<TTraits,TBase>
+::SetSlicingLevelOverride(unsigned int index, int level)
+{
+  m_Slicer[index]->SetPyramidLevelOverride(level);
+}
+
 template<class TTraits, class TBase>
 const typename ImageWrapper<TTraits,TBase>::ImageBaseType*
 ImageWrapper<TTraits,TBase>
@@ -1236,6 +1300,52 @@ ImageWrapper<TTraits,TBase>
   return m_Slicer[index]->GetObliqueReferenceImage();
 }
 
+template<class TTraits, class TBase>
+void
+ImageWrapper<TTraits,TBase>
+::SetUseMultiResolutionSlicing(bool flag)
+{
+  for(unsigned int i = 0; i < 3; i++)
+    m_Slicer[i]->SetUseMultiResolution(flag);
+
+  // Free the memory held by the pyramid if it is not going to be used
+  if(!flag)
+    m_ImagePyramid->ReleaseLevels();
+}
+
+template<class TTraits, class TBase>
+bool
+ImageWrapper<TTraits,TBase>
+::GetUseMultiResolutionSlicing() const
+{
+  return m_Slicer[0]->GetUseMultiResolution();
+}
+
+template<class TTraits, class TBase>
+void
+ImageWrapper<TTraits,TBase>
+::SetUseMultiResolutionOrthogonalSlicing(bool flag)
+{
+  for(unsigned int i = 0; i < 3; i++)
+    m_Slicer[i]->SetUseMultiResolutionForOrthogonalSlicing(flag);
+}
+
+template<class TTraits, class TBase>
+bool
+ImageWrapper<TTraits,TBase>
+::GetUseMultiResolutionOrthogonalSlicing() const
+{
+  return m_Slicer[0]->GetUseMultiResolutionForOrthogonalSlicing();
+}
+
+template<class TTraits, class TBase>
+typename ImageWrapper<TTraits,TBase>::ImagePyramidType *
+ImageWrapper<TTraits,TBase>
+::GetImagePyramid() const
+{
+  return m_ImagePyramid;
+}
+
 
 template<class TTraits, class TBase>
 void
@@ -1623,17 +1733,49 @@ ImageWrapper<TTraits,TBase>
   else
     thumb_axis = 0;
 
-  // Get the display slice
-  // For now, just use the z-axis for exporting the thumbnails
-  DisplaySliceType *slice = this->GetDisplaySlice(thumb_axis);
-  slice->GetSource()->UpdateLargestPossibleRegion();
+  // The thumbnail is sliced by a slicer of its own, so that the level and the
+  // output of the display slicer are left alone
+  SlicerPointer slicer = SlicerType::New();
+  slicer->SetInput(m_Image);
+  slicer->SetImagePyramid(m_ImagePyramid);
+  slicer->SetOrthogonalTransform(m_Slicer[thumb_axis]->GetOrthogonalTransform());
+  slicer->SetSliceIndex(m_Slicer[thumb_axis]->GetSliceIndex());
+  slicer->SetUseOrthogonalSlicing(true);
+
+  // The extents of the thumbnail are those of the full-resolution slice
+  slicer->SetPyramidLevelOverride(0);
+  slicer->UpdateOutputInformation();
 
   // The size of the slice
-  Vector2ui slice_dim = slice->GetBufferedRegion().GetSize();
+  Vector2ui slice_dim = slicer->GetOutput()->GetLargestPossibleRegion().GetSize();
 
   // The physical extents of the slice
-  Vector2d slice_extent(slice->GetSpacing()[0] * slice_dim[0],
-                        slice->GetSpacing()[1] * slice_dim[1]);
+  Vector2d slice_extent(slicer->GetOutput()->GetSpacing()[0] * slice_dim[0],
+                        slicer->GetOutput()->GetSpacing()[1] * slice_dim[1]);
+
+  // The thumbnail has far fewer pixels than the slice, so the slice is
+  // generated from the coarsest pyramid level that still has maxdim voxels
+  // across the larger dimension of the slice
+  int level = 0;
+  while(level + 1 < (int) ImagePyramidType::NumberOfLevels
+        && (slice_dim.max_value() >> (level + 1)) >= maxdim)
+    level++;
+
+  slicer->SetPyramidLevelOverride(level);
+  slicer->UpdateLargestPossibleRegion();
+
+  // Map the intensities of the slice to display colors
+  SliceType *raw = slicer->GetOutput();
+  DisplaySlicePointer slice = DisplaySliceType::New();
+  slice->SetRegions(raw->GetBufferedRegion());
+  slice->SetSpacing(raw->GetSpacing());
+  slice->SetOrigin(raw->GetOrigin());
+  slice->Allocate();
+
+  itk::ImageRegionConstIterator<SliceType> itRaw(raw, raw->GetBufferedRegion());
+  itk::ImageRegionIterator<DisplaySliceType> itDisp(slice, slice->GetBufferedRegion());
+  for(; !itRaw.IsAtEnd(); ++itRaw, ++itDisp)
+    itDisp.Set(m_DisplayMapping->MapPixel(itRaw.Get()));
 
   // The output thumbnail will have the extents as the slice, but its size
   // must be at max maxdim
@@ -1683,8 +1825,7 @@ ImageWrapper<TTraits,TBase>
 
   // Return the result
   opaquer->Update();
-  DisplaySlicePointer result = opaquer->GetOutput();
-  return result;
+  return opaquer->GetOutput();
 }
 
 template<class TTraits, class TBase>
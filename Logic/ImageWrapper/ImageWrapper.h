@@ -50,6 +50,8 @@ template <class TFunctor> class UnaryValueToValueFilter;
 template <class TInputImage, class TOutputImage, class TTraits>
 class AdaptiveSlicingPipeline;
 
+template <class TImage> class ImagePyramid;
+
 
 class SNAPSegmentationROISettings;
 
@@ -124,6 +126,9 @@ public:
   typedef AdaptiveSlicingPipeline<ImageType, SliceType, PreviewImageType> SlicerType;
   typedef SmartPtr<SlicerType>                                   SlicerPointer;
 
+  // Multi-resolution pyramid type
+  typedef ImagePyramid<ImageType>                              ImagePyramidType;
+
   // Preview source for preview pipelines
   typedef itk::ImageSource<PreviewImageType>                 PreviewFilterType;
 
@@ -339,10 +344,29 @@ public:
 
   const ImageBaseType* GetDisplayViewportGeometry(unsigned int index) const;
 
+  /**
+   * Whether the slicers should sample from a downsampled version of the image
+   * when the display viewport is coarser than the image voxels. For orthogonal
+   * slicing, this also requires SetUseMultiResolutionOrthogonalSlicing, and
+   * the display slices then have fewer pixels than the image slices, which
+   * the renderer scales up. The downsampled images are computed when they
+   * are first needed.
+   */
+  virtual void SetUseMultiResolutionSlicing(bool flag);
+  virtual bool GetUseMultiResolutionSlicing() const;
+
+  /** Get the multi-resolution pyramid associated with the image */
+  ImagePyramidType *GetImagePyramid() const;
+
   virtual void SetDisplayViewportGeometry(
       unsigned int index,
       const ImageBaseType *viewport_image) ITK_OVERRIDE;
 
+  virtual void SetSlicingLevelOverride(unsigned int index, int level) ITK_OVERRIDE;
+
+  virtual void SetUseMultiResolutionOrthogonalSlicing(bool flag) ITK_OVERRIDE;
+  virtual bool GetUseMultiResolutionOrthogonalSlicing() const ITK_OVERRIDE;
+
   /**
    * Get an ITK pipeline object holding the minimum value in the image. For
    * multi-component images, this is the minimum value over all components.
@@ -607,6 +631,9 @@ protected:
   /** The associated slicer filters */
   SlicerPointer m_Slicer[3];
 
+  /** Lazily computed multi-resolution pyramid, shared by the slicers */
+  SmartPtr<ImagePyramidType> m_ImagePyramid;
+
   /** The wrapped image */
   SmartPtr<ImageBaseType> m_ImageBase;
 
@@ -174,6 +174,22 @@ public:
       unsigned int index,
       const ImageBaseType *viewport_image) = 0;
 
+  /**
+   * Generate the display slice with the given index from a fixed level of
+   * the multi-resolution pyramid (0 being full resolution), rather than from
+   * the level that matches the display viewport. Pass -1 to restore the
+   * automatic choice.
+   */
+  virtual void SetSlicingLevelOverride(unsigned int index, int level) = 0;
+
+  /**
+   * Whether the orthogonal display slices are generated from a coarse level
+   * of the multi-resolution pyramid when the view is zoomed out. When off
+   * (the default), only oblique slices use the pyramid.
+   */
+  virtual void SetUseMultiResolutionOrthogonalSlicing(bool flag) = 0;
+  virtual bool GetUseMultiResolutionOrthogonalSlicing() const = 0;
+
 
   /** Return some image info independently of pixel type */
   irisVirtualGetMacro(ImageBase, ImageBaseType *)
@@ -43,30 +43,100 @@
 #include "LabelImageWrapper.h"
 #include "UndoDataManager.h"
 #include "Rebroadcaster.h"
+#include <itkCommand.h>
+#include <algorithm>
 
 LabelImageWrapper::LabelImageWrapper()
 {
   m_UndoManager = new UndoManagerType(4, 200000);
+  m_LabelIndexValid = false;
+  m_ImageModifiedCount = 0;
+  m_LabelIndexSyncCount = 0;
+  m_ImageModifiedObserverTag = 0;
 }
 
 LabelImageWrapper::~LabelImageWrapper()
 {
+  if(this->GetImage())
+    this->GetImage()->RemoveObserver(m_ImageModifiedObserverTag);
   delete m_UndoManager;
 }
 
 void LabelImageWrapper::UpdateImagePointer(
     ImageType *image, ImageBaseType *refSpace, ITKTransformType *tran)
 {
+  // Stop listening to the previous image
+  if(this->GetImage())
+    this->GetImage()->RemoveObserver(m_ImageModifiedObserverTag);
+
   Superclass::UpdateImagePointer(image, refSpace, tran);
   m_UndoManager->Clear();
 
+  // Count the modifications of the image, so that the label index can tell
+  // whether it has missed any of them
+  typedef itk::SimpleMemberCommand<Self> CommandType;
+  SmartPtr<CommandType> cmd = CommandType::New();
+  cmd->SetCallbackFunction(this, &Self::OnImageModified);
+  if(image)
+    m_ImageModifiedObserverTag = image->AddObserver(itk::ModifiedEvent(), cmd);
+  m_LabelIndexValid = false;
+
   // Modified event on the image is rebroadcast as the WrapperImageChangeEvent
   Rebroadcaster::Rebroadcast(image, itk::ModifiedEvent(),
                              this, WrapperImageChangeEvent());
 }
 
+void LabelImageWrapper::SwapImageContents(
+    ImageType *alternate, UndoManagerType *&alternateUndo)
+{
+  // Swap the buffers. This fires a modified event on the image
+  this->GetImage()->SwapBuffer(alternate);
+
+  // Each segmentation keeps its own undo history
+  if(!alternateUndo)
+    alternateUndo = new UndoManagerType(4, 200000);
+  std::swap(m_UndoManager, alternateUndo);
+  m_LabelIndexValid = false;
+}
+
+void LabelImageWrapper::OnImageModified()
+{
+  m_ImageModifiedCount++;
+}
+
+void LabelImageWrapper::UpdateLabelIndex(UndoManagerDelta *delta)
+{
+  // The delta is expected to come right after the single modified event
+  // fired when it was applied to the image (or with no event if it is empty)
+  unsigned long missed = m_ImageModifiedCount - m_LabelIndexSyncCount;
+  if(m_LabelIndexValid && missed <= 1)
+    {
+    unsigned long changed = m_LabelIndex.Update(this->GetImage(), delta, 1);
+    if((changed > 0) == (missed == 1))
+      {
+      m_LabelIndexSyncCount = m_ImageModifiedCount;
+      return;
+      }
+    }
+
+  m_LabelIndexValid = false;
+}
+
+const LabelStatisticsIndex *LabelImageWrapper::GetLabelIndex()
+{
+  if(!m_LabelIndexValid || m_ImageModifiedCount != m_LabelIndexSyncCount)
+    {
+    m_LabelIndex.Build(this->GetImage());
+    m_LabelIndexValid = true;
+    m_LabelIndexSyncCount = m_ImageModifiedCount;
+    }
+
+  return &m_LabelIndex;
+}
+
 void LabelImageWrapper::StoreIntermediateUndoDelta(UndoManagerDelta *delta)
 {
+  this->UpdateLabelIndex(delta);
   m_UndoManager->AddDeltaToStaging(delta);
 }
 
@@ -74,7 +144,10 @@ void LabelImageWrapper::StoreUndoPoint(const char *text, UndoManagerDelta *delta
 {
   // If there is a delta, add it to staging
   if(delta)
+    {
+    this->UpdateLabelIndex(delta);
     m_UndoManager->AddDeltaToStaging(delta);
+    }
 
   // Commit the deltas
   m_UndoManager->CommitStaging(text);
@@ -99,6 +172,9 @@ void LabelImageWrapper::Undo()
   typedef itk::ImageRegionIterator<ImageType> IteratorType;
   ImageType *imSeg = this->GetImage();
 
+  // The label index is updated along with the image if it is in sync
+  bool updateIndex = m_LabelIndexValid && m_ImageModifiedCount == m_LabelIndexSyncCount;
+
   // Iterate over all the deltas in reverse order
   UndoManagerType::DList::const_reverse_iterator dit = commit.GetDeltas().rbegin();
   for(; dit != commit.GetDeltas().rend(); ++dit)
@@ -121,10 +197,15 @@ void LabelImageWrapper::Undo()
         ++lit;
         }
       }
+
+    if(updateIndex)
+      m_LabelIndex.Update(imSeg, delta, -1);
     }
 
   // Set modified flags
   imSeg->Modified();
+  if(updateIndex)
+    m_LabelIndexSyncCount = m_ImageModifiedCount;
 }
 
 bool LabelImageWrapper::IsRedoPossible()
@@ -141,6 +222,9 @@ void LabelImageWrapper::Redo()
   typedef itk::ImageRegionIterator<ImageType> IteratorType;
   ImageType *imSeg = this->GetImage();
 
+  // The label index is updated along with the image if it is in sync
+  bool updateIndex = m_LabelIndexValid && m_ImageModifiedCount == m_LabelIndexSyncCount;
+
   // Iterate over all the deltas in reverse order
   UndoManagerType::DList::const_iterator dit = commit.GetDeltas().begin();
   for(; dit != commit.GetDeltas().end(); ++dit)
@@ -163,10 +247,15 @@ void LabelImageWrapper::Redo()
         ++lit;
         }
       }
+
+    if(updateIndex)
+      m_LabelIndex.Update(imSeg, delta, 1);
     }
 
   // Set modified flags
   imSeg->Modified();
+  if(updateIndex)
+    m_LabelIndexSyncCount = m_ImageModifiedCount;
 }
 
 LabelImageWrapper::UndoManagerDelta *
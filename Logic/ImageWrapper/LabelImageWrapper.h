@@ -3,6 +3,7 @@
 
 #include "ImageWrapperTraits.h"
 #include "ScalarImageWrapper.h"
+#include "LabelStatisticsIndex.h"
 
 template <typename TPixel> class UndoDataManager;
 template <typename TPixel> class UndoDelta;
@@ -70,12 +71,29 @@ public:
   /** Get the undo manager */
   itkGetMacro(UndoManager, const UndoManagerType *)
 
+  /**
+   * Exchange the voxels and the undo history of the segmentation with those
+   * of another image with the same buffered region. No voxels are copied, so
+   * this can be used to switch quickly between two segmentations, e.g., the
+   * main segmentation and the classification examples. The alternate undo
+   * manager is owned by the caller; if it is NULL, an empty one is created.
+   */
+  void SwapImageContents(ImageType *alternate, UndoManagerType *&alternateUndo);
+
   /** This is not used by the undo system itself, but uses the undo code to
    * store the contents of the image as an undo delta object, which can then
    * be stored in memory compactly. The caller is responsible for deleting the
    * array created in this call. */
   UndoManagerDelta *CompressImage() const;
 
+  /**
+   * Get the index of voxel counts, bounding boxes and slices for each label.
+   * The index is kept up to date from the undo deltas passed to this class,
+   * as long as every change to the image comes with a delta. Otherwise, it
+   * is recomputed from the image here.
+   */
+  const LabelStatisticsIndex *GetLabelIndex();
+
 protected:
 
   LabelImageWrapper();
@@ -85,6 +103,19 @@ protected:
   // image. These deltas are compressed, allowing us to store a bunch of
   // undo steps with little cost in performance or memory
   UndoManagerType *m_UndoManager;
+
+  // Index of the labels in the image. The index is in sync with the image if
+  // it has seen every modification of the image, which is checked by counting
+  // the modified events of the image.
+  LabelStatisticsIndex m_LabelIndex;
+  bool m_LabelIndexValid;
+  unsigned long m_ImageModifiedCount, m_LabelIndexSyncCount;
+  unsigned long m_ImageModifiedObserverTag;
+
+  void OnImageModified();
+
+  // Update the index with a delta that has just been applied to the image
+  void UpdateLabelIndex(UndoManagerDelta *delta);
 };
 
 #endif // LABELIMAGEWRAPPER_H
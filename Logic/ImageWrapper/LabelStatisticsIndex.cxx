@@ -0,0 +1,178 @@
+#include "LabelStatisticsIndex.h"
+#include "UndoDataManager.h"
+#include "RLEImageRegionIterator.h"
+#include <itkImageRegionConstIteratorWithIndex.h>
+#include <algorithm>
+
+LabelStatisticsIndex::Entry &
+LabelStatisticsIndex::GetEntry(LabelType label)
+{
+  EntryMap::iterator it = m_Entries.find(label);
+  if(it != m_Entries.end())
+    return it->second;
+
+  Entry &e = m_Entries[label];
+  e.count = 0;
+  for(int d = 0; d < 3; d++)
+    e.slices[d].resize(m_Region.GetSize(d), 0);
+  return e;
+}
+
+void LabelStatisticsIndex::AddRun(LabelType label, long x, long y, long z, long len, int sign)
+{
+  Entry &e = this->GetEntry(label);
+  e.count += sign * len;
+  for(long k = x; k < x + len; k++)
+    e.slices[0][k] += sign;
+  e.slices[1][y] += sign * len;
+  e.slices[2][z] += sign * len;
+
+  if(e.count == 0)
+    m_Entries.erase(label);
+}
+
+void LabelStatisticsIndex::Build(const LabelImageType *image)
+{
+  m_Entries.clear();
+  m_Region = image->GetBufferedRegion();
+  long nx = m_Region.GetSize(0);
+
+  // Along x, the runs are first accumulated as differences, so that each run
+  // is counted in constant time
+  typedef LabelImageType::BufferType BufferType;
+  const BufferType *buffer = image->GetBuffer();
+  itk::ImageRegionConstIteratorWithIndex<BufferType> it(buffer, buffer->GetBufferedRegion());
+  for(; !it.IsAtEnd(); ++it)
+    {
+    const LabelImageType::RLLine &line = it.Get();
+    long y = it.GetIndex()[0] - m_Region.GetIndex(1);
+    long z = it.GetIndex()[1] - m_Region.GetIndex(2);
+    long x = 0;
+    for(size_t s = 0; s < line.size(); s++)
+      {
+      long n = line[s].first;
+      Entry &e = this->GetEntry(line[s].second);
+      if(e.slices[0].size() == (size_t) nx)
+        e.slices[0].push_back(0);
+
+      e.count += n;
+      e.slices[0][x] += 1;
+      e.slices[0][x + n] -= 1;
+      e.slices[1][y] += n;
+      e.slices[2][z] += n;
+      x += n;
+      }
+    }
+
+  for(EntryMap::iterator ite = m_Entries.begin(); ite != m_Entries.end(); ++ite)
+    {
+    std::vector<long> &sx = ite->second.slices[0];
+    for(long x = 1; x < nx; x++)
+      sx[x] += sx[x - 1];
+    sx.resize(nx);
+    }
+}
+
+unsigned long
+LabelStatisticsIndex::Update(const LabelImageType *image, DeltaType *delta, int sign)
+{
+  RegionType region = delta->GetRegion();
+  long nx = region.GetSize(0), ny = region.GetSize(1);
+  long x0 = region.GetIndex(0) - m_Region.GetIndex(0);
+  long y0 = region.GetIndex(1) - m_Region.GetIndex(1);
+  long z0 = region.GetIndex(2) - m_Region.GetIndex(2);
+
+  // The delta runs follow the voxels of the region in order, x fastest. The
+  // runs where nothing changed are skipped without visiting their voxels
+  unsigned long changed = 0;
+  long pos = 0;
+  for(size_t i = 0; i < delta->GetNumberOfRLEs(); i++)
+    {
+    long n = delta->GetRLELength(i);
+    LabelType d = delta->GetRLEValue(i);
+    if(d == 0)
+      {
+      pos += n;
+      continue;
+      }
+
+    // Split the run into parts that lie within a row of the region, and
+    // read the new labels from the runs of the corresponding image row
+    for(long j = 0; j < n; )
+      {
+      long x = pos % nx, y = (pos / nx) % ny, z = pos / (nx * ny);
+      long len = std::min(n - j, nx - x);
+
+      LabelImageType::BufferType::IndexType lidx;
+      lidx[0] = region.GetIndex(1) + y;
+      lidx[1] = region.GetIndex(2) + z;
+      const LabelImageType::RLLine &line = image->GetBuffer()->GetPixel(lidx);
+
+      // Positions along the row, relative to the start of the image
+      long start = x0 + x, end = start + len, t = 0;
+      for(size_t r = 0; r < line.size() && t < end; t += line[r].first, r++)
+        {
+        long a = std::max(t, start), b = std::min(t + (long) line[r].first, end);
+        if(a >= b)
+          continue;
+
+        LabelType lNew = line[r].second;
+        LabelType lOld = (LabelType) (sign > 0 ? lNew - d : lNew + d);
+        this->AddRun(lOld, a, y0 + y, z0 + z, b - a, -1);
+        this->AddRun(lNew, a, y0 + y, z0 + z, b - a, 1);
+        changed += b - a;
+        }
+
+      j += len;
+      pos += len;
+      }
+    }
+
+  return changed;
+}
+
+unsigned long LabelStatisticsIndex::GetNumberOfVoxels(LabelType label) const
+{
+  EntryMap::const_iterator it = m_Entries.find(label);
+  return it == m_Entries.end() ? 0 : it->second.count;
+}
+
+bool LabelStatisticsIndex::IsLabelInSlice(LabelType label, int axis, long slice) const
+{
+  EntryMap::const_iterator it = m_Entries.find(label);
+  if(it == m_Entries.end())
+    return false;
+
+  long k = slice - m_Region.GetIndex(axis);
+  const std::vector<long> &sl = it->second.slices[axis];
+  return k >= 0 && k < (long) sl.size() && sl[k] > 0;
+}
+
+bool LabelStatisticsIndex::GetBoundingBox(LabelType label, RegionType &box) const
+{
+  EntryMap::const_iterator it = m_Entries.find(label);
+  if(it == m_Entries.end())
+    return false;
+
+  for(int d = 0; d < 3; d++)
+    {
+    const std::vector<long> &sl = it->second.slices[d];
+    long k0 = 0, k1 = (long) sl.size() - 1;
+    while(sl[k0] == 0)
+      k0++;
+    while(sl[k1] == 0)
+      k1--;
+    box.SetIndex(d, m_Region.GetIndex(d) + k0);
+    box.SetSize(d, k1 - k0 + 1);
+    }
+
+  return true;
+}
+
+std::vector<LabelType> LabelStatisticsIndex::GetLabels() const
+{
+  std::vector<LabelType> labels;
+  for(EntryMap::const_iterator it = m_Entries.begin(); it != m_Entries.end(); ++it)
+    labels.push_back(it->first);
+  return labels;
+}
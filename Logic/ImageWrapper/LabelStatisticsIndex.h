@@ -0,0 +1,78 @@
+#ifndef LABELSTATISTICSINDEX_H
+#define LABELSTATISTICSINDEX_H
+
+#include "SNAPCommon.h"
+#include "ImageWrapperTraits.h"
+#include <map>
+#include <vector>
+
+template <typename TPixel> class UndoDelta;
+
+/**
+ * \class LabelStatisticsIndex
+ * \brief Number of voxels of each label in a segmentation, and the number
+ * of voxels of the label in each slice along each axis
+ *
+ * This answers questions such as how many voxels have a given label, which
+ * slices contain the label and where its bounding box is, without scanning
+ * the label image. The index is built from the runs of the RLE image, and
+ * can then be kept up to date from the undo deltas produced by each edit,
+ * at a cost proportional to the size of the edit.
+ */
+class LabelStatisticsIndex
+{
+public:
+  typedef LabelImageWrapperTraits::ImageType                   LabelImageType;
+  typedef itk::ImageRegion<3>                                  RegionType;
+  typedef UndoDelta<LabelType>                                 DeltaType;
+
+  LabelStatisticsIndex() {}
+
+  /** Compute the index for the whole label image */
+  void Build(const LabelImageType *image);
+
+  /**
+   * Update the index after a delta has been applied to the image (sign = 1),
+   * or reverted as in undo (sign = -1). The image must already contain the
+   * new labels. Returns the number of voxels whose label changed.
+   */
+  unsigned long Update(const LabelImageType *image, DeltaType *delta, int sign);
+
+  /** Number of voxels with a label */
+  unsigned long GetNumberOfVoxels(LabelType label) const;
+
+  /** Whether a label is present in a slice along an axis */
+  bool IsLabelInSlice(LabelType label, int axis, long slice) const;
+
+  /**
+   * Compute the bounding box of a label in image index coordinates. Returns
+   * false if no voxel has the label.
+   */
+  bool GetBoundingBox(LabelType label, RegionType &box) const;
+
+  /** The labels that are present in the image, in increasing order */
+  std::vector<LabelType> GetLabels() const;
+
+protected:
+
+  // Voxel count of a label and per-slice voxel counts along each axis
+  struct Entry
+  {
+    unsigned long count;
+    std::vector<long> slices[3];
+  };
+
+  typedef std::map<LabelType, Entry> EntryMap;
+
+  // Get or create the entry for a label
+  Entry &GetEntry(LabelType label);
+
+  // Add a run of len voxels starting at x to the entry of a label (or remove
+  // it, if sign < 0). The position is relative to the image region
+  void AddRun(LabelType label, long x, long y, long z, long len, int sign);
+
+  EntryMap m_Entries;
+  RegionType m_Region;
+};
+
+#endif // LABELSTATISTICSINDEX_H
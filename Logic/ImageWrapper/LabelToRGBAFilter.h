@@ -23,6 +23,8 @@
 
 #include <itkRGBAPixel.h>
 #include <itkNumericTraitsRGBAPixel.h>
+#include <vector>
+#include <algorithm>
 
 /**
  * \class LabelToRGBAFilter
@@ -75,6 +77,28 @@ protected:
   void PrintSelf(std::ostream& os, itk::Indent indent) const ITK_OVERRIDE
     { os << indent << "LabelToRGBAFilter"; }
   
+  LabelToRGBAFilter()
+    : m_ColorTable(NULL), m_LookupTable(MAX_COLOR_LABELS + 1),
+      m_LookupTableFilled(MAX_COLOR_LABELS + 1, 0) {}
+
+  /**
+   * Get the color for a label from the dense lookup table. The table is
+   * filled lazily, because generating the default labels for the whole
+   * range of label values is expensive.
+   */
+  const OutputPixelType &LookupColor(InputPixelType label)
+    {
+    if(!m_LookupTableFilled[label])
+      {
+      const ColorLabel &cl = m_ColorTable->GetColorLabel(label);
+      const ColorLabel &clear = m_ColorTable->GetColorLabel(0);
+      (cl.IsVisible() ? cl : clear).GetRGBAVector(
+            m_LookupTable[label].GetDataPointer());
+      m_LookupTableFilled[label] = 1;
+      }
+    return m_LookupTable[label];
+    }
+
   /** Generate Data */
   void GenerateData( void ) ITK_OVERRIDE
     {
@@ -92,35 +116,41 @@ protected:
       outputPtr->Allocate();
       }
 
-    // Get the clear label
-    const ColorLabel &clear = m_ColorTable->GetColorLabel(0);
-    const ColorLabel *cllast = &clear;
-
-    // Keep track of the last pixel - this reduces the amount of color label
-    // lookups, taking advantage of the fact that segmentations are homogeneous
-    InputPixelType last_pixel = 0;
+    // Invalidate the lookup table if the color table has changed
+    if(m_LookupTableTime.GetMTime() < m_ColorTable->GetMTime())
+      {
+      std::fill(m_LookupTableFilled.begin(), m_LookupTableFilled.end(), 0);
+      m_LookupTableTime.Modified();
+      }
 
-    // Simple loop
+    // Segmentation slices are produced from run-length encoded data and
+    // consist of long runs of the same label. Each run is found with a tight
+    // scan of the labels and its color is looked up once and filled into
+    // the output span.
     const LabelType *xin = inputPtr->GetBufferPointer(), *xinend = xin + n;
     OutputPixelType *xout = outputPtr->GetBufferPointer();
-    for(; xin < xinend; ++xin, ++xout)
+    while(xin < xinend)
       {
-      if(*xin != last_pixel)
-        {
-        last_pixel = *xin;
-        const ColorLabel &cl = m_ColorTable->GetColorLabel(last_pixel);
-        if(cl.IsVisible())
-          cllast = &cl;
-        else
-          cllast = &clear;
-        }
-
-      cllast->GetRGBAVector(xout->GetDataPointer());
+      InputPixelType label = *xin;
+      const LabelType *xrun = xin + 1;
+      while(xrun < xinend && *xrun == label)
+        ++xrun;
+
+      OutputPixelType *xoutend = xout + (xrun - xin);
+      std::fill(xout, xoutend, this->LookupColor(label));
+      xin = xrun;
+      xout = xoutend;
       }
     }
 
 private:
   ColorLabelTable *m_ColorTable;
+
+  // Dense lookup table from label values to colors, and flags indicating
+  // which entries have been computed since the color table last changed
+  std::vector<OutputPixelType> m_LookupTable;
+  std::vector<unsigned char> m_LookupTableFilled;
+  itk::TimeStamp m_LookupTableTime;
 };
 
 #endif
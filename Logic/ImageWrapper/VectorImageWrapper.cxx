@@ -220,6 +220,7 @@ VectorImageWrapper<TTraits,TBase>
   // Pass the display geometry to the component wrapper
   for(int k = 0; k < 3; k++)
     wrapper->SetDisplayViewportGeometry(k, this->GetDisplayViewportGeometry(k));
+  wrapper->SetUseMultiResolutionOrthogonalSlicing(this->GetUseMultiResolutionOrthogonalSlicing());
 
   SmartPtr<ScalarImageWrapperBase> ptrout = wrapper.GetPointer();
 
@@ -256,6 +257,7 @@ VectorImageWrapper<TTraits,TBase>
     // Pass the display geometry to the component wrapper
     for(int k = 0; k < 3; k++)
       cw->SetDisplayViewportGeometry(k, this->GetDisplayViewportGeometry(k));
+    cw->SetUseMultiResolutionOrthogonalSlicing(this->GetUseMultiResolutionOrthogonalSlicing());
 
     // Initialize referencing the current wrapper
     cw->InitializeToWrapper(this, comp, referenceSpace, transform);
@@ -450,6 +452,50 @@ VectorImageWrapper<TTraits,TBase>
     }
 }
 
+template <class TTraits, class TBase>
+void
+VectorImageWrapper<TTraits,TBase>
+::SetSlicingLevelOverride(unsigned int index, int level)
+{
+  Superclass::SetSlicingLevelOverride(index, level);
+
+  // Propagate to owned scalar wrappers
+  for(ScalarRepIterator it = m_ScalarReps.begin(); it != m_ScalarReps.end(); ++it)
+    {
+    it->second->SetSlicingLevelOverride(index, level);
+    }
+}
+
+template <class TTraits, class TBase>
+void
+VectorImageWrapper<TTraits,TBase>
+::SetUseMultiResolutionOrthogonalSlicing(bool flag)
+{
+  Superclass::SetUseMultiResolutionOrthogonalSlicing(flag);
+
+  // Propagate to owned scalar wrappers
+  for(ScalarRepIterator it = m_ScalarReps.begin(); it != m_ScalarReps.end(); ++it)
+    {
+    it->second->SetUseMultiResolutionOrthogonalSlicing(flag);
+    }
+}
+
+template <class TTraits, class TBase>
+typename VectorImageWrapper<TTraits,TBase>::DisplaySlicePointer
+VectorImageWrapper<TTraits,TBase>
+::MakeThumbnail(unsigned int maxdim)
+{
+  // In the scalar display modes, the slices are displayed by one of the
+  // scalar representations, so it makes the thumbnail as well
+  MultiChannelDisplayMode mode = this->m_DisplayMapping->GetDisplayMode();
+  if(mode.UseRGB || mode.RenderAsGrid)
+    return Superclass::MakeThumbnail(maxdim);
+
+  ScalarImageWrapperBase *siw =
+      this->GetScalarRepresentation(mode.SelectedScalarRep, mode.SelectedComponent);
+  return siw->MakeThumbnail(maxdim);
+}
+
 template <class TTraits, class TBase>
 void
 VectorImageWrapper<TTraits,TBase>
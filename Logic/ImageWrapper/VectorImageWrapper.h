@@ -86,6 +86,7 @@ public:
   // Display types
   typedef typename Superclass::DisplaySliceType               DisplaySliceType;
   typedef typename Superclass::DisplayPixelType               DisplayPixelType;
+  typedef typename Superclass::DisplaySlicePointer         DisplaySlicePointer;
 
   // Iterator types
   typedef typename Superclass::Iterator                               Iterator;
@@ -222,6 +223,12 @@ public:
 
   virtual void SetDisplayViewportGeometry(unsigned int index, ImageBaseType *viewport_image);
 
+  virtual void SetSlicingLevelOverride(unsigned int index, int level) ITK_OVERRIDE;
+
+  virtual void SetUseMultiResolutionOrthogonalSlicing(bool flag) ITK_OVERRIDE;
+
+  virtual DisplaySlicePointer MakeThumbnail(unsigned int maxdim) ITK_OVERRIDE;
+
   virtual void SetDirectionMatrix(const vnl_matrix<double> &direction) ITK_OVERRIDE;
 
   virtual void CopyImageCoordinateTransform(const ImageWrapperBase *source) ITK_OVERRIDE;
@@ -105,6 +105,15 @@ public:
  * level set evolution is implemented in ITK.  This gives the software a bit of 
  * modularity.  As far as SNAP cares, the public methods declared in this class are
  * the only ways to control level set evolution.
+ *
+ * If the parameters specify a multiresolution factor, the first iterations
+ * are performed by a second driver that evolves the snake on a downsampled
+ * copy of the speed image. After SnakeParameters::GetCoarseIterations()
+ * iterations, the coarse level set is upsampled and used to restart the
+ * evolution at full resolution. Each coarse iteration counts as one
+ * iteration towards GetElapsedIterations(), and GetCurrentState() always
+ * returns an image at full resolution, so callers need not be aware of the
+ * coarse phase.
  */
 template <unsigned int VDimension> 
 class SNAPLevelSetDriver : public SNAPLevelSetDriverBase
@@ -142,7 +151,7 @@ public:
                      VectorImageType *externalAdvection = NULL);
 
   /** Virtual destructor */
-  virtual ~SNAPLevelSetDriver() {}
+  virtual ~SNAPLevelSetDriver();
 
   /** Set snake parameters */
   void SetSnakeParameters(const SnakeParameters &parms);
@@ -191,6 +200,26 @@ private:
   /** Speed image adaptor */
   typename ShortImageType::Pointer m_SpeedAdaptor;
 
+  /** The speed image, kept for building the coarse driver */
+  typename ShortImageType::Pointer m_SpeedImage;
+
+  /** Driver for the coarse phase of the evolution, NULL if there is none */
+  Self *m_CoarseDriver;
+
+  /** Downsampling factor of the coarse driver */
+  unsigned int m_CoarseFactor;
+
+  /** Whether the evolution is still in the coarse phase */
+  bool m_CoarsePhase;
+
+  /** Coarse state upsampled to full resolution, and the coarse iteration
+   * at which it was computed */
+  FloatImagePointer m_UpsampledState;
+  unsigned int m_UpsampledIteration;
+
+  /** Iterations performed in the coarse phase */
+  unsigned int m_IterationOffset;
+
   /** Last accepted snake parameters */
   SnakeParameters m_Parameters;
 
@@ -199,6 +228,18 @@ private:
 
   /** Internal routines */
   void DoCreateLevelSetFilter();
+
+  /** Set up the coarse driver, if the parameters ask for one */
+  void DoCreateCoarseDriver();
+
+  /** Restart the full resolution filter from the coarse state */
+  void DoFinishCoarsePhase();
+
+  /** Upsample the state of the coarse driver to full resolution. The result
+   * is cached until the coarse snake moves, so the state is upsampled at most
+   * once per coarse iteration, for display and for the switch to the full
+   * resolution phase alike */
+  FloatImageType *GetUpsampledCoarseState();
 };
 
 // Type definitions
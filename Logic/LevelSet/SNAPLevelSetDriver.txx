@@ -51,6 +51,13 @@
 #include "LevelSetExtensionFilter.h"
 
 #include "itkParallelSparseFieldLevelSetImageFilter.h"
+#include "itkNarrowBandImageFilterBase.h"
+#include "itkIsoContourDistanceImageFilter.h"
+#include "itkFastChamferDistanceImageFilter.h"
+#include "itkBinShrinkImageFilter.h"
+#include "itkImageRegionIterator.h"
+#include "AxisAlignedResampleImageFilter.h"
+#include <algorithm>
 
 // Disable some windows debug length messages
 #if defined(_MSC_VER)
@@ -98,6 +105,72 @@ public:
 };
 
 
+/**
+ * A narrow band solver for the SNAP level set function. ITK's
+ * NarrowBandLevelSetImageFilter only works with segmentation functions, so
+ * this class builds the band the same way that filter does, from the
+ * distance to the zero level set.
+ */
+template< class TInputImage, class TOutputImage >
+class SNAPNarrowBandLevelSetImageFilter
+    : public itk::NarrowBandImageFilterBase< TInputImage, TOutputImage >
+{
+public:
+
+  typedef SNAPNarrowBandLevelSetImageFilter                                Self;
+  typedef itk::NarrowBandImageFilterBase< TInputImage, TOutputImage >      Superclass;
+  typedef itk::SmartPointer< Self >                                        Pointer;
+  typedef itk::SmartPointer< const Self >                                  ConstPointer;
+  typedef TOutputImage                                                     OutputImageType;
+  typedef typename OutputImageType::PixelType                              PixelType;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro(Self)
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro(SNAPNarrowBandLevelSetImageFilter,
+               itk::NarrowBandImageFilterBase)
+
+protected:
+
+  typedef itk::IsoContourDistanceImageFilter<
+    OutputImageType, OutputImageType>                             IsoFilterType;
+  typedef itk::FastChamferDistanceImageFilter<
+    OutputImageType, OutputImageType>                         ChamferFilterType;
+
+  SNAPNarrowBandLevelSetImageFilter()
+  {
+    m_IsoFilter = IsoFilterType::New();
+    m_ChamferFilter = ChamferFilterType::New();
+  }
+
+  virtual void CreateNarrowBand() ITK_OVERRIDE
+  {
+    if(!this->m_NarrowBand->Empty())
+      this->m_NarrowBand->Clear();
+
+    // Compute the distance to the zero level set up to the edge of the band,
+    // adding the voxels within the band to the band
+    PixelType farValue = this->m_NarrowBand->GetTotalRadius() + 1;
+
+    m_IsoFilter->SetInput(this->GetOutput());
+    m_IsoFilter->SetFarValue(farValue);
+    m_IsoFilter->SetNumberOfThreads(this->GetNumberOfThreads());
+    m_IsoFilter->NarrowBandingOff();
+
+    m_ChamferFilter->SetInput(m_IsoFilter->GetOutput());
+    m_ChamferFilter->SetMaximumDistance(farValue);
+    m_ChamferFilter->SetNumberOfThreads(this->GetNumberOfThreads());
+    m_ChamferFilter->SetNarrowBand(this->m_NarrowBand.GetPointer());
+    m_ChamferFilter->Update();
+
+    this->GraftOutput(m_ChamferFilter->GetOutput());
+  }
+
+  typename IsoFilterType::Pointer m_IsoFilter;
+  typename ChamferFilterType::Pointer m_ChamferFilter;
+};
+
 // Create an inverting functor
 class InvertFunctor {
 public:
@@ -111,6 +184,9 @@ SNAPLevelSetDriver<VDimension>
 ::SNAPLevelSetDriver(FloatImageType *init, ShortImageType *speed,
                      const SnakeParameters &sparms,
                      VectorImageType *externalAdvection)
+  : m_CoarseDriver(NULL), m_CoarseFactor(1), m_CoarsePhase(false),
+    m_UpsampledIteration(itk::NumericTraits<unsigned int>::max()),
+    m_IterationOffset(0)
 {
   // Create the level set function
   m_LevelSetFunction = LevelSetFunctionType::New();
@@ -127,12 +203,155 @@ SNAPLevelSetDriver<VDimension>
 
   // Remember the input and output images for later initialization
   m_InitializationImage = init;
+  m_SpeedImage = speed;
 
   // Pass the parameters to the level set function
   AssignParametersToPhi(sparms,true);
 
   // Create the filter
   DoCreateLevelSetFilter();
+
+  // Create the driver for the coarse phase, if needed
+  DoCreateCoarseDriver();
+}
+
+template<unsigned int VDimension>
+SNAPLevelSetDriver<VDimension>
+::~SNAPLevelSetDriver()
+{
+  delete m_CoarseDriver;
+}
+
+template<unsigned int VDimension>
+void
+SNAPLevelSetDriver<VDimension>
+::DoCreateCoarseDriver()
+{
+  delete m_CoarseDriver;
+  m_CoarseDriver = NULL;
+  m_CoarsePhase = false;
+  m_UpsampledState = NULL;
+  m_UpsampledIteration = itk::NumericTraits<unsigned int>::max();
+
+  m_CoarseFactor = (unsigned int) std::max(1, m_Parameters.GetMultiResolutionFactor());
+  if(m_CoarseFactor == 1 || m_Parameters.GetCoarseIterations() <= 0)
+    return;
+
+  // There is nothing to gain on small images, where the coarse level set
+  // would be only a few voxels across
+  typename FloatImageType::SizeType size =
+      m_InitializationImage->GetLargestPossibleRegion().GetSize();
+  for(unsigned int d = 0; d < VDimension; d++)
+    {
+    if(size[d] < 4 * m_CoarseFactor)
+      {
+      m_CoarseFactor = 1;
+      return;
+      }
+    }
+
+  // Average the speed image over blocks of voxels
+  typedef itk::BinShrinkImageFilter<ShortImageType, ShortImageType> SpeedShrinkType;
+  typename SpeedShrinkType::Pointer fltSpeed = SpeedShrinkType::New();
+  fltSpeed->SetInput(m_SpeedImage);
+  fltSpeed->SetShrinkFactors(m_CoarseFactor);
+  fltSpeed->Update();
+  typename ShortImageType::Pointer coarseSpeed = fltSpeed->GetOutput();
+  coarseSpeed->DisconnectPipeline();
+
+  // Same for the initialization image. The level set values are in voxel
+  // units, so they are scaled down as well
+  typedef itk::BinShrinkImageFilter<FloatImageType, FloatImageType> InitShrinkType;
+  typename InitShrinkType::Pointer fltInit = InitShrinkType::New();
+  fltInit->SetInput(m_InitializationImage);
+  fltInit->SetShrinkFactors(m_CoarseFactor);
+  fltInit->Update();
+  FloatImagePointer coarseInit = fltInit->GetOutput();
+  coarseInit->DisconnectPipeline();
+
+  itk::ImageRegionIterator<FloatImageType> it(
+        coarseInit, coarseInit->GetBufferedRegion());
+  for(; !it.IsAtEnd(); ++it)
+    it.Set(it.Get() / m_CoarseFactor);
+
+  // The coarse driver uses the same equation. The external advection field,
+  // if any, is not downsampled; the coarse driver uses the gradient of the
+  // speed image instead, which only affects the coarse phase
+  SnakeParameters coarseParms = m_Parameters;
+  coarseParms.SetMultiResolutionFactor(1);
+  m_CoarseDriver = new Self(coarseInit, coarseSpeed, coarseParms);
+  m_CoarsePhase = true;
+}
+
+template<unsigned int VDimension>
+typename SNAPLevelSetDriver<VDimension>::FloatImageType *
+SNAPLevelSetDriver<VDimension>
+::GetUpsampledCoarseState()
+{
+  // The state is only recomputed when the coarse snake has moved
+  unsigned int iter = m_CoarseDriver->GetElapsedIterations();
+  if(m_UpsampledState && m_UpsampledIteration == iter)
+    return m_UpsampledState;
+
+  if(!m_UpsampledState)
+    {
+    m_UpsampledState = FloatImageType::New();
+    m_UpsampledState->CopyInformation(m_InitializationImage);
+    m_UpsampledState->SetRegions(m_InitializationImage->GetLargestPossibleRegion());
+    m_UpsampledState->Allocate();
+    }
+
+  // Resample a view of the coarse state that shares its buffer but not its
+  // pipeline, so that the coarse level set filter is not updated again
+  FloatImagePointer coarse = FloatImageType::New();
+  coarse->Graft(m_CoarseDriver->GetCurrentState());
+
+  // Each coarse voxel covers a block of fine voxels. The fine voxels near
+  // the edge of the image take the value of the nearest coarse voxel
+  typename FloatImageType::RegionType rFine = m_UpsampledState->GetBufferedRegion();
+  typename FloatImageType::PointType origin;
+  m_UpsampledState->TransformIndexToPhysicalPoint(rFine.GetIndex(), origin);
+
+  typedef AxisAlignedResampleImageFilter<FloatImageType, FloatImageType> ResampleFilter;
+  typename ResampleFilter::Pointer fltResample = ResampleFilter::New();
+  fltResample->SetInput(coarse);
+  fltResample->SetSize(rFine.GetSize());
+  fltResample->SetOutputSpacing(m_UpsampledState->GetSpacing());
+  fltResample->SetOutputOrigin(origin);
+  fltResample->SetExtrapolateFromEdge(true);
+
+  // The resampled level set is written into the buffer of the upsampled
+  // state, which keeps the index of the initialization image
+  fltResample->GraftOutput(m_UpsampledState);
+  fltResample->UpdateLargestPossibleRegion();
+
+  // The level set values are in voxel units
+  float f = (float) m_CoarseFactor;
+  float *buffer = m_UpsampledState->GetBufferPointer();
+  for(size_t i = 0; i < rFine.GetNumberOfPixels(); i++)
+    buffer[i] *= f;
+
+  m_UpsampledState->Modified();
+  m_UpsampledIteration = iter;
+  return m_UpsampledState;
+}
+
+template<unsigned int VDimension>
+void
+SNAPLevelSetDriver<VDimension>
+::DoFinishCoarsePhase()
+{
+  // Restart the full resolution filter from the upsampled coarse level set
+  FloatImagePointer state = GetUpsampledCoarseState();
+  m_IterationOffset = m_CoarseDriver->GetElapsedIterations();
+  m_CoarsePhase = false;
+  m_UpsampledState = NULL;
+  m_UpsampledIteration = itk::NumericTraits<unsigned int>::max();
+
+  m_LevelSetFilter->SetInput(state);
+  m_LevelSetFilter->SetStateToUninitialized();
+  m_LevelSetFilter->SetNumberOfIterations(0);
+  m_LevelSetFilter->UpdateLargestPossibleRegion();
 }
 
 template<unsigned int VDimension>
@@ -200,27 +419,22 @@ SNAPLevelSetDriver<VDimension>
     filter->SetDifferenceFunction(m_LevelSetFunction);
     filter->InPlaceOn();
     }
-/*
   else if(m_Parameters.GetSolver() == SnakeParameters::NARROW_BAND_SOLVER)
     {
-    // Define an extension to the appropriate filter class
-    typedef itk::NarrowBandLevelSetImageFilter<
-      FloatImageType,SpeedAdaptorType,float,FloatImageType> LevelSetFilterType;
-    typedef LevelSetExtensionFilter<LevelSetFilterType> ExtensionFilter;
-    typename ExtensionFilter::Pointer filter = ExtensionFilter::New();
+    typedef SNAPNarrowBandLevelSetImageFilter<
+        FloatImageType, FloatImageType> LevelSetFilterType;
+    typename LevelSetFilterType::Pointer filter = LevelSetFilterType::New();
 
     // Cast this specific filter down to the lowest common denominator that is
     // a filter
     m_LevelSetFilter = filter.GetPointer();
 
     // Perform the special configuration tasks on the filter
-    filter->SetSegmentationFunction(m_LevelSetFunction);
     filter->SetInput(m_InitializationImage);
     filter->SetNarrowBandTotalRadius(5);
     filter->SetNarrowBandInnerRadius(3);
-    filter->SetFeatureImage(m_LevelSetFunction->GetSpeedImage());  
+    filter->SetDifferenceFunction(m_LevelSetFunction);
     }
-*/
   else if(m_Parameters.GetSolver() == SnakeParameters::DENSE_SOLVER)
     {
     // Define an extension to the appropriate filter class
@@ -262,6 +476,8 @@ SNAPLevelSetDriver<VDimension>
 { 
   // Tell the filter to reinitialize next time that an update will 
   // be performed, and set the number of iterations to 0
+  m_IterationOffset = 0;
+  m_LevelSetFilter->SetInput(m_InitializationImage);
   m_LevelSetFilter->SetStateToUninitialized();
   m_LevelSetFilter->SetNumberOfIterations(0);
 
@@ -269,6 +485,19 @@ SNAPLevelSetDriver<VDimension>
   // requested region on this image, so it's important that we always 
   // update the entire image
   m_LevelSetFilter->UpdateLargestPossibleRegion();
+
+  // Go back to the coarse phase. The coarse driver is rebuilt if the
+  // downsampling factor has changed since it was created
+  if(m_CoarseDriver && (int) m_CoarseFactor == m_Parameters.GetMultiResolutionFactor())
+    {
+    m_CoarseDriver->Restart();
+    m_CoarsePhase = true;
+    m_UpsampledIteration = itk::NumericTraits<unsigned int>::max();
+    }
+  else
+    {
+    DoCreateCoarseDriver();
+    }
 }
 
 template<unsigned int VDimension>
@@ -276,6 +505,25 @@ void
 SNAPLevelSetDriver<VDimension>
 ::Run(unsigned int nIterations)
 {
+  // The first iterations are performed by the coarse driver
+  while(m_CoarsePhase && nIterations > 0)
+    {
+    unsigned int nCoarse = (unsigned int) std::max(0, m_Parameters.GetCoarseIterations());
+    unsigned int nDone = m_CoarseDriver->GetElapsedIterations();
+    if(nDone < nCoarse)
+      {
+      unsigned int nRun = std::min(nIterations, nCoarse - nDone);
+      m_CoarseDriver->Run(nRun);
+      nIterations -= nRun;
+      }
+
+    if(m_CoarseDriver->GetElapsedIterations() >= nCoarse)
+      DoFinishCoarsePhase();
+    }
+
+  if(nIterations == 0)
+    return;
+
   // Increment the number of iterations 
   unsigned int nElapsed = m_LevelSetFilter->GetElapsedIterations();
   m_LevelSetFilter->SetNumberOfIterations(nElapsed + nIterations);
@@ -291,6 +539,10 @@ bool
 SNAPLevelSetDriver<VDimension>
 ::IsEvolutionConverged()
 {
+  // The snake always goes on to the full resolution phase
+  if(m_CoarsePhase)
+    return false;
+
   if(m_LevelSetFilter->GetElapsedIterations() == 0)
     return false;
 
@@ -305,6 +557,11 @@ typename SNAPLevelSetDriver<VDimension>::FloatImageType *
 SNAPLevelSetDriver<VDimension>
 ::GetCurrentState()
 {
+  // During the coarse phase, the coarse level set is reported at full
+  // resolution, so that the caller can treat it like the filter output
+  if(m_CoarsePhase)
+    return GetUpsampledCoarseState();
+
   // Fix the spacing of the level set filter's output (huh?)
   m_LevelSetFilter->GetOutput()->SetDirection(m_InitializationImage->GetDirection());
   m_LevelSetFilter->GetOutput()->SetSpacing(m_InitializationImage->GetSpacing());
@@ -319,7 +576,10 @@ unsigned int
 SNAPLevelSetDriver<VDimension>
 ::GetElapsedIterations() const
 {
-  return m_LevelSetFilter->GetElapsedIterations();
+  if(m_CoarsePhase)
+    return m_CoarseDriver->GetElapsedIterations();
+
+  return m_IterationOffset + m_LevelSetFilter->GetElapsedIterations();
 }
 
 template<unsigned int VDimension>
@@ -332,6 +592,11 @@ SNAPLevelSetDriver<VDimension>
   // function to free memory
   m_LevelSetFilter = NULL;
   m_LevelSetFunction = NULL;
+
+  delete m_CoarseDriver;
+  m_CoarseDriver = NULL;
+  m_CoarsePhase = false;
+  m_UpsampledState = NULL;
 }
 
 template<unsigned int VDimension>
@@ -347,10 +612,19 @@ SNAPLevelSetDriver<VDimension>
   // may not cause it to recompute it's images
   AssignParametersToPhi(sparms,false);
 
-  // Create a new level set filter
+  // Create a new level set filter. This starts the evolution over, so
+  // the coarse phase is started over as well
   if(destructive)
     {
+    m_IterationOffset = 0;
     DoCreateLevelSetFilter();
+    DoCreateCoarseDriver();
+    }
+  else if(m_CoarseDriver)
+    {
+    SnakeParameters coarseParms = sparms;
+    coarseParms.SetMultiResolutionFactor(1);
+    m_CoarseDriver->SetSnakeParameters(coarseParms);
     }
 }
 
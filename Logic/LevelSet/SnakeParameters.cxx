@@ -64,6 +64,9 @@ SnakeParameters
 
   p.m_Solver = PARALLEL_SPARSE_FIELD_SOLVER;
 
+  p.m_MultiResolutionFactor = 1;
+  p.m_CoarseIterations = 50;
+
   return p;
 }
 
@@ -94,6 +97,9 @@ SnakeParameters
 
   p.m_Solver = PARALLEL_SPARSE_FIELD_SOLVER;
 
+  p.m_MultiResolutionFactor = 1;
+  p.m_CoarseIterations = 50;
+
   return p;
 }
 
@@ -124,6 +130,9 @@ SnakeParameters
 
   p.m_Solver = PARALLEL_SPARSE_FIELD_SOLVER;
 
+  p.m_MultiResolutionFactor = 1;
+  p.m_CoarseIterations = 50;
+
   return p;
 }
 
@@ -145,5 +154,7 @@ SnakeParameters
     m_LaplacianSpeedExponent == p.m_LaplacianSpeedExponent &&
     m_AdvectionWeight == p.m_AdvectionWeight &&
     m_AdvectionSpeedExponent == p.m_AdvectionSpeedExponent && 
-    m_Solver == p.m_Solver);
+    m_Solver == p.m_Solver &&
+    m_MultiResolutionFactor == p.m_MultiResolutionFactor &&
+    (m_MultiResolutionFactor <= 1 || m_CoarseIterations == p.m_CoarseIterations));
 }
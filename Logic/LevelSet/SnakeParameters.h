@@ -129,6 +129,22 @@ public:
     this->m_Solver = value;
   }
 
+  /** Downsampling factor for the coarse phase of the evolution (1, 2 or 4).
+   * With a factor of 1 the snake evolves at full resolution only */
+  itkGetConstMacro(MultiResolutionFactor,int);
+  void SetMultiResolutionFactor( int value )
+  {
+    this->m_MultiResolutionFactor = value;
+  }
+
+  /** Number of iterations performed at the coarse resolution before the
+   * level set is upsampled and refined at full resolution */
+  itkGetConstMacro(CoarseIterations,int);
+  void SetCoarseIterations( int value )
+  {
+    this->m_CoarseIterations = value;
+  }
+
   /** Type of equation (well known parameter sets) */
   itkGetConstMacro(SnakeType,SnakeType);
   void SetSnakeType( SnakeType value )
@@ -206,6 +222,9 @@ private:
   int m_AdvectionSpeedExponent;   
 
   SolverType m_Solver;
+
+  int m_MultiResolutionFactor;
+  int m_CoarseIterations;
 };
 
 #endif // __SnakeParameters_h_
@@ -41,10 +41,33 @@
 #include "LevelSetMeshPipeline.h"
 #include "VTKMeshPipeline.h"
 #include "MeshOptions.h"
+#include "ImageWrapperBase.h"
+#include <vtkAppendPolyData.h>
+#include <vtkFloatArray.h>
+#include <cmath>
+#include <algorithm>
+
+// Quantized state of a level set voxel: the sign, and the distance to the
+// zero level set in 1/16 voxel steps, saturated at one voxel. The mesh in a
+// brick only needs updating if the codes of its voxels have changed.
+inline signed char LevelSetVoxelCode(float phi)
+{
+  int q = std::min(16, (int) (std::fabs(phi) * 16));
+  return (signed char) (phi < 0 ? -1 - q : 1 + q);
+}
 
 LevelSetMeshPipeline
 ::LevelSetMeshPipeline()
 {
+  m_BricksValid = false;
+  m_NumberOfUpdatedBricks = 0;
+  m_Threader = itk::MultiThreader::New();
+  for(int d = 0; d < 3; d++)
+    {
+    m_Size[d] = m_BrickCount[d] = 0;
+    m_Origin[d] = m_Spacing[d] = 0.0;
+    }
+
   // Initialize the VTK Exporter
   m_VTKPipeline = new VTKMeshPipeline();
 
@@ -74,6 +97,9 @@ LevelSetMeshPipeline
 
     // Apply the options to the internal pipeline
     m_VTKPipeline->SetMeshOptions(m_MeshOptions);
+
+    // The bricks may be out of date if the full pipeline is used
+    m_BricksValid = false;
     }
 }
 
@@ -81,13 +107,21 @@ void
 LevelSetMeshPipeline
 ::UpdateMesh(itk::FastMutexLock *lock)
 {
-  // We need to generate a new mesh object. Otherwise, if there is concurrent
-  // rendering and mesh computation, the mesh would be accessed by two threads
-  // at the same time, which is a problem.
-  m_Mesh = vtkSmartPointer<vtkPolyData>::New();
+  if(CanUpdateIncrementally())
+    {
+    UpdateMeshIncrementally(lock);
+    }
+  else
+    {
+    // We need to generate a new mesh object. Otherwise, if there is concurrent
+    // rendering and mesh computation, the mesh would be accessed by two threads
+    // at the same time, which is a problem.
+    m_Mesh = vtkSmartPointer<vtkPolyData>::New();
 
-  // Run the pipeline
-  m_VTKPipeline->ComputeMesh(m_Mesh, lock);
+    // Run the pipeline
+    m_VTKPipeline->ComputeMesh(m_Mesh, lock);
+    m_BricksValid = false;
+    }
 
   // Set the modified flag so that we can use the MTime() of this object for dirty checks
   this->Modified();
@@ -104,5 +138,393 @@ LevelSetMeshPipeline
 {
   // Hook the input into the pipeline
   m_VTKPipeline->SetImage(image);
+
+  // The bricks must be rebuilt if the geometry of the image has changed
+  InputImageType::SizeType size = image->GetBufferedRegion().GetSize();
+  for(int d = 0; d < 3; d++)
+    {
+    if(m_Size[d] != (int) size[d] || m_Origin[d] != image->GetOrigin()[d]
+       || m_Spacing[d] != image->GetSpacing()[d])
+      m_BricksValid = false;
+    }
+
+  if(m_InputImage != image)
+    m_BricksValid = false;
+  m_InputImage = image;
+
+  // Same transform from VTK to RAS coordinates as in the VTK pipeline
+  vnl_matrix_fixed<double, 4, 4> vtk2nii =
+    ImageWrapperBase::ConstructVTKtoNiftiTransform(
+      image->GetDirection().GetVnlMatrix(),
+      image->GetOrigin().GetVnlVector(),
+      image->GetSpacing().GetVnlVector());
+  std::copy(vtk2nii.data_block(), vtk2nii.data_block() + 16, m_VTKToNifti);
+}
+
+bool
+LevelSetMeshPipeline
+::CanUpdateIncrementally() const
+{
+  // Decimation and smoothing change the mesh globally, and blurring the
+  // image changes the level set beyond the bricks that have moved
+  return m_InputImage
+      && !m_MeshOptions->GetUseGaussianSmoothing()
+      && !m_MeshOptions->GetUseDecimation()
+      && !m_MeshOptions->GetUseMeshSmoothing();
+}
+
+void
+LevelSetMeshPipeline
+::InitializeBricks()
+{
+  InputImageType::SizeType size = m_InputImage->GetBufferedRegion().GetSize();
+  size_t nVoxels = 1;
+  int nBricks = 1;
+  for(int d = 0; d < 3; d++)
+    {
+    m_Size[d] = (int) size[d];
+    m_Origin[d] = m_InputImage->GetOrigin()[d];
+    m_Spacing[d] = m_InputImage->GetSpacing()[d];
+
+    // Bricks are made up of marching cubes cells, whose lower corners are
+    // the voxels 0 to n-2
+    m_BrickCount[d] = std::max(1, (m_Size[d] - 2) / BRICK_SIZE + 1);
+    nVoxels *= m_Size[d];
+    nBricks *= m_BrickCount[d];
+    }
+
+  // The code 0 never occurs, so all bricks are extracted on the first update
+  m_VoxelCodes.assign(nVoxels, 0);
+  m_BrickMeshes.assign(nBricks, vtkSmartPointer<vtkPolyData>());
+  m_BricksValid = true;
+}
+
+void
+LevelSetMeshPipeline
+::MarkBricks(int x, int y, int z, std::vector<unsigned char> &dirty) const
+{
+  // The cells of brick b have their corners at voxels b*BRICK_SIZE to
+  // (b+1)*BRICK_SIZE, and their normals depend on one more voxel on each
+  // side, so a voxel can affect up to two bricks along each axis
+  int v[3] = { x, y, z }, b0[3], b1[3];
+  for(int d = 0; d < 3; d++)
+    {
+    b0[d] = v[d] > BRICK_SIZE ? (v[d] - 2) >> BRICK_BITS : 0;
+    b1[d] = std::min((v[d] + 1) >> BRICK_BITS, m_BrickCount[d] - 1);
+    }
+
+  for(int i = b0[0]; i <= b1[0]; i++)
+    for(int j = b0[1]; j <= b1[1]; j++)
+      for(int k = b0[2]; k <= b1[2]; k++)
+        dirty[i + m_BrickCount[0] * (j + m_BrickCount[1] * k)] = 1;
+}
+
+ITK_THREAD_RETURN_TYPE
+LevelSetMeshPipeline
+::ScanThreadCallback(void *arg)
+{
+  typedef itk::MultiThreader::ThreadInfoStruct ThreadInfo;
+  ThreadInfo *info = static_cast<ThreadInfo *>(arg);
+  LevelSetMeshPipeline *self = static_cast<LevelSetMeshPipeline *>(info->UserData);
+
+  // The range of slices handled by this thread
+  int thread = info->ThreadID, nThreads = info->NumberOfThreads;
+  int nx = self->m_Size[0], ny = self->m_Size[1], nz = self->m_Size[2];
+  int z0 = (nz * thread) / nThreads, z1 = (nz * (thread + 1)) / nThreads;
+
+  std::vector<unsigned char> &dirty = self->m_ThreadDirty[thread];
+  const float *phi = self->m_InputImage->GetBufferPointer();
+  signed char *codes = &self->m_VoxelCodes[0];
+
+  for(int z = z0; z < z1; z++)
+    {
+    for(int y = 0; y < ny; y++)
+      {
+      size_t offset = nx * (y + (size_t) ny * z);
+      for(int x = 0; x < nx; x++)
+        {
+        signed char code = LevelSetVoxelCode(phi[offset + x]);
+        if(code != codes[offset + x])
+          {
+          codes[offset + x] = code;
+          self->MarkBricks(x, y, z, dirty);
+          }
+        }
+      }
+    }
+
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+void
+LevelSetMeshPipeline
+::CopyModifiedBricks()
+{
+  // Scan the image for changes in parallel
+  int nBricks = (int) m_BrickMeshes.size();
+  int nThreads = m_Threader->GetNumberOfThreads();
+  m_ThreadDirty.assign(nThreads, std::vector<unsigned char>(nBricks, 0));
+  m_Threader->SetNumberOfThreads(nThreads);
+  m_Threader->SetSingleMethod(&LevelSetMeshPipeline::ScanThreadCallback, this);
+  m_Threader->SingleMethodExecute();
+
+  // Copy the voxels of the modified bricks, so that marching cubes can run
+  // while the level set goes on evolving
+  m_UpdateBricks.clear();
+  const float *phi = m_InputImage->GetBufferPointer();
+  for(int b = 0; b < nBricks; b++)
+    {
+    bool isDirty = false;
+    for(int t = 0; t < nThreads; t++)
+      isDirty = isDirty || m_ThreadDirty[t][b];
+    if(!isDirty)
+      continue;
+
+    // The voxels covered by the cells of the brick, including the upper
+    // faces, and the voxels around them that are needed for the normals
+    BrickCopy bc;
+    bc.brick = b;
+    int bidx[3] = { b % m_BrickCount[0],
+                    (b / m_BrickCount[0]) % m_BrickCount[1],
+                    b / (m_BrickCount[0] * m_BrickCount[1]) };
+    int lo[3], hlo[3], hdim[3];
+    for(int d = 0; d < 3; d++)
+      {
+      lo[d] = bidx[d] * BRICK_SIZE;
+      bc.dim[d] = std::min(lo[d] + BRICK_SIZE, m_Size[d] - 1) - lo[d] + 1;
+      hlo[d] = std::max(lo[d] - 1, 0);
+      hdim[d] = std::min(lo[d] + bc.dim[d], m_Size[d] - 1) - hlo[d] + 1;
+      bc.offset[d] = lo[d] - hlo[d];
+      }
+
+    bc.image = vtkSmartPointer<vtkImageData>::New();
+    bc.image->SetDimensions(hdim[0], hdim[1], hdim[2]);
+    bc.image->SetSpacing(m_Spacing[0], m_Spacing[1], m_Spacing[2]);
+    bc.image->SetOrigin(m_Origin[0] + hlo[0] * m_Spacing[0],
+                        m_Origin[1] + hlo[1] * m_Spacing[1],
+                        m_Origin[2] + hlo[2] * m_Spacing[2]);
+    bc.image->AllocateScalars(VTK_FLOAT, 1);
+
+    float *out = static_cast<float *>(bc.image->GetScalarPointer());
+    bool hasInside = false, hasOutside = false;
+    for(int z = 0; z < hdim[2]; z++)
+      {
+      for(int y = 0; y < hdim[1]; y++)
+        {
+        const float *row = phi + hlo[0] + m_Size[0] * (hlo[1] + y + (size_t) m_Size[1] * (hlo[2] + z));
+        bool inBrick = (y >= bc.offset[1] && y < bc.offset[1] + bc.dim[1]
+                        && z >= bc.offset[2] && z < bc.offset[2] + bc.dim[2]);
+        for(int x = 0; x < hdim[0]; x++)
+          {
+          *out++ = row[x];
+          if(inBrick && x >= bc.offset[0] && x < bc.offset[0] + bc.dim[0])
+            {
+            if(row[x] < 0) hasInside = true; else hasOutside = true;
+            }
+          }
+        }
+      }
+
+    // A brick that is all inside or all outside has an empty mesh
+    if(hasInside && hasOutside)
+      m_UpdateBricks.push_back(bc);
+    else
+      m_BrickMeshes[b] = NULL;
+    }
+}
+
+void
+LevelSetMeshPipeline
+::ComputeBrickNormals(vtkPolyData *mesh, vtkImageData *image)
+{
+  int dims[3];
+  double origin[3], spacing[3];
+  image->GetDimensions(dims);
+  image->GetOrigin(origin);
+  image->GetSpacing(spacing);
+  const float *s = static_cast<float *>(image->GetScalarPointer());
+
+  vtkSmartPointer<vtkFloatArray> normals = vtkSmartPointer<vtkFloatArray>::New();
+  normals->SetNumberOfComponents(3);
+  normals->SetNumberOfTuples(mesh->GetNumberOfPoints());
+  normals->SetName("Normals");
+
+  for(vtkIdType p = 0; p < mesh->GetNumberOfPoints(); p++)
+    {
+    // The point lies on the edge of a cell. Find the cell and the position
+    // of the point in the cell
+    double x[3], u[3];
+    int i0[3];
+    mesh->GetPoint(p, x);
+    for(int d = 0; d < 3; d++)
+      {
+      double c = (x[d] - origin[d]) / spacing[d];
+      i0[d] = std::max(0, std::min((int) std::floor(c), dims[d] - 2));
+      u[d] = std::max(0.0, std::min(c - i0[d], 1.0));
+      }
+
+    // Interpolate the gradients at the corners of the cell, which are
+    // computed as in vtkMarchingCubes: negated central differences, and
+    // one-sided differences at the edge of the image
+    double n[3] = { 0.0, 0.0, 0.0 };
+    for(int corner = 0; corner < 8; corner++)
+      {
+      int v[3];
+      double w = 1.0;
+      for(int d = 0; d < 3; d++)
+        {
+        int bit = (corner >> d) & 1;
+        v[d] = std::min(i0[d] + bit, dims[d] - 1);
+        w *= bit ? u[d] : 1.0 - u[d];
+        }
+      if(w == 0.0)
+        continue;
+
+      size_t stride[3] = { 1, (size_t) dims[0], (size_t) dims[0] * dims[1] };
+      size_t off = v[0] + stride[1] * v[1] + stride[2] * v[2];
+      for(int d = 0; d < 3; d++)
+        {
+        if(dims[d] == 1)
+          continue;
+        else if(v[d] == 0)
+          n[d] += w * (s[off] - s[off + stride[d]]) / spacing[d];
+        else if(v[d] == dims[d] - 1)
+          n[d] += w * (s[off - stride[d]] - s[off]) / spacing[d];
+        else
+          n[d] += w * 0.5 * (s[off - stride[d]] - s[off + stride[d]]) / spacing[d];
+        }
+      }
+
+    double len = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+    if(len > 0.0)
+      for(int d = 0; d < 3; d++)
+        n[d] /= len;
+    normals->SetTuple(p, n);
+    }
+
+  mesh->GetPointData()->SetNormals(normals);
+}
+
+ITK_THREAD_RETURN_TYPE
+LevelSetMeshPipeline
+::ExtractThreadCallback(void *arg)
+{
+  typedef itk::MultiThreader::ThreadInfoStruct ThreadInfo;
+  ThreadInfo *info = static_cast<ThreadInfo *>(arg);
+  LevelSetMeshPipeline *self = static_cast<LevelSetMeshPipeline *>(info->UserData);
+
+  // Each thread uses its own filters and transform
+  vtkSmartPointer<vtkTransform> transform = vtkSmartPointer<vtkTransform>::New();
+  transform->SetMatrix(self->m_VTKToNifti);
+  bool flip = transform->GetMatrix()->Determinant() < 0;
+
+  for(size_t k = info->ThreadID; k < self->m_UpdateBricks.size(); k += info->NumberOfThreads)
+    {
+    const BrickCopy &bc = self->m_UpdateBricks[k];
+
+    // Marching cubes runs on the cells of the brick, without the margin
+    vtkSmartPointer<vtkImageData> img = vtkSmartPointer<vtkImageData>::New();
+    double *origin = bc.image->GetOrigin(), *spacing = bc.image->GetSpacing();
+    int *hdim = bc.image->GetDimensions();
+    img->SetDimensions(bc.dim[0], bc.dim[1], bc.dim[2]);
+    img->SetSpacing(spacing);
+    img->SetOrigin(origin[0] + bc.offset[0] * spacing[0],
+                   origin[1] + bc.offset[1] * spacing[1],
+                   origin[2] + bc.offset[2] * spacing[2]);
+    img->AllocateScalars(VTK_FLOAT, 1);
+
+    const float *src = static_cast<float *>(bc.image->GetScalarPointer());
+    float *out = static_cast<float *>(img->GetScalarPointer());
+    for(int z = 0; z < bc.dim[2]; z++)
+      {
+      for(int y = 0; y < bc.dim[1]; y++)
+        {
+        const float *row = src + bc.offset[0]
+            + hdim[0] * (bc.offset[1] + y + (size_t) hdim[1] * (bc.offset[2] + z));
+        out = std::copy(row, row + bc.dim[0], out);
+        }
+      }
+
+    vtkSmartPointer<vtkMarchingCubes> mc = vtkSmartPointer<vtkMarchingCubes>::New();
+    mc->ComputeScalarsOff();
+    mc->ComputeGradientsOff();
+    mc->ComputeNormalsOff();
+    mc->SetNumberOfContours(1);
+    mc->SetValue(0, 0.0f);
+    mc->SetInputData(img);
+    mc->Update();
+
+    // The normals at the faces of the brick need the voxels beyond them
+    vtkSmartPointer<vtkPolyData> contour = mc->GetOutput();
+    ComputeBrickNormals(contour, bc.image);
+
+    vtkSmartPointer<vtkTransformPolyDataFilter> tf =
+        vtkSmartPointer<vtkTransformPolyDataFilter>::New();
+    tf->SetTransform(transform);
+    tf->SetInputData(contour);
+    tf->Update();
+
+    vtkSmartPointer<vtkPolyData> mesh = tf->GetOutput();
+
+    // In the case that the jacobian of the transform is negative,
+    // flip the normals around
+    vtkDataArray *nrm = mesh->GetPointData()->GetNormals();
+    if(flip && nrm)
+      {
+      for(vtkIdType i = 0; i < nrm->GetNumberOfTuples(); i++)
+        for(int j = 0; j < nrm->GetNumberOfComponents(); j++)
+          nrm->SetComponent(i, j, -nrm->GetComponent(i, j));
+      nrm->Modified();
+      }
+
+    self->m_BrickMeshes[bc.brick] =
+        mesh->GetNumberOfPoints() > 0 ? mesh : vtkSmartPointer<vtkPolyData>();
+    }
+
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+void
+LevelSetMeshPipeline
+::UpdateMeshIncrementally(itk::FastMutexLock *lock)
+{
+  // Find and copy the modified bricks while the level set is locked
+  if(lock) lock->Lock();
+  if(!m_BricksValid)
+    InitializeBricks();
+  CopyModifiedBricks();
+  if(lock) lock->Unlock();
+
+  // Run marching cubes in the modified bricks
+  m_NumberOfUpdatedBricks = (unsigned int) m_UpdateBricks.size();
+  if(m_UpdateBricks.size())
+    {
+    m_Threader->SetSingleMethod(&LevelSetMeshPipeline::ExtractThreadCallback, this);
+    m_Threader->SingleMethodExecute();
+    }
+  m_UpdateBricks.clear();
+
+  // Put the bricks together into a new mesh object, since the renderer may
+  // still be using the old one
+  vtkSmartPointer<vtkAppendPolyData> append = vtkSmartPointer<vtkAppendPolyData>::New();
+  int nInputs = 0;
+  for(size_t b = 0; b < m_BrickMeshes.size(); b++)
+    {
+    if(m_BrickMeshes[b])
+      {
+      append->AddInputData(m_BrickMeshes[b]);
+      nInputs++;
+      }
+    }
+
+  if(nInputs > 0)
+    {
+    append->Update();
+    m_Mesh = append->GetOutput();
+    }
+  else
+    {
+    m_Mesh = vtkSmartPointer<vtkPolyData>::New();
+    }
 }
 
@@ -40,6 +40,8 @@
 #include "vtkSmartPointer.h"
 #include "itkObject.h"
 #include "itkObjectFactory.h"
+#include "itkMultiThreader.h"
+#include <vector>
 
 // Forward reference to itk classes
 namespace itk {
@@ -51,13 +53,21 @@ namespace itk {
 class MeshOptions;
 class VTKMeshPipeline;
 class vtkPolyData;
+class vtkImageData;
 
 /**
  * \class LevelSetMeshPipeline
  * \brief A pipeline used to compute a mesh of the zero level set in SNAP.
  *
  * This pipeline takes a floating point image computed by the level
- * set filter and uses a contour algorithm to get a triangular mesh
+ * set filter and uses a contour algorithm to get a triangular mesh.
+ *
+ * While the snake evolves, only a small part of the contour moves between
+ * updates. Unless the mesh options call for decimation or smoothing, which
+ * operate on the whole mesh, the image is divided into bricks and the mesh
+ * is kept as a collection of per-brick meshes. Each update only reruns
+ * marching cubes in the bricks where the level set has crossed zero or
+ * moved by more than a small fraction of a voxel near the zero level set.
  */
 class LevelSetMeshPipeline : public itk::Object
 {
@@ -84,6 +94,13 @@ public:
   /** Get the stored mesh */
   vtkPolyData *GetMesh();
 
+  /** Number of bricks that were re-extracted by the last update */
+  irisGetMacro(NumberOfUpdatedBricks, unsigned int)
+
+  /** Bricks have 2^BRICK_BITS voxels on the side */
+  static const int BRICK_BITS = 5;
+  static const int BRICK_SIZE = 1 << BRICK_BITS;
+
 protected:
   
   /** Constructor, which builds the pipeline */
@@ -108,6 +125,64 @@ private:
 
   // The output mesh
   vtkSmartPointer<vtkPolyData> m_Mesh;
+
+  // Whether the mesh can be updated brick by brick with these options
+  bool CanUpdateIncrementally() const;
+
+  // Compute the mesh by re-extracting the modified bricks
+  void UpdateMeshIncrementally(itk::FastMutexLock *lock);
+
+  // Allocate the brick structure for the current image
+  void InitializeBricks();
+
+  // Find the bricks whose level set has changed and copy their voxels
+  void CopyModifiedBricks();
+
+  // Mark the bricks whose marching cubes cells, or the margin used for the
+  // normals, include a voxel
+  void MarkBricks(int x, int y, int z, std::vector<unsigned char> &dirty) const;
+
+  static ITK_THREAD_RETURN_TYPE ScanThreadCallback(void *arg);
+  static ITK_THREAD_RETURN_TYPE ExtractThreadCallback(void *arg);
+
+  // Geometry of the image for which the bricks were built
+  bool m_BricksValid;
+  int m_Size[3];
+  int m_BrickCount[3];
+  double m_Origin[3], m_Spacing[3];
+
+  // For each voxel, the sign of the level set and its distance to the zero
+  // level set (up to one voxel), quantized, as of the last update
+  std::vector<signed char> m_VoxelCodes;
+
+  // Per-thread flags for the bricks found to have changed by the scan
+  std::vector<std::vector<unsigned char> > m_ThreadDirty;
+
+  // The mesh of each brick, in RAS coordinates (NULL if empty)
+  std::vector<vtkSmartPointer<vtkPolyData> > m_BrickMeshes;
+
+  // A brick to re-extract. The copy of its voxels has a margin of one voxel
+  // (where the image allows), so that the normals at the faces of the brick
+  // are computed from the same differences as in the whole image
+  struct BrickCopy
+  {
+    int brick;
+    int offset[3], dim[3];
+    vtkSmartPointer<vtkImageData> image;
+  };
+
+  // The bricks to re-extract
+  std::vector<BrickCopy> m_UpdateBricks;
+
+  // Compute the normals of a brick mesh from the copy of the brick's voxels
+  static void ComputeBrickNormals(vtkPolyData *mesh, vtkImageData *image);
+
+  // Transform from VTK image coordinates to RAS, row major
+  double m_VTKToNifti[16];
+
+  unsigned int m_NumberOfUpdatedBricks;
+
+  SmartPtr<itk::MultiThreader> m_Threader;
 };
 
 #endif //__LevelSetMeshPipeline_h_
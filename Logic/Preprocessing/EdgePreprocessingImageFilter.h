@@ -51,6 +51,8 @@ namespace itk {
   template <class TIn, class TOut, class Fun> class UnaryFunctorImageFilter;
   template <class TIn, class TOut> class StreamingImageFilter;
   template <class TIn, class TOut> class CastImageFilter;
+  template <class TIn, class TOut> class ExtractImageFilter;
+  template <class TIn, class TOut> class SmoothingRecursiveGaussianImageFilter;
 }
 
 
@@ -107,6 +109,13 @@ private:
  * 
  * This functor implements a Gaussian blur, followed by a gradient magnitude
  * operator, followed by a 'contrast enhancement' intensity remapping filter.
+ *
+ * On CPU builds, the blur can be computed either by a discrete Gaussian
+ * kernel, whose size grows with the scale, or by a recursive (IIR)
+ * approximation, whose cost does not depend on the scale. The recursive
+ * filter only processes the requested region of the output padded by a
+ * margin of four standard deviations, so when the filter is streamed, the
+ * memory used for the intermediate images is limited to a slab.
  */
 template <typename TInputImage,typename TOutputImage>
 class EdgePreprocessingImageFilter: 
@@ -143,6 +152,13 @@ public:
                                                 GPUInternalImagePointer;
 #endif
 
+  /** How the Gaussian blur is computed on the CPU */
+  enum GaussianMode {
+    GAUSSIAN_AUTO,        // recursive for large scales, discrete otherwise
+    GAUSSIAN_DISCRETE,
+    GAUSSIAN_RECURSIVE
+  };
+
   /** Functor type used for thresholding */
   typedef EdgeRemappingFunctor<RealType>                    FunctorType;
 
@@ -164,6 +180,13 @@ public:
   /** Get the parameters pointer */
   EdgePreprocessingSettings *GetParameters();
 
+  /** Set how the Gaussian blur is computed (ignored on GPU builds) */
+  itkSetMacro(GaussianMode, GaussianMode)
+  itkGetConstMacro(GaussianMode, GaussianMode)
+
+  /** The smallest scale at which GAUSSIAN_AUTO uses the recursive filter */
+  static const double RECURSIVE_GAUSSIAN_MINIMUM_SCALE;
+
 protected:
 
   EdgePreprocessingImageFilter();
@@ -183,11 +206,18 @@ private:
 
   double m_InputImageMaximumGradientMagnitude;
 
+  GaussianMode m_GaussianMode;
+
   typedef itk::CastImageFilter<InputImageType, InternalImageType>   CastFilter;
 
   typedef itk::DiscreteGaussianImageFilter<InternalImageType,
                                            InternalImageType>       BlurFilter;
 
+  typedef itk::ExtractImageFilter<InputImageType, InternalImageType> ExtractFilter;
+
+  typedef itk::SmoothingRecursiveGaussianImageFilter<InternalImageType,
+                                           InternalImageType> RecursiveBlurFilter;
+
 #ifdef SNAP_USE_GPU
   typedef CPUImageToGPUImageFilter<GPUInternalImageType>        GPUImageSource;
   typedef itk::GPUDiscreteGaussianImageFilter<GPUInternalImageType,
@@ -204,6 +234,8 @@ private:
 
   SmartPtr<CastFilter> m_CastFilter;
   SmartPtr<BlurFilter> m_BlurFilter;
+  SmartPtr<ExtractFilter> m_ExtractFilter;
+  SmartPtr<RecursiveBlurFilter> m_RecursiveBlurFilter;
   SmartPtr<GradMagFilter> m_GradMagFilter;
   SmartPtr<RemapFilter> m_RemapFilter;
 
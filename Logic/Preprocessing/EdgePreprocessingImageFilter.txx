@@ -38,9 +38,17 @@
 
 #include <itkCastImageFilter.h>
 #include <itkDiscreteGaussianImageFilter.h>
+#include <itkExtractImageFilter.h>
+#include <itkSmoothingRecursiveGaussianImageFilter.h>
 #include <itkGradientMagnitudeImageFilter.h>
 #include <itkUnaryFunctorImageFilter.h>
 #include <IRISException.h>
+#include <cmath>
+
+template<typename TInputImage,typename TOutputImage>
+const double
+EdgePreprocessingImageFilter<TInputImage,TOutputImage>
+::RECURSIVE_GAUSSIAN_MINIMUM_SCALE = 2.0;
 
 template<typename TInputImage,typename TOutputImage>
 EdgePreprocessingImageFilter<TInputImage,TOutputImage>
@@ -52,6 +60,9 @@ EdgePreprocessingImageFilter<TInputImage,TOutputImage>
   // Set the gradient magnitude to default value
   m_InputImageMaximumGradientMagnitude = 0.0;
 
+  // Pick the Gaussian filter based on the scale
+  m_GaussianMode = GAUSSIAN_AUTO;
+
   // Initialize the mini-pipeline
   m_CastFilter = CastFilter::New();
   m_CastFilter->ReleaseDataFlagOn();
@@ -66,6 +77,17 @@ EdgePreprocessingImageFilter<TInputImage,TOutputImage>
   m_BlurFilter->SetInternalNumberOfStreamDivisions(1);
   m_BlurFilter->SetMaximumError(0.1);
 
+  // The recursive Gaussian works on a padded copy of the requested region
+  m_ExtractFilter = ExtractFilter::New();
+  m_ExtractFilter->SetDirectionCollapseToSubmatrix();
+  m_ExtractFilter->ReleaseDataFlagOn();
+
+  m_RecursiveBlurFilter = RecursiveBlurFilter::New();
+  m_RecursiveBlurFilter->SetInput(m_ExtractFilter->GetOutput());
+  m_RecursiveBlurFilter->SetNormalizeAcrossScale(false);
+  m_RecursiveBlurFilter->ReleaseDataFlagOn();
+
+  // The input of the gradient magnitude filter depends on the Gaussian mode
   m_GradMagFilter = GradMagFilter::New();
   m_GradMagFilter->SetInput(m_BlurFilter->GetOutput());
   m_GradMagFilter->ReleaseDataFlagOn();
@@ -114,7 +136,20 @@ EdgePreprocessingImageFilter<TInputImage,TOutputImage>
   pac->SetMiniPipelineFilter(this);
 
 #ifndef SNAP_USE_GPU
-  pac->RegisterInternalFilter(m_BlurFilter, 0.8);
+  // Decide which Gaussian filter to use
+  double scale = settings->GetGaussianBlurScale();
+  bool recursive = (m_GaussianMode == GAUSSIAN_RECURSIVE) ||
+      (m_GaussianMode == GAUSSIAN_AUTO && scale >= RECURSIVE_GAUSSIAN_MINIMUM_SCALE);
+
+  // The recursive filter needs at least four voxels along each dimension
+  for(unsigned int d = 0; d < ImageDimension; d++)
+    if(inputImage->GetLargestPossibleRegion().GetSize(d) < 4)
+      recursive = false;
+
+  if(recursive)
+    pac->RegisterInternalFilter(m_RecursiveBlurFilter, 0.8);
+  else
+    pac->RegisterInternalFilter(m_BlurFilter, 0.8);
 #else
   pac->RegisterInternalFilter(m_GPUBlurFilter, 0.8);
 #endif
@@ -126,9 +161,31 @@ EdgePreprocessingImageFilter<TInputImage,TOutputImage>
 
   // Configure the Gaussian
 #ifndef SNAP_USE_GPU
-  m_BlurFilter->SetUseImageSpacingOff();
-  m_BlurFilter->SetVariance(
-        settings->GetGaussianBlurScale() * settings->GetGaussianBlurScale());
+  if(recursive)
+    {
+    // Extract the requested region with a margin large enough for the
+    // truncation of the Gaussian at the slab boundaries to be negligible.
+    // One more voxel is needed by the gradient magnitude filter.
+    typename InputImageType::RegionType region = outputImage->GetRequestedRegion();
+    region.PadByRadius(static_cast<long>(std::ceil(4.0 * scale)) + 1);
+    region.Crop(inputImage->GetLargestPossibleRegion());
+    m_ExtractFilter->SetInput(inputImage);
+    m_ExtractFilter->SetExtractionRegion(region);
+
+    // The scale is given in voxel units, like for the discrete filter
+    typename RecursiveBlurFilter::SigmaArrayType sigma;
+    for(unsigned int d = 0; d < ImageDimension; d++)
+      sigma[d] = scale * inputImage->GetSpacing()[d];
+    m_RecursiveBlurFilter->SetSigmaArray(sigma);
+
+    m_GradMagFilter->SetInput(m_RecursiveBlurFilter->GetOutput());
+    }
+  else
+    {
+    m_BlurFilter->SetUseImageSpacingOff();
+    m_BlurFilter->SetVariance(scale * scale);
+    m_GradMagFilter->SetInput(m_BlurFilter->GetOutput());
+    }
 #else
   m_GPUBlurFilter->SetUseImageSpacingOff();
   m_GPUBlurFilter->SetVariance(
@@ -149,6 +206,12 @@ EdgePreprocessingImageFilter<TInputImage,TOutputImage>
   m_RemapFilter->GraftOutput(outputImage);
   m_RemapFilter->Update();
   this->GraftOutput(m_RemapFilter->GetOutput());
+
+  // In the recursive path, the mini-pipeline only knows about the extracted
+  // region, which the graft has copied to the output. The output must keep
+  // the largest possible region computed by GenerateOutputInformation, or
+  // the next piece requested by a streaming filter would fall outside of it
+  outputImage->SetLargestPossibleRegion(inputImage->GetLargestPossibleRegion());
 }
 
 template<typename TInputImage,typename TOutputImage>
@@ -1,6 +1,8 @@
 #include "EMGaussianMixtures.h"
-#include <iostream>
-#include <ctime>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include <vnl/vnl_math.h>
 
 EMGaussianMixtures::EMGaussianMixtures(double **x, int dataSize, int dataDim, int numOfClass)
   :m_x(x), m_numOfData(dataSize), m_dimOfGaussian(dataDim), m_numOfGaussian(numOfClass), m_setPriorFlag(0), m_numOfIteration(0), m_fail(0)
@@ -17,38 +19,55 @@ EMGaussianMixtures::EMGaussianMixtures(double **x, int dataSize, int dataDim, in
     {
     m_log_pdf[i] = &m_probs2[i*numOfClass];
     }
-  m_tmp1 = new double[numOfClass];
   m_tmp2 = new double[dataDim];
   m_tmp3 = new double[dataDim*dataDim];
   m_sum = new double[numOfClass];
   m_weight = new double[numOfClass];
 
+  // Copy the samples into a contiguous component-major array
+  m_X.resize((size_t) dataSize * dataDim);
+  for (int i = 0; i < dataSize; i++)
+    for (int k = 0; k < dataDim; k++)
+      m_X[(size_t) k * dataSize + i] = x[i][k];
+
+  m_UseCholesky.resize(numOfClass);
+  m_IsDelta.resize(numOfClass);
+  m_CholeskyFactor.resize(numOfClass * dataDim * dataDim);
+  m_LogNormFactor.resize(numOfClass);
+  m_Means.resize(numOfClass * dataDim);
+
+  m_Threader = itk::MultiThreader::New();
+  m_NumberOfThreads = m_Threader->GetNumberOfThreads();
+  m_ThreadSum.resize(m_NumberOfThreads * numOfClass);
+  m_ThreadLogLikelihood.resize(m_NumberOfThreads);
+  m_ThreadMoments.resize(m_NumberOfThreads * numOfClass * dataDim * dataDim);
+
   m_gmm = GaussianMixtureModel::New();
   m_gmm->Initialize(dataDim, numOfClass);
 
   m_maxIteration = 30;
   m_precision = 1.0e-7;
-  m_logLikelihood = std::numeric_limits<double>::infinity();
+  m_logLikelihood = -std::numeric_limits<double>::infinity();
+  m_lastLogLikelihood = m_logLikelihood;
 }
 
 EMGaussianMixtures::~EMGaussianMixtures()
 {
-  delete m_probs;
-  delete m_probs2;
-  delete m_latent;
-  delete m_log_pdf;
-  delete m_tmp1;
-  delete m_tmp2;
-  delete m_tmp3;
-  delete m_sum;
-  delete m_weight;
+  delete[] m_probs;
+  delete[] m_probs2;
+  delete[] m_latent;
+  delete[] m_log_pdf;
+  delete[] m_tmp2;
+  delete[] m_tmp3;
+  delete[] m_sum;
+  delete[] m_weight;
 }
 
 void EMGaussianMixtures::Reset(void)
 {
   m_numOfIteration = 0;
   m_fail = 0;
-  m_logLikelihood = std::numeric_limits<double>::infinity();
+  m_logLikelihood = -std::numeric_limits<double>::infinity();
   for (int i = 0; i < m_numOfData*m_numOfGaussian; i++)
     {
     m_probs[i] = 0;
@@ -104,23 +123,22 @@ int EMGaussianMixtures::GetMaxIteration(void)
 
 double ** EMGaussianMixtures::Update(void)
 {
-  double currentLogLikelihood = 0;
   m_numOfIteration = 0;
   m_fail = 0;
-  while ((fabs(m_logLikelihood - currentLogLikelihood) > m_precision) && (m_numOfIteration < m_maxIteration))
+  m_logLikelihood = -std::numeric_limits<double>::infinity();
+  while (m_numOfIteration < m_maxIteration)
     {
-    if (m_logLikelihood < currentLogLikelihood)
+    // The E-step computes the log likelihood for the current parameters
+    EvaluatePDF();
+    double currentLogLikelihood = EvaluateLogLikelihood();
+    if (currentLogLikelihood < m_logLikelihood)
       {
       m_fail = 1;
-      std::cout << "!!!!!! Log Likelihood increase, EM fails" << std::endl;
-      std::cout << "old=" <<m_logLikelihood << std::endl << "new=" << currentLogLikelihood << std::endl;
-      // break;
       }
     ++m_numOfIteration;
+    double change = fabs(m_logLikelihood - currentLogLikelihood);
     m_logLikelihood = currentLogLikelihood;
-    EvaluatePDF();
-    currentLogLikelihood = EvaluateLogLikelihood();
-    UpdateLatent();
+
     UpdateMean();
     UpdateCovariance();
     if (m_setPriorFlag == 0)
@@ -128,81 +146,107 @@ double ** EMGaussianMixtures::Update(void)
       UpdateWeight();
       }
 
-    std::cout << std::endl <<"=====================" << std::endl;
-    std::cout << "After " << m_numOfIteration << " Iteration:" << std::endl;
-    std::cout << "log likelihood:" << std::endl << m_logLikelihood << std::endl;
-    PrintParameters();
-    //getchar();
+    if (change <= m_precision)
+      break;
     }
   return m_latent;
 }
 
 double ** EMGaussianMixtures::UpdateOnce(void)
 {
-  long start = 0;
-  long end = 0;
-  start = clock();
   EvaluatePDF();
-  end = clock();
-  std::cout << "evaluate pdf spending " << (end-start)/1000 << std::endl;
-  start = clock();
   double currentLogLikelihood = EvaluateLogLikelihood();
-  end = clock();
-  std::cout << "evaluate likelihood spending " << (end-start)/1000 << std::endl;
-  if (m_logLikelihood < currentLogLikelihood)
+  if (currentLogLikelihood < m_logLikelihood)
     {
     m_fail = 1;
-    std::cout << "!!!!!! Log Likelihood increase, EM fails" << std::endl;
-    std::cout << "old=" <<m_logLikelihood << std::endl << "new=" << currentLogLikelihood << std::endl;
-    }
-  if (fabs(m_logLikelihood - currentLogLikelihood) <= m_precision)
-    {
-    std::cout << "Log Likelihood converged" << std::endl;
-    }
-  if (m_numOfIteration >= m_maxIteration)
-    {
-    std::cout << "Reach the maximum iteration number" << std::endl;
     }
   ++m_numOfIteration;
   m_logLikelihood = currentLogLikelihood;
-  
-  start = clock();
-  UpdateLatent();
-  end = clock();
-  std::cout << "latent spending " << (end-start)/1000 << std::endl;
-  start = clock();
+
   UpdateMean();
-  end = clock();
-  std::cout << "mean spending " << (end-start)/1000 << std::endl;
-  start = clock();
   UpdateCovariance();
-  end = clock();
-  std::cout << "covariance spending " << (end-start)/1000 << std::endl;
   if (m_setPriorFlag == 0)
     {
-    start = clock();
     UpdateWeight();
-    end = clock();
-    std::cout << "weight spending " << (end-start)/1000 << std::endl;
     }
 
-  std::cout << std::endl <<"=====================" << std::endl;
-  std::cout << "After " << m_numOfIteration << " Iteration:" << std::endl;
-  std::cout << "log likelihood:" << std::endl << m_logLikelihood << std::endl;
-  PrintParameters();
-  //getchar();
   return m_latent;
 }
 
-void EMGaussianMixtures::EvaluatePDF(void)
+void EMGaussianMixtures::ExecuteThreadedStep(ThreadedStep step)
+{
+  m_CurrentStep = step;
+  m_Threader->SetNumberOfThreads(m_NumberOfThreads);
+  m_Threader->SetSingleMethod(&EMGaussianMixtures::ThreadCallback, this);
+  m_Threader->SingleMethodExecute();
+}
+
+ITK_THREAD_RETURN_TYPE EMGaussianMixtures::ThreadCallback(void *arg)
+{
+  typedef itk::MultiThreader::ThreadInfoStruct ThreadInfo;
+  ThreadInfo *info = static_cast<ThreadInfo *>(arg);
+  EMGaussianMixtures *self = static_cast<EMGaussianMixtures *>(info->UserData);
+
+  // The range of samples handled by this thread
+  int thread = info->ThreadID, nThreads = info->NumberOfThreads;
+  int i0 = (int) (((long long) self->m_numOfData * thread) / nThreads);
+  int i1 = (int) (((long long) self->m_numOfData * (thread + 1)) / nThreads);
+
+  switch(self->m_CurrentStep)
+    {
+    case ESTEP: self->ThreadedEStep(thread, i0, i1); break;
+    case MEAN_STEP: self->ThreadedMeanStep(thread, i0, i1); break;
+    case COVARIANCE_STEP: self->ThreadedCovarianceStep(thread, i0, i1); break;
+    }
+
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+void EMGaussianMixtures::PrecomputeGaussians(void)
 {
-  for (int i = 0; i < m_numOfData; i++)
+  int n = m_dimOfGaussian;
+  for (int j = 0; j < m_numOfGaussian; j++)
     {
-    for (int j = 0; j < m_numOfGaussian; j++)
+    const VectorType &mean = m_gmm->GetMean(j);
+    const MatrixType &cov = m_gmm->GetCovariance(j);
+    for (int k = 0; k < n; k++)
+      m_Means[j*n+k] = mean[k];
+
+    m_IsDelta[j] = m_gmm->GetGaussian(j)->isDeltaFunction();
+
+    // Cholesky factorization cov = L L^T. If the matrix is not positive
+    // definite, the density is computed using the eigendecomposition
+    double *L = &m_CholeskyFactor[j*n*n];
+    double logdet = 0.0;
+    bool pd = true;
+    for (int c = 0; c < n && pd; c++)
       {
-      m_log_pdf[i][j] = m_gmm->EvaluateLogPDF(j, m_x[i]);
+      double s = cov(c,c);
+      for (int k = 0; k < c; k++)
+        s -= L[c*n+k] * L[c*n+k];
+      if (!(s > 0) || !vnl_math_isfinite(s))
+        {
+        pd = false;
+        break;
+        }
+      L[c*n+c] = sqrt(s);
+      logdet += 2.0 * log(L[c*n+c]);
+      for (int r = c + 1; r < n; r++)
+        {
+        double t = cov(r,c);
+        for (int k = 0; k < c; k++)
+          t -= L[r*n+k] * L[c*n+k];
+        L[r*n+c] = t / L[c*n+c];
+        }
       }
+
+    m_UseCholesky[j] = pd && vnl_math_isfinite(logdet);
+    m_LogNormFactor[j] = -0.5 * (n * log(2 * vnl_math::pi) + logdet);
     }
+}
+
+void EMGaussianMixtures::EvaluatePDF(void)
+{
   if (m_setPriorFlag == 0)
     {
     for (int j = 0; j < m_numOfGaussian; j++)
@@ -210,9 +254,116 @@ void EMGaussianMixtures::EvaluatePDF(void)
       m_weight[j] = m_gmm->GetWeight(j);
       }
     }
+
+  // Compute the Cholesky factors, then run the E-step in parallel
+  PrecomputeGaussians();
+  ExecuteThreadedStep(ESTEP);
+
+  // Combine the per-thread sums
+  m_lastLogLikelihood = 0.0;
+  for (int j = 0; j < m_numOfGaussian; j++)
+    m_sum[j] = 0.0;
+  for (int t = 0; t < m_NumberOfThreads; t++)
+    {
+    m_lastLogLikelihood += m_ThreadLogLikelihood[t];
+    for (int j = 0; j < m_numOfGaussian; j++)
+      m_sum[j] += m_ThreadSum[t*m_numOfGaussian+j];
+    }
 }
 
-#include <vnl/vnl_math.h>
+void EMGaussianMixtures::ThreadedEStep(int thread, int i0, int i1)
+{
+  const int BLOCK = 64;
+  int n = m_dimOfGaussian, ng = m_numOfGaussian;
+
+  // Scratch buffers: the whitened residuals for a block of samples, their
+  // squared norms, and vectors for the fallback density computation
+  std::vector<double> r(n * BLOCK), q(BLOCK);
+  VectorType xvec(n), xscratch(n);
+
+  // Log of the weights
+  std::vector<double> logw(ng);
+  for (int j = 0; j < ng; j++)
+    logw[j] = log(m_weight[j]);
+
+  double *sum = &m_ThreadSum[thread * ng];
+  double loglik = 0.0;
+  for (int j = 0; j < ng; j++)
+    sum[j] = 0.0;
+
+  for (int b0 = i0; b0 < i1; b0 += BLOCK)
+    {
+    int nb = std::min(BLOCK, i1 - b0);
+
+    // Compute the log-densities for the block
+    for (int j = 0; j < ng; j++)
+      {
+      if (m_UseCholesky[j])
+        {
+        // Solve L r = x - mean by forward substitution, for all samples in
+        // the block at once, and accumulate |r|^2
+        const double *L = &m_CholeskyFactor[j*n*n];
+        const double *mean = &m_Means[j*n];
+        for (int b = 0; b < nb; b++)
+          q[b] = 0.0;
+        for (int d = 0; d < n; d++)
+          {
+          const double *xd = &m_X[(size_t) d * m_numOfData + b0];
+          double *rd = &r[d * BLOCK];
+          for (int b = 0; b < nb; b++)
+            rd[b] = xd[b] - mean[d];
+          for (int e = 0; e < d; e++)
+            {
+            double l = L[d*n+e];
+            const double *re = &r[e * BLOCK];
+            for (int b = 0; b < nb; b++)
+              rd[b] -= l * re[b];
+            }
+          double linv = 1.0 / L[d*n+d];
+          for (int b = 0; b < nb; b++)
+            {
+            rd[b] *= linv;
+            q[b] += rd[b] * rd[b];
+            }
+          }
+        for (int b = 0; b < nb; b++)
+          m_log_pdf[b0+b][j] = m_LogNormFactor[j] - 0.5 * q[b];
+        }
+      else
+        {
+        for (int b = 0; b < nb; b++)
+          {
+          for (int d = 0; d < n; d++)
+            xvec[d] = m_X[(size_t) d * m_numOfData + b0 + b];
+          m_log_pdf[b0+b][j] = m_gmm->EvaluateLogPDF(j, xvec, xscratch);
+          }
+        }
+      }
+
+    // Compute the log-likelihood and the posteriors for the block
+    for (int i = b0; i < b0 + nb; i++)
+      {
+      double lik = 0.0;
+      for (int j = 0; j < ng; j++)
+        {
+        if (!m_IsDelta[j])
+          lik += (m_setPriorFlag ? m_prior[i][j] : m_weight[j]) * exp(m_log_pdf[i][j]);
+        }
+      loglik += log(lik);
+
+      if (m_setPriorFlag == 0)
+        {
+        for (int j = 0; j < ng; j++)
+          {
+          m_latent[i][j] = ComputePosterior(ng, m_log_pdf[i], m_weight, &logw[0], j);
+          sum[j] += m_latent[i][j];
+          }
+        }
+      }
+    }
+
+  m_ThreadLogLikelihood[thread] = loglik;
+}
 
 double EMGaussianMixtures::ComputePosterior(int nGauss, double *log_pdf, double *w, double *log_w, int j)
 {
@@ -264,92 +415,38 @@ double EMGaussianMixtures::ComputePosterior(int nGauss, double *log_pdf, double
   return post;
 }
 
-void EMGaussianMixtures::UpdateLatent(void)
+void EMGaussianMixtures::ThreadedMeanStep(int thread, int i0, int i1)
 {
-  double sum = 0;
-  for (int i = 0; i < m_numOfGaussian; i++)
-    {
-    m_sum[i] = 0;
-    }
+  int n = m_dimOfGaussian, ng = m_numOfGaussian;
+  double *mom = &m_ThreadMoments[thread * ng * n * n];
+  for (int j = 0; j < ng * n; j++)
+    mom[j] = 0.0;
 
-  // Compute log of the weights and store in logw
-  vnl_vector<double> logw(m_numOfGaussian);
-  for(int i = 0; i < m_numOfGaussian; i++)
-    logw(i) = log(m_weight[i]);
-  
-  if (m_setPriorFlag == 0)
+  // Accumulate sum_i latent[i][j] * x[i][k]
+  for (int k = 0; k < n; k++)
     {
-    for (int i = 0; i < m_numOfData; i++)
+    const double *xk = &m_X[(size_t) k * m_numOfData];
+    for (int i = i0; i < i1; i++)
       {
-      for (int j = 0; j < m_numOfGaussian; j++)
-        {
-        m_latent[i][j] = ComputePosterior(m_numOfGaussian, m_log_pdf[i], m_weight, logw.data_block(), j);
-        m_sum[j] += m_latent[i][j];
-        }
-
-
-      /*
-      sum = 0;
-      for (int j = 0; j < m_numOfGaussian; j++)
-        {
-        m_tmp1[j] = m_weight[j] * m_pdf[i][j];
-        sum += m_tmp1[j];
-        }
-      if(sum == 0)
-        {
-        for (int j = 0; j < m_numOfGaussian; j++)
-          {
-          m_latent[i][j] = 1.0 / m_numOfGaussian;
-          m_sum[j] += m_latent[i][j];
-          }
-        }
-      else
-        {
-        for (int j = 0; j < m_numOfGaussian; j++)
-          {
-          m_latent[i][j] = m_tmp1[j] / sum;
-          m_sum[j] += m_latent[i][j];
-          }
-        }
-        */
+      const double *lat = m_latent[i];
+      for (int j = 0; j < ng; j++)
+        mom[j*n+k] += lat[j] * xk[i];
       }
     }
-  else
-    {
-    /**= THIS IS NOT USED
-    for (int i = 0; i < m_numOfData; i++)
-      {
-      sum = 0;
-      for (int j = 0; j < m_numOfGaussian; j++)
-        {
-        m_tmp1[j] = m_prior[i][j] * m_pdf[i][j];
-        sum += m_tmp1[j];
-        }
-      for (int j = 0; j < m_numOfGaussian; j++)
-        {
-        m_latent[i][j] = m_tmp1[j] / sum;
-        m_sum[j] += m_latent[i][j];
-        }
-      }
-      */
-    }
 }
 
 void EMGaussianMixtures::UpdateMean(void)
 {
-  for (int i = 0; i < m_numOfGaussian; i++)
+  int n = m_dimOfGaussian, ng = m_numOfGaussian;
+  ExecuteThreadedStep(MEAN_STEP);
+
+  for (int i = 0; i < ng; i++)
     {
-    for (int j = 0; j < m_dimOfGaussian; j++)
+    for (int j = 0; j < n; j++)
       {
       m_tmp2[j] = 0;
-      }
-    
-    for (int j = 0; j < m_numOfData; j++)
-      {
-      for (int k = 0; k < m_dimOfGaussian; k++)
-        {
-        m_tmp2[k] += m_latent[j][i] * m_x[j][k];
-        }
+      for (int t = 0; t < m_NumberOfThreads; t++)
+        m_tmp2[j] += m_ThreadMoments[t * ng * n * n + i * n + j];
       }
 
     // This can lead to a possible divide by zero situation. In case the sum
@@ -357,70 +454,102 @@ void EMGaussianMixtures::UpdateMean(void)
     // to infinity
     if(m_sum[i] > 0)
       {
-      for (int j = 0; j < m_dimOfGaussian; j++)
+      for (int j = 0; j < n; j++)
         {
         m_tmp2[j] = m_tmp2[j] / m_sum[i];
         }
       }
     else
       {
-      for (int j = 0; j < m_dimOfGaussian; j++)
+      for (int j = 0; j < n; j++)
         {
         m_tmp2[j] = - std::numeric_limits<double>::infinity();
         }
       }
 
 
-    m_gmm->SetMean(i, VectorType(m_tmp2, m_dimOfGaussian));
+    m_gmm->SetMean(i, VectorType(m_tmp2, n));
     }
 }
 
-void EMGaussianMixtures::UpdateCovariance(void)
+void EMGaussianMixtures::ThreadedCovarianceStep(int thread, int i0, int i1)
 {
-  for (int i = 0; i < m_numOfGaussian; i++)
+  int n = m_dimOfGaussian, ng = m_numOfGaussian;
+  double *mom = &m_ThreadMoments[thread * ng * n * n];
+  for (int j = 0; j < ng * n * n; j++)
+    mom[j] = 0.0;
+
+  // Accumulate sum_i latent[i][j] * (x[i] - mean[j]) (x[i] - mean[j])^T, only
+  // the lower triangle is computed
+  std::vector<double> dx(n);
+  for (int i = i0; i < i1; i++)
     {
-    const VectorType &current_mean = m_gmm->GetMean(i);
-    
-    for (int j = 0; j < m_dimOfGaussian; j++)
+    const double *lat = m_latent[i];
+    for (int j = 0; j < ng; j++)
       {
-      for (int k = 0; k < m_dimOfGaussian; k++)
+      double w = lat[j];
+      if (w == 0)
+        continue;
+
+      const double *mean = &m_Means[j*n];
+      for (int k = 0; k < n; k++)
+        dx[k] = m_X[(size_t) k * m_numOfData + i] - mean[k];
+
+      double *mj = mom + j * n * n;
+      for (int k = 0; k < n; k++)
         {
-        m_tmp3[j*m_dimOfGaussian+k] = 0;
+        double wdk = w * dx[k];
+        for (int l = 0; l <= k; l++)
+          mj[k*n+l] += wdk * dx[l];
         }
       }
-    
-    for (int j = 0; j < m_numOfData; j++)
+    }
+}
+
+void EMGaussianMixtures::UpdateCovariance(void)
+{
+  int n = m_dimOfGaussian, ng = m_numOfGaussian;
+
+  // The covariance is computed about the updated means
+  for (int i = 0; i < ng; i++)
+    {
+    const VectorType &current_mean = m_gmm->GetMean(i);
+    for (int k = 0; k < n; k++)
+      m_Means[i*n+k] = current_mean[k];
+    }
+
+  ExecuteThreadedStep(COVARIANCE_STEP);
+
+  for (int i = 0; i < ng; i++)
+    {
+    for (int k = 0; k < n; k++)
       {
-      for (int k = 0; k < m_dimOfGaussian; k++)
+      for (int l = 0; l <= k; l++)
         {
-        m_tmp2[k] = m_x[j][k] - current_mean[k];
-        }
-      for (int k = 0; k < m_dimOfGaussian; k++)
-        {
-        for (int l = 0; l < m_dimOfGaussian; l++)
-          {
-          m_tmp3[k*m_dimOfGaussian+l] += m_tmp2[k] * m_tmp2[l] * m_latent[j][i];
-          }
+        double v = 0;
+        for (int t = 0; t < m_NumberOfThreads; t++)
+          v += m_ThreadMoments[t * ng * n * n + i * n * n + k * n + l];
+        m_tmp3[k*n+l] = m_tmp3[l*n+k] = v;
         }
       }
 
     if(m_sum[i] > 0)
       {
-      for (int j = 0; j < m_dimOfGaussian*m_dimOfGaussian; j++)
+      for (int j = 0; j < n*n; j++)
         {
         m_tmp3[j] = m_tmp3[j] / m_sum[i];
         }
       }
     else
       {
-      for (int j = 0; j < m_dimOfGaussian*m_dimOfGaussian; j++)
+      for (int j = 0; j < n*n; j++)
         {
         m_tmp3[j] = 0.0;
         }
       }
 
 
-    m_gmm->SetCovariance(i, MatrixType(m_tmp3, m_dimOfGaussian, m_dimOfGaussian));
+    m_gmm->SetCovariance(i, MatrixType(m_tmp3, n, n));
     }
 }
 
@@ -434,35 +563,7 @@ void EMGaussianMixtures::UpdateWeight(void)
 
 double EMGaussianMixtures::EvaluateLogLikelihood(void)
 {
-  double tmp1 = 0;
-  double tmp2 = 0;
-  if (m_setPriorFlag == 0)
-    {
-    for (int i = 0; i < m_numOfData; i++)
-      {
-      tmp1 = 0;
-      for (int j = 0; j < m_numOfGaussian; j++)
-        {
-        if(!m_gmm->GetGaussian(j)->isDeltaFunction())
-          tmp1 += m_weight[j] * exp(m_log_pdf[i][j]);
-        }
-      tmp2 += log(tmp1);
-      }
-    }
-  else
-    {
-    for (int i = 0; i < m_numOfData; i++)
-      {
-      tmp1 = 0;
-      for (int j = 0; j < m_numOfGaussian; j++)
-        {
-        if(!m_gmm->GetGaussian(j)->isDeltaFunction())
-          tmp1 += m_prior[i][j] * exp(m_log_pdf[i][j]);
-        }
-      tmp2 += log(tmp1);
-      }
-    }
-  return tmp1;
+  return m_lastLogLikelihood;
 }
 
 void EMGaussianMixtures::PrintParameters(void)
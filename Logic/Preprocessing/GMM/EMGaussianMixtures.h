@@ -3,7 +3,16 @@
 
 #include "GaussianMixtureModel.h"
 #include "SNAPCommon.h"
+#include <itkMultiThreader.h>
+#include <vector>
 
+/**
+ * Expectation-maximization for Gaussian mixture models. The samples are
+ * copied into a contiguous component-major (struct of arrays) buffer, and
+ * the log-densities are computed in blocks of samples using the Cholesky
+ * factor of each covariance matrix, which is computed once per iteration.
+ * The E-step and the sums in the M-step are split between threads.
+ */
 class EMGaussianMixtures
 {
 public:
@@ -31,17 +40,54 @@ public:
 
   double ** Update(void);
   double ** UpdateOnce(void);
+  // Log likelihood of the data under the parameters used in the last E-step
   double EvaluateLogLikelihood(void);
   void PrintParameters(void);
 
   static double ComputePosterior(int nGauss, double *log_pdf, double *w, double *log_w, int j);
 
 private:
+  // The E-step: computes the log-densities, the log-likelihood, the
+  // posteriors and the per-class sums of posteriors
   void EvaluatePDF(void);
-  void UpdateLatent(void);
   void UpdateMean(void);
   void UpdateCovariance(void);
   void UpdateWeight(void);
+
+  // Steps of the algorithm that are performed in parallel
+  enum ThreadedStep { ESTEP, MEAN_STEP, COVARIANCE_STEP };
+
+  // Run a step over all samples, split between threads
+  void ExecuteThreadedStep(ThreadedStep step);
+  static ITK_THREAD_RETURN_TYPE ThreadCallback(void *arg);
+
+  // Per-thread work for each step, on the samples in [i0, i1)
+  void ThreadedEStep(int thread, int i0, int i1);
+  void ThreadedMeanStep(int thread, int i0, int i1);
+  void ThreadedCovarianceStep(int thread, int i0, int i1);
+
+  // Compute the Cholesky factor of each covariance matrix
+  void PrecomputeGaussians(void);
+
+  // The samples in component-major order, i.e., m_X[k * m_numOfData + i]
+  std::vector<double> m_X;
+
+  // For each Gaussian: whether the covariance is positive definite, in which
+  // case the Cholesky factor (row-major) and log-normalization constant are
+  // used; otherwise the density is computed by the Gaussian class
+  std::vector<bool> m_UseCholesky, m_IsDelta;
+  std::vector<double> m_CholeskyFactor, m_LogNormFactor, m_Means;
+
+  // Per-thread partial sums
+  std::vector<double> m_ThreadSum, m_ThreadLogLikelihood, m_ThreadMoments;
+
+  // The threader and the step being executed
+  SmartPtr<itk::MultiThreader> m_Threader;
+  ThreadedStep m_CurrentStep;
+  int m_NumberOfThreads;
+
+  // Log-likelihood computed in the last E-step
+  double m_lastLogLikelihood;
   
   double **m_latent;
   double **m_log_pdf;
@@ -49,7 +95,6 @@ private:
   double **m_x;
   double *m_probs;
   double *m_probs2;
-  double *m_tmp1;
   double *m_tmp2;
   double *m_tmp3;
   double *m_sum;
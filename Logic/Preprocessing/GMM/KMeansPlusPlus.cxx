@@ -2,15 +2,24 @@
 #include "math.h"
 #include "time.h"
 #include "stdlib.h"
+#include <algorithm>
+#include <limits>
 
 KMeansPlusPlus::KMeansPlusPlus(double **x, int dataSize, int dataDim, int numOfClusters)
   :m_dataSize(dataSize), m_dataDim(dataDim), m_numOfClusters(numOfClusters)
 {
   m_x = x;
   m_xCenter = new int[dataSize];
-  m_centers = new int[numOfClusters];
   m_xCounter = new int[numOfClusters];
   m_distance = new double[dataSize];
+  m_centers.resize(numOfClusters * dataDim);
+
+  m_numOfMiniBatchIterations = 0;
+  m_miniBatchSize = 1000;
+
+  m_threader = itk::MultiThreader::New();
+  m_numOfThreads = m_threader->GetNumberOfThreads();
+  m_threadDistSum.resize(m_numOfThreads);
 
   m_gmm = GaussianMixtureModel::New();
   m_gmm->Initialize(dataDim, numOfClusters);
@@ -18,10 +27,9 @@ KMeansPlusPlus::KMeansPlusPlus(double **x, int dataSize, int dataDim, int numOfC
 
 KMeansPlusPlus::~KMeansPlusPlus()
 {
-  delete m_centers;
-  delete m_xCenter;
-  delete m_xCounter;
-  delete m_distance;
+  delete[] m_xCenter;
+  delete[] m_xCounter;
+  delete[] m_distance;
 }
 
 double KMeansPlusPlus::Distance(const double *x, const double *y)
@@ -34,97 +42,178 @@ double KMeansPlusPlus::Distance(const double *x, const double *y)
   return sqrt(tmp);
 }
 
-void KMeansPlusPlus::Initialize(void)
+void KMeansPlusPlus::ExecuteThreadedStep(ThreadedStep step)
+{
+  m_currentStep = step;
+  m_threader->SetNumberOfThreads(m_numOfThreads);
+  m_threader->SetSingleMethod(&KMeansPlusPlus::ThreadCallback, this);
+  m_threader->SingleMethodExecute();
+}
+
+ITK_THREAD_RETURN_TYPE KMeansPlusPlus::ThreadCallback(void *arg)
 {
-  // for (int i = 0; i < numOfClusters; i++)
-  // {
-  //   m_xCounter[i] = 0;
-  // }
+  typedef itk::MultiThreader::ThreadInfoStruct ThreadInfo;
+  ThreadInfo *info = static_cast<ThreadInfo *>(arg);
+  KMeansPlusPlus *self = static_cast<KMeansPlusPlus *>(info->UserData);
 
-  srand(time(0));
+  // The range of samples handled by this thread
+  int thread = info->ThreadID, nThreads = info->NumberOfThreads;
+  int i0 = (int) (((long long) self->m_dataSize * thread) / nThreads);
+  int i1 = (int) (((long long) self->m_dataSize * (thread + 1)) / nThreads);
 
-  m_centers[0] = (int)(((double) rand() / (double) RAND_MAX) * m_dataSize);
   double distSum = 0;
-  for (int i = 0; i < m_dataSize; i++)
+  if (self->m_currentStep == ADD_CENTER)
     {
-    m_xCenter[i] = m_centers[0];
-    m_distance[i] = Distance(m_x[i], m_x[m_centers[0]]);
-    distSum += m_distance[i];
+    // Update the distance to the nearest center with the new center
+    int c = self->m_newCenter;
+    const double *center = &self->m_centers[c * self->m_dataDim];
+    for (int j = i0; j < i1; j++)
+      {
+      double dist = self->Distance(self->m_x[j], center);
+      if (self->m_distance[j] > dist)
+        {
+        self->m_distance[j] = dist;
+        self->m_xCenter[j] = c;
+        }
+      distSum += self->m_distance[j];
+      }
     }
-  m_xCounter[0] = m_dataSize;
-
-  double probDist = 0;
-  double currentSum = 0;
-  int idx = 0;
-  for (int i = 1; i < m_numOfClusters; i++)
+  else
     {
-    m_xCounter[i] = 0;
-    probDist = ((double) rand() / (double) RAND_MAX) * distSum;
-    currentSum = 0;
-    for (idx = 0; idx < m_dataSize; idx++)
+    // Assign each sample to the nearest center
+    for (int j = i0; j < i1; j++)
       {
-      currentSum += m_distance[idx];
-      if (currentSum >= probDist)
+      self->m_distance[j] = std::numeric_limits<double>::infinity();
+      for (int c = 0; c < self->m_numOfClusters; c++)
         {
-        break;
+        double dist = self->Distance(self->m_x[j], &self->m_centers[c * self->m_dataDim]);
+        if (self->m_distance[j] > dist)
+          {
+          self->m_distance[j] = dist;
+          self->m_xCenter[j] = c;
+          }
         }
+      distSum += self->m_distance[j];
       }
+    }
 
-    m_centers[i] = idx;
+  self->m_threadDistSum[thread] = distSum;
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+void KMeansPlusPlus::RefineCenters(void)
+{
+  // Mini-batch k-means (Sculley, 2010): each sample in a batch moves its
+  // nearest center towards it with a rate that decreases with the number of
+  // samples that have been assigned to the center so far
+  std::vector<int> counts(m_numOfClusters, 0);
+  int batch = std::min(m_miniBatchSize, m_dataSize);
+  std::vector<int> samples(batch), nearest(batch);
 
-    distSum = 0;
-    for (int j = 0; j < m_dataSize; j++)
+  for (int iter = 0; iter < m_numOfMiniBatchIterations; iter++)
+    {
+    for (int b = 0; b < batch; b++)
       {
-      if (m_distance[j] > Distance(m_x[j], m_x[m_centers[i]]))
+      samples[b] = std::min((int)(((double) rand() / (double) RAND_MAX) * m_dataSize), m_dataSize - 1);
+
+      double best = std::numeric_limits<double>::infinity();
+      for (int c = 0; c < m_numOfClusters; c++)
         {
-        ++m_xCounter[i];
-        for (int k = 0; k < i; k++)
+        double dist = Distance(m_x[samples[b]], &m_centers[c * m_dataDim]);
+        if (dist < best)
           {
-          if (m_centers[k] == m_xCenter[j])
-            {
-            --m_xCounter[k];
-            break;
-            }
+          best = dist;
+          nearest[b] = c;
           }
-        m_distance[j] = Distance(m_x[j], m_x[m_centers[i]]);
-        m_xCenter[j] = m_centers[i];
         }
-      distSum += m_distance[j];
+      }
+
+    for (int b = 0; b < batch; b++)
+      {
+      int c = nearest[b];
+      double eta = 1.0 / (++counts[c]);
+      double *center = &m_centers[c * m_dataDim];
+      for (int k = 0; k < m_dataDim; k++)
+        center[k] = (1.0 - eta) * center[k] + eta * m_x[samples[b]][k];
       }
     }
+}
 
-  Gaussian::VectorType tmpMean(m_dataDim, 0.0);
-  for (int i = 0; i < m_numOfClusters; i++)
+void KMeansPlusPlus::Initialize(void)
+{
+  srand(time(0));
+
+  // Pick the first center at random
+  int first = std::min((int)(((double) rand() / (double) RAND_MAX) * m_dataSize), m_dataSize - 1);
+  std::copy(m_x[first], m_x[first] + m_dataDim, m_centers.begin());
+  for (int i = 0; i < m_dataSize; i++)
     {
-    m_gmm->SetMean(i, tmpMean);
+    m_distance[i] = std::numeric_limits<double>::infinity();
+    m_xCenter[i] = 0;
     }
+  m_newCenter = 0;
+  ExecuteThreadedStep(ADD_CENTER);
 
-  for (int i = 0; i < m_dataSize; i++)
+  for (int i = 1; i < m_numOfClusters; i++)
     {
-    for (int j = 0; j < m_numOfClusters; j++)
+    // Pick the next center with probability proportional to the distance
+    // to the nearest center. First find the range of samples of the thread
+    // in which the cumulative distance is reached, then scan that range.
+    double distSum = 0;
+    for (int t = 0; t < m_numOfThreads; t++)
+      distSum += m_threadDistSum[t];
+
+    double probDist = ((double) rand() / (double) RAND_MAX) * distSum;
+    double currentSum = 0;
+    int t = 0;
+    while (t < m_numOfThreads - 1 && currentSum + m_threadDistSum[t] < probDist)
+      currentSum += m_threadDistSum[t++];
+
+    int i0 = (int) (((long long) m_dataSize * t) / m_numOfThreads);
+    int i1 = (int) (((long long) m_dataSize * (t + 1)) / m_numOfThreads);
+    int idx = std::min(std::max(i0, i1 - 1), m_dataSize - 1);
+    for (int j = i0; j < i1; j++)
       {
-      if (m_xCenter[i] == m_centers[j])
+      currentSum += m_distance[j];
+      if (currentSum >= probDist)
         {
-        tmpMean = m_gmm->GetMean(j);
-        for (int k = 0; k < m_dataDim; k++)
-          {
-          tmpMean[k] = tmpMean[k] + m_x[i][k];
-          }
-        m_gmm->SetMean(j, tmpMean);
+        idx = j;
         break;
         }
       }
+
+    std::copy(m_x[idx], m_x[idx] + m_dataDim, m_centers.begin() + i * m_dataDim);
+    m_newCenter = i;
+    ExecuteThreadedStep(ADD_CENTER);
     }
-  // m_gmm->PrintParameters();
-  // getchar();
-  for (int i = 0; i < m_numOfClusters; i++)
+
+  // Refine the centers and reassign the samples to them
+  if (m_numOfMiniBatchIterations > 0)
     {
-    tmpMean = m_gmm->GetMean(i);
+    RefineCenters();
+    ExecuteThreadedStep(ASSIGN);
+    }
 
+  // Compute the means of the clusters
+  std::vector<double> sums(m_numOfClusters * m_dataDim, 0.0);
+  for (int j = 0; j < m_numOfClusters; j++)
+    m_xCounter[j] = 0;
+  for (int i = 0; i < m_dataSize; i++)
+    {
+    int c = m_xCenter[i];
+    ++m_xCounter[c];
+    for (int k = 0; k < m_dataDim; k++)
+      sums[c * m_dataDim + k] += m_x[i][k];
+    }
+
+  Gaussian::VectorType tmpMean(m_dataDim, 0.0);
+  for (int i = 0; i < m_numOfClusters; i++)
+    {
     if(m_xCounter[i] > 0)
       {
       // If this class is not empty, we set its mean
-      tmpMean /= m_xCounter[i];
+      for (int k = 0; k < m_dataDim; k++)
+        tmpMean[k] = sums[i * m_dataDim + k] / m_xCounter[i];
       }
     else
       {
@@ -142,17 +231,11 @@ void KMeansPlusPlus::Initialize(void)
     }
   for (int i = 0; i < m_dataSize; i++)
     {
-    for (int j = 0; j < m_numOfClusters; j++)
+    int c = m_xCenter[i];
+    double dist = Distance(m_x[i], m_gmm->GetMean(c).data_block());
+    if (radius[c] < dist)
       {
-      if (m_xCenter[i] == m_centers[j])
-        {
-        double dist = Distance(m_x[i], m_gmm->GetMean(j).data_block());
-        if (radius[j] < dist)
-          {
-          radius[j] = dist;
-          }
-        break;
-        }
+      radius[c] = dist;
       }
     }
 
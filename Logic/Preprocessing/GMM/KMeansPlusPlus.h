@@ -3,7 +3,16 @@
 
 #include "GaussianMixtureModel.h"
 #include "SNAPCommon.h"
+#include <itkMultiThreader.h>
+#include <vector>
 
+/**
+ * Initialization of a Gaussian mixture model using k-means++ seeding. The
+ * distances from the samples to the nearest center are updated in parallel
+ * after each new center is chosen. Optionally, the centers are then refined
+ * by mini-batch k-means, which only looks at a small random subset of the
+ * samples in each iteration.
+ */
 class KMeansPlusPlus
 {
 public:
@@ -13,16 +22,49 @@ public:
   double Distance(const double *x, const double *y);
   void Initialize(void);
   GaussianMixtureModel * GetGaussianMixtureModel(void);
+
+  /** Number of mini-batch k-means iterations after seeding (default 0) */
+  void SetNumberOfMiniBatchIterations(int n) { m_numOfMiniBatchIterations = n; }
+  int GetNumberOfMiniBatchIterations() const { return m_numOfMiniBatchIterations; }
+
+  /** Number of samples in each mini-batch (default 1000) */
+  void SetMiniBatchSize(int n) { m_miniBatchSize = n; }
+  int GetMiniBatchSize() const { return m_miniBatchSize; }
+
 private:
+
+  // Steps of the algorithm that are performed in parallel
+  enum ThreadedStep { ADD_CENTER, ASSIGN };
+
+  void ExecuteThreadedStep(ThreadedStep step);
+  static ITK_THREAD_RETURN_TYPE ThreadCallback(void *arg);
+
+  // Refine the centers using mini-batch k-means
+  void RefineCenters(void);
+
   double **m_x;
   int *m_xCenter;
-  int *m_centers;
   int *m_xCounter;
   double *m_distance;
   int m_dataSize;
   int m_dataDim;
   int m_numOfClusters;
+  int m_numOfMiniBatchIterations;
+  int m_miniBatchSize;
   SmartPtr<GaussianMixtureModel> m_gmm;
+
+  // The cluster centers, row-major
+  std::vector<double> m_centers;
+
+  // The center added in the ADD_CENTER step
+  int m_newCenter;
+
+  // Per-thread sums of the distances
+  std::vector<double> m_threadDistSum;
+
+  SmartPtr<itk::MultiThreader> m_threader;
+  ThreadedStep m_currentStep;
+  int m_numOfThreads;
 };
 
 #endif
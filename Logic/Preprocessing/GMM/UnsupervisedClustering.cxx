@@ -6,7 +6,10 @@
 #include "ImageWrapper.h"
 #include "ImageWrapperTraits.h"
 
+#include <itkMultiThreader.h>
+#include <itkMersenneTwisterRandomVariateGenerator.h>
 #include <algorithm>
+#include <set>
 
 UnsupervisedClustering::UnsupervisedClustering()
 {
@@ -14,6 +17,7 @@ UnsupervisedClustering::UnsupervisedClustering()
   m_NumberOfClusters = 3;
   m_DataArray = NULL;
   m_NumberOfSamples = 0;
+  m_NumberOfMiniBatchIterations = 0;
 }
 
 UnsupervisedClustering::~UnsupervisedClustering()
@@ -27,10 +31,10 @@ UnsupervisedClustering::~UnsupervisedClustering()
   if(m_DataArray)
     {
     // Delete the main data buffer
-    delete m_DataArray[0];
+    delete[] m_DataArray[0];
 
     // Delete the pointers into the buffer
-    delete m_DataArray;
+    delete[] m_DataArray;
     }
 
 
@@ -55,31 +59,102 @@ void UnsupervisedClustering::SetMixtureModel(GaussianMixtureModel *model)
   m_MixtureModel = m_ClusteringEM->GetGaussianMixtureModel();
 }
 
-#include "itkImageRandomConstIteratorWithIndex.hxx"
+// Data shared by the threads that read the sampled voxels
+struct UnsupervisedClusteringSampleData
+{
+  // Each layer, its number of components, and its voxel buffer. The buffer
+  // is NULL for layers that are not on the voxel grid of the speed image
+  std::vector<ImageWrapperBase *> Layers;
+  std::vector<int> Components;
+  std::vector<const GreyType *> Buffers;
+
+  std::vector<itk::OffsetValueType> Offsets;
+  const itk::ImageBase<3> *Image;
+  double **DataArray;
+};
+
+// Thread callback that reads a range of the sampled voxels. The threads only
+// read the image buffers, because the voxel access methods of the wrappers
+// go through the shared slicing pipeline
+static ITK_THREAD_RETURN_TYPE UnsupervisedClusteringSampleThreadCallback(void *arg)
+{
+  typedef itk::MultiThreader::ThreadInfoStruct ThreadInfo;
+  ThreadInfo *info = static_cast<ThreadInfo *>(arg);
+  UnsupervisedClusteringSampleData *data =
+      static_cast<UnsupervisedClusteringSampleData *>(info->UserData);
+
+  size_t n = data->Offsets.size();
+  size_t i0 = (n * info->ThreadID) / info->NumberOfThreads;
+  size_t i1 = (n * (info->ThreadID + 1)) / info->NumberOfThreads;
+  for(size_t i = i0; i < i1; i++)
+    {
+    double *out = data->DataArray[i];
+    for(size_t k = 0; k < data->Layers.size(); k++)
+      {
+      int nc = data->Components[k];
+      if(data->Buffers[k])
+        {
+        const GreyType *p = data->Buffers[k] + data->Offsets[i] * nc;
+        for(int c = 0; c < nc; c++)
+          out[c] = p[c];
+        }
+      out += nc;
+      }
+    }
+
+  return ITK_THREAD_RETURN_VALUE;
+}
 
 void UnsupervisedClustering::SampleDataSource()
 {
   if(m_DataArray)
     {
     // Delete the main data buffer
-    delete m_DataArray[0];
+    delete[] m_DataArray[0];
 
     // Delete the pointers into the buffer
-    delete m_DataArray;
+    delete[] m_DataArray;
     }
 
-  // Figure out the number of data components
+  // The samples are drawn from the voxels of the speed image, which should be
+  // initialized at this point. We use the speed image because we can easily
+  // access its internal image (it's always a scalar image)
+  assert(m_DataSource->IsSpeedLoaded());
+  typedef SpeedImageWrapper::ImageType SpeedImage;
+  SpeedImage *speed = m_DataSource->GetSpeed()->GetImage();
+
+  // Figure out the number of data components, and find the buffers of the
+  // layers that can be read directly
+  typedef itk::Image<GreyType, 3> GreyImageType;
+  typedef itk::VectorImage<GreyType, 3> GreyVectorImageType;
+  UnsupervisedClusteringSampleData sdata;
   unsigned int nComp = 0;
   for(LayerIterator lit = m_DataSource->GetLayers(
         MAIN_ROLE | OVERLAY_ROLE);
       !lit.IsAtEnd(); ++lit)
     {
-    nComp += lit.GetLayer()->GetNumberOfComponents();
+    ImageWrapperBase *layer = lit.GetLayer();
+    const GreyType *buffer = NULL;
+    if(layer->IsSlicingOrthogonal()
+       && layer->GetImageBase()->GetBufferedRegion() == speed->GetBufferedRegion())
+      {
+      GreyImageType *img = dynamic_cast<GreyImageType *>(layer->GetImageBase());
+      GreyVectorImageType *vimg = dynamic_cast<GreyVectorImageType *>(layer->GetImageBase());
+      if(img)
+        buffer = img->GetBufferPointer();
+      else if(vimg)
+        buffer = vimg->GetBufferPointer();
+      }
+
+    sdata.Layers.push_back(layer);
+    sdata.Components.push_back(layer->GetNumberOfComponents());
+    sdata.Buffers.push_back(buffer);
+    nComp += layer->GetNumberOfComponents();
     }
 
   // Size the data array
   int nvox = m_DataSource->GetMain()->GetNumberOfVoxels();
-  int nsam = (m_NumberOfSamples == 0) ? nvox : m_NumberOfSamples;
+  int nsam = (m_NumberOfSamples == 0 || m_NumberOfSamples > nvox) ? nvox : m_NumberOfSamples;
 
   // Create data structure for the EM code
   m_DataArray = new double *[nsam];
@@ -87,49 +162,70 @@ void UnsupervisedClustering::SampleDataSource()
   for(int i = 0; i < nsam; i++, buffer+=nComp)
     m_DataArray[i] = buffer;
 
-  // Create a random walk through the speed image, which should be initialized
-  // at this point. We iterate over the speed image because we can easily access
-  // its internal image (it's always a scalar image)
-  assert(m_DataSource->IsSpeedLoaded());
-  typedef SpeedImageWrapper::ImageType SpeedImage;
+  sdata.Image = speed;
+  sdata.DataArray = m_DataArray;
 
-  SpeedImage *speed = m_DataSource->GetSpeed()->GetImage();
-  typedef itk::ImageRandomConstIteratorWithIndex<SpeedImage> RandomIter;
-  RandomIter itRand(speed, speed->GetBufferedRegion());
-  itRand.SetNumberOfSamples(nsam);
-
-  // Initialize the 'central' samples list
-  m_CenterSamples.clear();
-  m_CenterSamples.reserve(400);
-
-  // Define the center region
-  itk::ImageRegion<3> rcenter = speed->GetBufferedRegion();
-  rcenter.ShrinkByRadius(to_itkSize(Vector3d(rcenter.GetSize()) * 0.2));
-
-  // Do the random walk
-  int pVoxel = 0;
-  for(; !itRand.IsAtEnd(); ++itRand)
+  // Draw the voxels to sample uniformly and without replacement (Floyd's
+  // algorithm). Sorting them makes the image reads below roughly sequential.
+  typedef itk::Statistics::MersenneTwisterRandomVariateGenerator RandomGenerator;
+  RandomGenerator::Pointer rng = RandomGenerator::New();
+  rng->Initialize();
+  if(nsam < nvox)
     {
-    // Go to the next sample location
-    itk::Index<3> idx = itRand.GetIndex();
-
-    // TODO: this is a really slow way to collect samples!
-    int iOffset = 0;
-    for(LayerIterator lit = m_DataSource->GetLayers(MAIN_ROLE | OVERLAY_ROLE);
-        !lit.IsAtEnd(); ++lit)
+    std::set<itk::OffsetValueType> selected;
+    for(itk::OffsetValueType j = nvox - nsam; j < nvox; j++)
       {
-      ImageWrapperBase *iw = lit.GetLayer();
-      iw->GetVoxelAsDouble(idx, m_DataArray[pVoxel] + iOffset);
-      iOffset += iw->GetNumberOfComponents();
+      itk::OffsetValueType t = rng->GetIntegerVariate(j);
+      if(!selected.insert(t).second)
+        selected.insert(j);
       }
+    sdata.Offsets.assign(selected.begin(), selected.end());
+    }
+  else
+    {
+    sdata.Offsets.resize(nvox);
+    for(int j = 0; j < nvox; j++)
+      sdata.Offsets[j] = j;
+    }
+
+  // Read the sampled voxels from all layers, splitting them between threads
+  itk::MultiThreader::Pointer threader = itk::MultiThreader::New();
+  threader->SetSingleMethod(UnsupervisedClusteringSampleThreadCallback, &sdata);
+  threader->SingleMethodExecute();
 
-    // Store as a 'central' sample if in the central 60% of the image
-    if(m_CenterSamples.size() < 400 && rcenter.IsInside(idx))
+  // Layers that are resampled to the speed image grid are read through the
+  // wrapper, which is not thread-safe, so this is done on this thread
+  bool resampled = std::find(sdata.Buffers.begin(), sdata.Buffers.end(),
+                             (const GreyType *) NULL) != sdata.Buffers.end();
+  for(int i = 0; resampled && i < nsam; i++)
+    {
+    itk::Index<3> idx = speed->ComputeIndex(sdata.Offsets[i]);
+    double *out = m_DataArray[i];
+    for(size_t k = 0; k < sdata.Layers.size(); k++)
       {
-      m_CenterSamples.push_back(pVoxel);
+      if(!sdata.Buffers[k])
+        sdata.Layers[k]->GetVoxelAsDouble(idx, out);
+      out += sdata.Components[k];
       }
+    }
 
-    pVoxel++;
+  // Define the center region
+  itk::ImageRegion<3> rcenter = speed->GetBufferedRegion();
+  rcenter.ShrinkByRadius(to_itkSize(Vector3d(rcenter.GetSize()) * 0.2));
+
+  // Pick up to 400 random 'central' samples, i.e., samples in the central 60%
+  // of the image. The samples are in raster order, so they are shuffled.
+  std::vector<int> central;
+  for(int i = 0; i < nsam; i++)
+    if(rcenter.IsInside(speed->ComputeIndex(sdata.Offsets[i])))
+      central.push_back(i);
+
+  m_CenterSamples.clear();
+  for(int i = 0; i < (int) central.size() && i < 400; i++)
+    {
+    int j = i + rng->GetIntegerVariate(central.size() - 1 - i);
+    std::swap(central[i], central[j]);
+    m_CenterSamples.push_back(central[i]);
     }
 
   m_NumberOfVoxels = nsam;
@@ -185,6 +281,7 @@ void UnsupervisedClustering::InitializeEM()
         m_DataArray, m_NumberOfVoxels,
         m_NumberOfComponents, m_NumberOfClusters);
 
+  m_ClusteringInitializer->SetNumberOfMiniBatchIterations(m_NumberOfMiniBatchIterations);
   m_ClusteringInitializer->Initialize();
 
   m_ClusteringEM->SetGaussianMixtureModel(
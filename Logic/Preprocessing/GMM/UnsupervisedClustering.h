@@ -30,6 +30,12 @@ public:
 
   void SetNumberOfSamples(int nSamples);
 
+  /**
+   * Number of mini-batch k-means iterations used to refine the k-means++
+   * cluster centers before the EM starts. Zero (default) disables refinement.
+   */
+  irisGetSetMacro(NumberOfMiniBatchIterations, int)
+
   void InitializeClusters();
 
   void Iterate();
@@ -52,6 +58,8 @@ protected:
 
   int m_NumberOfClusters, m_NumberOfComponents, m_NumberOfVoxels, m_NumberOfSamples;
 
+  int m_NumberOfMiniBatchIterations;
+
   bool m_SamplesDirty;
 
   // TODO: probably double is larger than we need
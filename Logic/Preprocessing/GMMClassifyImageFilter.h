@@ -3,10 +3,20 @@
 
 #include "itkImageToImageFilter.h"
 #include "GaussianMixtureModel.h"
+#include <vector>
 
 /**
  * @brief A class that takes multiple multi-component images and uses a
  * Gaussian mixture model to combine them into a single probability map.
+ *
+ * When the inputs have one or two integer-valued components in total, the
+ * output is a function of a small discrete set of intensities. In that case
+ * the filter tabulates the output over the range of intensities present in
+ * the input and classifies each voxel with a table lookup. The range is taken
+ * over the whole input, not the region being generated, so that a streamed
+ * update uses the same table for all of its pieces. The range is recomputed
+ * only when the inputs are modified, and the table only when the mixture
+ * model or the range changes.
  */
 template <class TInputImage, class TInputVectorImage, class TOutputImage>
 class GMMClassifyImageFilter :
@@ -54,6 +64,9 @@ public:
   /** We need to override this method because of multiple input types */
   void GenerateInputRequestedRegion() ITK_OVERRIDE;
 
+  /** Whether the last update used the lookup table (for testing) */
+  itkGetConstMacro(UseLookupTable, bool)
+
 protected:
 
   GMMClassifyImageFilter();
@@ -61,10 +74,57 @@ protected:
 
   void PrintSelf(std::ostream& os, itk::Indent indent) const ITK_OVERRIDE;
 
+  void BeforeThreadedGenerateData() ITK_OVERRIDE;
+
   void ThreadedGenerateData(const OutputImageRegionType &outputRegionForThread,
                             itk::ThreadIdType threadId) ITK_OVERRIDE;
 
+  /** Compute the output value for a sample x (exact path) */
+  OutputPixelType ComputeOutput(vnl_vector<double> &x,
+                                vnl_vector<double> &x_scratch,
+                                vnl_vector<double> &log_pdf);
+
+  /** Decide whether to use the lookup table and (re)build it if needed */
+  void UpdateLookupTable();
+
+  /** Flatten the model parameters, to detect changes to the model */
+  void GetModelSignature(std::vector<double> &sig);
+
+  /** Compute the range of the input intensities, unless the inputs have not
+   * changed since the last time. Returns false if the range is unavailable */
+  bool UpdateIntensityRange(int nComp);
+
+  static ITK_THREAD_RETURN_TYPE LookupTableThreadCallback(void *arg);
+
+  static ITK_THREAD_RETURN_TYPE IntensityRangeThreadCallback(void *arg);
+
   GaussianMixtureModel *m_MixtureModel;
+
+  // Weights of the Gaussians and their signs (1 foreground, -1 background)
+  vnl_vector<double> m_Weight, m_LogWeight, m_PFactor;
+
+  // Lookup table over the intensities [min, min + size) of up to two
+  // components, stored with the first component varying fastest
+  std::vector<OutputPixelType> m_LookupTable;
+  long m_LookupMin[2];
+  long m_LookupSize[2];
+  bool m_UseLookupTable;
+
+  // Model parameters from which the lookup table was computed
+  std::vector<double> m_LookupModelSignature;
+
+  // Range of the intensities of up to two components over m_RangeRegion,
+  // computed when the inputs were last modified at m_RangeMTime
+  long m_RangeMin[2], m_RangeMax[2];
+  InputImageRegionType m_RangeRegion;
+  itk::ModifiedTimeType m_RangeMTime;
+  int m_RangeComponents;
+
+  // Per-thread ranges, merged after the parallel pass
+  std::vector<long> m_ThreadRangeMin, m_ThreadRangeMax;
+
+  // Maximum number of entries in the lookup table
+  static const long MAX_LOOKUP_TABLE_SIZE = 1L << 22;
 };
 
 #ifndef ITK_MANUAL_INSTANTIATION
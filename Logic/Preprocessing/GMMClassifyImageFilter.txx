@@ -5,12 +5,22 @@
 #include "itkImageRegionConstIterator.h"
 #include "EMGaussianMixtures.h"
 #include "ImageCollectionToImageFilter.h"
+#include "itkMultiThreader.h"
+#include <limits>
+#include <algorithm>
 
 template <class TInputImage, class TInputVectorImage, class TOutputImage>
 GMMClassifyImageFilter<TInputImage, TInputVectorImage, TOutputImage>
 ::GMMClassifyImageFilter()
 {
   m_MixtureModel = NULL;
+  m_UseLookupTable = false;
+  m_LookupMin[0] = m_LookupMin[1] = 0;
+  m_LookupSize[0] = m_LookupSize[1] = 1;
+  m_RangeMin[0] = m_RangeMin[1] = 0;
+  m_RangeMax[0] = m_RangeMax[1] = -1;
+  m_RangeMTime = 0;
+  m_RangeComponents = 0;
 }
 
 template <class TInputImage, class TInputVectorImage, class TOutputImage>
@@ -24,7 +34,9 @@ void
 GMMClassifyImageFilter<TInputImage, TInputVectorImage, TOutputImage>
 ::SetMixtureModel(GaussianMixtureModel *model)
 {
+  // The lookup table is recomputed on the next update
   m_MixtureModel = model;
+  m_LookupModelSignature.clear();
   this->Modified();
 }
 
@@ -81,6 +93,270 @@ GMMClassifyImageFilter<TInputImage, TInputVectorImage, TOutputImage>
   os << indent << "GMMClassifyImageFilter" << std::endl;
 }
 
+template <class TInputImage, class TInputVectorImage, class TOutputImage>
+typename GMMClassifyImageFilter<TInputImage, TInputVectorImage, TOutputImage>::OutputPixelType
+GMMClassifyImageFilter<TInputImage, TInputVectorImage, TOutputImage>
+::ComputeOutput(vnl_vector<double> &x, vnl_vector<double> &x_scratch, vnl_vector<double> &log_pdf)
+{
+  int nGauss = m_MixtureModel->GetNumberOfGaussians();
+
+  // Evaluate the posterior probability robustly
+  for(int k = 0; k < nGauss; k++)
+    {
+    log_pdf[k] = m_MixtureModel->EvaluateLogPDF(k, x, x_scratch);
+    }
+
+  // Evaluate the GMM for each of the clusters
+  double pdiff = 0;
+  for(int k = 0; k < nGauss; k++)
+    {
+    double p = EMGaussianMixtures::ComputePosterior(
+          nGauss, log_pdf.data_block(), m_Weight.data_block(), m_LogWeight.data_block(), k);
+
+    pdiff += p * m_PFactor[k];
+    }
+
+  return (OutputPixelType)(pdiff * 0x7fff);
+}
+
+template <class TInputImage, class TInputVectorImage, class TOutputImage>
+void
+GMMClassifyImageFilter<TInputImage, TInputVectorImage, TOutputImage>
+::GetModelSignature(std::vector<double> &sig)
+{
+  sig.clear();
+  for(int k = 0; k < m_MixtureModel->GetNumberOfGaussians(); k++)
+    {
+    sig.push_back(m_MixtureModel->GetWeight(k));
+    sig.push_back(m_MixtureModel->IsForeground(k) ? 1.0 : 0.0);
+    const GaussianMixtureModel::VectorType &mean = m_MixtureModel->GetMean(k);
+    sig.insert(sig.end(), mean.begin(), mean.end());
+    const GaussianMixtureModel::MatrixType &cov = m_MixtureModel->GetCovariance(k);
+    sig.insert(sig.end(), cov.begin(), cov.end());
+    }
+}
+
+template <class TInputImage, class TInputVectorImage, class TOutputImage>
+ITK_THREAD_RETURN_TYPE
+GMMClassifyImageFilter<TInputImage, TInputVectorImage, TOutputImage>
+::LookupTableThreadCallback(void *arg)
+{
+  typedef itk::MultiThreader::ThreadInfoStruct ThreadInfo;
+  ThreadInfo *info = static_cast<ThreadInfo *>(arg);
+  Self *self = static_cast<Self *>(info->UserData);
+
+  // Each thread fills a range of rows of the table (values of the second
+  // component), or a range of entries if there is only one component
+  int nComp = self->m_MixtureModel->GetNumberOfComponents();
+  long nRows = self->m_LookupSize[1], rowSize = self->m_LookupSize[0];
+  if(nRows == 1)
+    std::swap(nRows, rowSize);
+
+  long r0 = (nRows * info->ThreadID) / info->NumberOfThreads;
+  long r1 = (nRows * (info->ThreadID + 1)) / info->NumberOfThreads;
+
+  vnl_vector<double> x(nComp), x_scratch(nComp);
+  vnl_vector<double> log_pdf(self->m_MixtureModel->GetNumberOfGaussians());
+
+  for(long r = r0; r < r1; r++)
+    {
+    for(long c = 0; c < rowSize; c++)
+      {
+      long pos = r * rowSize + c;
+      x[0] = (double) (self->m_LookupMin[0] + pos % self->m_LookupSize[0]);
+      if(nComp > 1)
+        x[1] = (double) (self->m_LookupMin[1] + pos / self->m_LookupSize[0]);
+      self->m_LookupTable[pos] = self->ComputeOutput(x, x_scratch, log_pdf);
+      }
+    }
+
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+template <class TInputImage, class TInputVectorImage, class TOutputImage>
+ITK_THREAD_RETURN_TYPE
+GMMClassifyImageFilter<TInputImage, TInputVectorImage, TOutputImage>
+::IntensityRangeThreadCallback(void *arg)
+{
+  typedef itk::MultiThreader::ThreadInfoStruct ThreadInfo;
+  ThreadInfo *info = static_cast<ThreadInfo *>(arg);
+  Self *self = static_cast<Self *>(info->UserData);
+
+  typedef ImageCollectionConstRegionIteratorWithIndex<
+      TInputImage, TInputVectorImage> CollectionIter;
+
+  // Each thread scans a range of slices along the slowest axis
+  InputImageRegionType region = self->m_RangeRegion;
+  unsigned int axis = ImageDimension - 1;
+  long n = region.GetSize(axis);
+  long k0 = (n * info->ThreadID) / info->NumberOfThreads;
+  long k1 = (n * (info->ThreadID + 1)) / info->NumberOfThreads;
+  if(k1 <= k0)
+    return ITK_THREAD_RETURN_VALUE;
+
+  region.SetIndex(axis, region.GetIndex(axis) + k0);
+  region.SetSize(axis, k1 - k0);
+
+  CollectionIter cit(region);
+  for( itk::InputDataObjectIterator it( self ); !it.IsAtEnd(); it++ )
+    cit.AddImage(it.GetInput());
+
+  int nComp = self->m_RangeComponents;
+  long *vmin = &self->m_ThreadRangeMin[2 * info->ThreadID];
+  long *vmax = &self->m_ThreadRangeMax[2 * info->ThreadID];
+  for(; !cit.IsAtEnd(); ++cit)
+    {
+    for(int i = 0; i < nComp; i++)
+      {
+      long v = (long) cit.Value(i);
+      if(v < vmin[i]) vmin[i] = v;
+      if(v > vmax[i]) vmax[i] = v;
+      }
+    }
+
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+template <class TInputImage, class TInputVectorImage, class TOutputImage>
+bool
+GMMClassifyImageFilter<TInputImage, TInputVectorImage, TOutputImage>
+::UpdateIntensityRange(int nComp)
+{
+  typedef itk::ImageBase<ImageDimension> ImageBaseType;
+
+  // The range is taken over the largest region, which the inputs must hold
+  // in memory, so that it does not depend on the piece being generated
+  InputImageRegionType region = this->GetOutput()->GetLargestPossibleRegion();
+  itk::ModifiedTimeType mtime = 0;
+  for( itk::InputDataObjectIterator it( this ); !it.IsAtEnd(); it++ )
+    {
+    ImageBaseType *input = dynamic_cast<ImageBaseType *>(it.GetInput());
+    if(!input || !input->GetBufferedRegion().IsInside(region))
+      return false;
+    mtime = std::max(mtime, input->GetMTime());
+    }
+
+  // Reuse the range if the inputs have not been modified since
+  if(m_RangeComponents == nComp && m_RangeRegion == region && mtime <= m_RangeMTime)
+    return true;
+
+  m_RangeRegion = region;
+  m_RangeComponents = nComp;
+
+  // Each thread finds the range of its part of the region
+  itk::MultiThreader *threader = this->GetMultiThreader();
+  threader->SetNumberOfThreads(this->GetNumberOfThreads());
+  int nThreads = threader->GetNumberOfThreads();
+  m_ThreadRangeMin.assign(2 * nThreads, std::numeric_limits<long>::max());
+  m_ThreadRangeMax.assign(2 * nThreads, std::numeric_limits<long>::min());
+  threader->SetSingleMethod(&Self::IntensityRangeThreadCallback, this);
+  threader->SingleMethodExecute();
+
+  for(int i = 0; i < 2; i++)
+    {
+    m_RangeMin[i] = std::numeric_limits<long>::max();
+    m_RangeMax[i] = std::numeric_limits<long>::min();
+    for(int t = 0; t < nThreads; t++)
+      {
+      m_RangeMin[i] = std::min(m_RangeMin[i], m_ThreadRangeMin[2 * t + i]);
+      m_RangeMax[i] = std::max(m_RangeMax[i], m_ThreadRangeMax[2 * t + i]);
+      }
+    }
+
+  m_RangeMTime = mtime;
+  return true;
+}
+
+template <class TInputImage, class TInputVectorImage, class TOutputImage>
+void
+GMMClassifyImageFilter<TInputImage, TInputVectorImage, TOutputImage>
+::UpdateLookupTable()
+{
+  typedef ImageCollectionConstRegionIteratorWithIndex<
+      TInputImage, TInputVectorImage> CollectionIter;
+  typedef typename CollectionIter::InternalPixelType ValueType;
+
+  m_UseLookupTable = false;
+
+  // The table only makes sense for one or two integer-valued components
+  int nComp = m_MixtureModel->GetNumberOfComponents();
+  if(!std::numeric_limits<InputComponentType>::is_integer
+     || !std::numeric_limits<typename InputVectorImageType::InternalPixelType>::is_integer
+     || !std::numeric_limits<ValueType>::is_integer
+     || nComp < 1 || nComp > 2)
+    return;
+
+  // Find the range of intensities in the input
+  if(!this->UpdateIntensityRange(nComp))
+    return;
+
+  // The table must be small, and smaller than the number of voxels, or the
+  // exact computation is cheaper
+  long vmin[2] = { m_RangeMin[0], nComp > 1 ? m_RangeMin[1] : 0 };
+  long size[2] = { 1, 1 }, nEntries = 1;
+  for(int i = 0; i < nComp; i++)
+    {
+    if(m_RangeMax[i] < m_RangeMin[i])
+      return;
+    size[i] = m_RangeMax[i] - m_RangeMin[i] + 1;
+    if(size[i] > MAX_LOOKUP_TABLE_SIZE)
+      return;
+    nEntries *= size[i];
+    }
+
+  if(nEntries > MAX_LOOKUP_TABLE_SIZE || nEntries > (long) m_RangeRegion.GetNumberOfPixels())
+    return;
+
+  m_UseLookupTable = true;
+
+  // Reuse the table if neither the range nor the model have changed
+  std::vector<double> signature;
+  GetModelSignature(signature);
+  if(signature == m_LookupModelSignature
+     && (long) m_LookupTable.size() == nEntries
+     && vmin[0] == m_LookupMin[0] && vmin[1] == m_LookupMin[1]
+     && size[0] == m_LookupSize[0] && size[1] == m_LookupSize[1])
+    return;
+
+  for(int i = 0; i < 2; i++)
+    {
+    m_LookupMin[i] = vmin[i];
+    m_LookupSize[i] = size[i];
+    }
+
+  // Compute the table in parallel
+  m_LookupTable.resize(nEntries);
+  itk::MultiThreader *threader = this->GetMultiThreader();
+  threader->SetNumberOfThreads(this->GetNumberOfThreads());
+  threader->SetSingleMethod(&Self::LookupTableThreadCallback, this);
+  threader->SingleMethodExecute();
+
+  m_LookupModelSignature = signature;
+}
+
+template <class TInputImage, class TInputVectorImage, class TOutputImage>
+void
+GMMClassifyImageFilter<TInputImage, TInputVectorImage, TOutputImage>
+::BeforeThreadedGenerateData()
+{
+  assert(m_MixtureModel);
+
+  // Compute the weights and the multiplier vector (1 for foreground, -1 for
+  // background) used by all threads
+  int nGauss = m_MixtureModel->GetNumberOfGaussians();
+  m_Weight.set_size(nGauss);
+  m_LogWeight.set_size(nGauss);
+  m_PFactor.set_size(nGauss);
+  for(int i = 0; i < nGauss; i++)
+    {
+    m_PFactor[i] = m_MixtureModel->IsForeground(i) ? 1.0 : -1.0;
+    m_LogWeight[i] = log(m_MixtureModel->GetWeight(i));
+    m_Weight[i] = m_MixtureModel->GetWeight(i);
+    }
+
+  this->UpdateLookupTable();
+}
+
 template <class TInputImage, class TInputVectorImage, class TOutputImage>
 void
 GMMClassifyImageFilter<TInputImage, TInputVectorImage, TOutputImage>
@@ -89,7 +365,6 @@ GMMClassifyImageFilter<TInputImage, TInputVectorImage, TOutputImage>
 {
   // Get the number of inputs
   assert(m_MixtureModel);
-  int n_input = this->GetNumberOfIndexedInputs();
   OutputImagePointer outputPtr = this->GetOutput(0);
 
   // Create a collection iterator
@@ -99,23 +374,6 @@ GMMClassifyImageFilter<TInputImage, TInputVectorImage, TOutputImage>
   typedef itk::ImageRegionIterator<TOutputImage> OutputIter;
   OutputIter it_out(outputPtr, outputRegionForThread);
 
-  vnl_vector<double> x(m_MixtureModel->GetNumberOfComponents());
-  vnl_vector<double> x_scratch(m_MixtureModel->GetNumberOfComponents());
-  vnl_vector<double> z_scratch(m_MixtureModel->GetNumberOfComponents());
-  vnl_vector<double> log_pdf(m_MixtureModel->GetNumberOfGaussians());
-  vnl_vector<double> log_w(m_MixtureModel->GetNumberOfGaussians());
-  vnl_vector<double> w(m_MixtureModel->GetNumberOfGaussians());
-  vnl_vector<double> p(m_MixtureModel->GetNumberOfGaussians());
-
-  // Create a multiplier vector (1 for foreground, -1 for background)
-  vnl_vector<double> pfactor(m_MixtureModel->GetNumberOfGaussians());
-  for(int i = 0; i < m_MixtureModel->GetNumberOfGaussians(); i++)
-    {
-    pfactor[i] = m_MixtureModel->IsForeground(i) ? 1.0 : -1.0;
-    log_w[i] = log(m_MixtureModel->GetWeight(i));
-    w[i] = m_MixtureModel->GetWeight(i);
-    }
-
   // Configure the input collection iterator
   CollectionIter cit(outputRegionForThread);
   for( itk::InputDataObjectIterator it( this ); !it.IsAtEnd(); it++ )
@@ -124,33 +382,39 @@ GMMClassifyImageFilter<TInputImage, TInputVectorImage, TOutputImage>
   // Get the number of components
   int nComp = cit.GetTotalComponents();
 
-  // Iterate through all the voxels
-  while ( !it_out.IsAtEnd() )
+  if(m_UseLookupTable)
     {
-    for(int i = 0; i < nComp; i++)
+    // Look up the output for each voxel
+    const OutputPixelType *table = &m_LookupTable[0];
+    long min0 = m_LookupMin[0], min1 = m_LookupMin[1], size0 = m_LookupSize[0];
+    if(nComp == 1)
       {
-      x[i] = cit.Value(i);
+      for(; !it_out.IsAtEnd(); ++it_out, ++cit)
+        it_out.Set(table[(long) cit.Value(0) - min0]);
       }
-
-    // Evaluate the posterior probability robustly
-    for(int k = 0; k < m_MixtureModel->GetNumberOfGaussians(); k++)
+    else
       {
-      log_pdf[k] = m_MixtureModel->EvaluateLogPDF(k, x, x_scratch);
+      for(; !it_out.IsAtEnd(); ++it_out, ++cit)
+        it_out.Set(table[((long) cit.Value(0) - min0)
+                         + ((long) cit.Value(1) - min1) * size0]);
       }
+    return;
+    }
 
-    // Evaluate the GMM for each of the clusters
-    double pdiff = 0;
-    for(int k = 0; k < m_MixtureModel->GetNumberOfGaussians(); k++)
-      {
-      p[k] = EMGaussianMixtures::ComputePosterior(
-            m_MixtureModel->GetNumberOfGaussians(),
-            log_pdf.data_block(), w.data_block(), log_w.data_block(), k);
+  vnl_vector<double> x(m_MixtureModel->GetNumberOfComponents());
+  vnl_vector<double> x_scratch(m_MixtureModel->GetNumberOfComponents());
+  vnl_vector<double> log_pdf(m_MixtureModel->GetNumberOfGaussians());
 
-      pdiff += p[k] * pfactor[k];
+  // Iterate through all the voxels
+  while ( !it_out.IsAtEnd() )
+    {
+    for(int i = 0; i < nComp; i++)
+      {
+      x[i] = cit.Value(i);
       }
 
     // Store the value
-    it_out.Set((OutputPixelType)(pdiff * 0x7fff));
+    it_out.Set(this->ComputeOutput(x, x_scratch, log_pdf));
 
     ++it_out;
     ++cit;
@@ -146,10 +146,10 @@ public:
   void SetRadius(const SizeType &size);
 
   /** Get the number of components across the collection */
-  itkGetMacro(TotalComponents, unsigned int)
+  itkGetConstMacro(TotalComponents, unsigned int)
 
   /** Get the optional neighborhood size */
-  itkGetMacro(NeighborhoodSize, int)
+  itkGetConstMacro(NeighborhoodSize, int)
 
   /** Standard iterator operations */
   bool IsAtEnd() const { return m_InternalIter.IsAtEnd(); }
@@ -176,6 +176,54 @@ public:
     return *(dataPtr);
   }
 
+  /** Compute the offset of a voxel in the images, for random access */
+  OffsetValueType ComputeOffset(const IndexType &index) const
+  {
+    return m_DummyImage->ComputeOffset(index);
+  }
+
+  /**
+   * Get a component in the neighborhood of the voxel at a given offset (see
+   * ComputeOffset), without moving the iterator (no bounds check). This can
+   * be called concurrently from multiple threads.
+   */
+  const InternalPixelType &NeighborValueAtOffset(
+      OffsetValueType offset, unsigned int comp, unsigned int nbr_idx) const
+  {
+    offset += m_NeighborhoodOffsetTable[nbr_idx];
+    return *(m_Start[comp] + offset * m_OffsetScaling[comp]);
+  }
+
+  /**
+   * Gather the patch features (all components, all neighbors) for a block of
+   * nVoxels consecutive voxels in memory, starting at the voxel at the given
+   * offset. The features are written in row-major order, one row of
+   * GetTotalComponents() * GetNeighborhoodSize() values per voxel, rows being
+   * rowStride values apart. For each component and neighbor, the voxels of
+   * the block are read sequentially, so blocks that fit in cache are much
+   * faster to fill than calling NeighborValue() for each entry (no bounds
+   * check). This can be called concurrently from multiple threads.
+   */
+  template <class TOutput>
+  void GatherPatchFeatures(OffsetValueType offset, int nVoxels,
+                           TOutput *out, int rowStride) const
+  {
+    int col = 0;
+    for(unsigned int comp = 0; comp < m_TotalComponents; comp++)
+      {
+      const InternalPixelType *start = m_Start[comp];
+      int scaling = m_OffsetScaling[comp];
+      for(int nbr = 0; nbr < m_NeighborhoodSize; nbr++, col++)
+        {
+        const InternalPixelType *src =
+            start + (offset + m_NeighborhoodOffsetTable[nbr]) * scaling;
+        TOutput *dst = out + col;
+        for(int v = 0; v < nVoxels; v++, src += scaling, dst += rowStride)
+          *dst = static_cast<TOutput>(*src);
+        }
+      }
+  }
+
 protected:
 
   // Collection of scalar images
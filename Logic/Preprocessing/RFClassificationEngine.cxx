@@ -5,11 +5,116 @@
 #include "ImageWrapper.h"
 #include "ImageCollectionToImageFilter.h"
 #include "RLEImageRegionIterator.h"
+#include <itkMultiThreader.h>
+#include <algorithm>
+#include <queue>
 
 // Includes from the random forest library
 #include "Library/classification.h"
 #include "Library/data.h"
 
+// Iterator over the anatomical images used to extract features
+typedef ImageCollectionConstRegionIteratorWithIndex<
+    AnatomicScalarImageWrapper::ImageType,
+    AnatomicImageWrapper::ImageType> RFCollectionIter;
+
+// A run of voxels with the same nonzero label along the x axis
+struct RFLabeledRun
+{
+  itk::Index<3> Start;
+  unsigned long Length;
+  LabelType Label;
+};
+
+// A labeled voxel considered for the training sample
+struct RFSampleVoxel
+{
+  unsigned int Key;
+  itk::OffsetValueType Offset;
+  itk::Index<3> Index;
+  LabelType Label;
+
+  // Ordering by the sampling key, the offset breaks ties
+  bool operator < (const RFSampleVoxel &other) const
+  {
+    return Key < other.Key || (Key == other.Key && Offset < other.Offset);
+  }
+
+  static bool CompareOffsets(const RFSampleVoxel &a, const RFSampleVoxel &b)
+  {
+    return a.Offset < b.Offset;
+  }
+
+  // Integer hash of the offset (MurmurHash3 finalizer)
+  static unsigned int Hash(itk::OffsetValueType offset)
+  {
+    unsigned int h = (unsigned int) offset;
+    h ^= h >> 16; h *= 0x85ebca6bu;
+    h ^= h >> 13; h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    return h;
+  }
+};
+
+// Data shared by the threads that gather the training features
+struct RFFeatureGatherData
+{
+  const RFCollectionIter *Iterator;
+  std::vector<itk::Index<3> > Indices;
+  std::vector<GreyType> Features;
+  int NumberOfColumns;
+  bool UseCoordinateFeatures;
+};
+
+// Thread callback that gathers the features for a range of rows
+static ITK_THREAD_RETURN_TYPE RFGatherFeaturesThreadCallback(void *arg)
+{
+  typedef itk::MultiThreader::ThreadInfoStruct ThreadInfo;
+  ThreadInfo *info = static_cast<ThreadInfo *>(arg);
+  RFFeatureGatherData *gather = static_cast<RFFeatureGatherData *>(info->UserData);
+  const RFCollectionIter *cit = gather->Iterator;
+
+  // The range of rows handled by this thread
+  unsigned long nRows = gather->Indices.size();
+  unsigned long row0 = (nRows * info->ThreadID) / info->NumberOfThreads;
+  unsigned long row1 = (nRows * (info->ThreadID + 1)) / info->NumberOfThreads;
+
+  // The rows are in raster order. Rows for consecutive voxels along x, which
+  // are common when all the labeled voxels fit in the sample, are gathered
+  // in blocks
+  const int maxBlock = 64;
+  int nPatchColumns = cit->GetTotalComponents() * cit->GetNeighborhoodSize();
+  for(unsigned long j = row0; j < row1; )
+    {
+    const itk::Index<3> &idx = gather->Indices[j];
+    int nBlock = 1;
+    while(nBlock < maxBlock && j + nBlock < row1)
+      {
+      const itk::Index<3> &next = gather->Indices[j + nBlock];
+      if(next[0] != idx[0] + nBlock || next[1] != idx[1] || next[2] != idx[2])
+        break;
+      nBlock++;
+      }
+
+    GreyType *row = &gather->Features[j * gather->NumberOfColumns];
+    cit->GatherPatchFeatures(cit->ComputeOffset(idx), nBlock, row, gather->NumberOfColumns);
+
+    if(gather->UseCoordinateFeatures)
+      {
+      for(int v = 0; v < nBlock; v++, row += gather->NumberOfColumns)
+        {
+        row[nPatchColumns] = idx[0] + v;
+        row[nPatchColumns + 1] = idx[1];
+        row[nPatchColumns + 2] = idx[2];
+        }
+      }
+
+    j += nBlock;
+    }
+
+  return ITK_THREAD_RETURN_VALUE;
+}
+
 template <class TPixel, class TLabel, int VDim>
 RFClassificationEngine<TPixel,TLabel,VDim>::RFClassificationEngine()
 {
@@ -39,6 +144,11 @@ void RFClassificationEngine<TPixel,TLabel,VDim>::SetDataSource(SNAPImageData *im
 
     // Reset the classifier
     m_Classifier->Reset();
+
+    // Clear the cached features
+    m_CachedOffsets.clear();
+    m_CachedFeatures.clear();
+    m_CacheSignature.clear();
     }
 }
 
@@ -53,13 +163,8 @@ void RFClassificationEngine<TPixel,TLabel,VDim>:: TrainClassifier()
 {
   assert(m_DataSource && m_DataSource->IsMainLoaded());
 
-  typedef ImageCollectionConstRegionIteratorWithIndex<
-      AnatomicScalarImageWrapper::ImageType,
-      AnatomicImageWrapper::ImageType> CollectionIter;
-
-  // TODO: in the future, we should only recompute the sample when we know
-  // that the data has changed. However, currently, we are just going to
-  // compute a new sample every time
+  // The sample is recomputed every time, but the features of voxels that
+  // were already sampled in the previous training are taken from the cache
 
   // Delete the sample
   if(m_Sample)
@@ -69,28 +174,55 @@ void RFClassificationEngine<TPixel,TLabel,VDim>:: TrainClassifier()
   // TODO: this is defaulting to the first image - is this correct?
   LabelImageWrapper *wrpSeg = m_DataSource->GetFirstSegmentationLayer();
   LabelImageWrapper::ImagePointer imgSeg = wrpSeg->GetImage();
-  typedef itk::ImageRegionConstIteratorWithIndex<LabelImageWrapper::ImageType> LabelIter;
+  typedef LabelImageWrapper::ImageType::RLLine LabelLine;
 
   // Shrink the buffered region by radius because we can't handle BCs
   itk::ImageRegion<3> reg = imgSeg->GetBufferedRegion();
   reg.ShrinkByRadius(m_PatchRadius);
 
-  // We need to iterate throught the label image once to determine the
-  // number of samples to allocate.
-  unsigned long nSamples = 0;
-  for(LabelIter lit(imgSeg, reg); !lit.IsAtEnd(); ++lit)
-    if(lit.Value())
-      nSamples++;
+  // Collect the runs of labeled voxels in the region directly from the RLE
+  // lines of the segmentation, without visiting each voxel
+  std::vector<RFLabeledRun> runs;
+  int x0 = reg.GetIndex(0), x1 = x0 + (int) reg.GetSize(0);
+  for(unsigned int z = 0; z < reg.GetSize(2); z++)
+    {
+    for(unsigned int y = 0; y < reg.GetSize(1); y++)
+      {
+      itk::Index<3> idx = reg.GetIndex();
+      idx[1] += y; idx[2] += z;
+      const LabelLine &line = imgSeg->GetBuffer()->GetPixel(
+            LabelImageWrapper::ImageType::truncateIndex(idx));
+
+      int xr = imgSeg->GetBufferedRegion().GetIndex(0);
+      for(unsigned int r = 0; r < line.size() && xr < x1; r++)
+        {
+        int xs = std::max(xr, x0), xe = std::min(xr + (int) line[r].first, x1);
+        if(line[r].second && xe > xs)
+          {
+          RFLabeledRun run;
+          run.Start = idx; run.Start[0] = xs;
+          run.Length = xe - xs;
+          run.Label = line[r].second;
+          runs.push_back(run);
+          }
+        xr += line[r].first;
+        }
+      }
+    }
 
   // Create an iterator for going over all the anatomical image data
-  CollectionIter cit(reg);
+  RFCollectionIter cit(reg);
   cit.SetRadius(m_PatchRadius);
 
-  // Add all the anatomical images to this iterator
+  // Add all the anatomical images to this iterator. Keep track of the images
+  // and their modification times, which determine if cached features are valid
+  std::vector<size_t> signature;
   for(LayerIterator it = m_DataSource->GetLayers(MAIN_ROLE | OVERLAY_ROLE);
       !it.IsAtEnd(); ++it)
     {
     cit.AddImage(it.GetLayer()->GetImageBase());
+    signature.push_back((size_t) it.GetLayer()->GetImageBase());
+    signature.push_back((size_t) it.GetLayer()->GetImageBase()->GetMTime());
     }
 
   // Get the number of components
@@ -102,35 +234,107 @@ void RFClassificationEngine<TPixel,TLabel,VDim>:: TrainClassifier()
   if(m_UseCoordinateFeatures)
     nColumns += 3;
 
-  // Create a new sample
-  m_Sample = new SampleType(nSamples, nColumns);
+  // The features also depend on the patch radius and the column layout
+  for(int d = 0; d < 3; d++)
+    signature.push_back(m_PatchRadius[d]);
+  signature.push_back(nColumns);
 
-  // Now fill out the samples
-  int iSample = 0;
-  for(LabelIter lit(imgSeg, reg); !lit.IsAtEnd(); ++lit, ++cit)
+  // Discard the cached features if the images or feature layout changed
+  if(signature != m_CacheSignature)
     {
-    LabelType label = lit.Value();
-    if(label)
+    m_CachedOffsets.clear();
+    m_CachedFeatures.clear();
+    m_CacheSignature = signature;
+    }
+
+  // Each tree is trained on at most maxTreeSamples voxels, which the forest
+  // draws separately for each tree. The trees draw from a pool of at most
+  // maxSamples voxels, so that features are only extracted for the pool
+  // rather than for every labeled voxel.
+  //
+  // Each labeled voxel gets a pseudo-random key computed from its offset,
+  // and the voxels with the smallest keys form the pool (bottom-k sampling).
+  // This is a uniform random sample, but unlike a fresh random draw, it only
+  // changes slightly when voxels are labeled or unlabeled, so that the
+  // features of most of the voxels sampled in the previous training can be
+  // reused.
+  const unsigned long maxTreeSamples = 10000;
+  const unsigned long maxSamples = 5 * maxTreeSamples;
+  std::priority_queue<RFSampleVoxel> heap;
+  for(unsigned long r = 0; r < runs.size(); r++)
+    {
+    RFSampleVoxel sv;
+    sv.Index = runs[r].Start;
+    sv.Offset = cit.ComputeOffset(runs[r].Start);
+    sv.Label = runs[r].Label;
+    for(unsigned long i = 0; i < runs[r].Length; i++, sv.Index[0]++, sv.Offset++)
       {
-      // Fill in the data
-      std::vector<GreyType> &column = m_Sample->data[iSample];
-      int k = 0;
-      for(int i = 0; i < nComp; i++)
-        for(int j = 0; j < nPatch; j++)
-          column[k++] = cit.NeighborValue(i,j);
-
-      // Add the coordinate features if used
-      if(m_UseCoordinateFeatures)
-        for(int d = 0; d < 3; d++)
-          column[k++] = lit.GetIndex()[d];
-
-      // Fill in the label
-      m_Sample->label[iSample] = label;
-
-      ++iSample;
+      sv.Key = RFSampleVoxel::Hash(sv.Offset);
+      if(heap.size() < maxSamples)
+        heap.push(sv);
+      else if(sv < heap.top())
+        {
+        heap.pop();
+        heap.push(sv);
+        }
       }
     }
 
+  // Sort the selected voxels in raster order
+  std::vector<RFSampleVoxel> selection;
+  selection.reserve(heap.size());
+  for(; !heap.empty(); heap.pop())
+    selection.push_back(heap.top());
+  std::sort(selection.begin(), selection.end(), RFSampleVoxel::CompareOffsets);
+
+  // Find the selected voxels whose features are in the cache. Only the
+  // remaining voxels need their features extracted from the images.
+  std::vector<long> cacheRow(selection.size(), -1);
+  RFFeatureGatherData gather;
+  for(unsigned long j = 0; j < selection.size(); j++)
+    {
+    std::vector<itk::OffsetValueType>::const_iterator itCache = std::lower_bound(
+          m_CachedOffsets.begin(), m_CachedOffsets.end(), selection[j].Offset);
+    if(itCache != m_CachedOffsets.end() && *itCache == selection[j].Offset)
+      cacheRow[j] = itCache - m_CachedOffsets.begin();
+    else
+      gather.Indices.push_back(selection[j].Index);
+    }
+
+  // Gather the features of the new voxels into a contiguous row-major
+  // buffer, splitting the rows between threads
+  gather.Iterator = &cit;
+  gather.NumberOfColumns = nColumns;
+  gather.UseCoordinateFeatures = m_UseCoordinateFeatures;
+  gather.Features.resize(gather.Indices.size() * nColumns);
+
+  if(gather.Indices.size())
+    {
+    itk::MultiThreader::Pointer threader = itk::MultiThreader::New();
+    threader->SetSingleMethod(RFGatherFeaturesThreadCallback, &gather);
+    threader->SingleMethodExecute();
+    }
+
+  // Merge the cached and the new rows into the new sample, which also
+  // becomes the new cache
+  std::vector<itk::OffsetValueType> offsets(selection.size());
+  std::vector<GreyType> features(selection.size() * nColumns);
+  m_Sample = new SampleType(selection.size(), nColumns);
+  for(unsigned long j = 0, iNew = 0; j < selection.size(); j++)
+    {
+    const GreyType *row = (cacheRow[j] >= 0)
+        ? &m_CachedFeatures[cacheRow[j] * nColumns]
+        : &gather.Features[(iNew++) * nColumns];
+
+    std::copy(row, row + nColumns, features.begin() + j * nColumns);
+    std::copy(row, row + nColumns, m_Sample->data[j].begin());
+    m_Sample->label[j] = selection[j].Label;
+    offsets[j] = selection[j].Offset;
+    }
+
+  m_CachedOffsets.swap(offsets);
+  m_CachedFeatures.swap(features);
+
   // Check that the sample has at least two distinct labels
   bool isValidSample = false;
   for(int iSample = 1; iSample < m_Sample->Size(); iSample++)
@@ -150,14 +354,13 @@ void RFClassificationEngine<TPixel,TLabel,VDim>:: TrainClassifier()
   params.treeNum = m_ForestSize;
   params.candidateNodeClassifierNum = 10;
   params.candidateClassifierThresholdNum = 10;
-  params.subSamplePercent = 0;
   params.splitIG = 0.1;
   params.leafEntropy = 0.05;
   params.verbose = true;
 
-  // Cap the number of training voxels at some reasonable number
-  if(m_Sample->Size() > 10000)
-    params.subSamplePercent = 100 * 10000.0 / m_Sample->Size();
+  // Cap the number of training voxels for each tree
+  if(m_Sample->Size() > (int) maxTreeSamples)
+    params.subSamplePercent = 100.0 * maxTreeSamples / m_Sample->Size();
   else
     params.subSamplePercent = 0;
 
@@ -5,6 +5,8 @@
 #include <itkObjectFactory.h>
 #include "SNAPCommon.h"
 #include <itkSize.h>
+#include <itkIntTypes.h>
+#include <vector>
 
 template <class TPixel, class TLabel, int VDim> class RandomForestClassifier;
 template <class TData, class TLabel> class MLData;
@@ -34,7 +36,11 @@ public:
   /** Reset the classifier */
   void ResetClassifier();
 
-  /** Train the classifier */
+  /**
+   * Train the classifier. The features of voxels that were in the previous
+   * training sample are reused, so only newly sampled voxels are read from
+   * the images. The forest itself is always trained from scratch.
+   */
   void TrainClassifier();
 
   /** Set the classifier */
@@ -93,6 +99,16 @@ protected:
   typedef MLData<GreyType, LabelType> SampleType;
   SampleType *m_Sample;
 
+  // Features of the voxels in the last training sample, stored row-major and
+  // sorted by voxel offset. They are reused when the classifier is retrained
+  // after more voxels have been labeled.
+  std::vector<itk::OffsetValueType> m_CachedOffsets;
+  std::vector<GreyType> m_CachedFeatures;
+
+  // The images, their modification times and the feature layout for which
+  // the cached features were computed
+  std::vector<size_t> m_CacheSignature;
+
 };
 
 #endif // RFCLASSIFICATIONENGINE_H
@@ -0,0 +1,121 @@
+#include "SpeedImageCache.h"
+#include <algorithm>
+
+SpeedImageCache::SpeedImageCache()
+{
+  // Room for a few full-size volumes
+  m_MaximumMemory = 512 * 1024 * 1024;
+}
+
+size_t SpeedImageCache::Entry::GetMemoryUsage() const
+{
+  return Values.size() * sizeof(GreyType) + RunLengths.size() * sizeof(unsigned int);
+}
+
+size_t SpeedImageCache::GetMemoryUsage() const
+{
+  size_t total = 0;
+  for(EntryList::const_iterator it = m_Entries.begin(); it != m_Entries.end(); ++it)
+    total += it->GetMemoryUsage();
+  return total;
+}
+
+bool SpeedImageCache::Retrieve(const std::string &key, SpeedImageType *image)
+{
+  for(EntryList::iterator it = m_Entries.begin(); it != m_Entries.end(); ++it)
+    {
+    if(it->Key != key)
+      continue;
+
+    if(it->Region != image->GetBufferedRegion())
+      return false;
+
+    // Decode the volume into the image buffer
+    GreyType *p = image->GetBufferPointer();
+    if(it->RunLengths.size())
+      {
+      for(size_t i = 0; i < it->RunLengths.size(); i++)
+        {
+        std::fill(p, p + it->RunLengths[i], it->Values[i]);
+        p += it->RunLengths[i];
+        }
+      }
+    else
+      {
+      std::copy(it->Values.begin(), it->Values.end(), p);
+      }
+
+    // Mark the entry as the most recently used
+    m_Entries.splice(m_Entries.begin(), m_Entries, it);
+    return true;
+    }
+
+  return false;
+}
+
+void SpeedImageCache::Store(const std::string &key, SpeedImageType *image)
+{
+  // Remove the existing entry with this key
+  for(EntryList::iterator it = m_Entries.begin(); it != m_Entries.end(); ++it)
+    {
+    if(it->Key == key)
+      {
+      m_Entries.erase(it);
+      break;
+      }
+    }
+
+  // Create the new entry as the most recently used one
+  m_Entries.push_front(Entry());
+  Entry &entry = m_Entries.front();
+  entry.Key = key;
+  entry.Region = image->GetBufferedRegion();
+
+  // Count the runs to decide whether to run-length encode
+  const GreyType *p = image->GetBufferPointer();
+  size_t n = entry.Region.GetNumberOfPixels(), nRuns = 0;
+  for(size_t i = 0; i < n; i++)
+    if(i == 0 || p[i] != p[i-1])
+      nRuns++;
+
+  if(nRuns * (sizeof(GreyType) + sizeof(unsigned int)) < n * sizeof(GreyType))
+    {
+    entry.Values.reserve(nRuns);
+    entry.RunLengths.reserve(nRuns);
+    for(size_t i = 0; i < n; i++)
+      {
+      if(i == 0 || p[i] != p[i-1])
+        {
+        entry.Values.push_back(p[i]);
+        entry.RunLengths.push_back(1);
+        }
+      else
+        {
+        entry.RunLengths.back()++;
+        }
+      }
+    }
+  else
+    {
+    entry.Values.assign(p, p + n);
+    }
+
+  if(entry.GetMemoryUsage() > m_MaximumMemory)
+    {
+    m_Entries.pop_front();
+    return;
+    }
+
+  // Evict the least recently used entries until the cache fits into memory
+  size_t total = this->GetMemoryUsage();
+  while(total > m_MaximumMemory)
+    {
+    total -= m_Entries.back().GetMemoryUsage();
+    m_Entries.pop_back();
+    }
+}
+
+void SpeedImageCache::Clear()
+{
+  m_Entries.clear();
+}
@@ -0,0 +1,77 @@
+#ifndef SPEEDIMAGECACHE_H
+#define SPEEDIMAGECACHE_H
+
+#include "SNAPCommon.h"
+#include <itkObject.h>
+#include <itkObjectFactory.h>
+#include <itkImage.h>
+#include <list>
+#include <string>
+#include <vector>
+
+/**
+ * A bounded cache of full-volume speed images. Each entry is identified by a
+ * key string that should encode everything the speed image depends on, i.e.,
+ * the preprocessing mode, its parameters and the state of the input layers.
+ * This allows the speed image to be reused when the user switches between
+ * preprocessing modes or reenters the active contour mode without changing
+ * anything.
+ *
+ * The volumes are stored losslessly. Volumes that consist of long runs of
+ * constant values (e.g., thresholded speed images) are run-length encoded.
+ * When the total size of the entries exceeds the memory limit, the least
+ * recently used entries are discarded.
+ */
+class SpeedImageCache : public itk::Object
+{
+public:
+  irisITKObjectMacro(SpeedImageCache, itk::Object)
+
+  typedef itk::Image<GreyType, 3> SpeedImageType;
+  typedef SpeedImageType::RegionType RegionType;
+
+  /** Maximum memory used by the cache, in bytes */
+  itkSetMacro(MaximumMemory, size_t)
+  itkGetConstMacro(MaximumMemory, size_t)
+
+  /** Memory currently used by the cache, in bytes */
+  size_t GetMemoryUsage() const;
+
+  /**
+   * Copy the cached volume with the given key into the buffer of the image,
+   * if there is one and its region matches. Returns whether this was done.
+   */
+  bool Retrieve(const std::string &key, SpeedImageType *image);
+
+  /** Store a copy of the buffer of an image under the given key */
+  void Store(const std::string &key, SpeedImageType *image);
+
+  /** Remove all entries */
+  void Clear();
+
+protected:
+
+  SpeedImageCache();
+  ~SpeedImageCache() {}
+
+  struct Entry
+  {
+    std::string Key;
+    RegionType Region;
+
+    // The voxel values, or the values of the runs if the run lengths are
+    // not empty
+    std::vector<GreyType> Values;
+    std::vector<unsigned int> RunLengths;
+
+    size_t GetMemoryUsage() const;
+  };
+
+  // Entries, most recently used first
+  typedef std::list<Entry> EntryList;
+  EntryList m_Entries;
+
+  size_t m_MaximumMemory;
+};
+
+#endif // SPEEDIMAGECACHE_H
@@ -2,7 +2,10 @@
 #include "itkImage.h"
 #include "itkVectorImage.h"
 #include "itkImageRegionIteratorWithIndex.h"
+#include "itkImageRegionConstIterator.h"
 #include "itkNeighborhoodIterator.h"
+#include <algorithm>
+#include <cmath>
 
 #define MIN(a,b) (((a)<(b))?(a):(b))
 #define MAX(a,b) (((a)>(b))?(a):(b))
@@ -11,71 +14,277 @@ const int MAX_VAL=100000;
 
 namespace bilwaj {
 
+// Replace a line of values by the sums of the values in a window of radius
+// r around each value, replicating the values at the ends of the line
+static void BoxSumLine(double *line, long n, long stride, long r, std::vector<double> &tmp)
+{
+  tmp.resize(n);
+  for(long i = 0; i < n; i++)
+    tmp[i] = line[i * stride];
+
+  double sum = 0.0;
+  for(long t = -r; t <= r; t++)
+    sum += tmp[std::min(std::max(t, 0L), n - 1)];
+
+  for(long i = 0; i < n; i++)
+    {
+    line[i * stride] = sum;
+    sum += tmp[std::min(i + r + 1, n - 1)] - tmp[std::max(i - r, 0L)];
+    }
+}
+
+// Replace a line of values by the min (or max) of the values in a window of
+// radius r around each value. Uses a monotonic queue of candidate indices,
+// so that the cost does not depend on the radius.
+static void BoxExtremumLine(double *line, long n, long stride, long r, bool isMax,
+                            std::vector<double> &tmp, std::vector<long> &queue)
+{
+  tmp.resize(n);
+  queue.resize(n);
+  for(long i = 0; i < n; i++)
+    tmp[i] = line[i * stride];
+
+  long head = 0, tail = 0, next = 0;
+  for(long i = 0; i < n; i++)
+    {
+    // Push the values entering the window, dropping the values that can
+    // no longer be the extremum
+    for(long last = std::min(i + r, n - 1); next <= last; next++)
+      {
+      while(tail > head && (isMax ? tmp[queue[tail-1]] <= tmp[next]
+                                  : tmp[queue[tail-1]] >= tmp[next]))
+        tail--;
+      queue[tail++] = next;
+      }
+
+    // Pop the values leaving the window
+    while(queue[head] < i - r)
+      head++;
+
+    line[i * stride] = tmp[queue[head]];
+    }
+}
+
+// Kinds of box filters applied to the slice statistics
+enum BoxFilterMode { BOX_SUM, BOX_MIN, BOX_MAX };
+
+// Apply a box filter separably to an n-dimensional array (first index varies
+// fastest)
+static void BoxFilterArray(double *data, const std::vector<long> &size,
+                           const std::vector<long> &radius, BoxFilterMode mode,
+                           std::vector<double> &tmp, std::vector<long> &queue)
+{
+  long n = 1;
+  for(unsigned int d = 0; d < size.size(); d++)
+    n *= size[d];
+
+  long stride = 1;
+  for(unsigned int d = 0; d < size.size(); d++)
+    {
+    long len = size[d], block = stride * len;
+    for(long outer = 0; outer < n; outer += block)
+      {
+      for(long inner = 0; inner < stride; inner++)
+        {
+        double *line = data + outer + inner;
+        if(mode == BOX_SUM)
+          BoxSumLine(line, len, stride, radius[d], tmp);
+        else
+          BoxExtremumLine(line, len, stride, radius[d], mode == BOX_MAX, tmp, queue);
+        }
+      }
+    stride = block;
+    }
+}
+
+template <class TInputImage, class TOutputImage>
+void
+MomentTextureFilter<TInputImage, TOutputImage>
+::ComputeSliceStatistics(const RegionType &sliceRegion, long slice,
+                         unsigned int nSums, double *stats,
+                         std::vector<double> &scratch)
+{
+  const unsigned int L = ImageDimension - 1;
+  const InputImageType *input = this->GetInput();
+  RegionType bufRegion = input->GetBufferedRegion();
+
+  // Clamp the slice to the input
+  long zFirst = bufRegion.GetIndex(L);
+  long zLast = zFirst + (long) bufRegion.GetSize(L) - 1;
+  RegionType region = sliceRegion;
+  region.SetIndex(L, std::min(std::max(slice, zFirst), zLast));
+  region.SetSize(L, 1);
+
+  // Read the intensities in the slice
+  long n = region.GetNumberOfPixels();
+  scratch.resize(n);
+  itk::ImageRegionConstIterator<InputImageType> it(input, region);
+  for(long i = 0; !it.IsAtEnd(); ++it, ++i)
+    scratch[i] = it.Get();
+
+  std::vector<long> size(L), radius(L);
+  for(unsigned int d = 0; d < L; d++)
+    {
+    size[d] = region.GetSize(d);
+    radius[d] = m_Radius[d];
+    }
+
+  // Powers of the intensity, followed by the intensity twice (for min, max)
+  std::vector<double> tmp;
+  std::vector<long> queue;
+  for(unsigned int c = 0; c < nSums + 2; c++)
+    {
+    double *channel = stats + c * n;
+    for(long i = 0; i < n; i++)
+      {
+      double v = scratch[i], vp = v;
+      if(c < nSums)
+        for(unsigned int k = 1; k <= c; k++)
+          vp *= v;
+      channel[i] = vp;
+      }
+
+    BoxFilterMode mode = c < nSums ? BOX_SUM : (c == nSums ? BOX_MIN : BOX_MAX);
+    BoxFilterArray(channel, size, radius, mode, tmp, queue);
+    }
+}
+
 template <class TInputImage, class TOutputImage>
 void
 MomentTextureFilter<TInputImage, TOutputImage>
 ::ThreadedGenerateData(const RegionType & outputRegionForThread,
                        itk::ThreadIdType threadId)
 {
-  // Iterator for the output region
-  typedef itk::ImageRegionIteratorWithIndex<OutputImageType> OutputIteratorType;
-  OutputIteratorType TexIt(this->GetOutput(), outputRegionForThread);
+  // The last dimension is processed slice by slice
+  const unsigned int L = ImageDimension - 1;
+  RegionType bufRegion = this->GetInput()->GetBufferedRegion();
+
+  // The in-slice region of the input that the neighborhoods of the output
+  // region span
+  RegionType footprint = outputRegionForThread;
+  long nPix = 1;
+  for(unsigned int d = 0; d < L; d++)
+    {
+    long first = std::max(
+          (long) outputRegionForThread.GetIndex(d) - (long) m_Radius[d],
+          (long) bufRegion.GetIndex(d));
+    long last = std::min(
+          (long) (outputRegionForThread.GetIndex(d) + outputRegionForThread.GetSize(d))
+          + (long) m_Radius[d] - 1,
+          (long) (bufRegion.GetIndex(d) + bufRegion.GetSize(d)) - 1);
+    footprint.SetIndex(d, first);
+    footprint.SetSize(d, last - first + 1);
+    nPix *= last - first + 1;
+    }
+
+  // The box statistics of the slices spanned by the neighborhood are kept in
+  // a ring buffer, and the sums over these slices are updated as we move on
+  unsigned int nSums = std::max(m_HighestDegree, 1u);
+  unsigned int nStats = nSums + 2;
+  long rz = m_Radius[L], nSlots = 2 * rz + 1;
+  std::vector<double> ring(nSlots * nStats * nPix), sums(nSums * nPix), scratch;
 
-  // Neighborhood iterator for the input region
-  typedef itk::ConstNeighborhoodIterator<InputImageType> NeighborhoodIterator;
-  NeighborhoodIterator InpIt(m_Radius,this->GetInput(), outputRegionForThread);
+  // Number of voxels in the neighborhood
+  double nNbr = 1.0;
+  for(unsigned int d = 0; d < ImageDimension; d++)
+    nNbr *= 2 * m_Radius[d] + 1;
+
+  // Binomial coefficients for expanding the central moments
+  std::vector<double> binom((nSums + 1) * (nSums + 1), 0.0);
+  for(unsigned int n = 0; n <= nSums; n++)
+    {
+    binom[n * (nSums + 1)] = 1.0;
+    for(unsigned int j = 1; j <= n; j++)
+      binom[n * (nSums + 1) + j] =
+          binom[(n-1) * (nSums + 1) + j - 1] + (j < n ? binom[(n-1) * (nSums + 1) + j] : 0.0);
+    }
 
   // Accumulator array
-  vnl_vector<float> accumX(m_HighestDegree);
+  vnl_vector<double> accumX(m_HighestDegree);
   OutputPixelType out_pix(m_HighestDegree);
 
-  for( TexIt.GoToBegin(); !TexIt.IsAtEnd(); ++TexIt, ++InpIt)
+  long zFirst = outputRegionForThread.GetIndex(L);
+  long zLast = zFirst + (long) outputRegionForThread.GetSize(L) - 1;
+  for(long z = zFirst; z <= zLast; z++)
     {
-    // On the first pass through the neighborhood compute the mean intensity and
-    // the intensity range in the neighborhood
-    float accum=0.0;
-    float min=0; //Store minimum voxel intensity value
-    float max=0; //Store maximum voxel intensity value
-
-    for(int j=0;j<InpIt.Size();j++)
+    if(z == zFirst)
       {
-      InputPixelType pix = InpIt.GetPixel(j);
-      accum += pix;
-      min=MIN(min, pix);
-      max=MAX(max, pix);
+      std::fill(sums.begin(), sums.end(), 0.0);
+      for(long t = z - rz; t <= z + rz; t++)
+        {
+        double *slot = &ring[(((t % nSlots) + nSlots) % nSlots) * nStats * nPix];
+        this->ComputeSliceStatistics(footprint, t, nSums, slot, scratch);
+        for(long i = 0; i < (long) sums.size(); i++)
+          sums[i] += slot[i];
+        }
+      }
+    else
+      {
+      // The slice leaving the neighborhood and the one entering it share a slot
+      long t = z + rz;
+      double *slot = &ring[(((t % nSlots) + nSlots) % nSlots) * nStats * nPix];
+      for(long i = 0; i < (long) sums.size(); i++)
+        sums[i] -= slot[i];
+      this->ComputeSliceStatistics(footprint, t, nSums, slot, scratch);
+      for(long i = 0; i < (long) sums.size(); i++)
+        sums[i] += slot[i];
       }
 
-    float range = max-min;
-    float mean = accum / InpIt.Size();
+    // Iterator for the output slice
+    RegionType outSlice = outputRegionForThread;
+    outSlice.SetIndex(L, z);
+    outSlice.SetSize(L, 1);
 
-    // On the second pass, compute the moments
-    accumX.fill(0.0f);
-    for(int j=0;j<InpIt.Size();j++)
+    typedef itk::ImageRegionIteratorWithIndex<OutputImageType> OutputIteratorType;
+    for(OutputIteratorType TexIt(this->GetOutput(), outSlice); !TexIt.IsAtEnd(); ++TexIt)
       {
-      InputPixelType pix = InpIt.GetPixel(j);
-      float norm_val = ((pix - mean) / range), norm_val_k = norm_val;
-      accumX[0] += norm_val;
-      for(int k = 1; k < m_HighestDegree; k++)
+      // Position in the in-slice footprint
+      long pos = 0, stride = 1;
+      for(unsigned int d = 0; d < L; d++)
         {
-        norm_val_k *= norm_val;
-        accumX[k] += norm_val_k;
+        pos += (TexIt.GetIndex()[d] - footprint.GetIndex(d)) * stride;
+        stride *= footprint.GetSize(d);
+        }
+
+      // The intensity range in the neighborhood (which always includes zero)
+      double min = 0, max = 0;
+      for(long s = 0; s < nSlots; s++)
+        {
+        min = std::min(min, ring[(s * nStats + nSums) * nPix + pos]);
+        max = std::max(max, ring[(s * nStats + nSums + 1) * nPix + pos]);
         }
-      }
 
-    // Scale the moments by neighborhood size
-    accumX /= InpIt.Size();
+      double range = max - min;
+      double mean = sums[pos] / nNbr;
 
-    // The first moment should just be the mean
-    accumX[0] = mean / range;
+      // The first moment is the mean, the others are central moments, which
+      // are expanded in terms of the sums of powers of the intensity
+      accumX.fill(0.0);
+      if(range > 0 && m_HighestDegree > 0)
+        {
+        accumX[0] = mean / range;
+        for(unsigned int k = 1; k < m_HighestDegree; k++)
+          {
+          unsigned int n = k + 1;
+          double moment = 0.0, mean_pow = 1.0;
+          for(int j = n; j >= 0; j--)
+            {
+            double raw = j > 0 ? sums[(j - 1) * nPix + pos] / nNbr : 1.0;
+            moment += binom[n * (nSums + 1) + j] * mean_pow * raw;
+            mean_pow *= -mean;
+            }
+          accumX[k] = moment / std::pow(range, (double) n);
+          }
+        }
 
-    // Assign to the output voxel
-    for(int k = 0; k < m_HighestDegree; k++)
-      {
-      out_pix[k] = static_cast<OutputComponentType>(1000 * accumX[k]);
-      }
+      // Assign to the output voxel
+      for(unsigned int k = 0; k < m_HighestDegree; k++)
+        {
+        out_pix[k] = static_cast<OutputComponentType>(1000 * accumX[k]);
+        }
 
-    // Assign to the output voxel
-    TexIt.Set(out_pix);
+      TexIt.Set(out_pix);
+      }
     }
 }
 
@@ -3,6 +3,7 @@
 
 #include "SNAPCommon.h"
 #include "itkImageToImageFilter.h"
+#include <vector>
 
 // Forward declarations
 namespace itk
@@ -13,6 +14,19 @@ template <class TImage> class ImageRegionIteratorWithIndex;
 
 namespace bilwaj {
 
+/**
+ * Computes, for each voxel, the moments of the intensity around the mean in
+ * a box neighborhood of a given radius. The first component is the mean,
+ * the k-th component is the k-th central moment, and all are normalized by
+ * the intensity range in the neighborhood.
+ *
+ * The moments are computed from box sums of the powers of the intensity,
+ * which are evaluated with separable running sums, and the range is computed
+ * with separable running min/max filters. Each thread works through its
+ * region one slice at a time, keeping the in-slice box statistics of the
+ * slices spanned by the neighborhood in a ring buffer. The cost per voxel
+ * therefore grows with the degree but hardly with the radius.
+ */
 template <class TInputImage, class TOutputImage>
 class MomentTextureFilter
     : public itk::ImageToImageFilter<TInputImage, TOutputImage>
@@ -55,6 +69,17 @@ protected:
 
   virtual void UpdateOutputInformation() ITK_OVERRIDE;
 
+  /**
+   * Compute the statistics of the box neighborhoods of one slice (along the
+   * last dimension) of the input within the in-slice region, i.e., the sums
+   * of powers 1 to nSums of the intensity followed by the min and max. The
+   * slice index is clamped to the input, which replicates the boundary like
+   * the neighborhood iterator's default boundary condition.
+   */
+  void ComputeSliceStatistics(const RegionType &sliceRegion, long slice,
+                              unsigned int nSums, double *stats,
+                              std::vector<double> &scratch);
+
   // Highest degree for which to generate the textures
   unsigned int m_HighestDegree;
 
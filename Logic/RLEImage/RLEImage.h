@@ -192,6 +192,10 @@ public:
     static typename BufferType::RegionType
         truncateRegion(const RegionType & region);
 
+    /** Exchange the pixel data with another image that has the same buffered
+    * region. Only the buffer pointers are swapped, no pixels are copied. */
+    void SwapBuffer(Self * other);
+
     /** Merges adjacent segments with duplicate values.
     * Automatically called when turning on OnTheFlyCleanup. */
     void CleanUp() const;
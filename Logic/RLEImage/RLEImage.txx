@@ -68,6 +68,23 @@ void RLEImage<TPixel, VImageDimension, CounterType>
     myBuffer->FillBuffer(line);
 }
 
+template< typename TPixel, unsigned int VImageDimension, typename CounterType >
+void RLEImage<TPixel, VImageDimension, CounterType>
+::SwapBuffer(Self * other)
+{
+    if (this->GetBufferedRegion() != other->GetBufferedRegion())
+        itkExceptionMacro(<< "Cannot swap buffers of images with different buffered regions");
+
+    typename BufferType::Pointer tmp = myBuffer;
+    myBuffer = other->myBuffer;
+    other->myBuffer = tmp;
+
+    std::swap(m_OnTheFlyCleanup, other->m_OnTheFlyCleanup);
+
+    this->Modified();
+    other->Modified();
+}
+
 template< typename TPixel, unsigned int VImageDimension, typename CounterType >
 void RLEImage<TPixel, VImageDimension, CounterType>::CleanUpLine(RLLine & line) const
 {
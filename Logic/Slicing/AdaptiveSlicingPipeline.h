@@ -50,6 +50,7 @@
 
 template <class TInputImage, class TOutputImage, class TPreviewImage> class IRISSlicer;
 template <class TInputImage, class TOutputImage> class NonOrthogonalSlicer;
+template <class TImage> class ImagePyramid;
 class ImageCoordinateTransform;
 
 using itk::DataObjectDecorator;
@@ -101,6 +102,9 @@ public:
   typedef IRISSlicer<TInputImage,TOutputImage,TPreviewImage> OrthogonalSlicerType;
   typedef NonOrthogonalSlicer<TInputImage,TOutputImage>   NonOrthogonalSlicerType;
 
+  /** Multi-resolution pyramid of the input image */
+  typedef ImagePyramid<TInputImage>                            ImagePyramidType;
+
   /** Reference space for non-orthogonal slicing */
   typedef typename itk::ImageBase<InputImageDimension> NonOrthogonalSliceReferenceSpace;
 
@@ -149,6 +153,41 @@ public:
   void SetUseNearestNeighbor(bool flag);
   bool GetUseNearestNeighbor() const;
 
+  /**
+   * Set the multi-resolution pyramid for the input image. When the pyramid
+   * is set and multi-resolution slicing is enabled, the slicers sample from
+   * the coarsest pyramid level whose voxel size does not exceed the spacing
+   * of the oblique reference image (i.e., the screen pixel size). This applies
+   * to orthogonal slicing as well, in which case the slice has fewer pixels
+   * than the corresponding slice of the input, and larger spacing.
+   */
+  void SetImagePyramid(ImagePyramidType *pyramid);
+  ImagePyramidType *GetImagePyramid() const;
+
+  /** Whether the image pyramid is used for slicing */
+  itkSetMacro(UseMultiResolution, bool)
+  itkGetMacro(UseMultiResolution, bool)
+
+  /**
+   * Whether the image pyramid is also used for orthogonal slicing, when it
+   * is not overridden by SetPyramidLevelOverride. This is off by default,
+   * since the user then sees a coarser slice when the view is zoomed out.
+   */
+  itkSetMacro(UseMultiResolutionForOrthogonalSlicing, bool)
+  itkGetMacro(UseMultiResolutionForOrthogonalSlicing, bool)
+
+  /**
+   * Use a fixed pyramid level instead of the one selected from the reference
+   * image. This is used when slices are generated for purposes other than
+   * display, such as thumbnails and exported slices. A negative value (the
+   * default) means that the level is selected automatically.
+   */
+  itkSetMacro(PyramidLevelOverride, int)
+  itkGetMacro(PyramidLevelOverride, int)
+
+  /** The pyramid level used to generate the last slice */
+  itkGetMacro(SlicingLevel, unsigned int)
+
   /** Look up intensity at the current slice index. This may update the filter */
   OutputPixelType LookupIntensityAtSliceIndex(const itk::ImageBase<3> *ref_space);
 
@@ -179,6 +218,23 @@ protected:
 
   IndexType m_SliceIndex;
 
+  itk::SmartPointer<ImagePyramidType> m_ImagePyramid;
+
+  bool m_UseMultiResolution;
+
+  bool m_UseMultiResolutionForOrthogonalSlicing;
+
+  int m_PyramidLevelOverride;
+
+  unsigned int m_SlicingLevel;
+
+  // Select the pyramid level from which the slice is sampled
+  unsigned int SelectPyramidLevel();
+
+  // Place the pixels of an orthogonal slice of a coarse level at the centers
+  // of the blocks of voxels that they cover
+  void UpdateCoarseSliceOrigin(OutputImageType *output);
+
   void MapInputsToSlicers();
 };
 
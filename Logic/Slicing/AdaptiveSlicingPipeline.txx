@@ -46,6 +46,7 @@
 #include "AdaptiveSlicingPipeline.h"
 #include "IRISSlicer.h"
 #include "NonOrthogonalSlicer.h"
+#include "ImagePyramid.h"
 #include "IRISVectorTypesToITKConversion.h"
 
 template<class TInputImage> class AdaptiveSlicingPipeline_PixelFiller
@@ -96,6 +97,12 @@ AdaptiveSlicingPipeline<TInputImage, TOutputImage, TPreviewImage>
 
   // Initially use the ortho
   m_UseOrthogonalSlicing = true;
+
+  // Use the pyramid, if one is provided
+  m_UseMultiResolution = true;
+  m_UseMultiResolutionForOrthogonalSlicing = false;
+  m_PyramidLevelOverride = -1;
+  m_SlicingLevel = 0;
 }
 
 template<typename TInputImage, typename TOutputImage, typename TPreviewImage>
@@ -107,14 +114,51 @@ AdaptiveSlicingPipeline<TInputImage, TOutputImage, TPreviewImage>
     this->GetOutput()->SetPixelContainer(NULL);
 }
 
+template<typename TInputImage, typename TOutputImage, typename TPreviewImage>
+unsigned int
+AdaptiveSlicingPipeline<TInputImage, TOutputImage, TPreviewImage>
+::SelectPyramidLevel()
+{
+  if(!m_UseMultiResolution || !m_ImagePyramid || !m_ImagePyramid->IsSupported()
+     || m_ImagePyramid->GetImage() != this->GetInput())
+    return 0;
+
+  // The preview image is only available at full resolution
+  if(m_UseOrthogonalSlicing && this->GetPreviewImage())
+    return 0;
+
+  if(m_PyramidLevelOverride >= 0)
+    return std::min((unsigned int) m_PyramidLevelOverride,
+                    (unsigned int) ImagePyramidType::NumberOfLevels - 1);
+
+  // When the display is zoomed out, each screen pixel covers many voxels, and
+  // it is cheaper (and less aliased) to sample from a coarser pyramid level
+  if(!this->GetObliqueReferenceImage())
+    return 0;
+
+  if(m_UseOrthogonalSlicing && !m_UseMultiResolutionForOrthogonalSlicing)
+    return 0;
+
+  double step = m_ImagePyramid->ComputeSamplingStep(
+                  this->GetObliqueReferenceImage(),
+                  this->GetObliqueTransformInput() ? this->GetObliqueTransform() : NULL);
+  return m_ImagePyramid->SelectLevel(step);
+}
+
 template<typename TInputImage, typename TOutputImage, typename TPreviewImage>
 void
 AdaptiveSlicingPipeline<TInputImage, TOutputImage, TPreviewImage>
 ::MapInputsToSlicers()
 {
+  // Select the input or one of its downsampled versions
+  m_SlicingLevel = this->SelectPyramidLevel();
+  InputImageType *input = (m_SlicingLevel > 0)
+      ? m_ImagePyramid->GetLevel(m_SlicingLevel)
+      : const_cast<InputImageType *>(this->GetInput());
+
   if(m_UseOrthogonalSlicing)
     {
-    m_OrthogonalSlicer->SetInput(this->GetInput());
+    m_OrthogonalSlicer->SetInput(input);
     m_OrthogonalSlicer->SetPreviewInput(
           const_cast<PreviewImageType *>(this->GetPreviewImage()));
 
@@ -138,18 +182,57 @@ AdaptiveSlicingPipeline<TInputImage, TOutputImage, TPreviewImage>
     m_OrthogonalSlicer->SetLineTraverseForward(
           tinv->GetCoordinateOrientation(1) > 0);
 
-    // Set the slice index
+    // Set the slice index. On a coarse level, this is the index of the voxel
+    // whose 2^k x 2^k x 2^k block contains the full-resolution slice
     m_OrthogonalSlicer->SetSliceIndex(
-          m_SliceIndex[m_OrthogonalSlicer->GetSliceDirectionImageAxis()]);
+          m_SliceIndex[m_OrthogonalSlicer->GetSliceDirectionImageAxis()] >> m_SlicingLevel);
     }
   else
     {
-    m_ObliqueSlicer->SetInput(this->GetInput());
+    m_ObliqueSlicer->SetInput(input);
     m_ObliqueSlicer->SetTransform(this->GetObliqueTransform());
     m_ObliqueSlicer->SetReferenceImage(this->GetObliqueReferenceImage());
     }
 }
 
+template<typename TInputImage, typename TOutputImage, typename TPreviewImage>
+void
+AdaptiveSlicingPipeline<TInputImage, TOutputImage, TPreviewImage>
+::UpdateCoarseSliceOrigin(OutputImageType *output)
+{
+  // The orthogonal slicer places the first pixel at the origin. On level k,
+  // that pixel is the average of a block of 2^k voxels along each axis, whose
+  // center is (2^k - 1) / 2 voxels of the full-resolution slice away
+  if(m_SlicingLevel == 0)
+    return;
+
+  double factor = 1 << m_SlicingLevel;
+  typename OutputImageType::PointType origin;
+  for(unsigned int d = 0; d < ImageDimension; d++)
+    origin[d] = 0.5 * (factor - 1) * output->GetSpacing()[d] / factor;
+  output->SetOrigin(origin);
+}
+
+template<typename TInputImage, typename TOutputImage, typename TPreviewImage>
+void
+AdaptiveSlicingPipeline<TInputImage, TOutputImage, TPreviewImage>
+::SetImagePyramid(ImagePyramidType *pyramid)
+{
+  if(m_ImagePyramid != pyramid)
+    {
+    m_ImagePyramid = pyramid;
+    this->Modified();
+    }
+}
+
+template<typename TInputImage, typename TOutputImage, typename TPreviewImage>
+typename AdaptiveSlicingPipeline<TInputImage, TOutputImage, TPreviewImage>::ImagePyramidType *
+AdaptiveSlicingPipeline<TInputImage, TOutputImage, TPreviewImage>
+::GetImagePyramid() const
+{
+  return m_ImagePyramid;
+}
+
 template<typename TInputImage, typename TOutputImage, typename TPreviewImage>
 void
 AdaptiveSlicingPipeline<TInputImage, TOutputImage, TPreviewImage>
@@ -167,6 +250,7 @@ AdaptiveSlicingPipeline<TInputImage, TOutputImage, TPreviewImage>
     m_OrthogonalSlicer->UpdateOutputInformation();
     m_OrthogonalSlicer->GetOutput()->SetRequestedRegionToLargestPossibleRegion();
     output->CopyInformation(m_OrthogonalSlicer->GetOutput());
+    this->UpdateCoarseSliceOrigin(output);
     }
   else
     {
@@ -219,6 +303,7 @@ AdaptiveSlicingPipeline<TInputImage, TOutputImage, TPreviewImage>
     {
     m_OrthogonalSlicer->Update();
     output->Graft(m_OrthogonalSlicer->GetOutput());
+    this->UpdateCoarseSliceOrigin(output);
     }
   else
     {
@@ -246,13 +331,25 @@ AdaptiveSlicingPipeline<TInputImage, TOutputImage, TPreviewImage>
   // The lookup location
   Vector3ui cursor(index);
 
-  if(m_UseOrthogonalSlicing)
+  // Continuous index of the lookup location in the input image
+  itk::ContinuousIndex<double, 3> native_cindex;
+  bool use_nn;
+
+  if(m_UseOrthogonalSlicing && m_SlicingLevel == 0)
     {
     // If we are using ortho slicing, we can just sample the slice
     Vector3ui slice_3d = this->GetOrthogonalTransform()->TransformVoxelIndex(cursor);
     itk::Index<2> slice_idx; slice_idx[0] = slice_3d[0]; slice_idx[1] = slice_3d[1];
     return this->GetOutput()->GetPixel(slice_idx);
     }
+  else if(m_UseOrthogonalSlicing)
+    {
+    // The slice was sampled from a coarse pyramid level, so the intensity is
+    // looked up at the cursor voxel in the full-resolution input
+    for(int d = 0; d < 3; d++)
+      native_cindex[d] = cursor[d];
+    use_nn = true;
+    }
   else
     {
     // The cursor may be outside of the slice, so we need to map the location back
@@ -266,26 +363,26 @@ AdaptiveSlicingPipeline<TInputImage, TOutputImage, TPreviewImage>
     native_point = this->GetObliqueTransform()->TransformPoint(cursor_point);
 
     // Map the native point to an index
-    itk::ContinuousIndex<double, 3> native_cindex;
     this->GetInput()->TransformPhysicalPointToContinuousIndex(native_point, native_cindex);
+    use_nn = false;
+    }
 
-    // Create a pointer to pixel data
-    unsigned int k = this->GetOutput()->GetNumberOfComponentsPerPixel();
-    OutputComponentType *out_arr = new OutputComponentType[k], *dummy = out_arr;
+  // Create a pointer to pixel data
+  unsigned int k = this->GetOutput()->GetNumberOfComponentsPerPixel();
+  OutputComponentType *out_arr = new OutputComponentType[k], *dummy = out_arr;
 
-    // Use worker class to interpolate input image - out_arr will be filled
-    typedef typename NonOrthogonalSlicerType::WorkerType WorkerType;
-    WorkerType worker(const_cast<InputImageType *>(this->GetInput()));
-    worker.ProcessVoxel(native_cindex.GetDataPointer(), false, &dummy);
+  // Use worker class to interpolate input image - out_arr will be filled
+  typedef typename NonOrthogonalSlicerType::WorkerType WorkerType;
+  WorkerType worker(const_cast<InputImageType *>(this->GetInput()));
+  worker.ProcessVoxel(native_cindex.GetDataPointer(), use_nn, &dummy);
 
-    // Create a pixel to return - we use a specialized class for vector/non-vector
-    OutputPixelType pix;
-    AdaptiveSlicingPipeline_PixelFiller<OutputImageType>
-        ::MakePixel(this->GetOutput(),pix, out_arr);
+  // Create a pixel to return - we use a specialized class for vector/non-vector
+  OutputPixelType pix;
+  AdaptiveSlicingPipeline_PixelFiller<OutputImageType>
+      ::MakePixel(this->GetOutput(),pix, out_arr);
 
-    delete[] out_arr;
-    return pix;
-    }
+  delete[] out_arr;
+  return pix;
 }
 
 
@@ -0,0 +1,134 @@
+#ifndef AXISALIGNEDRESAMPLEIMAGEFILTER_H
+#define AXISALIGNEDRESAMPLEIMAGEFILTER_H
+
+#include "itkImageToImageFilter.h"
+#include <vector>
+
+/**
+ * \class AxisAlignedResampleImageFilter
+ * \brief Resamples an image onto a grid that differs from the input grid
+ * only by scaling and translation along the image axes
+ *
+ * This is what happens when SNAP extracts a resampled ROI for snake mode,
+ * and when the snake result is mapped back onto the main image. In this
+ * case the position of a sample along each axis depends only on its index
+ * along that axis, so the interpolation indices and weights are computed
+ * once per axis, rather than once per voxel as in itk::ResampleImageFilter.
+ * The voxels are then interpolated with the same trilinear kernel as in
+ * FastLinearInterpolator, all components of a vector image at once. The
+ * output is computed in parallel over slabs.
+ *
+ * Only nearest neighbor and linear interpolation are supported. As in
+ * itk::LinearInterpolateImageFunction, samples within half a voxel of the
+ * edge of the input are interpolated from the nearest edge voxels, and
+ * samples further away are assigned the default value, unless
+ * ExtrapolateFromEdge is on, in which case they take the value of the
+ * nearest edge voxels as well.
+ *
+ * The output direction is that of the input. The output origin and spacing
+ * must be given with respect to the same directions. Only 2D and 3D images
+ * are supported.
+ */
+template <typename TInputImage, typename TOutputImage>
+class AxisAlignedResampleImageFilter
+    : public itk::ImageToImageFilter<TInputImage, TOutputImage>
+{
+public:
+  /** Standard class typedefs. */
+  typedef AxisAlignedResampleImageFilter                              Self;
+  typedef itk::ImageToImageFilter<TInputImage, TOutputImage>    Superclass;
+  typedef itk::SmartPointer<Self>                                  Pointer;
+  typedef itk::SmartPointer<const Self>                       ConstPointer;
+
+  typedef TInputImage                                       InputImageType;
+  typedef typename InputImageType::InternalPixelType    InputComponentType;
+
+  typedef TOutputImage                                     OutputImageType;
+  typedef typename OutputImageType::InternalPixelType  OutputComponentType;
+  typedef typename OutputImageType::RegionType       OutputImageRegionType;
+  typedef typename OutputImageType::SizeType                      SizeType;
+  typedef typename OutputImageType::SpacingType                SpacingType;
+  typedef typename OutputImageType::PointType                    PointType;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro(Self)
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro(AxisAlignedResampleImageFilter, ImageToImageFilter)
+
+  itkStaticConstMacro(ImageDimension, unsigned int, TOutputImage::ImageDimension);
+
+  /** Size of the output image */
+  itkSetMacro(Size, SizeType)
+  itkGetConstReferenceMacro(Size, SizeType)
+
+  /** Spacing of the output image */
+  itkSetMacro(OutputSpacing, SpacingType)
+  void SetOutputSpacing(const double *spacing)
+    { this->SetOutputSpacing(SpacingType(spacing)); }
+  itkGetConstReferenceMacro(OutputSpacing, SpacingType)
+
+  /** Origin of the output image */
+  itkSetMacro(OutputOrigin, PointType)
+  void SetOutputOrigin(const double *origin)
+    { this->SetOutputOrigin(PointType(origin)); }
+  itkGetConstReferenceMacro(OutputOrigin, PointType)
+
+  /** Interpolation type (linear by default) */
+  itkSetMacro(UseNearestNeighbor, bool)
+  itkGetMacro(UseNearestNeighbor, bool)
+
+  /** Value assigned to all components of samples outside of the input */
+  itkSetMacro(DefaultValue, double)
+  itkGetMacro(DefaultValue, double)
+
+  /** Whether samples outside of the input take the value of the nearest
+   * voxel of the input (off by default) */
+  itkSetMacro(ExtrapolateFromEdge, bool)
+  itkGetMacro(ExtrapolateFromEdge, bool)
+
+protected:
+
+  AxisAlignedResampleImageFilter();
+  ~AxisAlignedResampleImageFilter() {}
+
+  virtual void GenerateOutputInformation() ITK_OVERRIDE;
+
+  virtual void GenerateInputRequestedRegion() ITK_OVERRIDE;
+
+  virtual void BeforeThreadedGenerateData() ITK_OVERRIDE;
+
+  virtual void ThreadedGenerateData(const OutputImageRegionType& outputRegionForThread,
+                                    itk::ThreadIdType threadId) ITK_OVERRIDE;
+
+  // Interpolation table for one axis. For each output index, the offsets
+  // (in components) of the two input voxels that are blended, the weight
+  // of the second voxel, and whether the sample is inside of the input
+  struct AxisTable
+  {
+    std::vector<long> offset0, offset1;
+    std::vector<double> weight;
+    std::vector<bool> inside;
+  };
+
+  // Convert an interpolated value to an output component
+  static OutputComponentType CastValue(double value);
+
+private:
+
+  SizeType m_Size;
+  SpacingType m_OutputSpacing;
+  PointType m_OutputOrigin;
+  bool m_UseNearestNeighbor;
+  double m_DefaultValue;
+  bool m_ExtrapolateFromEdge;
+
+  // Tables for the x, y and z axes. A 2D image is a single slice along z
+  AxisTable m_Table[3];
+};
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "AxisAlignedResampleImageFilter.txx"
+#endif
+
+#endif // AXISALIGNEDRESAMPLEIMAGEFILTER_H
@@ -0,0 +1,222 @@
+#ifndef AXISALIGNEDRESAMPLEIMAGEFILTER_TXX
+#define AXISALIGNEDRESAMPLEIMAGEFILTER_TXX
+
+#include "AxisAlignedResampleImageFilter.h"
+#include "FastLinearInterpolator.h"
+#include "itkContinuousIndex.h"
+#include "itkProgressReporter.h"
+#include <algorithm>
+#include <cmath>
+
+template <class TInputImage, class TOutputImage>
+AxisAlignedResampleImageFilter<TInputImage, TOutputImage>
+::AxisAlignedResampleImageFilter()
+  : m_UseNearestNeighbor(false), m_DefaultValue(0.0), m_ExtrapolateFromEdge(false)
+{
+  m_Size.Fill(0);
+  m_OutputSpacing.Fill(1.0);
+  m_OutputOrigin.Fill(0.0);
+}
+
+template <class TInputImage, class TOutputImage>
+void
+AxisAlignedResampleImageFilter<TInputImage, TOutputImage>
+::GenerateOutputInformation()
+{
+  // This copies the direction and the number of components from the input
+  Superclass::GenerateOutputInformation();
+
+  OutputImageType *output = this->GetOutput();
+  OutputImageRegionType region;
+  region.SetSize(m_Size);
+  output->SetLargestPossibleRegion(region);
+  output->SetSpacing(m_OutputSpacing);
+  output->SetOrigin(m_OutputOrigin);
+  output->SetDirection(this->GetInput()->GetDirection());
+  output->SetNumberOfComponentsPerPixel(this->GetInput()->GetNumberOfComponentsPerPixel());
+}
+
+template <class TInputImage, class TOutputImage>
+void
+AxisAlignedResampleImageFilter<TInputImage, TOutputImage>
+::GenerateInputRequestedRegion()
+{
+  InputImageType *input = const_cast<InputImageType *>(this->GetInput());
+  if(input)
+    input->SetRequestedRegionToLargestPossibleRegion();
+}
+
+template <class TInputImage, class TOutputImage>
+typename AxisAlignedResampleImageFilter<TInputImage, TOutputImage>::OutputComponentType
+AxisAlignedResampleImageFilter<TInputImage, TOutputImage>
+::CastValue(double value)
+{
+  // Same as the bounds checking in itk::ResampleImageFilter
+  typedef itk::NumericTraits<OutputComponentType> Traits;
+  value = std::max(value, (double) Traits::NonpositiveMin());
+  value = std::min(value, (double) Traits::max());
+  return static_cast<OutputComponentType>(value);
+}
+
+template <class TInputImage, class TOutputImage>
+void
+AxisAlignedResampleImageFilter<TInputImage, TOutputImage>
+::BeforeThreadedGenerateData()
+{
+  const InputImageType *input = this->GetInput();
+  OutputImageType *output = this->GetOutput();
+
+  typedef FastWarpCompositeImageFilterInputImageTraits<TInputImage> InputTraits;
+  long nComp = InputTraits::GetPointerIncrementSize(input);
+
+  typename OutputImageType::IndexType idxStart = output->GetLargestPossibleRegion().GetIndex();
+  typename InputImageType::RegionType inRegion = input->GetBufferedRegion();
+
+  // The output axes are parallel to the input axes, so the continuous index
+  // of a sample along an axis depends only on its index along that axis
+  for(unsigned int d = 0; d < ImageDimension; d++)
+    {
+    AxisTable &tab = m_Table[d];
+    int n = m_Size[d], nIn = inRegion.GetSize(d);
+    long stride = nComp * input->GetOffsetTable()[d];
+
+    tab.offset0.resize(n);
+    tab.offset1.resize(n);
+    tab.weight.resize(n);
+    tab.inside.resize(n);
+
+    for(int i = 0; i < n; i++)
+      {
+      typename OutputImageType::IndexType idx = idxStart;
+      idx[d] += i;
+
+      PointType point;
+      itk::ContinuousIndex<double, ImageDimension> cix;
+      output->TransformIndexToPhysicalPoint(idx, point);
+      input->TransformPhysicalPointToContinuousIndex(point, cix);
+      double c = cix[d] - inRegion.GetIndex(d);
+
+      tab.inside[i] = m_ExtrapolateFromEdge || (c >= -0.5 && c < nIn - 0.5);
+
+      int k0, k1;
+      if(m_UseNearestNeighbor)
+        {
+        k0 = k1 = (int) std::floor(c + 0.5);
+        tab.weight[i] = 0.0;
+        }
+      else
+        {
+        k0 = (int) std::floor(c);
+        k1 = k0 + 1;
+        tab.weight[i] = c - k0;
+        }
+
+      tab.offset0[i] = stride * std::max(0, std::min(k0, nIn - 1));
+      tab.offset1[i] = stride * std::max(0, std::min(k1, nIn - 1));
+      }
+    }
+
+  // The missing axes of a 2D image have a single sample
+  for(unsigned int d = ImageDimension; d < 3; d++)
+    {
+    AxisTable &tab = m_Table[d];
+    tab.offset0.assign(1, 0);
+    tab.offset1.assign(1, 0);
+    tab.weight.assign(1, 0.0);
+    tab.inside.assign(1, true);
+    }
+}
+
+template <class TInputImage, class TOutputImage>
+void
+AxisAlignedResampleImageFilter<TInputImage, TOutputImage>
+::ThreadedGenerateData(const OutputImageRegionType &outputRegionForThread,
+                       itk::ThreadIdType threadId)
+{
+  const InputImageType *input = this->GetInput();
+  OutputImageType *output = this->GetOutput();
+
+  typedef FastWarpCompositeImageFilterInputImageTraits<TInputImage> InputTraits;
+  int nComp = InputTraits::GetPointerIncrementSize(input);
+  const InputComponentType *buffer = input->GetBufferPointer();
+
+  const AxisTable &tx = m_Table[0], &ty = m_Table[1], &tz = m_Table[2];
+  OutputComponentType defval = CastValue(m_DefaultValue);
+  bool use_nn = m_UseNearestNeighbor;
+
+  // Table entries are relative to the start of the output
+  typename OutputImageType::IndexType idxStart = output->GetLargestPossibleRegion().GetIndex();
+  typename OutputImageType::IndexType idxRegion = outputRegionForThread.GetIndex();
+  int x0 = idxRegion[0] - idxStart[0], nx = outputRegionForThread.GetSize(0);
+  int y0 = idxRegion[1] - idxStart[1], ny = outputRegionForThread.GetSize(1);
+  int z0 = 0, nz = 1;
+  for(unsigned int d = 2; d < ImageDimension; d++)
+    {
+    z0 = idxRegion[d] - idxStart[d];
+    nz = outputRegionForThread.GetSize(d);
+    }
+
+  itk::ProgressReporter progress(this, threadId, ny * nz);
+
+  for(int z = z0; z < z0 + nz; z++)
+    {
+    for(int y = y0; y < y0 + ny; y++)
+      {
+      typename OutputImageType::IndexType idxLine = idxRegion;
+      idxLine[1] = idxStart[1] + y;
+      for(unsigned int d = 2; d < ImageDimension; d++)
+        idxLine[d] = idxStart[d] + z;
+      OutputComponentType *out =
+          output->GetBufferPointer() + nComp * output->ComputeOffset(idxLine);
+
+      if(!ty.inside[y] || !tz.inside[z])
+        {
+        std::fill(out, out + nComp * nx, defval);
+        progress.CompletedPixel();
+        continue;
+        }
+
+      // The four input lines that are blended to form this output line
+      const InputComponentType *r00 = buffer + ty.offset0[y] + tz.offset0[z];
+      const InputComponentType *r10 = buffer + ty.offset1[y] + tz.offset0[z];
+      const InputComponentType *r01 = buffer + ty.offset0[y] + tz.offset1[z];
+      const InputComponentType *r11 = buffer + ty.offset1[y] + tz.offset1[z];
+      double fy = ty.weight[y], fz = tz.weight[z];
+
+      for(int x = x0; x < x0 + nx; x++)
+        {
+        if(!tx.inside[x])
+          {
+          for(int k = 0; k < nComp; k++)
+            *out++ = defval;
+          }
+        else if(use_nn)
+          {
+          const InputComponentType *p = r00 + tx.offset0[x];
+          for(int k = 0; k < nComp; k++)
+            *out++ = static_cast<OutputComponentType>(p[k]);
+          }
+        else
+          {
+          // Trilinear interpolation in the same order as FastLinearInterpolator
+          long i0 = tx.offset0[x], i1 = tx.offset1[x];
+          double fx = tx.weight[x];
+          for(int k = 0; k < nComp; k++, i0++, i1++)
+            {
+            double dx00 = r00[i0] + (r00[i1] - r00[i0]) * fx;
+            double dx01 = r01[i0] + (r01[i1] - r01[i0]) * fx;
+            double dx10 = r10[i0] + (r10[i1] - r10[i0]) * fx;
+            double dx11 = r11[i0] + (r11[i1] - r11[i0]) * fx;
+            double dxy0 = dx00 + (dx10 - dx00) * fy;
+            double dxy1 = dx01 + (dx11 - dx01) * fy;
+            *out++ = CastValue(dxy0 + (dxy1 - dxy0) * fz);
+            }
+          }
+        }
+
+      progress.CompletedPixel();
+      }
+    }
+}
+
+#endif // AXISALIGNEDRESAMPLEIMAGEFILTER_TXX
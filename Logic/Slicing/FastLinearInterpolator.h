@@ -29,6 +29,7 @@
 
 #include "itkVectorImage.h"
 #include "itkNumericTraits.h"
+#include <algorithm>
 
 template <class TFloat, class TInputComponentType>
 struct FastLinearInterpolatorOutputTraits
@@ -404,6 +405,79 @@ public:
     else return Superclass::OUTSIDE;
   }
 
+  /**
+   * Interpolate a run of n samples at positions cix + i * step, writing the
+   * sampled components of each sample consecutively into out. The caller
+   * must guarantee that for every sample, 0 <= cix[d] < size[d] - 1, so that
+   * the interpolation cube is inside the image; this is not checked. The
+   * samples are processed in blocks: offsets and weights for a block are
+   * computed first in tight loops that the compiler can vectorize, followed
+   * by the interpolation itself.
+   */
+  template <class TOutputComponent>
+  void InterpolateInteriorRun(const RealType *cix, const RealType *step, int n,
+                              TOutputComponent *out)
+  {
+    const int BLOCK = 8;
+    int off[BLOCK];
+    RealType wx[BLOCK], wy[BLOCK], wz[BLOCK];
+    int sx = this->nComp, sy = xsize * this->nComp, sz = xsize * ysize * this->nComp;
+
+    for(int i = 0; i < n; i += BLOCK)
+      {
+      int nb = std::min(BLOCK, n - i);
+
+      // Compute the offsets and weights for the block. The coordinates are
+      // non-negative, so truncation is the same as floor
+      for(int j = 0; j < nb; j++)
+        {
+        RealType px = cix[0] + (i + j) * step[0];
+        RealType py = cix[1] + (i + j) * step[1];
+        RealType pz = cix[2] + (i + j) * step[2];
+        int ix = (int) px, iy = (int) py, iz = (int) pz;
+        wx[j] = px - ix; wy[j] = py - iy; wz[j] = pz - iz;
+        off[j] = ix * sx + iy * sy + iz * sz;
+        }
+
+      // Interpolate the block
+      for(int j = 0; j < nb; j++)
+        {
+        const InputComponentType *p000 = this->buffer + off[j];
+        const InputComponentType *p010 = p000 + sy, *p001 = p000 + sz, *p011 = p001 + sy;
+        for(int c = 0; c < this->nSampled; c++)
+          {
+          OutputComponentType dx00 = Superclass::lerp(wx[j], p000[c], p000[c + sx]);
+          OutputComponentType dx10 = Superclass::lerp(wx[j], p010[c], p010[c + sx]);
+          OutputComponentType dx01 = Superclass::lerp(wx[j], p001[c], p001[c + sx]);
+          OutputComponentType dx11 = Superclass::lerp(wx[j], p011[c], p011[c + sx]);
+          OutputComponentType dxy0 = Superclass::lerp(wy[j], dx00, dx10);
+          OutputComponentType dxy1 = Superclass::lerp(wy[j], dx01, dx11);
+          *(out++) = static_cast<TOutputComponent>(Superclass::lerp(wz[j], dxy0, dxy1));
+          }
+        }
+      }
+  }
+
+  /**
+   * Nearest neighbor version of InterpolateInteriorRun, with the same
+   * requirements on the sample positions.
+   */
+  template <class TOutputComponent>
+  void InterpolateNearestNeighborInteriorRun(const RealType *cix, const RealType *step, int n,
+                                             TOutputComponent *out)
+  {
+    int sx = this->nComp, sy = xsize * this->nComp, sz = xsize * ysize * this->nComp;
+    for(int i = 0; i < n; i++)
+      {
+      int ix = (int) (cix[0] + i * step[0] + 0.5);
+      int iy = (int) (cix[1] + i * step[1] + 0.5);
+      int iz = (int) (cix[2] + i * step[2] + 0.5);
+      const InputComponentType *dp = this->buffer + ix * sx + iy * sy + iz * sz;
+      for(int c = 0; c < this->nSampled; c++)
+        *(out++) = static_cast<TOutputComponent>(dp[c]);
+      }
+  }
+
 
   template <class THistContainer>
   void PartialVolumeHistogramSample(RealType *cix, const InputComponentType *fixptr, THistContainer &hist)
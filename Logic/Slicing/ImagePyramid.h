@@ -0,0 +1,170 @@
+#ifndef IMAGEPYRAMID_H
+#define IMAGEPYRAMID_H
+
+#include "SNAPCommon.h"
+#include "itkObject.h"
+#include "itkObjectFactory.h"
+#include "itkImageBase.h"
+#include "itkImageToImageFilter.h"
+
+namespace itk
+{
+template <typename TParametersValueType,
+          unsigned int NInputDimensions,
+          unsigned int NOutputDimensions> class Transform;
+}
+
+/**
+ * \class ImagePyramidLevelFilter
+ * \brief Computes one level of an ImagePyramid from the previous level
+ *
+ * Each voxel in the output is the average of a 2x2x2 block of voxels in the
+ * input (fewer at the upper boundary when the input size is odd). The output
+ * has twice the voxel size of the input, and the center of the first output
+ * voxel is the center of the first 2x2x2 block. The filter always computes
+ * the whole output, in parallel over slabs. Works with itk::Image and with
+ * itk::VectorImage, whose buffers are contiguous.
+ */
+template <typename TImage>
+class ImagePyramidLevelFilter
+    : public itk::ImageToImageFilter<TImage, TImage>
+{
+public:
+  /** Standard class typedefs. */
+  typedef ImagePyramidLevelFilter                                     Self;
+  typedef itk::ImageToImageFilter<TImage, TImage>               Superclass;
+  typedef itk::SmartPointer<Self>                                  Pointer;
+  typedef itk::SmartPointer<const Self>                       ConstPointer;
+
+  typedef TImage                                                 ImageType;
+  typedef typename ImageType::InternalPixelType              ComponentType;
+  typedef typename ImageType::RegionType                 OutputImageRegionType;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro(Self)
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro(ImagePyramidLevelFilter, ImageToImageFilter)
+
+  itkStaticConstMacro(ImageDimension, unsigned int, TImage::ImageDimension);
+
+protected:
+
+  ImagePyramidLevelFilter() {}
+  ~ImagePyramidLevelFilter() {}
+
+  virtual void GenerateOutputInformation() ITK_OVERRIDE;
+
+  virtual void GenerateInputRequestedRegion() ITK_OVERRIDE;
+
+  virtual void EnlargeOutputRequestedRegion(itk::DataObject *output) ITK_OVERRIDE;
+
+  virtual void ThreadedGenerateData(const OutputImageRegionType& outputRegionForThread,
+                                    itk::ThreadIdType threadId) ITK_OVERRIDE;
+
+  // Convert an average to an output component
+  static ComponentType CastAverage(double value);
+};
+
+/**
+ * Helper traits class that creates the filters used to build the levels of
+ * an ImagePyramid. The default implementation does not support downsampling,
+ * so that pyramids for image types that cannot be downsampled directly (RLE
+ * images, image adaptors) consist of just the full-resolution image. Concrete
+ * images (itk::Image, itk::VectorImage) are supported through partial
+ * specialization in ImagePyramid.txx
+ */
+template <class TImage>
+class ImagePyramidLevelBuilder
+{
+public:
+  static bool IsSupported() { return false; }
+  static SmartPtr<itk::ProcessObject> CreateFilter(TImage *, SmartPtr<TImage> &)
+    { return NULL; }
+};
+
+/**
+ * \class ImagePyramid
+ * \brief A lazily computed multi-resolution pyramid of an image.
+ *
+ * Level 0 of the pyramid is the image itself. Each subsequent level is
+ * obtained by averaging 2x2x2 blocks of voxels in the previous level, so that
+ * level k has 2^k times the voxel size of the image. The levels are outputs
+ * of a chain of ImagePyramidLevelFilter objects that is created the first
+ * time a level is requested. The levels are computed, as a whole, when the
+ * pipeline that consumes them is updated, and are recomputed by the pipeline
+ * when the image is modified.
+ *
+ * The pyramid is used by the slicing pipeline to reduce the amount of data
+ * touched when an image is displayed at a zoom level where each screen pixel
+ * covers several image voxels.
+ */
+template <class TImage>
+class ImagePyramid : public itk::Object
+{
+public:
+
+  // Standard ITK class stuff
+  irisITKObjectMacro(ImagePyramid, itk::Object)
+
+  typedef TImage                                                   ImageType;
+  typedef SmartPtr<ImageType>                                   ImagePointer;
+  typedef itk::ImageBase<ImageType::ImageDimension>            ImageBaseType;
+  typedef itk::Transform<double, ImageType::ImageDimension,
+                         ImageType::ImageDimension>            TransformType;
+
+  /** Number of levels in the pyramid, including the full-resolution image */
+  itkStaticConstMacro(NumberOfLevels, unsigned int, 4);
+
+  /** Set the full-resolution image. This discards all the levels */
+  void SetImage(ImageType *image);
+
+  /** Get the full-resolution image */
+  ImageType *GetImage() const { return m_Levels[0]; }
+
+  /** Whether the pyramid can hold levels other than the image itself */
+  bool IsSupported() const;
+
+  /**
+   * Get the image at the given level. The image is the output of a filter,
+   * and it is not computed until the pipeline is updated. For image types
+   * that can not be downsampled, this always returns the full-resolution image.
+   */
+  ImageType *GetLevel(unsigned int level);
+
+  /**
+   * Select the level appropriate for sampling the image with a given step,
+   * expressed in units of full-resolution voxels. The coarsest level whose
+   * voxel size does not exceed the sampling step is returned.
+   */
+  unsigned int SelectLevel(double voxels_per_sample) const;
+
+  /**
+   * Compute the sampling step (in units of image voxels) of a 2D slice whose
+   * geometry is given by a reference image and a transform from the reference
+   * space to the physical space of the image. The smaller of the steps along
+   * the two in-plane directions of the reference image is returned.
+   */
+  double ComputeSamplingStep(const ImageBaseType *reference,
+                             const TransformType *transform) const;
+
+  /** Discard all the levels and their filters, freeing memory */
+  void ReleaseLevels();
+
+protected:
+
+  ImagePyramid();
+  ~ImagePyramid() {}
+
+  // The image at each level; level 0 is the image itself
+  ImagePointer m_Levels[NumberOfLevels];
+
+  // The filter that computes each level from the previous one
+  SmartPtr<itk::ProcessObject> m_Filters[NumberOfLevels];
+};
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "ImagePyramid.txx"
+#endif
+
+#endif // IMAGEPYRAMID_H
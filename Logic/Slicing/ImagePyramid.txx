@@ -0,0 +1,268 @@
+#ifndef IMAGEPYRAMID_TXX
+#define IMAGEPYRAMID_TXX
+
+#include "ImagePyramid.h"
+#include "itkImage.h"
+#include "itkVectorImage.h"
+#include "itkTransform.h"
+#include "itkContinuousIndex.h"
+#include "itkNumericTraits.h"
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+template <class TImage>
+void
+ImagePyramidLevelFilter<TImage>
+::GenerateOutputInformation()
+{
+  // This copies the direction and the number of components from the input
+  Superclass::GenerateOutputInformation();
+
+  const ImageType *input = this->GetInput();
+  ImageType *output = this->GetOutput();
+  OutputImageRegionType inRegion = input->GetLargestPossibleRegion();
+
+  // The output voxels are twice the size of the input voxels, and the center
+  // of the first output voxel is the center of the first 2x2x2 block
+  OutputImageRegionType region;
+  itk::ContinuousIndex<double, ImageDimension> cixOrigin;
+  typename ImageType::SpacingType spacing = input->GetSpacing();
+  for(unsigned int d = 0; d < ImageDimension; d++)
+    {
+    region.SetSize(d, (inRegion.GetSize(d) + 1) / 2);
+    cixOrigin[d] = inRegion.GetIndex(d) + 0.5;
+    spacing[d] *= 2.0;
+    }
+
+  typename ImageType::PointType origin;
+  input->TransformContinuousIndexToPhysicalPoint(cixOrigin, origin);
+
+  output->SetLargestPossibleRegion(region);
+  output->SetSpacing(spacing);
+  output->SetOrigin(origin);
+  output->SetDirection(input->GetDirection());
+  output->SetNumberOfComponentsPerPixel(input->GetNumberOfComponentsPerPixel());
+}
+
+template <class TImage>
+void
+ImagePyramidLevelFilter<TImage>
+::GenerateInputRequestedRegion()
+{
+  ImageType *input = const_cast<ImageType *>(this->GetInput());
+  if(input)
+    input->SetRequestedRegionToLargestPossibleRegion();
+}
+
+template <class TImage>
+void
+ImagePyramidLevelFilter<TImage>
+::EnlargeOutputRequestedRegion(itk::DataObject *output)
+{
+  // The levels are consumed one slice at a time, so computing the whole level
+  // at once avoids redoing the work each time the slice changes
+  output->SetRequestedRegionToLargestPossibleRegion();
+}
+
+template <class TImage>
+typename ImagePyramidLevelFilter<TImage>::ComponentType
+ImagePyramidLevelFilter<TImage>
+::CastAverage(double value)
+{
+  if(itk::NumericTraits<ComponentType>::is_integer)
+    return static_cast<ComponentType>(std::floor(value + 0.5));
+  return static_cast<ComponentType>(value);
+}
+
+template <class TImage>
+void
+ImagePyramidLevelFilter<TImage>
+::ThreadedGenerateData(const OutputImageRegionType &outputRegionForThread,
+                       itk::ThreadIdType itkNotUsed(threadId))
+{
+  const ImageType *input = this->GetInput();
+  ImageType *output = this->GetOutput();
+
+  // The input is buffered in full, with a fixed number of components per voxel
+  OutputImageRegionType inRegion = input->GetBufferedRegion();
+  int nx = inRegion.GetSize(0), ny = inRegion.GetSize(1), nz = inRegion.GetSize(2);
+  int nc = input->GetNumberOfComponentsPerPixel();
+  const ComponentType *src = input->GetBufferPointer();
+  std::vector<double> accum(nc);
+
+  typename ImageType::IndexType idxOut = outputRegionForThread.GetIndex();
+  typename ImageType::IndexType idxOutStart = output->GetBufferedRegion().GetIndex();
+  int i0 = idxOut[0] - idxOutStart[0], i1 = i0 + outputRegionForThread.GetSize(0);
+  int j0 = idxOut[1] - idxOutStart[1], j1 = j0 + outputRegionForThread.GetSize(1);
+  int k0 = idxOut[2] - idxOutStart[2], k1 = k0 + outputRegionForThread.GetSize(2);
+
+  for(int k = k0; k < k1; k++)
+    {
+    for(int j = j0; j < j1; j++)
+      {
+      typename ImageType::IndexType idx = idxOut;
+      idx[1] += j - j0; idx[2] += k - k0;
+      ComponentType *dst = output->GetBufferPointer() + output->ComputeOffset(idx) * nc;
+
+      for(int i = i0; i < i1; i++)
+        {
+        std::fill(accum.begin(), accum.end(), 0.0);
+        int n = 0;
+        for(int z = 2 * k; z < std::min(2 * k + 2, nz); z++)
+          {
+          for(int y = 2 * j; y < std::min(2 * j + 2, ny); y++)
+            {
+            const ComponentType *p = src + ((z * ny + y) * (size_t) nx + 2 * i) * nc;
+            for(int x = 2 * i; x < std::min(2 * i + 2, nx); x++, n++)
+              for(int c = 0; c < nc; c++)
+                accum[c] += *p++;
+            }
+          }
+
+        for(int c = 0; c < nc; c++)
+          *dst++ = CastAverage(accum[c] / n);
+        }
+      }
+    }
+}
+
+/**
+ * Level builder for the concrete image types, whose levels are computed by
+ * ImagePyramidLevelFilter
+ */
+template <class TImage>
+class ImagePyramidConcreteLevelBuilder
+{
+public:
+  static bool IsSupported() { return true; }
+
+  static SmartPtr<itk::ProcessObject> CreateFilter(TImage *input, SmartPtr<TImage> &output)
+  {
+    typedef ImagePyramidLevelFilter<TImage> FilterType;
+    SmartPtr<FilterType> filter = FilterType::New();
+    filter->SetInput(input);
+    output = filter->GetOutput();
+    return filter.GetPointer();
+  }
+};
+
+template <class TPixel, unsigned int VDim>
+class ImagePyramidLevelBuilder< itk::Image<TPixel, VDim> >
+    : public ImagePyramidConcreteLevelBuilder< itk::Image<TPixel, VDim> >
+{
+};
+
+template <class TPixel, unsigned int VDim>
+class ImagePyramidLevelBuilder< itk::VectorImage<TPixel, VDim> >
+    : public ImagePyramidConcreteLevelBuilder< itk::VectorImage<TPixel, VDim> >
+{
+};
+
+
+template <class TImage>
+ImagePyramid<TImage>
+::ImagePyramid()
+{
+}
+
+template <class TImage>
+void
+ImagePyramid<TImage>
+::SetImage(ImageType *image)
+{
+  if(m_Levels[0].GetPointer() != image)
+    {
+    this->ReleaseLevels();
+    m_Levels[0] = image;
+    this->Modified();
+    }
+}
+
+template <class TImage>
+bool
+ImagePyramid<TImage>
+::IsSupported() const
+{
+  return ImagePyramidLevelBuilder<TImage>::IsSupported();
+}
+
+template <class TImage>
+typename ImagePyramid<TImage>::ImageType *
+ImagePyramid<TImage>
+::GetLevel(unsigned int level)
+{
+  if(!m_Levels[0] || !this->IsSupported())
+    return m_Levels[0];
+
+  level = std::min(level, (unsigned int) NumberOfLevels - 1);
+
+  // Create the filters for the levels that have not been requested before.
+  // The data are computed by the pipeline, so the levels are brought up to
+  // date automatically when the image is modified
+  for(unsigned int k = 1; k <= level; k++)
+    {
+    if(!m_Filters[k])
+      m_Filters[k] = ImagePyramidLevelBuilder<TImage>::CreateFilter(m_Levels[k-1], m_Levels[k]);
+    }
+
+  return m_Levels[level];
+}
+
+template <class TImage>
+unsigned int
+ImagePyramid<TImage>
+::SelectLevel(double voxels_per_sample) const
+{
+  if(!this->IsSupported())
+    return 0;
+
+  unsigned int level = 0;
+  while(level + 1 < NumberOfLevels && (1 << (level + 1)) <= voxels_per_sample)
+    level++;
+
+  return level;
+}
+
+template <class TImage>
+double
+ImagePyramid<TImage>
+::ComputeSamplingStep(const ImageBaseType *reference, const TransformType *transform) const
+{
+  typedef typename ImageBaseType::IndexType IndexType;
+  typedef typename ImageBaseType::PointType PointType;
+  typedef itk::ContinuousIndex<double, ImageType::ImageDimension> CIndexType;
+
+  // Take the first voxel in the reference image and its neighbors along the
+  // two in-plane directions
+  IndexType idx[3];
+  idx[0] = reference->GetLargestPossibleRegion().GetIndex();
+  idx[1] = idx[0]; idx[1][0]++;
+  idx[2] = idx[0]; idx[2][1]++;
+
+  // Map these voxels into the continuous index space of the image
+  CIndexType cix[3];
+  for(int i = 0; i < 3; i++)
+    {
+    PointType pRef, pImg;
+    reference->TransformIndexToPhysicalPoint(idx[i], pRef);
+    pImg = transform ? transform->TransformPoint(pRef) : pRef;
+    m_Levels[0]->TransformPhysicalPointToContinuousIndex(pImg, cix[i]);
+    }
+
+  return std::min((cix[1] - cix[0]).GetNorm(), (cix[2] - cix[0]).GetNorm());
+}
+
+template <class TImage>
+void
+ImagePyramid<TImage>
+::ReleaseLevels()
+{
+  for(unsigned int k = 1; k < NumberOfLevels; k++)
+    {
+    m_Filters[k] = NULL;
+    m_Levels[k] = NULL;
+    }
+}
+
+#endif // IMAGEPYRAMID_TXX
@@ -74,6 +74,13 @@ public:
 
   inline void ProcessVoxel(double *cix, bool use_nn, OutputComponentType **out_ptr);
 
+  /**
+   * Process n voxels at positions cix + i * step, all of which are known to
+   * have their interpolation neighborhood inside the image
+   */
+  inline void ProcessInteriorRun(double *cix, double *step, int n, bool use_nn,
+                                 OutputComponentType **out_ptr);
+
   inline void SkipVoxels(int n, OutputComponentType **out_ptr);
 
 protected:
@@ -164,6 +171,12 @@ protected:
 
   virtual void VerifyInputInformation() ITK_OVERRIDE { }
 
+  typedef itk::ContinuousIndex<double, InputImageDimension> CIndexType;
+
+  // Check whether the k-th sample along a line is in the interior region
+  static bool IsSampleInInterior(const CIndexType &cixStart, const CIndexType &cixStep, int k,
+                                 const CIndexType &cixInterior0, const CIndexType &cixInterior1);
+
   virtual void GenerateOutputInformation() ITK_OVERRIDE;
 
   virtual void GenerateInputRequestedRegion() ITK_OVERRIDE;
@@ -177,7 +190,12 @@ private:
 
 
 /**
- * An specialization of the traits class for RLE images
+ * An specialization of the traits class for RLE images. RLE images hold
+ * labels, so they are always sampled using nearest neighbor interpolation.
+ * The worker keeps track of the current RLE line and of the run within that
+ * line that contains the last sample. Consecutive samples along a scanline
+ * usually fall in the same or an adjacent run of the same line, so each
+ * lookup is amortized O(1) instead of a scan from the start of the line.
  */
 template <typename TPixel, typename CounterType, typename TOutputImage>
 class NonOrthogonalSlicerPixelAccessTraitsWorker<
@@ -186,17 +204,34 @@ class NonOrthogonalSlicerPixelAccessTraitsWorker<
 public:
 
   typedef RLEImage<TPixel, 3, CounterType> InputImageType;
+  typedef typename InputImageType::RLLine RLLine;
   typedef typename TOutputImage::InternalPixelType OutputComponentType;
 
-  NonOrthogonalSlicerPixelAccessTraitsWorker(InputImageType *adaptor) {}
+  NonOrthogonalSlicerPixelAccessTraitsWorker(InputImageType *image);
   ~NonOrthogonalSlicerPixelAccessTraitsWorker() {}
 
-  inline void ProcessVoxel(double *cix, bool use_nn, OutputComponentType **out_ptr)
-  {
-    assert(0);
-  }
+  inline void ProcessVoxel(double *cix, bool use_nn, OutputComponentType **out_ptr);
+
+  inline void ProcessInteriorRun(double *cix, double *step, int n, bool use_nn,
+                                 OutputComponentType **out_ptr);
+
+  inline void SkipVoxels(int n, OutputComponentType **out_ptr);
+
+protected:
+
+  // Look up the label at a voxel that is inside of the image
+  inline TPixel GetLabel(int x, int y, int z);
+
+  // The lines of the RLE image and the image dimensions
+  const RLLine *m_Lines;
+  int m_Size[3];
+
+  // The current line and its (y,z) coordinates
+  const RLLine *m_Line;
+  int m_LineY, m_LineZ;
 
-  inline void SkipVoxels(int n, OutputComponentType **out_ptr) {}
+  // The current run in the line and its extent [m_RunStart, m_RunEnd)
+  int m_Run, m_RunStart, m_RunEnd;
 };
 
 
@@ -217,6 +252,8 @@ public:
   ~NonOrthogonalSlicerPixelAccessTraitsWorker();
 
   inline void ProcessVoxel(double *cix, bool use_nn, OutputComponentType **out_ptr);
+  inline void ProcessInteriorRun(double *cix, double *step, int n, bool use_nn,
+                                 OutputComponentType **out_ptr);
   inline void SkipVoxels(int n, OutputComponentType **out_ptr);
 
 protected:
@@ -258,6 +295,8 @@ public:
   ~NonOrthogonalSlicerPixelAccessTraitsWorker();
 
   inline void ProcessVoxel(double *cix, bool use_nn, OutputComponentType **out_ptr);
+  inline void ProcessInteriorRun(double *cix, double *step, int n, bool use_nn,
+                                 OutputComponentType **out_ptr);
   inline void SkipVoxels(int n, OutputComponentType **out_ptr);
 
 protected:
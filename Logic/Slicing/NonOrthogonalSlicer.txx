@@ -46,6 +46,7 @@
 #include "NonOrthogonalSlicer.h"
 #include "FastLinearInterpolator.h"
 #include "ImageRegionConstIteratorWithIndexOverride.h"
+#include "RLEImage.h"
 
 template <class TInputImage, class TOutputImage>
 NonOrthogonalSlicer<TInputImage, TOutputImage>
@@ -106,6 +107,21 @@ NonOrthogonalSlicer<TInputImage, TOutputImage>
 }
 
 
+template <class TInputImage, class TOutputImage>
+bool
+NonOrthogonalSlicer<TInputImage, TOutputImage>
+::IsSampleInInterior(const CIndexType &cixStart, const CIndexType &cixStep, int k,
+                     const CIndexType &cixInterior0, const CIndexType &cixInterior1)
+{
+  for(int d = 0; d < InputImageDimension; d++)
+    {
+    double x = cixStart[d] + k * cixStep[d];
+    if(x < cixInterior0[d] || x >= cixInterior1[d])
+      return false;
+    }
+  return true;
+}
+
 template <class TInputImage, class TOutputImage>
 void
 NonOrthogonalSlicer<TInputImage, TOutputImage>
@@ -141,6 +157,17 @@ NonOrthogonalSlicer<TInputImage, TOutputImage>
         input->GetBufferedRegion().GetSize()[d] - 0.5;
     }
 
+  // Get the extents of the region in which a sample can be interpolated
+  // without any bounds checking, i.e., all of its neighbors are in the image
+  itk::ContinuousIndex<double, InputImageDimension> cixInterior0, cixInterior1;
+  for(int d = 0; d < InputImageDimension; d++)
+    {
+    cixInterior0[d] = input->GetBufferedRegion().GetIndex()[d] + 1.0e-6;
+    cixInterior1[d] =
+        input->GetBufferedRegion().GetIndex()[d] +
+        input->GetBufferedRegion().GetSize()[d] - 1.0 - 1.0e-6;
+    }
+
   // Create a fast interpolator for the input image - via the traits, allowing for
   // partial specialization for imageadapters and other such things
   WorkerType worker(input);
@@ -228,36 +255,70 @@ NonOrthogonalSlicer<TInputImage, TOutputImage>
     if(skipLine)
       {
       worker.SkipVoxels(line_len, &outPixelPtr);
+      continue;
       }
-    else
+
+    // Find the range of voxels [kInStart, kInEnd] whose interpolation
+    // neighborhood lies entirely inside the image. Because the transform is
+    // affine, this range is found analytically and then verified at its end
+    // points, with a small margin guarding against roundoff
+    int kInStart = kStart, kInEnd = kEnd;
+    for(int d = 0; d < InputImageDimension; d++)
       {
-      // Skip the starting voxels
-      if(kStart > 0)
+      double x0 = cixInterior0[d], x1 = cixInterior1[d], dx = cixStep[d], x = cixSample[d];
+      if(fabs(dx) < 1.0e-5)
         {
-        // Skip the voxels
-        worker.SkipVoxels(kStart, &outPixelPtr);
-
-        // Update the sample location
-        for(int d = 0; d < InputImageDimension; d++)
-          cixSample[d] += kStart * cixStep[d];
+        if(x < x0 || x >= x1)
+          kInEnd = kInStart - 1;
         }
-
-      // Process the voxels that cross the image cube
-      for(int i = kStart; i <= kEnd; i++)
+      else if(dx > 0)
         {
-        worker.ProcessVoxel(cixSample.GetDataPointer(), use_nn, &outPixelPtr);
-
-        // Update the sample location
-        for(int d = 0; d < InputImageDimension; d++)
-          cixSample[d] += cixStep[d];
+        kInStart = std::max(kInStart, (int) ceil((x0 - x) / dx));
+        kInEnd = std::min(kInEnd, (int) ceil((x1 - x) / dx) - 1);
         }
+      else
+        {
+        kInStart = std::max(kInStart, (int) floor((x1 - x) / dx) + 1);
+        kInEnd = std::min(kInEnd, (int) floor((x0 - x) / dx));
+        }
+      }
+
+    while(kInStart <= kInEnd && !IsSampleInInterior(cixSample, cixStep, kInStart, cixInterior0, cixInterior1))
+      kInStart++;
+    while(kInStart <= kInEnd && !IsSampleInInterior(cixSample, cixStep, kInEnd, cixInterior0, cixInterior1))
+      kInEnd--;
+
+    // Skip the starting voxels
+    if(kStart > 0)
+      worker.SkipVoxels(kStart, &outPixelPtr);
 
-      // Process the rest
-      if(kEnd < line_len - 1)
+    // Process the voxels that cross the image cube. The sample locations are
+    // computed directly from the line start to avoid accumulating roundoff
+    itk::ContinuousIndex<double, InputImageDimension> cix;
+    for(int i = kStart; i <= kEnd; i++)
+      {
+      for(int d = 0; d < InputImageDimension; d++)
+        cix[d] = cixSample[d] + i * cixStep[d];
+
+      if(i == kInStart && kInEnd >= kInStart)
         {
-        worker.SkipVoxels((line_len - 1) - kEnd, &outPixelPtr);
+        // Process the interior voxels in a single call
+        int n = kInEnd - kInStart + 1;
+        worker.ProcessInteriorRun(cix.GetDataPointer(), cixStep.GetDataPointer(),
+                                  n, use_nn, &outPixelPtr);
+        i = kInEnd;
+        }
+      else
+        {
+        worker.ProcessVoxel(cix.GetDataPointer(), use_nn, &outPixelPtr);
         }
       }
+
+    // Process the rest
+    if(kEnd < line_len - 1)
+      {
+      worker.SkipVoxels((line_len - 1) - kEnd, &outPixelPtr);
+      }
     }
 }
 
@@ -301,6 +362,20 @@ NonOrthogonalSlicerPixelAccessTraitsWorker<TInputImage, TOutputImage>
     }
 }
 
+template <class TInputImage, class TOutputImage>
+void
+NonOrthogonalSlicerPixelAccessTraitsWorker<TInputImage, TOutputImage>
+::ProcessInteriorRun(double *cix, double *step, int n, bool use_nn,
+                     OutputComponentType **out_ptr)
+{
+  if(use_nn)
+    m_Interpolator.InterpolateNearestNeighborInteriorRun(cix, step, n, *out_ptr);
+  else
+    m_Interpolator.InterpolateInteriorRun(cix, step, n, *out_ptr);
+
+  (*out_ptr) += n * m_NumComponents;
+}
+
 template <class TInputImage, class TOutputImage>
 void
 NonOrthogonalSlicerPixelAccessTraitsWorker<TInputImage, TOutputImage>
@@ -313,6 +388,97 @@ NonOrthogonalSlicerPixelAccessTraitsWorker<TInputImage, TOutputImage>
 
 
 
+/*
+ * Traits for RLE images
+ */
+template <typename TPixel, typename CounterType, typename TOutputImage>
+NonOrthogonalSlicerPixelAccessTraitsWorker<RLEImage<TPixel, 3, CounterType>, TOutputImage>
+::NonOrthogonalSlicerPixelAccessTraitsWorker(InputImageType *image)
+{
+  m_Lines = image->GetBuffer()->GetBufferPointer();
+  for(int d = 0; d < 3; d++)
+    m_Size[d] = image->GetBufferedRegion().GetSize()[d];
+
+  m_Line = NULL;
+  m_LineY = m_LineZ = -1;
+  m_Run = m_RunStart = m_RunEnd = 0;
+}
+
+template <typename TPixel, typename CounterType, typename TOutputImage>
+TPixel
+NonOrthogonalSlicerPixelAccessTraitsWorker<RLEImage<TPixel, 3, CounterType>, TOutputImage>
+::GetLabel(int x, int y, int z)
+{
+  // Switch to a different line if needed, starting at its first run
+  if(y != m_LineY || z != m_LineZ)
+    {
+    m_Line = m_Lines + (y + z * m_Size[1]);
+    m_LineY = y;
+    m_LineZ = z;
+    m_Run = 0;
+    m_RunStart = 0;
+    m_RunEnd = (*m_Line)[0].first;
+    }
+
+  // Walk forward or backward from the current run to the run containing x
+  while(x >= m_RunEnd)
+    {
+    m_RunStart = m_RunEnd;
+    m_RunEnd += (*m_Line)[++m_Run].first;
+    }
+  while(x < m_RunStart)
+    {
+    m_RunEnd = m_RunStart;
+    m_RunStart -= (*m_Line)[--m_Run].first;
+    }
+
+  return (*m_Line)[m_Run].second;
+}
+
+template <typename TPixel, typename CounterType, typename TOutputImage>
+void
+NonOrthogonalSlicerPixelAccessTraitsWorker<RLEImage<TPixel, 3, CounterType>, TOutputImage>
+::ProcessVoxel(double *cix, bool itkNotUsed(use_nn), OutputComponentType **out_ptr)
+{
+  int x = (int) floor(cix[0] + 0.5);
+  int y = (int) floor(cix[1] + 0.5);
+  int z = (int) floor(cix[2] + 0.5);
+
+  if(x >= 0 && x < m_Size[0] && y >= 0 && y < m_Size[1] && z >= 0 && z < m_Size[2])
+    *(*out_ptr)++ = static_cast<OutputComponentType>(this->GetLabel(x, y, z));
+  else
+    *(*out_ptr)++ = 0;
+}
+
+template <typename TPixel, typename CounterType, typename TOutputImage>
+void
+NonOrthogonalSlicerPixelAccessTraitsWorker<RLEImage<TPixel, 3, CounterType>, TOutputImage>
+::ProcessInteriorRun(double *cix, double *step, int n, bool itkNotUsed(use_nn),
+                     OutputComponentType **out_ptr)
+{
+  // All samples are inside the image and non-negative, no checks needed
+  OutputComponentType *out = *out_ptr;
+  for(int i = 0; i < n; i++)
+    {
+    int x = (int) (cix[0] + i * step[0] + 0.5);
+    int y = (int) (cix[1] + i * step[1] + 0.5);
+    int z = (int) (cix[2] + i * step[2] + 0.5);
+    out[i] = static_cast<OutputComponentType>(this->GetLabel(x, y, z));
+    }
+  (*out_ptr) += n;
+}
+
+template <typename TPixel, typename CounterType, typename TOutputImage>
+void
+NonOrthogonalSlicerPixelAccessTraitsWorker<RLEImage<TPixel, 3, CounterType>, TOutputImage>
+::SkipVoxels(int n, OutputComponentType **out_ptr)
+{
+  for(int i = 0; i < n; i++)
+    *(*out_ptr)++ = 0;
+}
+
+
+
 /*
  * Traits for the component extracting image adaptor. Note that in the call to the
  * constructor for the interpolator, we are passing the buffer pointer offset by
@@ -356,6 +522,21 @@ NonOrthogonalSlicerPixelAccessTraitsWorker<itk::VectorImageToImageAdaptor<TPixel
     }
 }
 
+template <typename TPixelType, unsigned int Dimension, typename TOutputImage>
+void
+NonOrthogonalSlicerPixelAccessTraitsWorker<itk::VectorImageToImageAdaptor<TPixelType, Dimension>, TOutputImage>
+::ProcessInteriorRun(double *cix, double *step, int n, bool use_nn,
+                     OutputComponentType **out_ptr)
+{
+  // A single component is sampled, so the output is contiguous
+  if(use_nn)
+    m_Interpolator.InterpolateNearestNeighborInteriorRun(cix, step, n, *out_ptr);
+  else
+    m_Interpolator.InterpolateInteriorRun(cix, step, n, *out_ptr);
+
+  (*out_ptr) += n;
+}
+
 template <typename TPixelType, unsigned int Dimension, typename TOutputImage>
 void
 NonOrthogonalSlicerPixelAccessTraitsWorker<itk::VectorImageToImageAdaptor<TPixelType, Dimension>, TOutputImage>
@@ -420,6 +601,23 @@ NonOrthogonalSlicerPixelAccessTraitsWorker<
 }
 
 
+template <typename TPixelType, unsigned int Dimension, typename TAccessor, typename TOutputImage>
+void
+NonOrthogonalSlicerPixelAccessTraitsWorker<
+  itk::ImageAdaptor<itk::VectorImage<TPixelType, Dimension>, TAccessor>, TOutputImage>
+::ProcessInteriorRun(double *cix, double *step, int n, bool use_nn,
+                     OutputComponentType **out_ptr)
+{
+  // The accessor has to be applied to each voxel, so just step along the run
+  double cix_i[Dimension];
+  for(int i = 0; i < n; i++)
+    {
+    for(unsigned int d = 0; d < Dimension; d++)
+      cix_i[d] = cix[d] + i * step[d];
+    this->ProcessVoxel(cix_i, use_nn, out_ptr);
+    }
+}
+
 template <typename TPixelType, unsigned int Dimension, typename TAccessor, typename TOutputImage>
 void
 NonOrthogonalSlicerPixelAccessTraitsWorker<
@@ -0,0 +1,100 @@
+#include "RGBASliceCompositor.h"
+#include "IRISException.h"
+#include <algorithm>
+
+// Rounded division by 255, exact for x in [0, 255*255]
+inline unsigned int rgba_compositor_div255(unsigned int x)
+{
+  x += 128;
+  return (x + (x >> 8)) >> 8;
+}
+
+RGBASliceCompositor::RGBASliceCompositor()
+{
+}
+
+void RGBASliceCompositor::SetLayers(const std::vector<ImageType *> &slices,
+                                    const std::vector<double> &opacities)
+{
+  assert(slices.size() == opacities.size());
+
+  // Quantize the opacities the same way as the OpenGL renderer
+  std::vector<unsigned char> opacity_ub(opacities.size());
+  for(unsigned int i = 0; i < opacities.size(); i++)
+    opacity_ub[i] = (unsigned char)(255 * std::max(0.0, std::min(1.0, opacities[i])));
+
+  // Check if anything has changed
+  bool changed = (opacity_ub != m_Opacity);
+  for(unsigned int i = 0; !changed && i < slices.size(); i++)
+    changed = (this->GetInput(i) != slices[i]);
+
+  if(changed)
+    {
+    for(unsigned int i = slices.size(); i < m_Opacity.size(); i++)
+      this->SetNthInput(i, NULL);
+    this->SetNumberOfIndexedInputs(slices.size());
+    for(unsigned int i = 0; i < slices.size(); i++)
+      this->SetNthInput(i, slices[i]);
+
+    m_Opacity = opacity_ub;
+    this->Modified();
+    }
+}
+
+void RGBASliceCompositor::BeforeThreadedGenerateData()
+{
+  if(m_Opacity.size() == 0)
+    throw IRISException("No layers to composite");
+
+  // All the layers must have the same buffered region as the base layer
+  ImageType::RegionType region = this->GetInput(0)->GetBufferedRegion();
+  for(unsigned int i = 1; i < m_Opacity.size(); i++)
+    {
+    if(this->GetInput(i)->GetBufferedRegion() != region)
+      throw IRISException("Slices being composited have different dimensions");
+    }
+}
+
+void RGBASliceCompositor::ThreadedGenerateData(const OutputImageRegionType &region,
+                                               itk::ThreadIdType threadId)
+{
+  ImageType *output = this->GetOutput();
+  int nx = region.GetSize(0), ny = region.GetSize(1);
+  int nc = 4 * nx;
+
+  // Work with the output one line at a time. Lines in all the inputs are
+  // contiguous and have identical offsets.
+  itk::Index<2> idx = region.GetIndex();
+  for(int y = 0; y < ny; y++, idx[1]++)
+    {
+    unsigned char *dst = output->GetPixel(idx).GetDataPointer();
+
+    // Draw the base layer without transparency
+    const unsigned char *src = this->GetInput(0)->GetPixel(idx).GetDataPointer();
+    for(int i = 0; i < nc; i += 4)
+      {
+      dst[i]   = src[i];
+      dst[i+1] = src[i+1];
+      dst[i+2] = src[i+2];
+      dst[i+3] = 255;
+      }
+
+    // Blend each of the overlays on top
+    for(unsigned int k = 1; k < m_Opacity.size(); k++)
+      {
+      unsigned int opacity = m_Opacity[k];
+      if(opacity == 0)
+        continue;
+
+      src = this->GetInput(k)->GetPixel(idx).GetDataPointer();
+      for(int i = 0; i < nc; i += 4)
+        {
+        unsigned int a = rgba_compositor_div255(src[i+3] * opacity);
+        unsigned int ia = 255 - a;
+        dst[i]   = rgba_compositor_div255(src[i]   * a + dst[i]   * ia);
+        dst[i+1] = rgba_compositor_div255(src[i+1] * a + dst[i+1] * ia);
+        dst[i+2] = rgba_compositor_div255(src[i+2] * a + dst[i+2] * ia);
+        }
+      }
+    }
+}
@@ -0,0 +1,68 @@
+#ifndef RGBASLICECOMPOSITOR_H
+#define RGBASLICECOMPOSITOR_H
+
+#include "SNAPCommon.h"
+#include "itkRGBAPixel.h"
+#include <itkImageToImageFilter.h>
+#include <vector>
+
+/**
+ * This filter blends the RGBA display slices of several image layers into a
+ * single RGBA slice, reproducing on the CPU what the slice renderer does with
+ * one textured quad per layer. The first input is the base layer, which is
+ * drawn opaque. Each subsequent input
+ * is blended over the result using its own alpha channel scaled by the
+ * opacity of the layer (i.e., glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA)).
+ *
+ * All inputs must have the same size, which is the case for layers that are
+ * sliced orthogonally in the same reference space. The blending is done in
+ * 8-bit fixed point arithmetic with loops that the compiler can vectorize.
+ */
+class RGBASliceCompositor :
+    public itk::ImageToImageFilter<itk::Image<itk::RGBAPixel<unsigned char>, 2>,
+                                   itk::Image<itk::RGBAPixel<unsigned char>, 2> >
+{
+public:
+
+  typedef itk::RGBAPixel<unsigned char>                             PixelType;
+  typedef itk::Image<PixelType, 2>                                  ImageType;
+
+  typedef RGBASliceCompositor                                            Self;
+  typedef itk::ImageToImageFilter<ImageType, ImageType>            Superclass;
+  typedef itk::SmartPointer<Self>                                     Pointer;
+  typedef itk::SmartPointer<const Self>                          ConstPointer;
+
+  typedef Superclass::OutputImageRegionType             OutputImageRegionType;
+
+  itkTypeMacro(RGBASliceCompositor, ImageToImageFilter)
+  itkNewMacro(Self)
+
+  /**
+   * Set the layers to be blended and their opacities. The first layer is the
+   * base layer, for which the opacity is ignored. The filter is only marked
+   * as modified if the layers or opacities differ from the current ones, so
+   * this can be called on every redraw.
+   */
+  void SetLayers(const std::vector<ImageType *> &slices,
+                 const std::vector<double> &opacities);
+
+  /** Get the number of layers */
+  unsigned int GetNumberOfLayers() const { return m_Opacity.size(); }
+
+  /** Check that the inputs can be composited */
+  void BeforeThreadedGenerateData() ITK_OVERRIDE;
+
+  /** The actual work */
+  void ThreadedGenerateData(const OutputImageRegionType &region,
+                            itk::ThreadIdType threadId) ITK_OVERRIDE;
+
+protected:
+
+  RGBASliceCompositor();
+  virtual ~RGBASliceCompositor() {}
+
+  // Opacity of each layer, quantized to 8 bits like glColor4ub
+  std::vector<unsigned char> m_Opacity;
+};
+
+#endif // RGBASLICECOMPOSITOR_H
@@ -0,0 +1,156 @@
+#include <iostream>
+#include <cstdlib>
+#include <cmath>
+
+using namespace std;
+
+#include <itkImage.h>
+#include <itkVectorImage.h>
+#include <itkImageRegionIterator.h>
+#include <itkImageRegionConstIterator.h>
+#include <itkResampleImageFilter.h>
+#include <itkIdentityTransform.h>
+#include <itkLinearInterpolateImageFunction.h>
+#include <itkNearestNeighborInterpolateImageFunction.h>
+#include <itkTimeProbe.h>
+#include "AxisAlignedResampleImageFilter.h"
+
+typedef itk::Image<float, 3> FloatImageType;
+typedef itk::VectorImage<short, 3> VectorImageType;
+
+// Geometry of a resampled ROI
+struct ROIGeometry
+{
+  FloatImageType::SizeType size;
+  FloatImageType::SpacingType spacing;
+  FloatImageType::PointType origin;
+};
+
+// Compute the ROI geometry as in ImageWrapper::DeepCopyRegion. The ROI is
+// shifted by a small fraction of a voxel so that no sample falls half way
+// between two voxels, where nearest neighbor would be ambiguous
+ROIGeometry makeROI(itk::ImageBase<3> *image, int roiStart, int roiSize, const int *newSize)
+{
+  ROIGeometry g;
+  for(int d = 0; d < 3; d++)
+    {
+    g.size[d] = newSize[d];
+    g.spacing[d] = image->GetSpacing()[d] * roiSize / newSize[d];
+    g.origin[d] = image->GetOrigin()[d]
+        + (roiStart - 0.5 + 0.013) * image->GetSpacing()[d] + 0.5 * g.spacing[d];
+    }
+  return g;
+}
+
+template <class TImage>
+typename TImage::Pointer resampleITK(TImage *image, const ROIGeometry &g, bool nn)
+{
+  typedef itk::ResampleImageFilter<TImage, TImage> FilterType;
+  typename FilterType::Pointer filter = FilterType::New();
+  filter->SetInput(image);
+  filter->SetTransform(itk::IdentityTransform<double, 3>::New());
+  if(nn)
+    filter->SetInterpolator(itk::NearestNeighborInterpolateImageFunction<TImage, double>::New());
+  else
+    filter->SetInterpolator(itk::LinearInterpolateImageFunction<TImage, double>::New());
+  filter->SetSize(g.size);
+  filter->SetOutputSpacing(g.spacing);
+  filter->SetOutputOrigin(g.origin);
+  filter->SetOutputDirection(image->GetDirection());
+  filter->Update();
+  return filter->GetOutput();
+}
+
+template <class TImage>
+typename TImage::Pointer resampleFast(TImage *image, const ROIGeometry &g, bool nn)
+{
+  typedef AxisAlignedResampleImageFilter<TImage, TImage> FilterType;
+  typename FilterType::Pointer filter = FilterType::New();
+  filter->SetInput(image);
+  filter->SetUseNearestNeighbor(nn);
+  filter->SetSize(g.size);
+  filter->SetOutputSpacing(g.spacing);
+  filter->SetOutputOrigin(g.origin);
+  filter->Update();
+  return filter->GetOutput();
+}
+
+// Largest difference between the components of two images
+template <class TImage>
+double maxDifference(TImage *a, TImage *b)
+{
+  const typename TImage::InternalPixelType *pa = a->GetBufferPointer(), *pb = b->GetBufferPointer();
+  size_t n = a->GetPixelContainer()->Size();
+  double diff = 0;
+  for(size_t i = 0; i < n; i++)
+    diff = std::max(diff, std::fabs((double) pa[i] - (double) pb[i]));
+  return diff;
+}
+
+// Compare the ROI resampling filter with itk::ResampleImageFilter, for an
+// upsampled and a downsampled ROI that touches the edge of the image
+int main(int argc, char *argv[])
+{
+  int n = argc > 1 ? atoi(argv[1]) : 96;
+  srand(0);
+
+  FloatImageType::Pointer image = FloatImageType::New();
+  FloatImageType::RegionType region;
+  region.SetSize(0, n);
+  region.SetSize(1, n);
+  region.SetSize(2, n);
+  image->SetRegions(region);
+  FloatImageType::SpacingType spacing;
+  spacing[0] = 0.9; spacing[1] = 1.1; spacing[2] = 2.0;
+  image->SetSpacing(spacing);
+  image->Allocate();
+  itk::ImageRegionIterator<FloatImageType> it(image, region);
+  for(; !it.IsAtEnd(); ++it)
+    it.Set((float) (rand() % 1000));
+
+  VectorImageType::Pointer vimage = VectorImageType::New();
+  vimage->CopyInformation(image);
+  vimage->SetRegions(region);
+  vimage->SetNumberOfComponentsPerPixel(3);
+  vimage->Allocate();
+  short *vbuf = vimage->GetBufferPointer();
+  for(size_t i = 0; i < 3 * region.GetNumberOfPixels(); i++)
+    vbuf[i] = (short) (rand() % 1000);
+
+  int upSize[] = { 3 * n / 2, 2 * n, 5 * n / 4 };
+  int downSize[] = { n / 3, n / 2, n / 4 };
+  ROIGeometry roi[] = { makeROI(image, 0, n, upSize), makeROI(image, n / 4, n / 2, downSize) };
+
+  bool success = true;
+  cout << "roi,interpolation,max_difference,itk_seconds,fast_seconds" << endl;
+  for(int r = 0; r < 2; r++)
+    {
+    for(int nn = 0; nn < 2; nn++)
+      {
+      itk::TimeProbe tITK, tFast;
+      tITK.Start();
+      FloatImageType::Pointer ref = resampleITK<FloatImageType>(image, roi[r], nn);
+      tITK.Stop();
+      tFast.Start();
+      FloatImageType::Pointer out = resampleFast<FloatImageType>(image, roi[r], nn);
+      tFast.Stop();
+
+      double diff = maxDifference<FloatImageType>(ref, out);
+      cout << r << "," << (nn ? "nearest" : "linear") << "," << diff << ","
+           << tITK.GetTotal() << "," << tFast.GetTotal() << endl;
+      if(diff > 1.0e-2)
+        success = false;
+      }
+
+    // Vector images are sampled with nearest neighbor, which must match exactly
+    VectorImageType::Pointer vref = resampleITK<VectorImageType>(vimage, roi[r], true);
+    VectorImageType::Pointer vout = resampleFast<VectorImageType>(vimage, roi[r], true);
+    if(maxDifference<VectorImageType>(vref, vout) > 0)
+      {
+      cerr << "Vector image resampling differs for ROI " << r << endl;
+      success = false;
+      }
+    }
+
+  return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
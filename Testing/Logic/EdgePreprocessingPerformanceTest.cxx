@@ -0,0 +1,114 @@
+#include <iostream>
+#include <cstdlib>
+#include <cmath>
+
+using namespace std;
+
+#include <itkImageFileReader.h>
+#include <itkGradientMagnitudeImageFilter.h>
+#include <itkMinimumMaximumImageCalculator.h>
+#include <itkStreamingImageFilter.h>
+#include <itkTimeProbe.h>
+#include "EdgePreprocessingSettings.h"
+#include "EdgePreprocessingImageFilter.h"
+
+typedef itk::Image<short, 3> ImageType;
+typedef itk::Image<float, 3> FloatImageType;
+typedef EdgePreprocessingImageFilter<ImageType, ImageType> FilterType;
+typedef itk::StreamingImageFilter<ImageType, ImageType> StreamerType;
+
+// Compute the speed image with the given Gaussian mode, streaming it in the
+// given number of slabs like the preprocessing preview wrapper does
+ImageType::Pointer computeSpeed(ImageType *image, double maxGradMag,
+                                EdgePreprocessingSettings *settings,
+                                FilterType::GaussianMode mode, int divisions,
+                                double &seconds)
+{
+  FilterType::Pointer filter = FilterType::New();
+  filter->SetInput(image);
+  filter->SetParameters(settings);
+  filter->SetInputImageMaximumGradientMagnitude(maxGradMag);
+  filter->SetGaussianMode(mode);
+
+  StreamerType::Pointer streamer = StreamerType::New();
+  streamer->SetInput(filter->GetOutput());
+  streamer->SetNumberOfStreamDivisions(divisions);
+
+  itk::TimeProbe probe;
+  probe.Start();
+  streamer->Update();
+  probe.Stop();
+
+  seconds = probe.GetTotal();
+  return streamer->GetOutput();
+}
+
+// Compare the discrete and recursive Gaussian paths of the edge
+// preprocessing filter on an image, for small and large scales
+int main(int argc, char *argv[])
+{
+  if(argc < 2)
+    {
+    cerr << "Usage: " << argv[0] << " image.ext [divisions] [tolerance]" << endl;
+    return EXIT_FAILURE;
+    }
+
+  int divisions = argc > 2 ? atoi(argv[2]) : 9;
+  double tolerance = argc > 3 ? atof(argv[3]) : 0.02;
+
+  typedef itk::ImageFileReader<ImageType> ReaderType;
+  ReaderType::Pointer reader = ReaderType::New();
+  reader->SetFileName(argv[1]);
+  reader->Update();
+  ImageType::Pointer image = reader->GetOutput();
+
+  // The maximum gradient magnitude, which the application computes the same way
+  typedef itk::GradientMagnitudeImageFilter<ImageType, FloatImageType> GradMagType;
+  GradMagType::Pointer gradmag = GradMagType::New();
+  gradmag->SetInput(image);
+  gradmag->Update();
+
+  typedef itk::MinimumMaximumImageCalculator<FloatImageType> CalculatorType;
+  CalculatorType::Pointer calc = CalculatorType::New();
+  calc->SetImage(gradmag->GetOutput());
+  calc->ComputeMaximum();
+
+  SmartPtr<EdgePreprocessingSettings> settings = EdgePreprocessingSettings::New();
+
+  double scales[] = { 0.5, 1.0, 2.0, 4.0, 8.0 };
+  bool failed = false;
+
+  cout << "scale,discrete_sec,recursive_sec,mean_abs_diff" << endl;
+  for(int k = 0; k < 5; k++)
+    {
+    settings->SetGaussianBlurScale(scales[k]);
+
+    double t_discrete, t_recursive;
+    ImageType::Pointer out_discrete = computeSpeed(
+          image, calc->GetMaximum(), settings, FilterType::GAUSSIAN_DISCRETE,
+          divisions, t_discrete);
+    ImageType::Pointer out_recursive = computeSpeed(
+          image, calc->GetMaximum(), settings, FilterType::GAUSSIAN_RECURSIVE,
+          divisions, t_recursive);
+
+    // Mean difference relative to the range of the speed image
+    size_t n = out_discrete->GetBufferedRegion().GetNumberOfPixels();
+    const short *p = out_discrete->GetBufferPointer();
+    const short *q = out_recursive->GetBufferPointer();
+    double diff = 0.0;
+    for(size_t i = 0; i < n; i++)
+      diff += fabs((double) p[i] - (double) q[i]);
+    diff /= n * (double) 0x7fff;
+
+    cout << scales[k] << "," << t_discrete << "," << t_recursive << "," << diff << endl;
+
+    // The recursive approximation is only used (and accurate) at larger scales
+    if(scales[k] >= FilterType::RECURSIVE_GAUSSIAN_MINIMUM_SCALE && diff > tolerance)
+      {
+      cerr << "Recursive and discrete outputs differ at scale " << scales[k] << endl;
+      failed = true;
+      }
+    }
+
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
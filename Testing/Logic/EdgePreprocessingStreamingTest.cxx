@@ -0,0 +1,122 @@
+#include <iostream>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+
+using namespace std;
+
+#include <itkImageRegionIteratorWithIndex.h>
+#include <itkStreamingImageFilter.h>
+#include "EdgePreprocessingSettings.h"
+#include "EdgePreprocessingImageFilter.h"
+
+typedef itk::Image<short, 3> ImageType;
+typedef EdgePreprocessingImageFilter<ImageType, ImageType> FilterType;
+typedef itk::StreamingImageFilter<ImageType, ImageType> StreamerType;
+
+// Create a noisy image of a bright ellipsoid on a dark background
+ImageType::Pointer makeImage(int n)
+{
+  ImageType::RegionType region;
+  for(int d = 0; d < 3; d++)
+    {
+    region.SetIndex(d, 5 * d);
+    region.SetSize(d, n + 3 * d);
+    }
+
+  ImageType::Pointer image = ImageType::New();
+  image->SetRegions(region);
+  image->Allocate();
+
+  itk::ImageRegionIteratorWithIndex<ImageType> it(image, region);
+  for(; !it.IsAtEnd(); ++it)
+    {
+    double r2 = 0.0;
+    for(int d = 0; d < 3; d++)
+      {
+      double c = region.GetIndex(d) + 0.5 * region.GetSize(d);
+      double x = (it.GetIndex()[d] - c) / (0.3 * region.GetSize(d));
+      r2 += x * x;
+      }
+    it.Set((short) ((r2 < 1.0 ? 1000 : 200) + rand() % 100));
+    }
+
+  return image;
+}
+
+// Compute the speed image, streaming it in the given number of slabs like the
+// preprocessing preview wrapper does. The output of the filter must keep the
+// geometry of the input after the last slab.
+ImageType::Pointer computeSpeed(ImageType *image, EdgePreprocessingSettings *settings,
+                                FilterType::GaussianMode mode, int divisions, bool &ok)
+{
+  FilterType::Pointer filter = FilterType::New();
+  filter->SetInput(image);
+  filter->SetParameters(settings);
+  filter->SetInputImageMaximumGradientMagnitude(400.0);
+  filter->SetGaussianMode(mode);
+
+  StreamerType::Pointer streamer = StreamerType::New();
+  streamer->SetInput(filter->GetOutput());
+  streamer->SetNumberOfStreamDivisions(divisions);
+  streamer->Update();
+
+  ok = filter->GetOutput()->GetLargestPossibleRegion() == image->GetLargestPossibleRegion()
+      && streamer->GetOutput()->GetBufferedRegion() == image->GetLargestPossibleRegion();
+  if(!ok)
+    cerr << "Streaming in " << divisions << " pieces changes the output geometry" << endl;
+
+  return streamer->GetOutput();
+}
+
+// Maximum difference between two speed images, relative to the speed range
+double compare(ImageType *a, ImageType *b)
+{
+  size_t n = a->GetBufferedRegion().GetNumberOfPixels();
+  const short *p = a->GetBufferPointer(), *q = b->GetBufferPointer();
+  double maxdiff = 0.0;
+  for(size_t i = 0; i < n; i++)
+    maxdiff = std::max(maxdiff, fabs((double) p[i] - (double) q[i]));
+  return maxdiff / (double) 0x7fff;
+}
+
+// Stream the edge preprocessing filter in several pieces, with both Gaussian
+// filters, and compare with the output computed in one piece
+int main(int argc, char *argv[])
+{
+  int n = argc > 1 ? atoi(argv[1]) : 40;
+  srand(0);
+
+  ImageType::Pointer image = makeImage(n);
+  SmartPtr<EdgePreprocessingSettings> settings = EdgePreprocessingSettings::New();
+  settings->SetGaussianBlurScale(2.0);
+
+  FilterType::GaussianMode modes[] = { FilterType::GAUSSIAN_DISCRETE, FilterType::GAUSSIAN_RECURSIVE };
+  const char *names[] = { "discrete", "recursive" };
+
+  // The discrete filter requests the whole margin of its kernel, so streaming
+  // does not change its output. The recursive filter is truncated at four
+  // standard deviations from each piece.
+  double tolerance[] = { 0.0, 0.01 };
+
+  bool success = true;
+  for(int k = 0; k < 2; k++)
+    {
+    bool ok1, ok9;
+    ImageType::Pointer whole = computeSpeed(image, settings, modes[k], 1, ok1);
+    ImageType::Pointer pieces = computeSpeed(image, settings, modes[k], 9, ok9);
+    success = ok1 && ok9 && success;
+    if(!ok1 || !ok9)
+      continue;
+
+    double diff = compare(whole, pieces);
+    if(diff > tolerance[k])
+      {
+      cerr << "Streamed " << names[k] << " output differs from the whole output by "
+           << diff << endl;
+      success = false;
+      }
+    }
+
+  return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,181 @@
+#include <iostream>
+#include <cstdlib>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+using namespace std;
+
+#include <itkImage.h>
+#include <itkVectorImage.h>
+#include <itkMultiThreader.h>
+#include "ImagePyramid.h"
+
+typedef itk::Image<float, 3> FloatImageType;
+typedef itk::VectorImage<short, 3> VectorImageType;
+
+// Fill an image with random values, using an odd size along some axes so that
+// the partial blocks at the upper boundary are exercised
+template <class TImage>
+typename TImage::Pointer makeImage(int n, int nc)
+{
+  typename TImage::RegionType region;
+  typename TImage::SpacingType spacing;
+  typename TImage::PointType origin;
+  for(int d = 0; d < 3; d++)
+    {
+    region.SetSize(d, n + 2 * d + 1);
+    spacing[d] = 0.5 + 0.25 * d;
+    origin[d] = -10.0 * d;
+    }
+
+  typename TImage::Pointer image = TImage::New();
+  image->SetRegions(region);
+  image->SetSpacing(spacing);
+  image->SetOrigin(origin);
+  image->SetNumberOfComponentsPerPixel(nc);
+  image->Allocate();
+
+  typename TImage::InternalPixelType *p = image->GetBufferPointer();
+  for(size_t i = 0; i < region.GetNumberOfPixels() * nc; i++)
+    p[i] = (typename TImage::InternalPixelType) (rand() % 2000 - 1000);
+  return image;
+}
+
+// Build a level of the pyramid with the given number of threads
+template <class TImage>
+typename TImage::Pointer buildLevel(TImage *image, unsigned int level, int threads)
+{
+  itk::MultiThreader::SetGlobalDefaultNumberOfThreads(threads);
+  SmartPtr< ImagePyramid<TImage> > pyramid = ImagePyramid<TImage>::New();
+  pyramid->SetImage(image);
+  typename TImage::Pointer output = pyramid->GetLevel(level);
+  output->Update();
+  return output;
+}
+
+// Compare a pyramid level with the average of the corresponding blocks of
+// voxels in the full-resolution image, computed by brute force, and check that
+// the level occupies the same physical extent as the image
+template <class TImage>
+bool check(TImage *image, TImage *output, unsigned int level, bool rounded, const char *what)
+{
+  typedef typename TImage::InternalPixelType ComponentType;
+  int nc = image->GetNumberOfComponentsPerPixel();
+  int b = 1 << level;
+  typename TImage::SizeType sz = image->GetBufferedRegion().GetSize();
+  typename TImage::SizeType szOut = output->GetBufferedRegion().GetSize();
+
+  bool ok = true;
+  for(int d = 0; d < 3; d++)
+    {
+    if(szOut[d] != (sz[d] + b - 1) / b)
+      ok = false;
+
+    // The voxels of the level are b times larger, and the first one is
+    // centered on the center of the first block
+    double spacing = image->GetSpacing()[d] * b;
+    double origin = image->GetOrigin()[d] + 0.5 * (b - 1) * image->GetSpacing()[d];
+    if(fabs(output->GetSpacing()[d] - spacing) > 1e-6 || fabs(output->GetOrigin()[d] - origin) > 1e-6)
+      ok = false;
+    }
+
+  if(!ok)
+    {
+    cerr << "Wrong geometry of level " << level << " (" << what << ")" << endl;
+    return false;
+    }
+
+  // Averaging 2x2x2 blocks k times is not the same as averaging the
+  // 2^k x 2^k x 2^k blocks when the blocks are partial or the values are
+  // rounded, so the test tolerates the rounding error of each level
+  double tol = rounded ? 0.5 * level + 1e-6 : 1e-3;
+  const ComponentType *src = image->GetBufferPointer();
+  const ComponentType *dst = output->GetBufferPointer();
+  double maxdiff = 0.0;
+  for(int k = 0; k < (int) szOut[2]; k++)
+    for(int j = 0; j < (int) szOut[1]; j++)
+      for(int i = 0; i < (int) szOut[0]; i++)
+        {
+        // Only the full blocks have a simple brute force average
+        bool full = (int) sz[0] >= (i+1) * b && (int) sz[1] >= (j+1) * b && (int) sz[2] >= (k+1) * b;
+        for(int c = 0; c < nc; c++, dst++)
+          {
+          if(!full)
+            continue;
+
+          double sum = 0.0;
+          for(int z = k * b; z < (k+1) * b; z++)
+            for(int y = j * b; y < (j+1) * b; y++)
+              for(int x = i * b; x < (i+1) * b; x++)
+                sum += src[((z * sz[1] + y) * sz[0] + x) * nc + c];
+
+          maxdiff = std::max(maxdiff, fabs(sum / (b * b * b) - *dst));
+          }
+        }
+
+  if(maxdiff > tol)
+    {
+    cerr << "Level " << level << " (" << what << ") differs from the block average by "
+         << maxdiff << endl;
+    return false;
+    }
+
+  return true;
+}
+
+// The level must not depend on the number of threads
+template <class TImage>
+bool compareThreads(TImage *a, TImage *b, const char *what)
+{
+  size_t n = a->GetBufferedRegion().GetNumberOfPixels() * a->GetNumberOfComponentsPerPixel();
+  if(a->GetBufferedRegion() != b->GetBufferedRegion()
+     || !std::equal(a->GetBufferPointer(), a->GetBufferPointer() + n, b->GetBufferPointer()))
+    {
+    cerr << "Multithreaded level differs from the single-threaded level ("
+         << what << ")" << endl;
+    return false;
+    }
+  return true;
+}
+
+template <class TImage>
+bool testImage(TImage *image, bool rounded, const char *what)
+{
+  bool success = true;
+  for(unsigned int level = 1; level < ImagePyramid<TImage>::NumberOfLevels; level++)
+    {
+    typename TImage::Pointer l1 = buildLevel(image, level, 1);
+    typename TImage::Pointer lN = buildLevel(image, level, 8);
+    success = check(image, l1.GetPointer(), level, rounded, what) && success;
+    success = compareThreads(l1.GetPointer(), lN.GetPointer(), what) && success;
+    }
+
+  // Modifying the image must cause the levels to be recomputed
+  SmartPtr< ImagePyramid<TImage> > pyramid = ImagePyramid<TImage>::New();
+  pyramid->SetImage(image);
+  typename TImage::Pointer level = pyramid->GetLevel(2);
+  level->Update();
+  image->GetBufferPointer()[0] += 100;
+  image->Modified();
+  level->Update();
+  success = check(image, level.GetPointer(), 2, rounded, what) && success;
+
+  return success;
+}
+
+int main(int argc, char *argv[])
+{
+  int n = argc > 1 ? atoi(argv[1]) : 48;
+  srand(0);
+
+  bool success = true;
+
+  FloatImageType::Pointer fimg = makeImage<FloatImageType>(n, 1);
+  success = testImage(fimg.GetPointer(), false, "float image") && success;
+
+  VectorImageType::Pointer vimg = makeImage<VectorImageType>(n, 3);
+  success = testImage(vimg.GetPointer(), true, "vector image") && success;
+
+  return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
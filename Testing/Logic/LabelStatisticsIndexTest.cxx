@@ -0,0 +1,131 @@
+#include <iostream>
+#include <cstdlib>
+#include <algorithm>
+#include <map>
+
+using namespace std;
+
+#include <itkImageRegionIteratorWithIndex.h>
+#include "RLEImageRegionIterator.h"
+#include "SegmentationUpdateIterator.h"
+#include "LabelStatisticsIndex.h"
+
+typedef LabelStatisticsIndex::LabelImageType LabelImageType;
+typedef LabelStatisticsIndex::DeltaType UndoDelta;
+typedef itk::ImageRegion<3> RegionType;
+
+// Compare two indices, and the voxel counts with those found by scanning
+// the image
+bool compare(const LabelStatisticsIndex &a, const LabelStatisticsIndex &b,
+             LabelImageType *image, const char *what)
+{
+  std::map<LabelType, unsigned long> counts;
+  itk::ImageRegionIterator<LabelImageType> it(image, image->GetBufferedRegion());
+  for(; !it.IsAtEnd(); ++it)
+    counts[it.Get()]++;
+
+  std::vector<LabelType> la = a.GetLabels(), lb = b.GetLabels();
+  bool ok = (la == lb) && (la.size() == counts.size());
+  for(size_t i = 0; ok && i < la.size(); i++)
+    {
+    LabelType l = la[i];
+    RegionType ba, bb;
+    a.GetBoundingBox(l, ba);
+    b.GetBoundingBox(l, bb);
+    if(a.GetNumberOfVoxels(l) != counts[l] || b.GetNumberOfVoxels(l) != counts[l] || ba != bb)
+      ok = false;
+
+    const RegionType &region = image->GetBufferedRegion();
+    for(int d = 0; d < 3; d++)
+      for(long k = region.GetIndex(d); k < region.GetIndex(d) + (long) region.GetSize(d); k++)
+        if(a.IsLabelInSlice(l, d, k) != b.IsLabelInSlice(l, d, k))
+          ok = false;
+    }
+
+  if(!ok)
+    cerr << "Incremental index differs from the rebuilt index after " << what << endl;
+  return ok;
+}
+
+// Apply a delta in reverse, as LabelImageWrapper::Undo does
+void undo(LabelImageType *image, UndoDelta *delta)
+{
+  itk::ImageRegionIterator<LabelImageType> it(image, delta->GetRegion());
+  for(size_t i = 0; i < delta->GetNumberOfRLEs(); i++)
+    {
+    LabelType d = delta->GetRLEValue(i);
+    for(size_t j = 0; j < delta->GetRLELength(i); j++, ++it)
+      if(d != 0)
+        it.Set(it.Get() - d);
+    }
+}
+
+// Paint random boxes with random labels into a segmentation, updating the
+// label index from each delta, then undo all of the edits. After each step,
+// the index must match the index built from scratch.
+int main(int argc, char *argv[])
+{
+  int n = argc > 1 ? atoi(argv[1]) : 64;
+  srand(0);
+
+  RegionType region;
+  for(int d = 0; d < 3; d++)
+    {
+    region.SetIndex(d, 10 * d);
+    region.SetSize(d, n + d);
+    }
+
+  LabelImageType::Pointer image = LabelImageType::New();
+  image->SetRegions(region);
+  image->Allocate();
+  image->FillBuffer(0);
+
+  LabelStatisticsIndex index, reference;
+  index.Build(image);
+
+  bool success = true;
+  std::vector<UndoDelta *> deltas;
+  for(int i = 0; i < 40; i++)
+    {
+    RegionType box;
+    for(int d = 0; d < 3; d++)
+      {
+      long a = rand() % region.GetSize(d), b = rand() % region.GetSize(d);
+      box.SetIndex(d, region.GetIndex(d) + std::min(a, b));
+      box.SetSize(d, std::abs(a - b) + 1);
+      }
+
+    LabelType label = (LabelType) (rand() % 5);
+    DrawOverFilter filter(i % 3 ? PAINT_OVER_ALL : PAINT_OVER_VISIBLE, 0);
+    SegmentationUpdateIterator it(image, box, label, filter);
+    for(; !it.IsAtEnd(); ++it)
+      it.PaintAsForeground();
+    it.Finalize();
+
+    UndoDelta *delta = it.RelinquishDelta();
+    index.Update(image, delta, 1);
+    deltas.push_back(delta);
+
+    reference.Build(image);
+    success = compare(index, reference, image, "painting") && success;
+    }
+
+  for(int i = (int) deltas.size() - 1; i >= 0; i--)
+    {
+    undo(image, deltas[i]);
+    index.Update(image, deltas[i], -1);
+    delete deltas[i];
+
+    reference.Build(image);
+    success = compare(index, reference, image, "undo") && success;
+    }
+
+  // Only the background is left
+  if(index.GetLabels().size() != 1 || index.GetNumberOfVoxels(0) != region.GetNumberOfPixels())
+    {
+    cerr << "Undoing all edits does not restore the background" << endl;
+    success = false;
+    }
+
+  return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,263 @@
+#include <iostream>
+#include <cstdlib>
+#include <cmath>
+#include <vector>
+#include <map>
+#include <algorithm>
+
+using namespace std;
+
+#include <itkImage.h>
+#include <itkImageRegionIteratorWithIndex.h>
+#include <itkMultiThreader.h>
+#include <vtkSmartPointer.h>
+#include <vtkPolyData.h>
+#include <vtkPointData.h>
+#include <vtkIdList.h>
+#include <vtkTriangleFilter.h>
+#include <vtkPointLocator.h>
+#include "LevelSetMeshPipeline.h"
+#include "VTKMeshPipeline.h"
+#include "MeshOptions.h"
+
+typedef LevelSetMeshPipeline::InputImageType ImageType;
+
+// A triangle, given by point ids and rotated so that the smallest id comes
+// first, which keeps the orientation
+struct Triangle
+{
+  vtkIdType id[3];
+  Triangle(vtkIdType a, vtkIdType b, vtkIdType c)
+  {
+    vtkIdType t[] = { a, b, c };
+    int k = (a <= b && a <= c) ? 0 : (b <= c ? 1 : 2);
+    for(int i = 0; i < 3; i++)
+      id[i] = t[(k + i) % 3];
+  }
+  bool operator < (const Triangle &o) const
+  {
+    return std::lexicographical_compare(id, id + 3, o.id, o.id + 3);
+  }
+};
+
+typedef std::map<Triangle, int> TriangleCount;
+
+// Quantize a signed distance the way the level set is seen by the change
+// detection of the incremental mesh, i.e., in steps of 1/16 voxel and up to
+// one voxel away from the zero level set. Changes smaller than a step, or
+// changes beyond one voxel, are deliberately not picked up by the incremental
+// update, so the level set is built so that every change is seen. Values
+// are in the middle of the steps, so that none is exactly zero.
+float quantize(double d)
+{
+  double q = (std::floor(16.0 * d) + 0.5) / 16.0;
+  return (float) std::max(-16.5 / 16.0, std::min(16.5 / 16.0, q));
+}
+
+// Distance to a sphere, in voxels
+double sphere(const itk::Index<3> &idx, double cx, double cy, double cz, double r)
+{
+  double dx = idx[0] - cx, dy = idx[1] - cy, dz = idx[2] - cz;
+  return std::sqrt(dx * dx + dy * dy + dz * dz) - r;
+}
+
+// The level set of a large sphere, optionally with a bump added on its
+// surface and a dent carved out of it
+void fillLevelSet(ImageType *image, bool bump, bool dent)
+{
+  itk::ImageRegionIteratorWithIndex<ImageType> it(image, image->GetBufferedRegion());
+  for(; !it.IsAtEnd(); ++it)
+    {
+    itk::Index<3> idx = it.GetIndex();
+    double d = sphere(idx, 40, 36, 24, 18);
+    if(bump)
+      d = std::min(d, sphere(idx, 32, 32, 40, 3.5));
+    if(dent)
+      d = std::max(d, -sphere(idx, 56, 36, 32, 3.5));
+    it.Set(quantize(d));
+    }
+  image->Modified();
+}
+
+// Triangulate a mesh, which may consist of strips
+vtkSmartPointer<vtkPolyData> triangulate(vtkPolyData *mesh)
+{
+  vtkSmartPointer<vtkTriangleFilter> tf = vtkSmartPointer<vtkTriangleFilter>::New();
+  tf->SetInputData(mesh);
+  tf->PassVertsOff();
+  tf->PassLinesOff();
+  tf->Update();
+  return tf->GetOutput();
+}
+
+// Compare the mesh updated brick by brick with the mesh computed for the
+// whole image. The brick meshes repeat the points on the faces of the
+// bricks, so the points are matched by position, and then the triangles
+// (with their orientation) and the normals at the points must agree
+bool compareMeshes(vtkPolyData *incMesh, vtkPolyData *refMesh, const char *what)
+{
+  vtkSmartPointer<vtkPolyData> inc = triangulate(incMesh);
+  vtkSmartPointer<vtkPolyData> ref = triangulate(refMesh);
+
+  if(ref->GetNumberOfCells() == 0)
+    {
+    cerr << what << ": the reference mesh is empty" << endl;
+    return false;
+    }
+
+  vtkSmartPointer<vtkPointLocator> locator = vtkSmartPointer<vtkPointLocator>::New();
+  locator->SetDataSet(ref);
+  locator->BuildLocator();
+
+  vtkDataArray *incNormals = inc->GetPointData()->GetNormals();
+  vtkDataArray *refNormals = ref->GetPointData()->GetNormals();
+  if(!incNormals || !refNormals)
+    {
+    cerr << what << ": missing normals" << endl;
+    return false;
+    }
+
+  // Match the points and compare the normals
+  std::vector<vtkIdType> match(inc->GetNumberOfPoints());
+  for(vtkIdType i = 0; i < inc->GetNumberOfPoints(); i++)
+    {
+    double x[3], y[3], ni[3], nr[3];
+    inc->GetPoint(i, x);
+    match[i] = locator->FindClosestPoint(x);
+    ref->GetPoint(match[i], y);
+    incNormals->GetTuple(i, ni);
+    refNormals->GetTuple(match[i], nr);
+
+    double dist = 0, ndiff = 0;
+    for(int d = 0; d < 3; d++)
+      {
+      dist = std::max(dist, std::fabs(x[d] - y[d]));
+      ndiff = std::max(ndiff, std::fabs(ni[d] - nr[d]));
+      }
+
+    if(dist > 1e-3)
+      {
+      cerr << what << ": point " << x[0] << "," << x[1] << "," << x[2]
+           << " is not in the reference mesh" << endl;
+      return false;
+      }
+    if(ndiff > 1e-3)
+      {
+      cerr << what << ": normal at " << x[0] << "," << x[1] << "," << x[2]
+           << " is " << ni[0] << "," << ni[1] << "," << ni[2]
+           << " but should be " << nr[0] << "," << nr[1] << "," << nr[2] << endl;
+      return false;
+      }
+    }
+
+  // Compare the triangles
+  TriangleCount tInc, tRef;
+  vtkSmartPointer<vtkIdList> ids = vtkSmartPointer<vtkIdList>::New();
+  for(vtkIdType c = 0; c < inc->GetNumberOfCells(); c++)
+    {
+    inc->GetCellPoints(c, ids);
+    tInc[Triangle(match[ids->GetId(0)], match[ids->GetId(1)], match[ids->GetId(2)])]++;
+    }
+
+  for(vtkIdType c = 0; c < ref->GetNumberOfCells(); c++)
+    {
+    ref->GetCellPoints(c, ids);
+    tRef[Triangle(ids->GetId(0), ids->GetId(1), ids->GetId(2))]++;
+    }
+
+  if(tInc != tRef)
+    {
+    cerr << what << ": the meshes have different triangles ("
+         << inc->GetNumberOfCells() << " vs " << ref->GetNumberOfCells() << ")" << endl;
+    return false;
+    }
+
+  return true;
+}
+
+// Update the incremental mesh and compare it with the mesh of the full
+// pipeline. After the first update, only some of the bricks should be
+// extracted again
+bool updateAndCompare(LevelSetMeshPipeline *pipeline, VTKMeshPipeline *full,
+                      ImageType *image, int nBricks, bool first, const char *what)
+{
+  pipeline->UpdateMesh();
+  unsigned int nUpdated = pipeline->GetNumberOfUpdatedBricks();
+  if(first ? (nUpdated == 0) : (nUpdated == 0 || (int) nUpdated >= nBricks))
+    {
+    cerr << what << ": " << nUpdated << " of " << nBricks << " bricks were updated" << endl;
+    return false;
+    }
+
+  vtkSmartPointer<vtkPolyData> ref = vtkSmartPointer<vtkPolyData>::New();
+  full->SetImage(image);
+  full->ComputeMesh(ref);
+
+  return compareMeshes(pipeline->GetMesh(), ref, what);
+}
+
+// Build the mesh of a level set incrementally after a series of localized
+// changes, on and next to the faces and edges of the bricks, and check that
+// it is the same as the mesh computed from the whole image
+int main(int argc, char *argv[])
+{
+  int threads = argc > 1 ? atoi(argv[1]) : 4;
+  itk::MultiThreader::SetGlobalDefaultNumberOfThreads(threads);
+
+  // The image is not a multiple of the brick size, and has a direction
+  // with a negative determinant, so that the normals are flipped
+  ImageType::Pointer image = ImageType::New();
+  ImageType::RegionType region;
+  region.SetSize(0, 80);
+  region.SetSize(1, 72);
+  region.SetSize(2, 48);
+  image->SetRegions(region);
+  image->Allocate();
+
+  double spacing[] = { 0.9, 1.1, 1.3 };
+  double origin[] = { -10.0, 5.0, 2.0 };
+  image->SetSpacing(spacing);
+  image->SetOrigin(origin);
+  ImageType::DirectionType dir;
+  dir.SetIdentity();
+  dir(0, 0) = -1.0;
+  image->SetDirection(dir);
+
+  const int bs = LevelSetMeshPipeline::BRICK_SIZE;
+  int nBricks = 1;
+  for(int d = 0; d < 3; d++)
+    nBricks *= std::max(1, ((int) region.GetSize(d) - 2) / bs + 1);
+
+  // Decimation and smoothing would make the pipeline recompute everything
+  SmartPtr<MeshOptions> options = MeshOptions::New();
+  options->SetUseGaussianSmoothing(false);
+  options->SetUseDecimation(false);
+  options->SetUseMeshSmoothing(false);
+
+  SmartPtr<LevelSetMeshPipeline> pipeline = LevelSetMeshPipeline::New();
+  pipeline->SetMeshOptions(options);
+
+  VTKMeshPipeline full;
+  full.SetMeshOptions(options);
+
+  bool success = true;
+
+  // The sphere crosses the faces of the bricks along all three axes
+  fillLevelSet(image, false, false);
+  pipeline->SetImage(image);
+  success = updateAndCompare(pipeline, &full, image, nBricks, true, "Initial mesh") && success;
+
+  // A bump at the corner of four bricks
+  fillLevelSet(image, true, false);
+  success = updateAndCompare(pipeline, &full, image, nBricks, false, "Bump at brick edge") && success;
+
+  // A dent on the face between two layers of bricks
+  fillLevelSet(image, true, true);
+  success = updateAndCompare(pipeline, &full, image, nBricks, false, "Dent at brick face") && success;
+
+  // Remove the bump again
+  fillLevelSet(image, false, true);
+  success = updateAndCompare(pipeline, &full, image, nBricks, false, "Bump removed") && success;
+
+  return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
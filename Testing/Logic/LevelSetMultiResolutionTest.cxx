@@ -0,0 +1,130 @@
+#include <iostream>
+#include <cstdlib>
+#include <algorithm>
+
+using namespace std;
+
+#include <itkImageRegionIterator.h>
+#include <itkImageRegionIteratorWithIndex.h>
+#include "SNAPLevelSetDriver.h"
+
+typedef itk::Image<short, 3> ImageType;
+typedef itk::Image<float, 3> FloatImageType;
+
+// Inside/outside speed image of an ellipsoid, and an initialization image
+// with a bubble at its center, using the same values as
+// SNAPImageData::InitializeSegmentation
+void makeImages(int n, ImageType::Pointer &speed, FloatImageType::Pointer &init)
+{
+  ImageType::RegionType region;
+  ImageType::SpacingType spacing;
+  for(int d = 0; d < 3; d++)
+    {
+    // Odd sizes, so that the coarse grid does not cover the whole image
+    region.SetSize(d, n + 2 * d + 1);
+    spacing[d] = 1.0 + 0.25 * d;
+    }
+
+  speed = ImageType::New();
+  speed->SetRegions(region);
+  speed->SetSpacing(spacing);
+  speed->Allocate();
+
+  init = FloatImageType::New();
+  init->CopyInformation(speed);
+  init->SetRegions(region);
+  init->Allocate();
+
+  itk::ImageRegionIteratorWithIndex<ImageType> it(speed, region);
+  itk::ImageRegionIterator<FloatImageType> itInit(init, region);
+  for(; !it.IsAtEnd(); ++it, ++itInit)
+    {
+    double r2 = 0.0, b2 = 0.0;
+    for(int d = 0; d < 3; d++)
+      {
+      double x = it.GetIndex()[d] - 0.5 * region.GetSize(d);
+      r2 += (x * x) / (0.09 * region.GetSize(d) * region.GetSize(d));
+      b2 += x * x;
+      }
+    it.Set(r2 < 1.0 ? 0x7fff : -0x7fff);
+    itInit.Set(b2 <= 16.0 ? -4.0f : 4.0f);
+    }
+}
+
+// Run the snake for a number of iterations, checking that the state is
+// always reported at full resolution, and return the final state
+FloatImageType::Pointer runSnake(ImageType *speed, FloatImageType *init,
+                                 const SnakeParameters &param,
+                                 unsigned int nIter, bool &ok)
+{
+  SNAPLevelSetDriver3d driver(init, speed, param);
+  ok = true;
+  for(unsigned int i = 0; i < nIter; i += 10)
+    {
+    driver.Run(10);
+    FloatImageType *state = driver.GetCurrentState();
+    if(driver.GetElapsedIterations() != i + 10
+       || state->GetBufferedRegion() != init->GetBufferedRegion())
+      {
+      cerr << "Wrong state after " << i + 10 << " iterations with factor "
+           << param.GetMultiResolutionFactor() << endl;
+      ok = false;
+      }
+    }
+
+  FloatImageType::Pointer result = FloatImageType::New();
+  result->CopyInformation(init);
+  result->SetRegions(init->GetBufferedRegion());
+  result->Allocate();
+
+  FloatImageType *state = driver.GetCurrentState();
+  std::copy(state->GetBufferPointer(),
+            state->GetBufferPointer() + init->GetBufferedRegion().GetNumberOfPixels(),
+            result->GetBufferPointer());
+  return result;
+}
+
+// Evolve the snake with and without the coarse phase, and check that the two
+// segmentations agree once both snakes have filled the ellipsoid
+int main(int argc, char *argv[])
+{
+  int n = argc > 1 ? atoi(argv[1]) : 48;
+  unsigned int nIter = argc > 2 ? atoi(argv[2]) : 150;
+
+  ImageType::Pointer speed;
+  FloatImageType::Pointer init;
+  makeImages(n, speed, init);
+
+  SnakeParameters param = SnakeParameters::GetDefaultInOutParameters();
+  bool success = true, ok;
+
+  param.SetMultiResolutionFactor(1);
+  FloatImageType::Pointer single = runSnake(speed, init, param, nIter, ok);
+  success = ok && success;
+
+  param.SetMultiResolutionFactor(2);
+  param.SetCoarseIterations(30);
+  FloatImageType::Pointer multi = runSnake(speed, init, param, nIter, ok);
+  success = ok && success;
+
+  // Compare the inside of the two snakes
+  size_t nPix = init->GetBufferedRegion().GetNumberOfPixels();
+  const float *p = single->GetBufferPointer(), *q = multi->GetBufferPointer();
+  size_t nUnion = 0, nDiff = 0;
+  for(size_t i = 0; i < nPix; i++)
+    {
+    bool a = p[i] < 0.0f, b = q[i] < 0.0f;
+    nUnion += (a || b) ? 1 : 0;
+    nDiff += (a != b) ? 1 : 0;
+    }
+
+  double ratio = nUnion ? nDiff * 1.0 / nUnion : 1.0;
+  if(ratio > 0.05)
+    {
+    cerr << "Coarse-to-fine and single resolution snakes differ in "
+         << nDiff << " of " << nUnion << " voxels" << endl;
+    success = false;
+    }
+
+  return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
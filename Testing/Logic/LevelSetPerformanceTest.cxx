@@ -0,0 +1,326 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+#include <list>
+#include <algorithm>
+#include <vector>
+
+using namespace std;
+
+#include <itkImageFileReader.h>
+#include <itkImageRegionIterator.h>
+#include <itkImageRegionIteratorWithIndex.h>
+#include <itkGradientMagnitudeImageFilter.h>
+#include <itkMinimumMaximumImageCalculator.h>
+#include <itkMultiThreader.h>
+#include <itkTimeProbe.h>
+#include <itksys/SystemInformation.hxx>
+#include <itksys/SystemTools.hxx>
+#include "Registry.h"
+#include "SNAPRegistryIO.h"
+#include "SNAPLevelSetDriver.h"
+#include "EdgePreprocessingSettings.h"
+#include "EdgePreprocessingImageFilter.h"
+#include "ThresholdSettings.h"
+#include "SmoothBinaryThresholdImageFilter.h"
+
+typedef itk::Image<short, 3> ImageType;
+typedef itk::Image<float, 3> FloatImageType;
+
+struct BenchmarkBubble
+{
+  Vector3i center;
+  double radius;
+};
+
+// Compute the speed image as the preprocessing wizard page would
+ImageType::Pointer computeSpeed(ImageType *image, Registry &folder, bool &edge)
+{
+  edge = (folder["Mode"][string("Edge")] == "Edge");
+  if(edge)
+    {
+    // The maximum gradient magnitude, which the application computes the same way
+    typedef itk::GradientMagnitudeImageFilter<ImageType, FloatImageType> GradMagType;
+    GradMagType::Pointer gradmag = GradMagType::New();
+    gradmag->SetInput(image);
+    gradmag->Update();
+
+    typedef itk::MinimumMaximumImageCalculator<FloatImageType> CalculatorType;
+    CalculatorType::Pointer calc = CalculatorType::New();
+    calc->SetImage(gradmag->GetOutput());
+    calc->ComputeMaximum();
+
+    SmartPtr<EdgePreprocessingSettings> settings = EdgePreprocessingSettings::New();
+    settings->SetGaussianBlurScale(
+          folder["GaussianBlurScale"][(double) settings->GetGaussianBlurScale()]);
+    settings->SetRemappingSteepness(
+          folder["RemappingSteepness"][(double) settings->GetRemappingSteepness()]);
+    settings->SetRemappingExponent(
+          folder["RemappingExponent"][(double) settings->GetRemappingExponent()]);
+
+    typedef EdgePreprocessingImageFilter<ImageType, ImageType> FilterType;
+    FilterType::Pointer filter = FilterType::New();
+    filter->SetInput(image);
+    filter->SetParameters(settings);
+    filter->SetInputImageMaximumGradientMagnitude(calc->GetMaximum());
+    filter->Update();
+    return filter->GetOutput();
+    }
+  else
+    {
+    typedef itk::MinimumMaximumImageCalculator<ImageType> CalculatorType;
+    CalculatorType::Pointer calc = CalculatorType::New();
+    calc->SetImage(image);
+    calc->Compute();
+
+    SmartPtr<ThresholdSettings> settings = ThresholdSettings::New();
+    settings->SetThresholdMode(ThresholdSettings::TWO_SIDED);
+    settings->SetLowerThreshold(folder["LowerThreshold"][(double) calc->GetMinimum()]);
+    settings->SetUpperThreshold(folder["UpperThreshold"][(double) calc->GetMaximum()]);
+    settings->SetSmoothness(folder["Smoothness"][3.0]);
+
+    typedef SmoothBinaryThresholdImageFilter<ImageType, ImageType> FilterType;
+    FilterType::Pointer filter = FilterType::New();
+    filter->SetInput(image);
+    filter->SetParameters(settings);
+    filter->SetInputImageMinimum(calc->GetMinimum());
+    filter->SetInputImageMaximum(calc->GetMaximum());
+    filter->Update();
+    return filter->GetOutput();
+    }
+}
+
+// Create the initialization image from the bubbles, using the same values
+// as SNAPImageData::InitializeSegmentation
+FloatImageType::Pointer makeInitialization(ImageType *speed,
+                                           const vector<BenchmarkBubble> &bubbles)
+{
+  FloatImageType::Pointer init = FloatImageType::New();
+  init->CopyInformation(speed);
+  init->SetRegions(speed->GetBufferedRegion());
+  init->Allocate();
+
+  itk::ImageRegionIteratorWithIndex<FloatImageType> it(init, init->GetBufferedRegion());
+  for(; !it.IsAtEnd(); ++it)
+    {
+    FloatImageType::PointType pt;
+    init->TransformIndexToPhysicalPoint(it.GetIndex(), pt);
+
+    float value = 4.0f;
+    for(size_t i = 0; i < bubbles.size(); i++)
+      {
+      FloatImageType::IndexType idx;
+      for(int d = 0; d < 3; d++)
+        idx[d] = bubbles[i].center[d];
+
+      FloatImageType::PointType ptCenter;
+      init->TransformIndexToPhysicalPoint(idx, ptCenter);
+      if(pt.SquaredEuclideanDistanceTo(ptCenter) <= bubbles[i].radius * bubbles[i].radius)
+        value = -4.0f;
+      }
+    it.Set(value);
+    }
+
+  return init;
+}
+
+// Run the level set driver with a given solver and number of threads,
+// and write the measurements as a JSON object
+bool runBenchmark(ImageType *speed, const vector<BenchmarkBubble> &bubbles,
+                  SnakeParameters param, SnakeParameters::SolverType solver,
+                  const string &solverName, int nThreads, unsigned int nIter,
+                  ostream &json)
+{
+  itksys::SystemInformation sysinfo;
+  long long memBase = sysinfo.GetProcMemoryUsed(), memPeak = memBase;
+
+  // Filters take their number of threads from the global default
+  itk::MultiThreader::SetGlobalDefaultNumberOfThreads(nThreads);
+  param.SetSolver(solver);
+
+  FloatImageType::Pointer init = makeInitialization(speed, bubbles);
+
+  itk::TimeProbe probeSetup, probeRun;
+  vector<unsigned long> activeVoxels, insideVoxels;
+  unsigned int nElapsed = 0;
+  try
+    {
+    probeSetup.Start();
+    SNAPLevelSetDriver3d driver(init, speed, param);
+    probeSetup.Stop();
+    memPeak = std::max(memPeak, (long long) sysinfo.GetProcMemoryUsed());
+
+    for(unsigned int i = 0; i < nIter; i++)
+      {
+      probeRun.Start();
+      driver.Run(1);
+      probeRun.Stop();
+
+      // The active layer holds the voxels next to the zero level set. The
+      // number of voxels inside shows whether the snake has converged
+      FloatImageType *state = driver.GetCurrentState();
+      unsigned long nActive = 0, nInside = 0;
+      itk::ImageRegionIterator<FloatImageType> it(state, state->GetBufferedRegion());
+      for(; !it.IsAtEnd(); ++it)
+        {
+        float phi = it.Get();
+        if(phi <= 0.5f && phi >= -0.5f)
+          nActive++;
+        if(phi < 0.0f)
+          nInside++;
+        }
+      activeVoxels.push_back(nActive);
+      insideVoxels.push_back(nInside);
+
+      memPeak = std::max(memPeak, (long long) sysinfo.GetProcMemoryUsed());
+      }
+
+    nElapsed = driver.GetElapsedIterations();
+    }
+  catch(std::exception &exc)
+    {
+    cerr << "Solver " << solverName << " failed with " << nThreads
+         << " threads: " << exc.what() << endl;
+    return false;
+    }
+
+  json << "    {" << endl;
+  json << "      \"solver\": \"" << solverName << "\"," << endl;
+  json << "      \"threads\": " << nThreads << "," << endl;
+  json << "      \"iterations\": " << nElapsed << "," << endl;
+  json << "      \"setup_seconds\": " << probeSetup.GetTotal() << "," << endl;
+  json << "      \"seconds\": " << probeRun.GetTotal() << "," << endl;
+  json << "      \"iterations_per_second\": " << nElapsed / probeRun.GetTotal() << "," << endl;
+  json << "      \"peak_memory_kb\": " << memPeak - memBase << "," << endl;
+
+  json << "      \"active_voxels\": [";
+  for(size_t i = 0; i < activeVoxels.size(); i++)
+    json << (i ? ", " : "") << activeVoxels[i];
+  json << "]," << endl;
+
+  json << "      \"inside_voxels\": [";
+  for(size_t i = 0; i < insideVoxels.size(); i++)
+    json << (i ? ", " : "") << insideVoxels[i];
+  json << "]" << endl;
+  json << "    }";
+
+  return nElapsed == nIter && (nIter == 0 || activeVoxels.back() > 0);
+}
+
+// Run the snake outside of the GUI with each solver at several thread counts
+// and report the speed and the convergence as JSON. The image, the speed
+// function, the snake parameters and the bubbles are read from a registry
+// (XML) file; see Testing/TestData/levelset_benchmark.xml
+int main(int argc, char *argv[])
+{
+  if(argc < 2)
+    {
+    cerr << "Usage: " << argv[0] << " config.xml [output.json]" << endl;
+    return EXIT_FAILURE;
+    }
+
+  Registry config;
+  SNAPRegistryIO rio;
+  try
+    {
+    config.ReadFromXMLFile(argv[1]);
+    }
+  catch(std::exception &exc)
+    {
+    cerr << "Unable to read " << argv[1] << ": " << exc.what() << endl;
+    return EXIT_FAILURE;
+    }
+
+  // The image path is relative to the config file
+  string dir = itksys::SystemTools::GetFilenamePath(
+        itksys::SystemTools::CollapseFullPath(argv[1]));
+  string fnImage = itksys::SystemTools::CollapseFullPath(
+        config["Image"][string("")], dir);
+
+  typedef itk::ImageFileReader<ImageType> ReaderType;
+  ReaderType::Pointer reader = ReaderType::New();
+  reader->SetFileName(fnImage);
+  reader->Update();
+
+  bool edge;
+  ImageType::Pointer speed = computeSpeed(reader->GetOutput(), config.Folder("Preprocessing"), edge);
+
+  // Snake parameters default to those used by the wizard for the mode
+  SnakeParameters param = rio.ReadSnakeParameters(
+        config.Folder("SnakeParameters"),
+        edge ? SnakeParameters::GetDefaultEdgeParameters()
+             : SnakeParameters::GetDefaultInOutParameters());
+
+  Registry &fBubbles = config.Folder("Bubbles");
+  vector<BenchmarkBubble> bubbles(fBubbles["ArraySize"][(unsigned int) 0]);
+  for(size_t i = 0; i < bubbles.size(); i++)
+    {
+    Registry &fb = fBubbles.Folder(Registry::Key("Element[%d]", (int) i));
+    bubbles[i].center = fb["Center"][Vector3i(0)];
+    bubbles[i].radius = fb["Radius"][3.0];
+    }
+
+  unsigned int nIter = config["Iterations"][(unsigned int) 100];
+
+  list<string> solvers;
+  config["Solvers"].GetList(solvers);
+  if(solvers.empty())
+    {
+    solvers.push_back("ParallelSparseField");
+    solvers.push_back("NarrowBand");
+    solvers.push_back("Dense");
+    }
+
+  list<int> threads;
+  config["Threads"].GetList(threads);
+  if(threads.empty())
+    threads.push_back(itk::MultiThreader::GetGlobalDefaultNumberOfThreads());
+
+  ostringstream json;
+  ImageType::SizeType size = speed->GetBufferedRegion().GetSize();
+  json << "{" << endl;
+  json << "  \"image\": \"" << fnImage << "\"," << endl;
+  json << "  \"size\": [" << size[0] << ", " << size[1] << ", " << size[2] << "]," << endl;
+  json << "  \"runs\": [" << endl;
+
+  bool success = true, first = true;
+  for(list<string>::iterator its = solvers.begin(); its != solvers.end(); ++its)
+    {
+    SnakeParameters::SolverType solver;
+    if(!SNAPRegistryIO::GetEnumMapSolver().GetEnumValue(*its, solver))
+      {
+      cerr << "Unknown solver " << *its << endl;
+      success = false;
+      continue;
+      }
+
+    for(list<int>::iterator itt = threads.begin(); itt != threads.end(); ++itt)
+      {
+      ostringstream run;
+      if(runBenchmark(speed, bubbles, param, solver, *its, *itt, nIter, run))
+        {
+        json << (first ? "" : ",\n") << run.str();
+        first = false;
+        }
+      else
+        {
+        success = false;
+        }
+      }
+    }
+
+  json << endl << "  ]" << endl << "}" << endl;
+
+  if(argc > 2)
+    {
+    ofstream fout(argv[2]);
+    fout << json.str();
+    }
+  else
+    {
+    cout << json.str();
+    }
+
+  return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
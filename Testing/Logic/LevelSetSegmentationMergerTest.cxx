@@ -0,0 +1,174 @@
+#include <iostream>
+#include <cstdlib>
+
+using namespace std;
+
+#include <itkImageRegionIterator.h>
+#include <itkImageRegionIteratorWithIndex.h>
+#include <itkTimeProbe.h>
+#include "RLEImageRegionIterator.h"
+#include "SegmentationUpdateIterator.h"
+#include "LevelSetSegmentationMerger.h"
+
+typedef LevelSetSegmentationMerger::LabelImageType LabelImageType;
+typedef LevelSetSegmentationMerger::LevelSetImageType LevelSetImageType;
+typedef LevelSetSegmentationMerger::UndoDelta UndoDelta;
+typedef itk::Image<LabelType, 3> PlainLabelImageType;
+typedef itk::ImageRegion<3> RegionType;
+
+// Create an RLE label image from a plain image
+LabelImageType::Pointer compress(PlainLabelImageType *plain)
+{
+  LabelImageType::Pointer image = LabelImageType::New();
+  image->SetRegions(plain->GetBufferedRegion());
+  image->Allocate();
+  itk::ImageRegionIterator<LabelImageType> it(image, image->GetBufferedRegion());
+  itk::ImageRegionIterator<PlainLabelImageType> ip(plain, plain->GetBufferedRegion());
+  for(; !it.IsAtEnd(); ++it, ++ip)
+    it.Set(ip.Get());
+  return image;
+}
+
+// Compare an RLE label image with a plain image over the whole image
+unsigned long countDifferences(LabelImageType *image, PlainLabelImageType *plain)
+{
+  unsigned long n = 0;
+  itk::ImageRegionIterator<LabelImageType> it(image, image->GetBufferedRegion());
+  itk::ImageRegionIterator<PlainLabelImageType> ip(plain, plain->GetBufferedRegion());
+  for(; !it.IsAtEnd(); ++it, ++ip)
+    if(it.Get() != ip.Get())
+      n++;
+  return n;
+}
+
+// Apply a delta in reverse, as LabelImageWrapper::Undo does
+void undo(LabelImageType *image, UndoDelta *delta)
+{
+  itk::ImageRegionIterator<LabelImageType> it(image, delta->GetRegion());
+  for(size_t i = 0; i < delta->GetNumberOfRLEs(); i++)
+    {
+    LabelType d = delta->GetRLEValue(i);
+    for(size_t j = 0; j < delta->GetRLELength(i); j++, ++it)
+      if(d != 0)
+        it.Set(it.Get() - d);
+    }
+}
+
+// Paste a level set into a segmentation with blocks of labels, using each of
+// the draw-over modes, and compare the result and the undo delta with those
+// of the voxel by voxel SegmentationUpdateIterator
+int main(int argc, char *argv[])
+{
+  int n = argc > 1 ? atoi(argv[1]) : 128;
+  srand(0);
+
+  // Segmentation made of blocks of labels 0-3
+  PlainLabelImageType::Pointer labels = PlainLabelImageType::New();
+  RegionType region;
+  region.SetSize(0, n);
+  region.SetSize(1, n);
+  region.SetSize(2, n);
+  labels->SetRegions(region);
+  labels->Allocate();
+  itk::ImageRegionIteratorWithIndex<PlainLabelImageType> itl(labels, region);
+  for(; !itl.IsAtEnd(); ++itl)
+    {
+    itk::Index<3> idx = itl.GetIndex();
+    itl.Set((LabelType) (((idx[0] / 7) * 3 + (idx[1] / 5) + (idx[2] / 11)) % 4));
+    }
+
+  // A sphere in the middle of the ROI
+  RegionType roi;
+  for(int d = 0; d < 3; d++)
+    {
+    roi.SetIndex(d, n / 4 + d);
+    roi.SetSize(d, n / 2);
+    }
+
+  LevelSetImageType::Pointer phi = LevelSetImageType::New();
+  RegionType roiLocal;
+  roiLocal.SetSize(roi.GetSize());
+  phi->SetRegions(roiLocal);
+  phi->Allocate();
+  itk::ImageRegionIteratorWithIndex<LevelSetImageType> itp(phi, roiLocal);
+  for(; !itp.IsAtEnd(); ++itp)
+    {
+    double r2 = 0;
+    for(int d = 0; d < 3; d++)
+      {
+      double x = itp.GetIndex()[d] - n / 5.0;
+      r2 += x * x;
+      }
+    itp.Set((float) (r2 - (n / 6.0) * (n / 6.0)));
+    }
+
+  DrawOverFilter filters[] = {
+    DrawOverFilter(PAINT_OVER_ALL, 0),
+    DrawOverFilter(PAINT_OVER_VISIBLE, 0),
+    DrawOverFilter(PAINT_OVER_ONE, 2) };
+
+  bool success = true;
+  cout << "mode,invert,changed_voxels,delta_voxels,iterator_seconds,merger_seconds" << endl;
+  for(int f = 0; f < 3; f++)
+    {
+    for(int invert = 0; invert < 2; invert++)
+      {
+      LabelImageType::Pointer seg1 = compress(labels), seg2 = compress(labels);
+      itk::TimeProbe tIter, tMerge;
+
+      // Reference: voxel by voxel
+      tIter.Start();
+      SegmentationUpdateIterator itTarget(seg1, roi, 3, filters[f]);
+      itk::ImageRegionConstIterator<LevelSetImageType> itSource(phi, roiLocal);
+      for(; !itSource.IsAtEnd(); ++itSource, ++itTarget)
+        {
+        float v = itSource.Value();
+        if((!invert && v <= 0) || (invert && v >= 0))
+          itTarget.PaintAsForeground();
+        else
+          itTarget.PaintAsBackground();
+        }
+      itTarget.Finalize();
+      tIter.Stop();
+
+      // Run-based merge
+      tMerge.Start();
+      LevelSetSegmentationMerger merger(seg2, roi, 3, filters[f]);
+      merger.Merge(phi, invert);
+      tMerge.Stop();
+
+      UndoDelta *delta = merger.RelinquishDelta();
+      cout << f << "," << invert << "," << merger.GetNumberOfChangedVoxels() << ","
+           << delta->GetRegion().GetNumberOfPixels() << ","
+           << tIter.GetTotal() << "," << tMerge.GetTotal() << endl;
+
+      // The segmentations must be the same
+      PlainLabelImageType::Pointer ref = PlainLabelImageType::New();
+      ref->SetRegions(region);
+      ref->Allocate();
+      itk::ImageRegionIterator<LabelImageType> it1(seg1, region);
+      itk::ImageRegionIterator<PlainLabelImageType> itr(ref, region);
+      for(; !it1.IsAtEnd(); ++it1, ++itr)
+        itr.Set(it1.Get());
+
+      if(countDifferences(seg2, ref) > 0)
+        {
+        cerr << "Merged segmentation differs for mode " << f << endl;
+        success = false;
+        }
+
+      // Undoing the delta must restore the original segmentation
+      if(merger.GetNumberOfChangedVoxels() > 0)
+        undo(seg2, delta);
+      if(countDifferences(seg2, labels) > 0)
+        {
+        cerr << "Undo does not restore the segmentation for mode " << f << endl;
+        success = false;
+        }
+
+      delete delta;
+      }
+    }
+
+  return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
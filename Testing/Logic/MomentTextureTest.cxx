@@ -0,0 +1,172 @@
+#include <iostream>
+#include <cstdlib>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+using namespace std;
+
+#include <itkImage.h>
+#include <itkVectorImage.h>
+#include <itkImageRegionIteratorWithIndex.h>
+#include <itkImageRegionConstIteratorWithIndex.h>
+#include <itkMultiThreader.h>
+#include "MomentTextures.h"
+
+typedef itk::Image<short, 3> ImageType;
+typedef itk::VectorImage<short, 3> TextureImageType;
+typedef bilwaj::MomentTextureFilter<ImageType, TextureImageType> FilterType;
+typedef itk::ImageRegion<3> RegionType;
+
+// Moments of the neighborhood of a voxel, computed directly from the
+// intensities. The neighborhood replicates the values at the image boundary,
+// its range always includes zero, and the moments are zero if the range is
+// zero
+void bruteForceMoments(ImageType *image, const itk::Index<3> &center,
+                       const itk::Size<3> &radius, unsigned int degree,
+                       vector<double> &moments)
+{
+  RegionType region = image->GetBufferedRegion();
+  vector<double> values;
+  itk::Index<3> idx;
+  for(long dz = -(long) radius[2]; dz <= (long) radius[2]; dz++)
+    for(long dy = -(long) radius[1]; dy <= (long) radius[1]; dy++)
+      for(long dx = -(long) radius[0]; dx <= (long) radius[0]; dx++)
+        {
+        long off[] = { dx, dy, dz };
+        for(int d = 0; d < 3; d++)
+          {
+          long first = region.GetIndex(d);
+          long last = first + (long) region.GetSize(d) - 1;
+          idx[d] = std::min(std::max(center[d] + off[d], first), last);
+          }
+        values.push_back(image->GetPixel(idx));
+        }
+
+  double vmin = 0, vmax = 0, sum = 0;
+  for(size_t i = 0; i < values.size(); i++)
+    {
+    vmin = std::min(vmin, values[i]);
+    vmax = std::max(vmax, values[i]);
+    sum += values[i];
+    }
+
+  double range = vmax - vmin, mean = sum / values.size();
+  moments.assign(degree, 0.0);
+  if(range == 0)
+    return;
+
+  moments[0] = mean / range;
+  for(unsigned int k = 1; k < degree; k++)
+    {
+    double m = 0;
+    for(size_t i = 0; i < values.size(); i++)
+      m += pow((values[i] - mean) / range, (double) (k + 1));
+    moments[k] = m / values.size();
+    }
+}
+
+// Run the filter with a given radius and compare every voxel of its output
+// with the moments computed by brute force. Both are truncated to integers
+// after scaling by 1000, so they may differ by one where rounding errors
+// cross an integer
+bool testRadius(ImageType *image, const itk::Size<3> &radius, unsigned int degree)
+{
+  FilterType::Pointer filter = FilterType::New();
+  filter->SetInput(image);
+  filter->SetRadius(radius);
+  filter->SetHighestDegree(degree);
+  filter->Update();
+
+  TextureImageType *out = filter->GetOutput();
+  if(out->GetNumberOfComponentsPerPixel() != degree
+     || out->GetBufferedRegion() != image->GetBufferedRegion())
+    {
+    cerr << "Wrong output size for radius " << radius << endl;
+    return false;
+    }
+
+  vector<double> moments;
+  itk::ImageRegionConstIteratorWithIndex<TextureImageType> it(out, out->GetBufferedRegion());
+  for(; !it.IsAtEnd(); ++it)
+    {
+    bruteForceMoments(image, it.GetIndex(), radius, degree, moments);
+    TextureImageType::PixelType pix = it.Get();
+    for(unsigned int k = 0; k < degree; k++)
+      {
+      int expected = (int) (1000 * moments[k]);
+      if(abs(pix[k] - expected) > 1)
+        {
+        cerr << "Radius " << radius << ", voxel " << it.GetIndex()
+             << ", moment " << k + 1 << ": " << pix[k]
+             << " should be " << expected << endl;
+        return false;
+        }
+      }
+    }
+
+  return true;
+}
+
+// Compare the moment texture filter with brute force for several radii and
+// degrees, on an image that has a zero region (where the moments vanish),
+// a constant region, and noise, with one and with many threads
+int main(int argc, char *argv[])
+{
+  int n = argc > 1 ? atoi(argv[1]) : 20;
+  srand(0);
+
+  RegionType region;
+  for(int d = 0; d < 3; d++)
+    {
+    region.SetIndex(d, 3 * d - 2);
+    region.SetSize(d, n + 2 * d);
+    }
+
+  ImageType::Pointer image = ImageType::New();
+  image->SetRegions(region);
+  image->Allocate();
+
+  itk::ImageRegionIteratorWithIndex<ImageType> it(image, region);
+  for(; !it.IsAtEnd(); ++it)
+    {
+    itk::Index<3> idx = it.GetIndex();
+    long x = idx[0] - region.GetIndex(0);
+    if(x < n / 4)
+      it.Set(0);
+    else if(x < n / 2)
+      it.Set(250);
+    else
+      it.Set((short) (rand() % 2001 - 1000));
+    }
+
+  // Radii, including zero, anisotropic radii and radii larger than the zero
+  // region along some axes
+  long radii[][3] = { {0,0,0}, {1,1,1}, {2,2,2}, {1,2,0}, {3,1,2}, {0,0,4} };
+  unsigned int degrees[] = { 1, 3, 4 };
+
+  bool success = true;
+  int threads[] = { 1, 8 };
+  for(int t = 0; t < 2; t++)
+    {
+    itk::MultiThreader::SetGlobalDefaultNumberOfThreads(threads[t]);
+    for(int r = 0; r < 6; r++)
+      {
+      itk::Size<3> radius;
+      for(int d = 0; d < 3; d++)
+        radius[d] = radii[r][d];
+
+      for(int k = 0; k < 3; k++)
+        {
+        if(!testRadius(image, radius, degrees[k]))
+          {
+          cerr << "  with degree " << degrees[k] << " and "
+               << threads[t] << " threads" << endl;
+          success = false;
+          }
+        }
+      }
+    }
+
+  return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
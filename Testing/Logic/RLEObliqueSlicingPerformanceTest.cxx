@@ -0,0 +1,119 @@
+#include <iostream>
+#include <cstdlib>
+
+using namespace std;
+
+#include <itkImage.h>
+#include <itkImageFileReader.h>
+#include <itkEuler3DTransform.h>
+#include <itkTimeProbe.h>
+#include "RLEImage.h"
+#include "RLERegionOfInterestImageFilter.h"
+#include "NonOrthogonalSlicer.h"
+
+typedef itk::Image<unsigned short, 3> Seg3DImageType;
+typedef itk::Image<unsigned short, 2> Seg2DImageType;
+typedef RLEImage<unsigned short> RLEImage3D;
+typedef itk::ImageBase<3> ReferenceType;
+typedef itk::Euler3DTransform<double> TransformType;
+
+// Time the oblique slicer on an image and return its last output
+template <class TInputImage>
+Seg2DImageType::Pointer timeSlicer(TInputImage *image, ReferenceType *reference,
+                                   TransformType *transform, int repeats, double &ms)
+{
+  typedef NonOrthogonalSlicer<TInputImage, Seg2DImageType> SlicerType;
+  typename SlicerType::Pointer slicer = SlicerType::New();
+  slicer->SetInput(image);
+  slicer->SetReferenceImage(reference);
+  slicer->SetTransform(transform);
+  slicer->SetUseNearestNeighbor(true);
+
+  itk::TimeProbe probe;
+  for(int r = 0; r < repeats; r++)
+    {
+    slicer->Modified();
+    probe.Start();
+    slicer->Update();
+    probe.Stop();
+    }
+
+  ms = 1000.0 * probe.GetMean();
+  return slicer->GetOutput();
+}
+
+// Slice a segmentation image obliquely through its center, stored both as a
+// regular image and as an RLE image, and check that the results are the same
+int main(int argc, char *argv[])
+{
+  if(argc < 2)
+    {
+    cerr << "Usage: " << argv[0] << " segmentation.ext [angle_degrees] [repeats]" << endl;
+    return EXIT_FAILURE;
+    }
+
+  double angle = argc > 2 ? atof(argv[2]) : 30.0;
+  int repeats = argc > 3 ? atoi(argv[3]) : 20;
+
+  typedef itk::ImageFileReader<Seg3DImageType> ReaderType;
+  ReaderType::Pointer reader = ReaderType::New();
+  reader->SetFileName(argv[1]);
+  reader->Update();
+  Seg3DImageType::Pointer dense = reader->GetOutput();
+
+  typedef itk::RegionOfInterestImageFilter<Seg3DImageType, RLEImage3D> ConverterType;
+  ConverterType::Pointer converter = ConverterType::New();
+  converter->SetInput(dense);
+  converter->SetRegionOfInterest(dense->GetLargestPossibleRegion());
+  converter->Update();
+  RLEImage3D::Pointer rle = converter->GetOutput();
+
+  // The reference is the middle axial slice of the image
+  ReferenceType::RegionType region = dense->GetLargestPossibleRegion();
+  region.SetIndex(2, region.GetSize(2) / 2);
+  region.SetSize(2, 1);
+
+  Seg3DImageType::Pointer reference = Seg3DImageType::New();
+  reference->CopyInformation(dense);
+  reference->SetRegions(region);
+
+  // Rotate the slice about the center of the image
+  itk::ContinuousIndex<double, 3> cixCenter;
+  for(int d = 0; d < 3; d++)
+    cixCenter[d] = (dense->GetLargestPossibleRegion().GetSize(d) - 1) / 2.0;
+
+  TransformType::InputPointType center;
+  dense->TransformContinuousIndexToPhysicalPoint(cixCenter, center);
+
+  TransformType::Pointer transform = TransformType::New();
+  transform->SetCenter(center);
+  double rad = angle * vnl_math::pi / 180.0;
+  transform->SetRotation(rad, 0.5 * rad, 0.0);
+
+  double ms_dense, ms_rle;
+  Seg2DImageType::Pointer out_dense =
+      timeSlicer<Seg3DImageType>(dense, reference, transform, repeats, ms_dense);
+  Seg2DImageType::Pointer out_rle =
+      timeSlicer<RLEImage3D>(rle, reference, transform, repeats, ms_rle);
+
+  // Compare the slices
+  size_t n = out_dense->GetBufferedRegion().GetNumberOfPixels();
+  const unsigned short *p = out_dense->GetBufferPointer();
+  const unsigned short *q = out_rle->GetBufferPointer();
+  size_t n_diff = 0;
+  for(size_t i = 0; i < n; i++)
+    if(p[i] != q[i])
+      n_diff++;
+
+  cout << "storage,ms_per_slice" << endl;
+  cout << "dense," << ms_dense << endl;
+  cout << "rle," << ms_rle << endl;
+
+  if(n_diff > 0)
+    {
+    cerr << n_diff << " of " << n << " pixels differ between dense and RLE slices" << endl;
+    return EXIT_FAILURE;
+    }
+
+  return EXIT_SUCCESS;
+}
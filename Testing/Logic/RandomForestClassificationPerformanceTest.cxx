@@ -0,0 +1,228 @@
+#include <iostream>
+#include <cstdlib>
+#include <vector>
+#include <algorithm>
+
+using namespace std;
+
+#include <itkImageFileReader.h>
+#include <itkImageRegionConstIteratorWithIndex.h>
+#include <itkTimeProbe.h>
+#include "PreprocessingFilterConfigTraits.h"
+#include "ImageCollectionToImageFilter.h"
+#include "RandomForestClassifier.h"
+#include "RandomForestClassifyImageFilter.h"
+#include "RandomForestClassifyImageFilter.txx"
+
+// Includes from the random forest library
+#include "Library/classification.h"
+#include "Library/data.h"
+
+typedef RFPreprocessingFilterConfigTraits::GreyScalarType ImageType;
+typedef RFPreprocessingFilterConfigTraits::GreyVectorType VectorImageType;
+typedef ImageCollectionConstRegionIteratorWithIndex<
+  ImageType, VectorImageType> CollectionIterator;
+typedef RFPreprocessingFilterConfigTraits::FilterType FilterType;
+typedef RFPreprocessingFilterConfigTraits::ParameterType ClassifierType;
+typedef MLData<GreyType, LabelType> SampleType;
+
+ImageType::Pointer loadImage(const char *filename)
+{
+  typedef itk::ImageFileReader<ImageType> ReaderType;
+  ReaderType::Pointer reader = ReaderType::New();
+  reader->SetFileName(filename);
+  reader->Update();
+  return reader->GetOutput();
+}
+
+// Train a forest on voxels sampled from the images. The labels come from a
+// spatial pattern that the intensities only partly explain, so that the
+// trees grow to a realistic depth
+SmartPtr<ClassifierType> trainForest(const vector<ImageType::Pointer> &images,
+                                     int forestSize, int nSamples)
+{
+  ImageType::RegionType region = images[0]->GetBufferedRegion();
+  SampleType sample(nSamples, images.size());
+  for(int j = 0; j < nSamples; j++)
+    {
+    ImageType::IndexType idx;
+    for(int d = 0; d < 3; d++)
+      idx[d] = region.GetIndex(d) + rand() % region.GetSize(d);
+
+    for(unsigned int i = 0; i < images.size(); i++)
+      sample.data[j][i] = images[i]->GetPixel(idx);
+    sample.label[j] = 1 + (idx[0] / 8 + idx[1] / 8 + idx[2] / 8) % 3;
+    }
+
+  TrainingParameters params;
+  params.treeDepth = 30;
+  params.treeNum = forestSize;
+  params.candidateNodeClassifierNum = 10;
+  params.candidateClassifierThresholdNum = 10;
+  params.subSamplePercent = 0;
+  params.splitIG = 0.1;
+  params.leafEntropy = 0.05;
+  params.verbose = false;
+
+  SmartPtr<ClassifierType> classifier = ClassifierType::New();
+  typedef ClassifierType::RFAxisClassifierType RFAxisClassifierType;
+  Classification<GreyType, LabelType, RFAxisClassifierType> classification;
+  classification.Learning(
+        params, sample,
+        *classifier->GetForest(),
+        classifier->GetValidLabel(),
+        classifier->GetClassToLabelMapping());
+
+  // The first class is foreground, the rest are background
+  int n_classes = classifier->GetClassToLabelMapping().size();
+  classifier->GetClassWeights().resize(n_classes, -1.0);
+  classifier->GetClassWeights().front() = 1.0;
+
+  ClassifierType::RadiusType radius;
+  radius.Fill(0);
+  classifier->SetPatchRadius(radius);
+  classifier->SetUseCoordinateFeatures(false);
+
+  return classifier;
+}
+
+// Make a two-component vector image from a scalar image, so that the patch
+// features are also gathered from interleaved components
+VectorImageType::Pointer makeVectorImage(ImageType *image)
+{
+  VectorImageType::Pointer vec = VectorImageType::New();
+  vec->SetRegions(image->GetBufferedRegion());
+  vec->SetVectorLength(2);
+  vec->Allocate();
+
+  size_t n = image->GetBufferedRegion().GetNumberOfPixels();
+  const GreyType *src = image->GetBufferPointer();
+  GreyType *dst = vec->GetBufferPointer();
+  for(size_t i = 0; i < n; i++)
+    {
+    dst[2 * i] = src[i];
+    dst[2 * i + 1] = (GreyType)(src[i] / 2 - (GreyType) i);
+    }
+  return vec;
+}
+
+// Gather the patch features for blocks of voxels consecutive along x, and
+// check that they equal the features gathered one voxel at a time, and the
+// values read from the images at each offset in the patch
+bool checkBlockFeatures(const vector<ImageType::Pointer> &images, int radius)
+{
+  VectorImageType::Pointer vec = makeVectorImage(images[0]);
+  ImageType::RegionType region = images[0]->GetBufferedRegion();
+
+  CollectionIterator cit(region);
+  for(unsigned int i = 0; i < images.size(); i++)
+    cit.AddScalarImage(images[i]);
+  cit.AddVectorImage(vec);
+
+  itk::Size<3> rad;
+  rad.Fill(radius);
+  cit.SetRadius(rad);
+
+  int nCols = cit.GetTotalComponents() * cit.GetNeighborhoodSize();
+  const int maxBlock = 64;
+  vector<GreyType> block(maxBlock * nCols), single(nCols);
+
+  for(int trial = 0; trial < 200; trial++)
+    {
+    // Pick a block whose patches are all inside the image
+    int w = region.GetSize(0) - 2 * radius;
+    int nBlock = 1 + rand() % std::min(maxBlock, w);
+    ImageType::IndexType idx;
+    idx[0] = region.GetIndex(0) + radius + rand() % (w - nBlock + 1);
+    for(int d = 1; d < 3; d++)
+      idx[d] = region.GetIndex(d) + radius + rand() % (region.GetSize(d) - 2 * radius);
+
+    cit.GatherPatchFeatures(cit.ComputeOffset(idx), nBlock, &block[0], nCols);
+
+    for(int v = 0; v < nBlock; v++)
+      {
+      ImageType::IndexType iv = idx;
+      iv[0] += v;
+      cit.GatherPatchFeatures(cit.ComputeOffset(iv), 1, &single[0], nCols);
+
+      // Neighbors are ordered with x varying fastest
+      int col = 0;
+      for(unsigned int comp = 0; comp < cit.GetTotalComponents(); comp++)
+        {
+        for(int dz = -radius; dz <= radius; dz++)
+          for(int dy = -radius; dy <= radius; dy++)
+            for(int dx = -radius; dx <= radius; dx++, col++)
+              {
+              ImageType::IndexType in = iv;
+              in[0] += dx; in[1] += dy; in[2] += dz;
+              GreyType ref = comp < images.size()
+                  ? images[comp]->GetPixel(in)
+                  : vec->GetPixel(in)[comp - images.size()];
+
+              GreyType fb = block[v * nCols + col], fs = single[col];
+              if(fb != ref || fs != ref)
+                {
+                cerr << "Patch feature " << col << " of voxel " << iv
+                     << " with radius " << radius << " is " << fb
+                     << " in a block of " << nBlock << " and " << fs
+                     << " on its own, but should be " << ref << endl;
+                return false;
+                }
+              }
+        }
+      }
+    }
+
+  return true;
+}
+
+// Check the block feature gatherer, then classify all the voxels in the
+// images with forests of increasing size and report the throughput
+int main(int argc, char *argv[])
+{
+  if(argc < 2)
+    {
+    cerr << "Usage: " << argv[0] << " image1.ext [image2.ext ...]" << endl;
+    return EXIT_FAILURE;
+    }
+
+  vector<ImageType::Pointer> images;
+  for(int i = 1; i < argc; i++)
+    {
+    images.push_back(loadImage(argv[i]));
+    if(images[i-1]->GetBufferedRegion() != images[0]->GetBufferedRegion())
+      {
+      cerr << "Image " << argv[i] << " does not match the size of the first image" << endl;
+      return EXIT_FAILURE;
+      }
+    }
+
+  // The training features must not depend on how the voxels are blocked
+  for(int radius = 0; radius <= 2; radius++)
+    if(!checkBlockFeatures(images, radius))
+      return EXIT_FAILURE;
+
+  double nVoxels = images[0]->GetBufferedRegion().GetNumberOfPixels();
+  int forestSizes[] = { 10, 25, 50, 100, 200 };
+
+  cout << "trees,seconds,voxels_per_sec" << endl;
+  for(int k = 0; k < 5; k++)
+    {
+    SmartPtr<ClassifierType> classifier = trainForest(images, forestSizes[k], 5000);
+
+    SmartPtr<FilterType> filter = FilterType::New();
+    for(unsigned int i = 0; i < images.size(); i++)
+      filter->AddScalarImage(images[i]);
+    filter->SetClassifier(classifier);
+
+    itk::TimeProbe probe;
+    probe.Start();
+    filter->Update();
+    probe.Stop();
+
+    double t = probe.GetTotal();
+    cout << forestSizes[k] << "," << t << "," << nVoxels / t << endl;
+    }
+
+  return EXIT_SUCCESS;
+}
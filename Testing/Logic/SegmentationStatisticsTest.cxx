@@ -0,0 +1,200 @@
+#include <iostream>
+#include <cstdlib>
+#include <cmath>
+#include <vector>
+#include <map>
+#include <algorithm>
+
+using namespace std;
+
+#include <itkImageRegionIteratorWithIndex.h>
+#include <itkMultiThreader.h>
+#include <vnl/vnl_math.h>
+#include "RLEImageRegionIterator.h"
+#include "SegmentationStatistics.h"
+
+typedef SegmentationStatistics::LabelImageType LabelImageType;
+typedef SegmentationStatistics::GreyImageType GreyImageType;
+typedef itk::ImageRegion<3> RegionType;
+
+// Intensities of a label in each image, collected by brute force
+typedef std::map<LabelType, std::vector< std::vector<double> > > ValueMap;
+
+// Fill an image with random values in [vmin, vmax]
+GreyImageType::Pointer makeImage(const RegionType &region, int vmin, int vmax)
+{
+  GreyImageType::Pointer image = GreyImageType::New();
+  image->SetRegions(region);
+  image->Allocate();
+
+  GreyType *p = image->GetBufferPointer();
+  for(size_t i = 0; i < region.GetNumberOfPixels(); i++)
+    p[i] = (GreyType) (vmin + rand() % (vmax - vmin + 1));
+  return image;
+}
+
+// Value at a position in sorted values, interpolated between neighbors
+double percentile(std::vector<double> v, double p)
+{
+  std::sort(v.begin(), v.end());
+  double pos = p / 100.0 * (v.size() - 1);
+  size_t r0 = (size_t) floor(pos), r1 = std::min(r0 + 1, v.size() - 1);
+  return v[r0] + (pos - r0) * (v[r1] - v[r0]);
+}
+
+// Compare the statistics with the mean, standard deviation and percentiles
+// of the intensities of each label. The percentiles of the images with a
+// wide range of values are estimated from histograms, and may be off by a bin
+bool check(const SegmentationStatistics &stats, const ValueMap &values,
+           const std::vector<GreyImageType *> &images,
+           const std::vector<double> &pct, int threads)
+{
+  const SegmentationStatistics::EntryMap &em = stats.GetStats();
+  if(em.size() != values.size())
+    {
+    cerr << "Wrong number of labels with " << threads << " threads" << endl;
+    return false;
+    }
+
+  bool ok = true;
+  for(ValueMap::const_iterator it = values.begin(); it != values.end(); ++it)
+    {
+    SegmentationStatistics::EntryMap::const_iterator ite = em.find(it->first);
+    if(ite == em.end() || ite->second.count != it->second[0].size())
+      {
+      cerr << "Wrong count for label " << it->first << " with " << threads << " threads" << endl;
+      ok = false;
+      continue;
+      }
+
+    const SegmentationStatistics::Entry &entry = ite->second;
+    for(size_t j = 0; j < images.size(); j++)
+      {
+      const std::vector<double> &v = it->second[j];
+      double sum = 0, ssd = 0;
+      for(size_t i = 0; i < v.size(); i++)
+        sum += v[i];
+      double mean = sum / v.size();
+      for(size_t i = 0; i < v.size(); i++)
+        ssd += (v[i] - mean) * (v[i] - mean);
+      double stdev = sqrt(ssd / (v.size() - 1));
+
+      if(fabs(entry.mean[j] - mean) > 1e-6 * (1 + fabs(mean))
+         || fabs(entry.stdev[j] - stdev) > 1e-6 * (1 + stdev))
+        {
+        cerr << "Label " << it->first << ", image " << j << ", " << threads << " threads: "
+             << "mean/stdev " << entry.mean[j] << "/" << entry.stdev[j]
+             << " should be " << mean << "/" << stdev << endl;
+        ok = false;
+        }
+
+      const GreyType *p = images[j]->GetBufferPointer();
+      size_t n = images[j]->GetBufferedRegion().GetNumberOfPixels();
+      double range = *std::max_element(p, p + n) - *std::min_element(p, p + n);
+      double tol = range < 1024 ? 1e-6 : range / 1024;
+      for(size_t k = 0; k < pct.size(); k++)
+        {
+        double pv = percentile(v, pct[k]);
+        if(fabs(entry.percentile(j, k) - pv) > tol)
+          {
+          cerr << "Label " << it->first << ", image " << j << ", " << threads << " threads: "
+               << "percentile " << pct[k] << " is " << entry.percentile(j, k)
+               << " but should be " << pv << endl;
+          ok = false;
+          }
+        }
+      }
+    }
+
+  return ok;
+}
+
+// Compute the statistics of a segmentation with several labels over images
+// with narrow and wide intensity ranges, with one and with many threads, and
+// compare them with the statistics computed by brute force
+int main(int argc, char *argv[])
+{
+  int n = argc > 1 ? atoi(argv[1]) : 40;
+  srand(0);
+
+  RegionType region;
+  for(int d = 0; d < 3; d++)
+    {
+    region.SetIndex(d, 5 * d);
+    region.SetSize(d, n + 3 * d);
+    }
+
+  // Labels in slabs and blobs, so that the lines have runs of many lengths
+  LabelImageType::Pointer seg = LabelImageType::New();
+  seg->SetRegions(region);
+  seg->Allocate();
+  seg->FillBuffer(0);
+
+  itk::ImageRegionIteratorWithIndex<LabelImageType> it(seg, region);
+  for(; !it.IsAtEnd(); ++it)
+    {
+    itk::Index<3> idx = it.GetIndex();
+    LabelType label = (LabelType) ((idx[0] / 7 + idx[2] / 5) % 3);
+    double r = 0;
+    for(int d = 0; d < 3; d++)
+      {
+      double dx = idx[d] - (region.GetIndex(d) + region.GetSize(d) * 0.4);
+      r += dx * dx;
+      }
+    if(r < n * n / 16.0)
+      label = 7;
+    else if(rand() % 50 == 0)
+      label = 12;
+    it.Set(label);
+    }
+
+  std::vector<GreyImageType::Pointer> imagePtrs;
+  imagePtrs.push_back(makeImage(region, -100, 300));
+  imagePtrs.push_back(makeImage(region, -20000, 20000));
+
+  std::vector<GreyImageType *> images;
+  for(size_t j = 0; j < imagePtrs.size(); j++)
+    images.push_back(imagePtrs[j].GetPointer());
+
+  // Collect the intensities of each label
+  ValueMap values;
+  itk::ImageRegionIteratorWithIndex<LabelImageType> itv(seg, region);
+  for(; !itv.IsAtEnd(); ++itv)
+    {
+    std::vector< std::vector<double> > &v = values[itv.Get()];
+    v.resize(images.size());
+    for(size_t j = 0; j < images.size(); j++)
+      v[j].push_back(images[j]->GetPixel(itv.GetIndex()));
+    }
+
+  std::vector<double> pct;
+  pct.push_back(50.0);
+  pct.push_back(90.0);
+
+  bool success = true;
+  int threads[] = { 1, 8 };
+  for(int t = 0; t < 2; t++)
+    {
+    itk::MultiThreader::SetGlobalDefaultNumberOfThreads(threads[t]);
+    SegmentationStatistics stats;
+    stats.SetPercentiles(pct);
+    stats.Compute(seg, images);
+    success = check(stats, values, images, pct, threads[t]) && success;
+    }
+
+  // An image that does not match the segmentation gets NaN statistics
+  RegionType other = region;
+  other.SetSize(0, n + 1);
+  GreyImageType::Pointer mismatched = makeImage(other, 0, 10);
+  std::vector<GreyImageType *> withMismatch(1, mismatched.GetPointer());
+  SegmentationStatistics stats;
+  stats.Compute(seg, withMismatch);
+  const SegmentationStatistics::Entry &e0 = stats.GetStats().find(0)->second;
+  if(e0.count != values[0][0].size() || !vnl_math_isnan(e0.mean[0]))
+    {
+    cerr << "Mismatched image should have NaN statistics" << endl;
+    success = false;
+    }
+
+  return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
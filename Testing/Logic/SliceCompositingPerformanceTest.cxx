@@ -0,0 +1,127 @@
+#include <iostream>
+#include <cstdlib>
+#include <vector>
+#include <algorithm>
+
+using namespace std;
+
+#include <itkImage.h>
+#include <itkTimeProbe.h>
+#include "RGBASliceCompositor.h"
+
+typedef RGBASliceCompositor::ImageType SliceType;
+
+SliceType::Pointer makeRandomSlice(int w, int h)
+{
+  SliceType::Pointer slice = SliceType::New();
+  SliceType::RegionType region;
+  region.SetSize(0, w);
+  region.SetSize(1, h);
+  slice->SetRegions(region);
+  slice->Allocate();
+
+  unsigned char *p = slice->GetBufferPointer()->GetDataPointer();
+  for(size_t i = 0; i < 4 * (size_t) w * h; i++)
+    p[i] = (unsigned char)(rand() & 0xff);
+
+  return slice;
+}
+
+// Blend the slices using floating point arithmetic, which is how OpenGL would
+// do it, and compare every pixel of the compositor output with the result.
+// The compositor rounds to 8 bits after each layer, so each layer may add
+// about one unit of error
+bool checkSlice(const vector<SliceType::Pointer> &slices,
+                const vector<double> &opacity, SliceType *result)
+{
+  size_t npix = result->GetBufferedRegion().GetNumberOfPixels();
+  if(npix != slices[0]->GetBufferedRegion().GetNumberOfPixels())
+    return false;
+
+  const unsigned char *q = result->GetBufferPointer()->GetDataPointer();
+  int max_err = 0;
+  for(size_t j = 0; j < npix; j++)
+    {
+    double rgb[3];
+    const unsigned char *p = slices[0]->GetBufferPointer()->GetDataPointer() + 4 * j;
+    for(int c = 0; c < 3; c++)
+      rgb[c] = p[c] / 255.0;
+
+    for(unsigned int k = 1; k < slices.size(); k++)
+      {
+      p = slices[k]->GetBufferPointer()->GetDataPointer() + 4 * j;
+      double a = (p[3] / 255.0) * ((unsigned char)(opacity[k] * 255) / 255.0);
+      for(int c = 0; c < 3; c++)
+        rgb[c] = (p[c] / 255.0) * a + rgb[c] * (1 - a);
+      }
+
+    for(int c = 0; c < 3; c++)
+      max_err = max(max_err, abs(q[4 * j + c] - (int)(rgb[c] * 255 + 0.5)));
+
+    if(q[4 * j + 3] != 255)
+      {
+      cerr << "Composited pixel " << j << " is not opaque" << endl;
+      return false;
+      }
+    }
+
+  if(max_err > (int) slices.size())
+    {
+    cerr << "Largest difference from the reference is " << max_err << endl;
+    return false;
+    }
+  return true;
+}
+
+int main(int argc, char *argv[])
+{
+  if(argc < 4)
+    {
+    cerr << "Usage: " << argv[0] << " width height max_layers [repeats]" << endl;
+    return EXIT_FAILURE;
+    }
+
+  int w = atoi(argv[1]), h = atoi(argv[2]), max_layers = atoi(argv[3]);
+  int repeats = argc > 4 ? atoi(argv[4]) : 20;
+
+  vector<SliceType::Pointer> all_slices;
+  for(int i = 0; i < max_layers; i++)
+    all_slices.push_back(makeRandomSlice(w, h));
+
+  RGBASliceCompositor::Pointer compositor = RGBASliceCompositor::New();
+
+  cout << "layers,ms_per_composite,mpixels_per_sec" << endl;
+  for(int n = 1; n <= max_layers; n++)
+    {
+    vector<SliceType::Pointer> slices(all_slices.begin(), all_slices.begin() + n);
+    vector<SliceType *> inputs;
+    vector<double> opacity;
+    for(int i = 0; i < n; i++)
+      {
+      inputs.push_back(slices[i]);
+      opacity.push_back(i == 0 ? 1.0 : (i % 3) * 0.4);
+      }
+
+    compositor->SetLayers(inputs, opacity);
+
+    itk::TimeProbe probe;
+    for(int r = 0; r < repeats; r++)
+      {
+      compositor->Modified();
+      probe.Start();
+      compositor->Update();
+      probe.Stop();
+      }
+
+    if(!checkSlice(slices, opacity, compositor->GetOutput()))
+      {
+      cerr << "Composited slice does not match reference for " << n << " layers" << endl;
+      return EXIT_FAILURE;
+      }
+
+    double ms = 1000.0 * probe.GetMean();
+    cout << n << "," << ms << "," << (w * (double) h) / (1000.0 * ms) << endl;
+    }
+
+  return EXIT_SUCCESS;
+}
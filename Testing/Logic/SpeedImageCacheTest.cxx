@@ -0,0 +1,355 @@
+#include <iostream>
+#include <cstdlib>
+#include <string>
+#include <algorithm>
+
+using namespace std;
+
+#include <itkImageRegionIteratorWithIndex.h>
+#include "itksys/SystemTools.hxx"
+#include "SpeedImageCache.h"
+#include "IRISApplication.h"
+#include "ImageIODelegates.h"
+#include "ImageWrapperBase.h"
+#include "SlicePreviewFilterWrapper.h"
+#include "ThresholdSettings.h"
+#include "EdgePreprocessingSettings.h"
+#include "UIReporterDelegates.h"
+
+typedef SpeedImageCache::SpeedImageType ImageType;
+typedef ImageType::RegionType RegionType;
+
+class DummySystemInfoDelegate : public SystemInfoDelegate
+{
+public:
+
+  DummySystemInfoDelegate(const char *argv0)
+    {
+    m_ExecutableName = argv0;
+    }
+
+  virtual std::string GetApplicationDirectory()
+    {
+    return itksys::SystemTools::GetFilenamePath(m_ExecutableName);
+    }
+
+  virtual std::string GetApplicationFile()
+    {
+    return m_ExecutableName;
+    }
+
+  virtual std::string GetApplicationPermanentDataLocation()
+    {
+    return std::string(".itksnap.test");
+    }
+
+  virtual std::string GetUserDocumentsLocation()
+    {
+    return std::string(".itksnap.test");
+    }
+
+  virtual std::string EncodeServerURL(const std::string &url)
+    {
+    return url;
+    }
+
+  typedef SystemInfoDelegate::GrayscaleImage GrayscaleImage;
+  typedef SystemInfoDelegate::RGBAPixelType RGBAPixelType;
+  typedef SystemInfoDelegate::RGBAImageType RGBAImageType;
+
+  virtual void LoadResourceAsImage2D(std::string tag, GrayscaleImage *image) {}
+  virtual void LoadResourceAsRegistry(std::string tag, Registry &reg) {}
+  virtual void WriteRGBAImage2D(std::string file, RGBAImageType *image) {}
+
+protected:
+  std::string m_ExecutableName;
+};
+
+ImageType::Pointer makeImage(const RegionType &region)
+{
+  ImageType::Pointer image = ImageType::New();
+  image->SetRegions(region);
+  image->Allocate();
+  image->FillBuffer(0);
+  return image;
+}
+
+// An image with long runs of constant values, including the extremes of the
+// pixel type, which the cache should run-length encode
+ImageType::Pointer makePiecewiseConstantImage(const RegionType &region)
+{
+  ImageType::Pointer image = makeImage(region);
+  itk::ImageRegionIteratorWithIndex<ImageType> it(image, region);
+  for(; !it.IsAtEnd(); ++it)
+    {
+    itk::Index<3> idx = it.GetIndex();
+    switch(((idx[0] - region.GetIndex(0)) / 8 + idx[2]) % 3)
+      {
+      case 0: it.Set(-32768); break;
+      case 1: it.Set(32767); break;
+      default: it.Set(-1); break;
+      }
+    }
+  return image;
+}
+
+// An image of noise, which the cache should store voxel by voxel
+ImageType::Pointer makeRandomImage(const RegionType &region)
+{
+  ImageType::Pointer image = makeImage(region);
+  GreyType *p = image->GetBufferPointer();
+  for(size_t i = 0; i < region.GetNumberOfPixels(); i++)
+    p[i] = (GreyType) (rand() % 65536 - 32768);
+  return image;
+}
+
+size_t rawSize(const RegionType &region)
+{
+  return region.GetNumberOfPixels() * sizeof(GreyType);
+}
+
+bool sameBuffer(ImageType *a, ImageType *b)
+{
+  size_t n = a->GetBufferedRegion().GetNumberOfPixels();
+  return std::equal(a->GetBufferPointer(), a->GetBufferPointer() + n, b->GetBufferPointer());
+}
+
+// Store an image and retrieve it into a fresh image, which should then be
+// identical to the original. The memory used by the entry tells which of the
+// storage paths was taken
+bool testRoundTrip(ImageType *image, bool expectRLE, const char *what)
+{
+  SmartPtr<SpeedImageCache> cache = SpeedImageCache::New();
+  RegionType region = image->GetBufferedRegion();
+
+  cache->Store(what, image);
+  size_t usage = cache->GetMemoryUsage();
+  if(expectRLE ? (usage >= rawSize(region)) : (usage != rawSize(region)))
+    {
+    cerr << what << ": entry uses " << usage << " bytes for "
+         << rawSize(region) << " bytes of voxels" << endl;
+    return false;
+    }
+
+  ImageType::Pointer out = makeImage(region);
+  if(!cache->Retrieve(what, out) || !sameBuffer(image, out))
+    {
+    cerr << what << ": the retrieved image differs from the stored one" << endl;
+    return false;
+    }
+
+  // Retrieving again, after the entry has become the most recent, or into an
+  // image with a different region, or with an unknown key
+  ImageType::Pointer again = makeImage(region);
+  RegionType other = region;
+  other.SetSize(0, region.GetSize(0) + 1);
+  ImageType::Pointer mismatched = makeImage(other);
+  if(!cache->Retrieve(what, again) || !sameBuffer(image, again)
+     || cache->Retrieve(what, mismatched) || cache->Retrieve("unknown", again))
+    {
+    cerr << what << ": wrong result of repeated or mismatched retrieval" << endl;
+    return false;
+    }
+
+  return true;
+}
+
+// With room for two entries, storing a third one should evict the least
+// recently used entry, where retrieving an entry counts as using it
+bool testEviction(const RegionType &region)
+{
+  SmartPtr<SpeedImageCache> cache = SpeedImageCache::New();
+  cache->SetMaximumMemory(2 * rawSize(region) + rawSize(region) / 2);
+
+  ImageType::Pointer a = makeRandomImage(region);
+  ImageType::Pointer b = makeRandomImage(region);
+  ImageType::Pointer c = makeRandomImage(region);
+  ImageType::Pointer out = makeImage(region);
+
+  cache->Store("a", a);
+  cache->Store("b", b);
+  if(!cache->Retrieve("a", out))
+    {
+    cerr << "Entry a should fit into the cache" << endl;
+    return false;
+    }
+
+  cache->Store("c", c);
+
+  bool ok = true;
+  if(cache->Retrieve("b", out))
+    {
+    cerr << "The least recently used entry b should have been evicted" << endl;
+    ok = false;
+    }
+  if(!cache->Retrieve("a", out) || !sameBuffer(a, out)
+     || !cache->Retrieve("c", out) || !sameBuffer(c, out))
+    {
+    cerr << "Entries a and c should have been kept" << endl;
+    ok = false;
+    }
+  if(cache->GetMemoryUsage() > cache->GetMaximumMemory())
+    {
+    cerr << "The cache uses " << cache->GetMemoryUsage() << " bytes, more than "
+         << cache->GetMaximumMemory() << endl;
+    ok = false;
+    }
+
+  // Replacing an entry with the same key does not evict anything
+  cache->Store("a", b);
+  if(!cache->Retrieve("a", out) || !sameBuffer(b, out) || !cache->Retrieve("c", out))
+    {
+    cerr << "Storing under an existing key should replace the entry" << endl;
+    ok = false;
+    }
+
+  // An entry larger than the whole cache is not stored
+  cache->SetMaximumMemory(rawSize(region) / 2);
+  cache->Store("d", a);
+  if(cache->Retrieve("d", out))
+    {
+    cerr << "An entry larger than the cache should not be stored" << endl;
+    ok = false;
+    }
+
+  cache->Clear();
+  if(cache->GetMemoryUsage() != 0 || cache->Retrieve("c", out))
+    {
+    cerr << "The cache should be empty after clearing it" << endl;
+    ok = false;
+    }
+
+  return ok;
+}
+
+bool checkKey(const std::string &key, const std::string &ref, bool same, const char *what)
+{
+  if(key.empty() || (key == ref) != same)
+    {
+    cerr << what << ": key '" << key << "' should " << (same ? "" : "not ")
+         << "be the same as '" << ref << "'" << endl;
+    return false;
+    }
+  return true;
+}
+
+// Load an image, enter the active contour mode, and check that the cache key
+// changes with the parameters of the threshold and edge preprocessing modes
+// and with the region of interest, and only with them
+bool testKeys(const char *fname)
+{
+  IRISApplication::Pointer app = IRISApplication::New();
+  IRISWarningList wl;
+  app->LoadImage(fname, MAIN_ROLE, wl);
+
+  SNAPSegmentationROISettings roi = app->GetGlobalState()->GetSegmentationROISettings();
+  RegionType full = app->GetCurrentImageData()->GetImageRegion();
+  RegionType region = full;
+  for(int d = 0; d < 3; d++)
+    {
+    region.SetIndex(d, region.GetIndex(d) + 2);
+    region.SetSize(d, region.GetSize(d) - 4);
+    }
+  roi.SetROI(region);
+  app->GetGlobalState()->SetSegmentationROISettings(roi);
+  app->InitializeSNAPImageData(roi);
+  app->SetCurrentImageDataToSNAP();
+
+  bool ok = true;
+
+  // Thresholding
+  app->EnterPreprocessingMode(PREPROCESS_THRESHOLD);
+  ScalarImageWrapperBase *active =
+      app->GetPreprocessingFilterPreviewer(PREPROCESS_THRESHOLD)->GetActiveScalarLayer();
+  ThresholdSettings *ts = active
+      ? dynamic_cast<ThresholdSettings *>(active->GetUserData("ThresholdSettings")) : NULL;
+  if(!ts)
+    {
+    cerr << "No threshold settings for the active layer" << endl;
+    return false;
+    }
+
+  std::string kThresh = app->GetSpeedImageCacheKey();
+  ok = checkKey(app->GetSpeedImageCacheKey(), kThresh, true, "Unchanged threshold") && ok;
+
+  float lower = ts->GetLowerThreshold();
+  ts->SetLowerThreshold(lower + 1.5f);
+  ok = checkKey(app->GetSpeedImageCacheKey(), kThresh, false, "Lower threshold") && ok;
+  ts->SetLowerThreshold(lower);
+  ok = checkKey(app->GetSpeedImageCacheKey(), kThresh, true, "Restored threshold") && ok;
+
+  float smoothness = ts->GetSmoothness();
+  ts->SetSmoothness(smoothness + 0.25f);
+  ok = checkKey(app->GetSpeedImageCacheKey(), kThresh, false, "Smoothness") && ok;
+  ts->SetSmoothness(smoothness);
+
+  // Edge attraction
+  app->EnterPreprocessingMode(PREPROCESS_EDGE);
+  std::string kEdge = app->GetSpeedImageCacheKey();
+  ok = checkKey(kEdge, kThresh, false, "Edge mode") && ok;
+
+  EdgePreprocessingSettings *es = app->GetEdgePreprocessingSettings();
+  float scale = es->GetGaussianBlurScale();
+  es->SetGaussianBlurScale(scale * 2);
+  ok = checkKey(app->GetSpeedImageCacheKey(), kEdge, false, "Blur scale") && ok;
+  es->SetGaussianBlurScale(scale);
+  ok = checkKey(app->GetSpeedImageCacheKey(), kEdge, true, "Restored blur scale") && ok;
+
+  float exponent = es->GetRemappingExponent();
+  es->SetRemappingExponent(exponent + 1);
+  ok = checkKey(app->GetSpeedImageCacheKey(), kEdge, false, "Remapping exponent") && ok;
+  es->SetRemappingExponent(exponent);
+
+  // The region of interest
+  roi.SetROI(full);
+  app->GetGlobalState()->SetSegmentationROISettings(roi);
+  ok = checkKey(app->GetSpeedImageCacheKey(), kEdge, false, "Region of interest") && ok;
+
+  // Back to thresholding
+  roi.SetROI(region);
+  app->GetGlobalState()->SetSegmentationROISettings(roi);
+  app->EnterPreprocessingMode(PREPROCESS_THRESHOLD);
+  ok = checkKey(app->GetSpeedImageCacheKey(), kThresh, true, "Threshold mode reentered") && ok;
+
+  app->EnterPreprocessingMode(PREPROCESS_NONE);
+  return ok;
+}
+
+// Check that the speed image cache stores piecewise constant and noisy
+// volumes losslessly, that it evicts the least recently used volumes, and
+// that the keys under which IRISApplication caches the speed images follow
+// the preprocessing parameters
+int main(int argc, char *argv[])
+{
+  if(argc < 2)
+    {
+    cerr << "Usage: " << argv[0] << " image [size]" << endl;
+    return EXIT_FAILURE;
+    }
+
+  int n = argc > 2 ? atoi(argv[2]) : 32;
+  srand(0);
+
+  DummySystemInfoDelegate sidel(argv[0]);
+  SystemInterface::SetSystemInfoDelegate(&sidel);
+
+  RegionType region;
+  for(int d = 0; d < 3; d++)
+    {
+    region.SetIndex(d, 4 * d - 3);
+    region.SetSize(d, n + d);
+    }
+
+  bool success = true;
+
+  ImageType::Pointer constant = makePiecewiseConstantImage(region);
+  success = testRoundTrip(constant, true, "Piecewise constant") && success;
+
+  ImageType::Pointer noise = makeRandomImage(region);
+  success = testRoundTrip(noise, false, "Noise") && success;
+
+  success = testEviction(region) && success;
+  success = testKeys(argv[1]) && success;
+
+  return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}